@@ -0,0 +1,220 @@
+#define _CRT_SECURE_NO_DEPRECATE
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include "yocto_api.h"
+
+using namespace std;
+
+// Micro-benchmark of the data logger stream decoding: compares the
+// per-value decoding (one calibration handler call per value, with its
+// vector arguments copied each time) with the bulk decoding done by
+// YDataStream::_parseStream and YDataStream::_calibrateColumn.
+// No module is needed, the streams are generated locally.
+
+#define NROWS   100000
+#define NPASSES 20
+
+// Gives access to the stream internals, as done by YDataStream subclasses
+class BenchStream : public YDataStream
+{
+public:
+  BenchStream(YFunction *parent, bool isAvg, int npt) : YDataStream(parent)
+  {
+    _isAvg = isAvg;
+    if (npt > 0) {
+      // n-point linear calibration, as stored in the module settings
+      _caltyp = npt;
+      _calhdl = YAPI::LinearCalibrationHandler;
+      for (int i = 0; i < npt; i++) {
+        _calpar.push_back(i * 10000);
+        _calpar.push_back(i * 10000 + 250);
+        _calraw.push_back(i * 10.0);
+        _calref.push_back(i * 10.0 + 0.25);
+      }
+    }
+  }
+
+  // per-value decoding, as done before the bulk decoder
+  int parseStreamPerValue(const string& sdata)
+  {
+    vector<int> udat = YAPI::_decodeWords(_parent->_json_get_string(sdata));
+    int idx = 0;
+
+    _minColumn.clear();
+    _avgColumn.clear();
+    _maxColumn.clear();
+    if (_isAvg) {
+      while (idx + 5 < (int)udat.size()) {
+        _minColumn.push_back(_decodeVal(udat[idx + 2] + (udat[idx + 3] << 16)));
+        _avgColumn.push_back(_decodeAvg(udat[idx] + ((udat[idx + 1] ^ 0x8000) << 16), 1));
+        _maxColumn.push_back(_decodeVal(udat[idx + 4] + (udat[idx + 5] << 16)));
+        idx += 6;
+      }
+    } else {
+      while (idx + 1 < (int)udat.size()) {
+        _avgColumn.push_back(_decodeAvg(udat[idx] + ((udat[idx + 1] ^ 0x8000) << 16), 1));
+        idx += 2;
+      }
+    }
+    _nRows = (int)_avgColumn.size();
+    return _nRows;
+  }
+
+  // calibration of a whole column, one handler call per value
+  void calibratePerValue(vector<double>& values)
+  {
+    for (size_t i = 0; i < values.size(); i++) {
+      values[i] = _calhdl(values[i], _caltyp, _calpar, _calraw, _calref);
+    }
+  }
+
+  void calibrateBulk(vector<double>& values)
+  {
+    _calibrateColumn(values);
+  }
+
+  double checksum(void)
+  {
+    const double *values;
+    double sum = 0;
+    int count = _getColumnData(_isAvg ? 1 : 0, values);
+
+    for (int i = 0; i < count; i++) {
+      sum += values[i];
+    }
+    return sum;
+  }
+};
+
+// Encode a 16-bit word the way the data logger does
+static void encodeWord(string& res, int w)
+{
+  char c;
+
+  if (w == 0) {
+    res += '*';
+  } else if (w == 0xffff) {
+    res += 'X';
+  } else if (w == 0x7fff) {
+    res += 'Y';
+  } else {
+    res += (char)('0' + (w & 31));
+    res += (char)('0' + ((w >> 5) & 31));
+    c = (char)('0' + (w >> 10));
+    res += (c == '\\' ? 'z' : c);
+  }
+}
+
+// Build a stream of NROWS rows with values between 15 and 35, where
+// about one word out of three repeats a previous word
+static string buildStream(bool isAvg)
+{
+  string res = "\"";
+  int ncols = (isAvg ? 3 : 1);
+
+  srand(1234);
+  for (int row = 0; row < NROWS; row++) {
+    for (int col = 0; col < ncols; col++) {
+      int val = 15000 + rand() % 20000;
+      if (row > 0 && rand() % 3 == 0) {
+        // back-reference to the same word of the previous row
+        res += (char)('a' + 2 * ncols - 1);
+        res += (char)('a' + 2 * ncols - 1);
+        continue;
+      }
+      if (col == 1 || !isAvg) {
+        // averages have the sign bit of the high word inverted
+        encodeWord(res, val & 0xffff);
+        encodeWord(res, ((val >> 16) & 0xffff) ^ 0x8000);
+      } else {
+        encodeWord(res, val & 0xffff);
+        encodeWord(res, (val >> 16) & 0xffff);
+      }
+    }
+  }
+  res += "\"";
+  return res;
+}
+
+static void report(const char *what, u64 ms, double count)
+{
+  if (ms == 0) ms = 1;
+  printf("  %-28s %8.2f Msamples/s\n", what, count * 1000.0 / ms / 1000000.0);
+}
+
+static void benchParse(YFunction *parent, bool isAvg, int npt)
+{
+  BenchStream stream(parent, isAvg, npt);
+  string sdata = buildStream(isAvg);
+  double samples = (double)NROWS * (isAvg ? 3 : 1) * NPASSES;
+  double sumBefore = 0, sumAfter = 0;
+  u64 t0, t1;
+
+  printf("%s stream, %d-point calibration:\n",
+         isAvg ? "averaged" : "single-measure", npt);
+  t0 = YAPI::GetTickCount();
+  for (int i = 0; i < NPASSES; i++) {
+    stream.parseStreamPerValue(sdata);
+    sumBefore += stream.checksum();
+  }
+  t1 = YAPI::GetTickCount();
+  report("decoding per value", t1 - t0, samples);
+  t0 = YAPI::GetTickCount();
+  for (int i = 0; i < NPASSES; i++) {
+    stream._parseStream(sdata);
+    sumAfter += stream.checksum();
+  }
+  t1 = YAPI::GetTickCount();
+  report("bulk decoding", t1 - t0, samples);
+  if (sumBefore != sumAfter) {
+    printf("  *** results differ: %f != %f\n", sumBefore, sumAfter);
+  }
+}
+
+static void benchCalibration(YFunction *parent, int npt)
+{
+  BenchStream stream(parent, true, npt);
+  vector<double> raw(NROWS), values;
+  double sumBefore = 0, sumAfter = 0;
+  u64 t0, t1;
+
+  for (int i = 0; i < NROWS; i++) {
+    raw[i] = (i % 5000) / 100.0;
+  }
+  printf("column calibration, %d points:\n", npt);
+  t0 = YAPI::GetTickCount();
+  for (int i = 0; i < NPASSES; i++) {
+    values = raw;
+    stream.calibratePerValue(values);
+    sumBefore += values[NROWS / 2];
+  }
+  t1 = YAPI::GetTickCount();
+  report("calibration per value", t1 - t0, (double)NROWS * NPASSES);
+  t0 = YAPI::GetTickCount();
+  for (int i = 0; i < NPASSES; i++) {
+    values = raw;
+    stream.calibrateBulk(values);
+    sumAfter += values[NROWS / 2];
+  }
+  t1 = YAPI::GetTickCount();
+  report("bulk calibration", t1 - t0, (double)NROWS * NPASSES);
+  if (sumBefore != sumAfter) {
+    printf("  *** results differ: %f != %f\n", sumBefore, sumAfter);
+  }
+}
+
+int main(int argc, const char * argv[])
+{
+  // the sensor is only used as the parent of the streams, it is never accessed
+  YSensor *parent = YSensor::FindSensor("BENCHMARK.sensor");
+
+  benchParse(parent, false, 0);
+  benchParse(parent, true, 0);
+  benchParse(parent, true, 3);
+  benchCalibration(parent, 2);
+  benchCalibration(parent, 5);
+  YAPI::FreeAPI();
+
+  return 0;
+}
@@ -0,0 +1,3 @@
+if "%VCINSTALLDIR%"=="" call "%VS140COMNTOOLS%vsvars32.bat"
+if "%VCINSTALLDIR%"=="" call "%VS100COMNTOOLS%vsvars32.bat"
+@nmake /nologo %1
@@ -0,0 +1,141 @@
+#define _CRT_SECURE_NO_DEPRECATE
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "yocto_api.h"
+extern "C" {
+#include "yapi/yproto.h"
+}
+
+using namespace std;
+
+// Throughput benchmark of the network notification parser: the traffic
+// of a /not.byn notification channel is pushed into the notification fifo
+// of a hub in chunks of random size, as done by the network thread, and
+// parsed by handleNetNotification(). The traffic is either read from a
+// file recorded on a real hub, or generated by the program itself.
+
+#define NPASSES 20
+
+// Generate about 256KB of traffic: mostly short value notifications,
+// some timed reports, keep-alives and a few full notifications
+static string buildTraffic(void)
+{
+  string res;
+  char buffer[128];
+
+  srand(1234);
+  while (res.size() < 256 * 1024) {
+    int devydx = rand() % 32;
+    int funydx = rand() % 15;
+    switch (rand() % 8) {
+    case 0:
+      // keep-alive
+      res += '\n';
+      break;
+    case 1:
+      sprintf(buffer, "%c%c%c%02X%02X%02X%02X\n", NOTIFY_NETPKT_TIMEV2YDX,
+              'A' + devydx, '0' + funydx, rand() % 256, rand() % 256, rand() % 256, rand() % 256);
+      res += buffer;
+      break;
+    case 2:
+      sprintf(buffer, "%s%cBENCHMK1-%05d,temperature,%d.%d\n", NOTIFY_NETPKT_START,
+              NOTIFY_NETPKT_FUNCVAL, devydx, rand() % 40, rand() % 100);
+      res += buffer;
+      break;
+    default:
+      sprintf(buffer, "%c%c%c%d.%d\n", NOTIFY_NETPKT_FUNCVALYDX,
+              'A' + devydx, '0' + funydx, rand() % 1000, rand() % 100);
+      res += buffer;
+      break;
+    }
+  }
+  return res;
+}
+
+static bool loadTraffic(const char *fname, string& res)
+{
+  char buffer[4096];
+  size_t len;
+  FILE *f = fopen(fname, "rb");
+
+  if (f == NULL) {
+    return false;
+  }
+  while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+    res.append(buffer, len);
+  }
+  fclose(f);
+  return true;
+}
+
+// Push the whole traffic through the notification fifo of the hub
+static void parseTraffic(HubSt *hub, const string& traffic)
+{
+  const u8 *data = (const u8*)traffic.data();
+  size_t pos = 0;
+
+  yFifoEmpty(&hub->not_fifo);
+  while (pos < traffic.size()) {
+    u16 toread = yFifoGetFree(&hub->not_fifo);
+    u16 chunk = (u16)(1 + rand() % 1460);
+    if (chunk > toread) chunk = toread;
+    if (chunk > traffic.size() - pos) chunk = (u16)(traffic.size() - pos);
+    yPushFifo(&hub->not_fifo, data + pos, chunk);
+    pos += chunk;
+    while (handleNetNotification(hub));
+  }
+}
+
+int main(int argc, const char * argv[])
+{
+  string errmsg, traffic;
+  HubSt *hub;
+  u64 t0, t1;
+  u32 notifications = 0;
+
+  if (argc > 1) {
+    if (!loadTraffic(argv[1], traffic)) {
+      cerr << "Unable to read " << argv[1] << endl;
+      return 1;
+    }
+    cout << "Recorded traffic: " << argv[1];
+  } else {
+    traffic = buildTraffic();
+    cout << "Generated traffic";
+  }
+  cout << " (" << traffic.size() << " bytes)" << endl;
+
+  // the API is only initialized for the notification handlers, no device is used
+  if (YAPI::InitAPI(Y_DETECT_NONE, errmsg) != YAPI::SUCCESS) {
+    cerr << "InitAPI failed: " << errmsg << endl;
+    return 1;
+  }
+  // a hub that has not yet received its device list: device indexes
+  // are not mapped, so the notifications are parsed but not dispatched
+  hub = (HubSt*)calloc(1, sizeof(HubSt));
+  memset(hub->devYdxMap, 255, sizeof(hub->devYdxMap));
+  yFifoInit(&hub->not_fifo, hub->not_buffer, sizeof(hub->not_buffer));
+
+  for (size_t i = 0; i < traffic.size(); i++) {
+    if (traffic[i] == NOTIFY_NETPKT_STOP && i > 0 && traffic[i - 1] != NOTIFY_NETPKT_STOP) {
+      notifications++;
+    }
+  }
+  t0 = YAPI::GetTickCount();
+  for (int i = 0; i < NPASSES; i++) {
+    parseTraffic(hub, traffic);
+  }
+  t1 = YAPI::GetTickCount();
+  if (t1 == t0) t1++;
+  printf("%.1f MB/s, %.2f M notifications/s\n",
+         (double)traffic.size() * NPASSES / 1000.0 / (t1 - t0),
+         (double)notifications * NPASSES / 1000.0 / (t1 - t0));
+
+  yFifoCleanup(&hub->not_fifo);
+  free(hub);
+  YAPI::FreeAPI();
+
+  return 0;
+}
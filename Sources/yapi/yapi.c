@@ -226,6 +226,14 @@ static write_timedcb_onfile(YAPI_FUNCTION fundescr, double deviceTime, const u8
 #endif
 
 
+// Wake up the thread blocked in yapiSleep() or yapiWaitForEvents(), so that
+// a notification forwarded from a hub thread is dispatched without delay
+static void yWakeUpSleep(void)
+{
+    ySetEvent(&yContext->exitSleepEvent);
+}
+
+
 void yFunctionUpdate(YAPI_FUNCTION fundescr, const char* value)
 {
     if (yContext->functionCallback) {
@@ -235,6 +243,7 @@ void yFunctionUpdate(YAPI_FUNCTION fundescr, const char* value)
 #endif
         yContext->functionCallback(fundescr, value);
         yLeaveCriticalSection(&yContext->functionCallbackCS);
+        yWakeUpSleep();
     }
 }
 
@@ -251,6 +260,7 @@ void yFunctionTimedUpdate(YAPI_FUNCTION fundescr, u64 deviceTimeMs, u64 duration
 #endif
         yContext->timedReportCallback(fundescr, deviceTimeMs / 1000.0, report, len, duration);
         yLeaveCriticalSection(&yContext->functionCallbackCS);
+        yWakeUpSleep();
     }
 }
 
@@ -756,6 +766,7 @@ void wpSafeUpdate(HubSt* hub, u8 devYdx, yStrRef serialref, yStrRef lnameref, yU
                 yEnterCriticalSection(&yContext->deviceCallbackCS);
                 yContext->changeCallback(serialref);
                 yLeaveCriticalSection(&yContext->deviceCallbackCS);
+                yWakeUpSleep();
             }
         }
         if (reg & 2) {
@@ -763,6 +774,7 @@ void wpSafeUpdate(HubSt* hub, u8 devYdx, yStrRef serialref, yStrRef lnameref, yU
                 yEnterCriticalSection(&yContext->functionCallbackCS);
                 yContext->beaconCallback(serialref, beacon);
                 yLeaveCriticalSection(&yContext->functionCallbackCS);
+                yWakeUpSleep();
             }
         }
     }
@@ -1734,6 +1746,7 @@ static HubSt* yapiAllocHub(const char* url, char* errmsg)
         hub->http.lastTraffic = yapiGetTickCount();
     } else {
         hub->ws.s_next_async_id = 48;
+        hub->ws.skt = INVALID_SOCKET;
     }
 #ifdef TRACE_NET_HUB
     dbglog("HUB%p: %x->%s allocated \n",hub, hub->url, hub->name);
@@ -1757,6 +1770,9 @@ static void yapiFreeHub(HubSt* hub)
             yReqFree(hub->http.notReq);
         }
     }
+    if (hub->proto != PROTO_WEBSOCKET) {
+        yHTTPPoolExpire(hub, 1);
+    }
     yDeleteCriticalSection(&hub->access);
     yFifoCleanup(&hub->not_fifo);
     if (hub->ref_api) yFree(hub->ref_api);
@@ -1791,7 +1807,11 @@ static void unregisterNetHub(yUrlRef huburl)
             while (yThreadIsRunning(&hub->net_thread) && (yapiGetTickCount() - timeref < YIO_DEFAULT_TCP_TIMEOUT)) {
                 yApproximateSleep(10);
             }
+#ifdef YAPI_USE_EPOLL
+            yNetLoopRemoveHub(hub);
+#else
             yThreadKill(&hub->net_thread);
+#endif
             yapiFreeHub(hub);
             yContext->nethub[i] = NULL;
             break;
@@ -1942,6 +1962,7 @@ static YRETCODE yapiInitAPI_internal(int detect_type, char* errmsg)
     yMemset(ctx,0,sizeof(yContextSt));
     ctx->detecttype = detect_type;
     ctx->deviceListValidityMs = DEFAULT_NET_DEVLIST_VALIDITY_MS;
+    ctx->httpPoolSize = DEFAULT_HTTP_POOL_SIZE;
 
     //initialize enumeration CS
     initializeAllCS(ctx);
@@ -2097,6 +2118,65 @@ static u64 yapiGetNetDevListValidity_internal(void)
 }
 
 
+static void yapiSetHTTPPoolSize_internal(int poolSize)
+{
+    if (!yContext) {
+        return;
+    }
+    if (poolSize < 0) {
+        poolSize = 0;
+    } else if (poolSize > HTTP_POOL_MAX) {
+        poolSize = HTTP_POOL_MAX;
+    }
+    yEnterCriticalSection(&yContext->updateDev_cs);
+    yContext->httpPoolSize = poolSize;
+    yLeaveCriticalSection(&yContext->updateDev_cs);
+}
+
+
+static int yapiGetHTTPPoolSize_internal(void)
+{
+    int res;
+    if (!yContext) {
+        return DEFAULT_HTTP_POOL_SIZE;
+    }
+    yEnterCriticalSection(&yContext->updateDev_cs);
+    res = yContext->httpPoolSize;
+    yLeaveCriticalSection(&yContext->updateDev_cs);
+    return res;
+}
+
+
+static YRETCODE yapiGetHTTPPoolStats_internal(const char* url, int* hits, int* misses, int* idle, char* errmsg)
+{
+    int i;
+    yUrlRef huburl;
+    HubSt* hub = NULL;
+
+    if (!yContext) {
+        return YERR(YAPI_NOT_INITIALIZED);
+    }
+    huburl = yHashUrl(url, "", 1, errmsg);
+    if (huburl == INVALID_HASH_IDX) {
+        return YERRMSG(YAPI_INVALID_ARGUMENT, "Unknown hub");
+    }
+    yEnterCriticalSection(&yContext->enum_cs);
+    for (i = 0; i < NBMAX_NET_HUB; i++) {
+        if (yContext->nethub[i] && yHashSameHub(yContext->nethub[i]->url, huburl)) {
+            hub = yContext->nethub[i];
+            break;
+        }
+    }
+    if (hub == NULL || hub->proto == PROTO_WEBSOCKET) {
+        yLeaveCriticalSection(&yContext->enum_cs);
+        return YERRMSG(YAPI_INVALID_ARGUMENT, "Not a registered HTTP hub");
+    }
+    yHTTPPoolGetStats(hub, hits, misses, idle);
+    yLeaveCriticalSection(&yContext->enum_cs);
+    return YAPI_SUCCESS;
+}
+
+
 static void yapiRegisterLogFunction_internal(yapiLogFunction logfun)
 {
     char errmsg[YOCTO_ERRMSG_LEN];
@@ -2296,6 +2376,7 @@ static void wpUpdateTCP(HubSt* hub, const char* serial, const char* name, u8 bea
             yEnterCriticalSection(&yContext->deviceCallbackCS);
             yContext->changeCallback(serialref);
             yLeaveCriticalSection(&yContext->deviceCallbackCS);
+            yWakeUpSleep();
         }
     }
     if (status & 2) {
@@ -2304,69 +2385,47 @@ static void wpUpdateTCP(HubSt* hub, const char* serial, const char* name, u8 bea
             yEnterCriticalSection(&yContext->functionCallbackCS);
             yContext->beaconCallback(serialref, beacon);
             yLeaveCriticalSection(&yContext->functionCallbackCS);
+            yWakeUpSleep();
         }
     }
 }
 
-int handleNetNotification(HubSt* hub)
+// longest short notification accepted (stop marker included)
+#define NOTIFY_NETPKT_SHORT_MAX_LEN 128
+
+/*
+ * Handle one notification of pktlen bytes (stop marker excluded), parsed in place.
+ * nextchar is the byte received right after the stop marker, or -1 if there is none yet.
+ */
+static void yDispatchNetNotification(HubSt* hub, char* pkt, u16 pktlen, int nextchar)
 {
     u16 pos;
-    u16 end, size;
-    char buffer[128];
     char* p;
-    u8 pkttype = 0, devydx, funydx, funclass;
+    u8 pkttype, devydx, funydx, funclass;
     char *serial = NULL, *name, *funcid, *children;
     char value[YOCTO_PUBVAL_LEN];
     u8 report[18];
-    char netstop = NOTIFY_NETPKT_STOP;
-    char escapechar = 27;
 #ifdef DEBUG_NET_NOTIFICATION
     u32             abspos = hub->notifAbsPos;
     char            Dbuffer[1024];
-    u8              throwbuf[1024];
-    u16             tmp;
 #endif
 
-    // search for start of notification
-    size = yFifoGetUsed(&(hub->not_fifo));
-    while (size >= NOTIFY_NETPKT_START_LEN) {
-        yPeekFifo(&(hub->not_fifo), &pkttype, 1, 0);
-        if (pkttype != NOTIFY_NETPKT_STOP) break;
-        // drop newline and loop
-        yPopFifo(&(hub->not_fifo),NULL, 1);
-        // note: keep-alive packets don't count in the notification channel position
-        size--;
-    }
-    if (size < NOTIFY_NETPKT_START_LEN) {
-        return 0;
-    }
-    // make sure we have a full notification
-    end = ySeekFifo(&(hub->not_fifo), (u8*)&netstop, 1, 0, 0, 0);
-    if (end == 0xffff) {
-        if (yFifoGetFree(&(hub->not_fifo)) == 0) {
-            dbglog("Too many invalid notifications, clearing buffer\n");
-            yFifoEmpty((&(hub->not_fifo)));
-            return 1;
-        }
-        return 0;
-    }
-    // make sure we have a full notification
-    if (0xffff != ySeekFifo(&(hub->not_fifo), (u8*)&escapechar, 1, 0, end, 0)) {
+    pkt[pktlen] = 0;
+    pkttype = *pkt;
+    if (memchr(pkt, 27, pktlen) != NULL) {
         // drop notification that contain esc char
-        yPopFifo(&(hub->not_fifo), NULL, end + 1);
-        return 1;
+        return;
     }
     // handle short funcvalydx notifications
     if (pkttype >= NOTIFY_NETPKT_CONFCHGYDX && pkttype <= NOTIFY_NETPKT_TIMEAVGYDX) {
         memset(value, 0, YOCTO_PUBVAL_LEN);
-        if (end + 1 > (u16)sizeof(buffer)) {
-            dbglog("Drop invalid short notification (too long :%d)\n", end + 1);
-            hub->notifAbsPos += end + 1;
-            return 1;
+        if (pktlen < 3 || pktlen + 1 > NOTIFY_NETPKT_SHORT_MAX_LEN) {
+            dbglog("Drop invalid short notification (length :%d)\n", pktlen + 1);
+            hub->notifAbsPos += pktlen + 1;
+            return;
         }
-        yPopFifo(&(hub->not_fifo), (u8*)buffer, end + 1);
-        hub->notifAbsPos += end + 1;
-        p = buffer + 1;
+        hub->notifAbsPos += pktlen + 1;
+        p = pkt + 1;
         devydx = (*p++) - 'A';
         funydx = (*p++) - '0';
         if (funydx & 64) {
@@ -2424,6 +2483,7 @@ int handleNetNotification(HubSt* hub)
 #endif
                     yContext->confChangeCallback(serialref);
                     yLeaveCriticalSection(&yContext->deviceCallbackCS);
+                    yWakeUpSleep();
                 }
             }
             break;
@@ -2511,39 +2571,30 @@ int handleNetNotification(HubSt* hub)
         default:
             break;
         }
-        return 1;
+        return;
     }
 
     // make sure packet is a valid notification
-    pos = ySeekFifo(&(hub->not_fifo), (u8*)(NOTIFY_NETPKT_START), NOTIFY_NETPKT_START_LEN, 0, end, 0);
-    if (pos != 0) {
+    if (pktlen < NOTIFY_NETPKT_START_LEN || memcmp(pkt, NOTIFY_NETPKT_START, NOTIFY_NETPKT_START_LEN) != 0) {
         // does not start with signature, drop everything until stop marker
 #ifdef DEBUG_NET_NOTIFICATION
-        memset(throwbuf, 0, sizeof(throwbuf));
-        tmp = (end > 50 ? 50 : end);
-        yPopFifo(&(hub->not_fifo),throwbuf,tmp);
-        yPopFifo(&(hub->not_fifo),NULL,end+1-tmp);
-        Dbuffer[1023]=0;
-        YSPRINTF(Dbuffer,512,"throw %d / %d [%s]\n",
-                 end,pos,throwbuf);
+        YSPRINTF(Dbuffer,512,"throw %d [%.50s]\n",
+                 pktlen,pkt);
         dumpNotif(Dbuffer);
-#else
-        yPopFifo(&(hub->not_fifo),NULL, end + 1);
 #endif
-        hub->notifAbsPos += end + 1;
-        return 0;
+        hub->notifAbsPos += pktlen + 1;
+        return;
+    }
+    if (pktlen - NOTIFY_NETPKT_START_LEN >= NOTIFY_NETPKT_MAX_LEN) {
+        dbglog("Drop invalid notification (too long :%d)\n", pktlen + 1);
+        hub->notifAbsPos += pktlen + 1;
+        return;
     }
 
-    // full packet at start of fifo
-    size = end - NOTIFY_NETPKT_START_LEN;
-    YASSERT(NOTIFY_NETPKT_MAX_LEN > size);
-    yPopFifo(&(hub->not_fifo),NULL,NOTIFY_NETPKT_START_LEN);
-    yPopFifo(&(hub->not_fifo), (u8*)buffer, size + 1);
-    buffer[size] = 0;
-    pkttype = *buffer;
-    p = buffer + 1;
+    // full packet
+    pkttype = pkt[NOTIFY_NETPKT_START_LEN];
+    p = pkt + NOTIFY_NETPKT_START_LEN + 1;
     if (pkttype == NOTIFY_NETPKT_NOT_SYNC) {
-        int testPing;
 #ifdef DEBUG_NET_NOTIFICATION
         YSPRINTF(Dbuffer,512,"Sync from %d to %s\n",
              hub->notifAbsPos, p);
@@ -2552,26 +2603,25 @@ int handleNetNotification(HubSt* hub)
         hub->notifAbsPos = atoi(p);
         //look if we have a \n just after the sync notification
         // if yes this mean that the hub will send some ping notification
-        testPing = ySeekFifo(&(hub->not_fifo), (u8*)&netstop, 1, 0, 1, 0);
-        if (testPing == 0) {
+        if (nextchar == NOTIFY_NETPKT_STOP) {
 #ifdef DEBUG_NET_NOTIFICATION
             YSPRINTF(Dbuffer,1024,"HUB: %X->%s will send ping notification\n",hub->url,hub->name);
             dumpNotif(Dbuffer);
 #endif
             hub->send_ping = 1;
         }
-        return 1;
+        return;
     }
-    hub->notifAbsPos += size + 1 + NOTIFY_NETPKT_START_LEN;
+    hub->notifAbsPos += pktlen + 1;
     if (pkttype != NOTIFY_NETPKT_FUNCVALYDX) {
         serial = p;
         p = strchr(serial,NOTIFY_NETPKT_SEP);
         if (p == NULL) {
 #ifdef DEBUG_NET_NOTIFICATION
-            YSPRINTF(Dbuffer,512,"no serialFOR %s\n",buffer);
+            YSPRINTF(Dbuffer,512,"no serialFOR %s\n",pkt);
             dumpNotif(Dbuffer);
 #endif
-            return 0;
+            return;
         }
         *p++ = 0;
     }
@@ -2585,7 +2635,7 @@ int handleNetNotification(HubSt* hub)
 #ifdef DEBUG_NET_NOTIFICATION
                 dbglog("drop: invalid new name (%X)\n",pkttype);
 #endif
-            return 1;
+            return;
         }
         *p++ = 0;
 #ifdef DEBUG_NET_NOTIFICATION
@@ -2602,7 +2652,7 @@ int handleNetNotification(HubSt* hub)
 #ifdef DEBUG_NET_NOTIFICATION
                 dbglog("drop: invalid funcid (%X:%s)\n",pkttype,serial);
 #endif
-            return 1;
+            return;
         }
         *p++ = 0;
         name = p;
@@ -2621,7 +2671,7 @@ int handleNetNotification(HubSt* hub)
 #ifdef DEBUG_NET_NOTIFICATION
                 dbglog("drop: invalid funcid (%X)\n",pkttype);
 #endif
-            return 1;
+            return;
         }
         *p++ = 0;
         memset(value, 0,YOCTO_PUBVAL_LEN);
@@ -2641,7 +2691,7 @@ int handleNetNotification(HubSt* hub)
 #ifdef DEBUG_NET_NOTIFICATION
                 dbglog("drop: invalid funcid (%X:%s)\n",pkttype,serial);
 #endif
-            return 1;
+            return;
         }
         *p++ = 0;
         name = p;
@@ -2650,7 +2700,7 @@ int handleNetNotification(HubSt* hub)
 #ifdef DEBUG_NET_NOTIFICATION
                 dbglog("drop: invalid funcname (%X:%s)\n",pkttype,serial);
 #endif
-            return 1;
+            return;
         }
         *p++ = 0;
         funydx = atoi(p);
@@ -2674,7 +2724,7 @@ int handleNetNotification(HubSt* hub)
 #ifdef DEBUG_NET_NOTIFICATION
                 dbglog("drop: invalid children notification (%X)\n",pkttype);
 #endif
-            return 1;
+            return;
         }
         *p++ = 0;
 #ifdef DEBUG_NET_NOTIFICATION
@@ -2715,7 +2765,84 @@ int handleNetNotification(HubSt* hub)
         break;
 
     }
-    return 1;
+    return;
+}
+
+
+/*
+ * Handle all the complete notifications available in the notification fifo.
+ * The fifo is only used by the thread that feeds it, so notifications are
+ * located with a single scan of its contiguous part and parsed in place,
+ * then popped at once. Returns 1 if some data has been consumed.
+ */
+int handleNetNotification(HubSt* hub)
+{
+    u8* view;
+    u8* stop;
+    u8 c;
+    u16 avail, used, consumed, end, pktlen;
+    int nextchar;
+    char buffer[NOTIFY_NETPKT_SHORT_MAX_LEN];
+    char netstop = NOTIFY_NETPKT_STOP;
+
+    used = yFifoGetUsed(&(hub->not_fifo));
+    avail = yPeekContinuousFifo(&(hub->not_fifo), &view, 0);
+    consumed = 0;
+    while (consumed < avail) {
+        if (view[consumed] == NOTIFY_NETPKT_STOP) {
+            // drop newline
+            // note: keep-alive packets don't count in the notification channel position
+            consumed++;
+            continue;
+        }
+        stop = (u8*)memchr(view + consumed, NOTIFY_NETPKT_STOP, avail - consumed);
+        if (stop == NULL) {
+            break;
+        }
+        pktlen = (u16)(stop - view - consumed);
+        end = consumed + pktlen + 1;
+        if (end < avail) {
+            nextchar = view[end];
+        } else if (end < used) {
+            yPeekFifo(&(hub->not_fifo), &c, 1, end);
+            nextchar = c;
+        } else {
+            nextchar = -1;
+        }
+        yDispatchNetNotification(hub, (char*)view + consumed, pktlen, nextchar);
+        consumed = end;
+    }
+    if (consumed > 0) {
+        yPopFifo(&(hub->not_fifo), NULL, consumed);
+        return 1;
+    }
+    if (avail < used) {
+        // first notification wraps around the end of the fifo buffer
+        end = ySeekFifo(&(hub->not_fifo), (u8*)&netstop, 1, 0, 0, 0);
+        if (end != 0xffff) {
+            if (end + 1 > (u16)sizeof(buffer)) {
+                dbglog("Drop invalid notification (too long :%d)\n", end + 1);
+                yPopFifo(&(hub->not_fifo), NULL, end + 1);
+                hub->notifAbsPos += end + 1;
+                return 1;
+            }
+            yPopFifo(&(hub->not_fifo), (u8*)buffer, end + 1);
+            if (yPeekFifo(&(hub->not_fifo), &c, 1, 0) == 1) {
+                nextchar = c;
+            } else {
+                nextchar = -1;
+            }
+            yDispatchNetNotification(hub, buffer, end, nextchar);
+            return 1;
+        }
+    }
+    // no full notification yet
+    if (yFifoGetFree(&(hub->not_fifo)) == 0) {
+        dbglog("Too many invalid notifications, clearing buffer\n");
+        yFifoEmpty((&(hub->not_fifo)));
+        return 1;
+    }
+    return 0;
 }
 
 static int yTcpTrafficPending(void)
@@ -2745,185 +2872,212 @@ void request_pending_logs(HubSt* hub)
     }
 }
 
-static void* yhelper_thread(void* ctx)
+/*
+ * Handle the (re)connection of the notification socket of a HTTP hub, and
+ * build the list of requests to monitor. Returns the number of requests.
+ */
+static int yhelper_prepare(HubSt* hub, RequestSt** selectlist, char* errmsg)
 {
-    int i, towatch;
-    u8 buffer[512];
-    yThread* thread = (yThread*)ctx;
-    char errmsg[YOCTO_ERRMSG_LEN];
-    HubSt* hub = (HubSt*)thread->ctx;
-    RequestSt *req, *selectlist[1 + ALLOC_YDX_PER_HUB];
-    u32 toread;
-    int res;
-    int first_notification_connection = 1;
+    int i, towatch, res;
+    RequestSt* req;
 #ifdef DEBUG_NET_NOTIFICATION
     char        Dbuffer[1024];
 #endif
 
-
-    yThreadSignalStart(thread);
-    while (!yThreadMustEnd(thread)) {
-        // Handle async connections as well in this thread
-        request_pending_logs(hub);
-        towatch = 0;
-        if (hub->state == NET_HUB_ESTABLISHED || hub->state == NET_HUB_TRYING) {
-            selectlist[towatch] = hub->http.notReq;
-            towatch++;
-        } else if (hub->state == NET_HUB_TOCLOSE) {
-            yReqClose(hub->http.notReq);
-            hub->state = NET_HUB_CLOSED;
-        } else if (hub->state == NET_HUB_DISCONNECTED) {
-            u64 now;
-            if (hub->http.notReq == NULL) {
-                hub->http.notReq = yReqAlloc(hub);
-            }
-            now = yapiGetTickCount();
-            if ((u64)(now - hub->lastAttempt) > hub->attemptDelay) {
-                char request[256];
+    // Handle async connections as well in this thread
+    request_pending_logs(hub);
+    towatch = 0;
+    if (hub->state == NET_HUB_ESTABLISHED || hub->state == NET_HUB_TRYING) {
+        selectlist[towatch] = hub->http.notReq;
+        towatch++;
+    } else if (hub->state == NET_HUB_TOCLOSE) {
+        yReqClose(hub->http.notReq);
+        hub->state = NET_HUB_CLOSED;
+    } else if (hub->state == NET_HUB_DISCONNECTED) {
+        u64 now;
+        if (hub->http.notReq == NULL) {
+            hub->http.notReq = yReqAlloc(hub);
+        }
+        now = yapiGetTickCount();
+        if ((u64)(now - hub->lastAttempt) > hub->attemptDelay) {
+            char request[256];
 #ifdef TRACE_NET_HUB
-                dbglog("TRACE(%X->%s): try to open notification socket at %d\n",hub->url,hub->name, hub->notifAbsPos);
+            dbglog("TRACE(%X->%s): try to open notification socket at %d\n",hub->url,hub->name, hub->notifAbsPos);
 #endif
-                // reset fifo
-                yFifoEmpty(&(hub->not_fifo));
-                if (first_notification_connection) {
-                    YSPRINTF(request, 256, "GET /not.byn HTTP/1.1\r\n\r\n");
-                } else {
-                    YSPRINTF(request, 256, "GET /not.byn?abs=%u HTTP/1.1\r\n\r\n", hub->notifAbsPos);
-                }
-                res = yReqOpen(hub->http.notReq, 2 * YIO_DEFAULT_TCP_TIMEOUT, 0, request, YSTRLEN(request), 0, NULL, NULL, NULL, NULL, errmsg);
-                if (YISERR(res)) {
-                    hub->attemptDelay = 500 << hub->retryCount;
-                    if (hub->attemptDelay > 8000)
-                        hub->attemptDelay = 8000;
-                    hub->lastAttempt = yapiGetTickCount();
-                    hub->retryCount++;
-                    yEnterCriticalSection(&hub->access);
-                    hub->errcode = ySetErr(res, hub->errmsg, errmsg, NULL, 0);
-                    yLeaveCriticalSection(&hub->access);
+            // reset fifo
+            yFifoEmpty(&(hub->not_fifo));
+            if (!hub->notifReopen) {
+                YSPRINTF(request, 256, "GET /not.byn HTTP/1.1\r\n\r\n");
+            } else {
+                YSPRINTF(request, 256, "GET /not.byn?abs=%u HTTP/1.1\r\n\r\n", hub->notifAbsPos);
+            }
+            res = yReqOpen(hub->http.notReq, 2 * YIO_DEFAULT_TCP_TIMEOUT, 0, request, YSTRLEN(request), 0, NULL, NULL, NULL, NULL, errmsg);
+            if (YISERR(res)) {
+                hub->attemptDelay = 500 << hub->retryCount;
+                if (hub->attemptDelay > 8000)
+                    hub->attemptDelay = 8000;
+                hub->lastAttempt = yapiGetTickCount();
+                hub->retryCount++;
+                yEnterCriticalSection(&hub->access);
+                hub->errcode = ySetErr(res, hub->errmsg, errmsg, NULL, 0);
+                yLeaveCriticalSection(&hub->access);
 
 #ifdef TRACE_NET_HUB
-                dbglog("TRACE(%X->%s): unable to open notification socket(%s)\n",hub->url,hub->name,errmsg);
-                dbglog("TRACE(%X->%s): retry in %dms (%d retries)\n",hub->url,hub->name,hub->attemptDelay,hub->retryCount);
+            dbglog("TRACE(%X->%s): unable to open notification socket(%s)\n",hub->url,hub->name,errmsg);
+            dbglog("TRACE(%X->%s): retry in %dms (%d retries)\n",hub->url,hub->name,hub->attemptDelay,hub->retryCount);
 #endif
-                } else {
+            } else {
 #ifdef TRACE_NET_HUB
-                    dbglog("TRACE(%X->%s): notification socket open\n",hub->url,hub->name);
+                dbglog("TRACE(%X->%s): notification socket open\n",hub->url,hub->name);
 #endif
 #ifdef DEBUG_NET_NOTIFICATION
-                    YSPRINTF(Dbuffer,1024,"HUB: %X->%s started\n",hub->url,hub->name);
-                    dumpNotif(Dbuffer);
+                YSPRINTF(Dbuffer,1024,"HUB: %X->%s started\n",hub->url,hub->name);
+                dumpNotif(Dbuffer);
 #endif
-                    hub->state = NET_HUB_TRYING;
-                    hub->retryCount = 0;
-                    hub->attemptDelay = 500;
-                    hub->http.lastTraffic = yapiGetTickCount();
-                    hub->send_ping = 0;
-                    selectlist[towatch++] = hub->http.notReq;
-                    first_notification_connection = 0;
-                }
+                hub->state = NET_HUB_TRYING;
+                hub->retryCount = 0;
+                hub->attemptDelay = 500;
+                hub->http.lastTraffic = yapiGetTickCount();
+                hub->send_ping = 0;
+                selectlist[towatch++] = hub->http.notReq;
+                hub->notifReopen = 1;
             }
         }
+    }
 
-        // Handle async connections as well in this thread
-        for (i = 0; i < ALLOC_YDX_PER_HUB; i++) {
-            req = yContext->tcpreq[i];
-            if (req == NULL || req->hub != hub) {
-                continue;
-            }
-            if (yReqIsAsync(req)) {
-                selectlist[towatch++] = req;
-            }
+    // Handle async connections as well in this thread
+    for (i = 0; i < ALLOC_YDX_PER_HUB; i++) {
+        req = yContext->tcpreq[i];
+        if (req == NULL || req->hub != hub) {
+            continue;
         }
+        if (yReqIsAsync(req)) {
+            selectlist[towatch++] = req;
+        }
+    }
+    return towatch;
+}
 
-        if (YISERR(yReqMultiSelect(selectlist, towatch, 1000, &hub->wuce, errmsg))) {
-            dbglog("yTcpMultiSelectReq failed (%s)\n",errmsg);
-            yApproximateSleep(1000);
-        } else {
-            for (i = 0; i < towatch; i++) {
-                req = selectlist[i];
-                if (req == hub->http.notReq) {
-                    toread = yFifoGetFree(&hub->not_fifo);
-                    while (toread > 0) {
-                        if (toread >= sizeof(buffer)) toread = sizeof(buffer) - 1;
-                        res = yReqRead(req, buffer, toread);
-                        if (res > 0) {
-                            buffer[res] = 0;
+/*
+ * Process the data received on the monitored requests of a HTTP hub
+ */
+static void yhelper_process(HubSt* hub, RequestSt** selectlist, int towatch)
+{
+    int i, res;
+    u8 buffer[512];
+    char errmsg[YOCTO_ERRMSG_LEN];
+    RequestSt* req;
+    u32 toread;
+#ifdef DEBUG_NET_NOTIFICATION
+    char        Dbuffer[1024];
+#endif
+
+    for (i = 0; i < towatch; i++) {
+        req = selectlist[i];
+        if (req == hub->http.notReq) {
+            toread = yFifoGetFree(&hub->not_fifo);
+            while (toread > 0) {
+                if (toread >= sizeof(buffer)) toread = sizeof(buffer) - 1;
+                res = yReqRead(req, buffer, toread);
+                if (res > 0) {
+                    buffer[res] = 0;
 #if 0 //def DEBUG_NET_NOTIFICATION
-                            YSPRINTF(Dbuffer,1024,"HUB: %X->%s push %d [\n%s\n]\n",hub->url,hub->name,res,buffer);
-                            dumpNotif(Dbuffer);
+                    YSPRINTF(Dbuffer,1024,"HUB: %X->%s push %d [\n%s\n]\n",hub->url,hub->name,res,buffer);
+                    dumpNotif(Dbuffer);
 #endif
-                            yPushFifo(&(hub->not_fifo), (u8*)buffer, res);
-                            if (hub->state == NET_HUB_TRYING) {
-                                int eoh = ySeekFifo(&(hub->not_fifo), (u8 *)"\r\n\r\n", 4, 0, 0, 0);
-                                if (eoh != 0xffff) {
-                                    if (eoh >= 12) {
-                                        yPopFifo(&(hub->not_fifo), (u8 *)buffer, 12);
-                                        yPopFifo(&(hub->not_fifo), NULL, eoh + 4 - 12);
-                                        if (!memcmp((u8 *)buffer, (u8 *)"HTTP/1.1 200", 12)) {
-                                            hub->state = NET_HUB_ESTABLISHED;
-                                        }
-                                    }
-                                    if (hub->state != NET_HUB_ESTABLISHED) {
-                                        // invalid header received, give up
-                                        char hubname[YOCTO_HOSTNAME_NAME] = "";
-                                        hub->state = NET_HUB_TOCLOSE;
-                                        yHashGetUrlPort(hub->url, hubname, NULL, NULL, NULL, NULL, NULL);
-                                        dbglog("Network hub %s cannot provide notifications", hubname);
-                                    }
+                    yPushFifo(&(hub->not_fifo), (u8*)buffer, res);
+                    if (hub->state == NET_HUB_TRYING) {
+                        int eoh = ySeekFifo(&(hub->not_fifo), (u8 *)"\r\n\r\n", 4, 0, 0, 0);
+                        if (eoh != 0xffff) {
+                            if (eoh >= 12) {
+                                yPopFifo(&(hub->not_fifo), (u8 *)buffer, 12);
+                                yPopFifo(&(hub->not_fifo), NULL, eoh + 4 - 12);
+                                if (!memcmp((u8 *)buffer, (u8 *)"HTTP/1.1 200", 12)) {
+                                    hub->state = NET_HUB_ESTABLISHED;
                                 }
                             }
-                            if (hub->state == NET_HUB_ESTABLISHED) {
-                                while (handleNetNotification(hub));
+                            if (hub->state != NET_HUB_ESTABLISHED) {
+                                // invalid header received, give up
+                                char hubname[YOCTO_HOSTNAME_NAME] = "";
+                                hub->state = NET_HUB_TOCLOSE;
+                                yHashGetUrlPort(hub->url, hubname, NULL, NULL, NULL, NULL, NULL);
+                                dbglog("Network hub %s cannot provide notifications", hubname);
                             }
-                            hub->http.lastTraffic = yapiGetTickCount();
-                        } else {
-                            if (hub->send_ping && ((u64)(yapiGetTickCount() - hub->http.lastTraffic)) > NET_HUB_NOT_CONNECTION_TIMEOUT) {
+                        }
+                    }
+                    if (hub->state == NET_HUB_ESTABLISHED) {
+                        while (handleNetNotification(hub));
+                    }
+                    hub->http.lastTraffic = yapiGetTickCount();
+                } else {
+                    if (hub->send_ping && ((u64)(yapiGetTickCount() - hub->http.lastTraffic)) > NET_HUB_NOT_CONNECTION_TIMEOUT) {
 #ifdef TRACE_NET_HUB
 
-                                dbglog("network hub %s(%x) didn't respond for too long (%d)\n", hub->name, hub->url, res);
+                        dbglog("network hub %s(%x) didn't respond for too long (%d)\n", hub->name, hub->url, res);
 #endif
-                                yReqClose(req);
-                                hub->state = NET_HUB_DISCONNECTED;
-                            }
-                            // nothing more to be read, exit loop
-                            break;
-                        }
-                        toread = yFifoGetFree(&hub->not_fifo);
-                    }
-                    res = yReqIsEof(req, errmsg);
-                    if (res != 0) {
-                        // error or remote close
                         yReqClose(req);
                         hub->state = NET_HUB_DISCONNECTED;
-                        if (res == 1) {
-                            // remote close
-                            YERRMSG(YAPI_IO_ERROR, "Connection closed by remote host");
-                            dbglog("Disconnected from network hub %s (%s)\n", hub->name, errmsg);
-                        } else {
-                            //error
-                            hub->attemptDelay = 500 << hub->retryCount;
-                            if (hub->attemptDelay > 8000)
-                                hub->attemptDelay = 8000;
-                            hub->lastAttempt = yapiGetTickCount();
-                            hub->retryCount++;
-                            yEnterCriticalSection(&hub->access);
-                            hub->errcode = ySetErr(res, hub->errmsg, errmsg, NULL, 0);
-                            yLeaveCriticalSection(&hub->access);
-                        }
-#ifdef DEBUG_NET_NOTIFICATION
-                        YSPRINTF(Dbuffer, 1024, "Network hub %X->%s has closed the connection for notification\n", hub->url, hub->name);
-                        dumpNotif(Dbuffer);
-#endif
-                    }
-                } else if (yReqIsAsync(req)) {
-                    res = yReqIsEof(req, errmsg);
-                    if (res != 0) {
-                        yReqClose(req);
                     }
+                    // nothing more to be read, exit loop
+                    break;
+                }
+                toread = yFifoGetFree(&hub->not_fifo);
+            }
+            res = yReqIsEof(req, errmsg);
+            if (res != 0) {
+                // error or remote close
+                yReqClose(req);
+                hub->state = NET_HUB_DISCONNECTED;
+                if (res == 1) {
+                    // remote close
+                    YERRMSG(YAPI_IO_ERROR, "Connection closed by remote host");
+                    dbglog("Disconnected from network hub %s (%s)\n", hub->name, errmsg);
+                } else {
+                    //error
+                    hub->attemptDelay = 500 << hub->retryCount;
+                    if (hub->attemptDelay > 8000)
+                        hub->attemptDelay = 8000;
+                    hub->lastAttempt = yapiGetTickCount();
+                    hub->retryCount++;
+                    yEnterCriticalSection(&hub->access);
+                    hub->errcode = ySetErr(res, hub->errmsg, errmsg, NULL, 0);
+                    yLeaveCriticalSection(&hub->access);
                 }
+#ifdef DEBUG_NET_NOTIFICATION
+                YSPRINTF(Dbuffer, 1024, "Network hub %X->%s has closed the connection for notification\n", hub->url, hub->name);
+                dumpNotif(Dbuffer);
+#endif
+            }
+        } else if (yReqIsAsync(req)) {
+            res = yReqIsEof(req, errmsg);
+            if (res != 0) {
+                yReqClose(req);
             }
         }
     }
+    // close the keep-alive connections that have been idle for too long
+    yHTTPPoolExpire(hub, 0);
+}
+
+#ifndef YAPI_USE_EPOLL
+static void* yhelper_thread(void* ctx)
+{
+    int towatch;
+    yThread* thread = (yThread*)ctx;
+    char errmsg[YOCTO_ERRMSG_LEN];
+    HubSt* hub = (HubSt*)thread->ctx;
+    RequestSt* selectlist[1 + ALLOC_YDX_PER_HUB];
+
+    yThreadSignalStart(thread);
+    while (!yThreadMustEnd(thread)) {
+        towatch = yhelper_prepare(hub, selectlist, errmsg);
+        if (YISERR(yReqMultiSelect(selectlist, towatch, 1000, &hub->wuce, errmsg))) {
+            dbglog("yTcpMultiSelectReq failed (%s)\n",errmsg);
+            yApproximateSleep(1000);
+        } else {
+            yhelper_process(hub, selectlist, towatch);
+        }
+    }
 
     if (hub->state == NET_HUB_TOCLOSE) {
         yReqClose(hub->http.notReq);
@@ -2934,6 +3088,36 @@ static void* yhelper_thread(void* ctx)
     return NULL;
 }
 
+#else
+/*
+ * One iteration of yhelper_thread, used by the event loops. Data already
+ * received is read without waiting, the sockets of the monitored requests
+ * are then handed back to the event loop.
+ */
+static int yhelper_step(HubSt* hub, int mode, YSOCKET* skts, int* nbskts, char* errmsg)
+{
+    int i, towatch;
+    RequestSt* selectlist[1 + ALLOC_YDX_PER_HUB];
+
+    if (mode == YNET_STEP_RUN) {
+        towatch = yhelper_prepare(hub, selectlist, errmsg);
+        yReqPoll(selectlist, towatch, errmsg);
+        yhelper_process(hub, selectlist, towatch);
+        for (i = 0; i < towatch; i++) {
+            if (selectlist[i]->http.skt != INVALID_SOCKET) {
+                skts[(*nbskts)++] = selectlist[i]->http.skt;
+            }
+        }
+        return 1000;
+    }
+    if (hub->state == NET_HUB_TOCLOSE || mode == YNET_STEP_ABORT) {
+        yReqClose(hub->http.notReq);
+        hub->state = NET_HUB_CLOSED;
+    }
+    return -1;
+}
+#endif
+
 
 static YRETCODE yapiLockFunctionCallBack_internal(char* errmsg)
 {
@@ -3011,7 +3195,11 @@ static YRETCODE yapiRegisterHubEx(const char* url, int checkacces, char* errmsg)
     } else {
         HubSt* hubst = NULL;
         int firstfree;
+#ifdef YAPI_USE_EPOLL
+        yNetHubStep step_handler;
+#else
         void* (*thead_handler)(void*);
+#endif
 
         hubst = yapiAllocHub(url, errmsg);
         if (hubst == NULL) {
@@ -3043,6 +3231,17 @@ static YRETCODE yapiRegisterHubEx(const char* url, int checkacces, char* errmsg)
                 yLeaveCriticalSection(&yContext->enum_cs);
                 return (YRETCODE)res;
             }
+#ifdef YAPI_USE_EPOLL
+            if (hubst->proto == PROTO_WEBSOCKET) {
+                step_handler = ws_step;
+            } else {
+                step_handler = yhelper_step;
+            }
+            if (YISERR(res = yNetLoopAddHub(yContext->nethub[i], step_handler, errmsg))) {
+                yLeaveCriticalSection(&yContext->enum_cs);
+                return (YRETCODE)res;
+            }
+#else
             if (hubst->proto == PROTO_WEBSOCKET) {
                 thead_handler = ws_thread;
             } else {
@@ -3053,6 +3252,7 @@ static YRETCODE yapiRegisterHubEx(const char* url, int checkacces, char* errmsg)
                 yLeaveCriticalSection(&yContext->enum_cs);
                 return YERRMSG(YAPI_IO_ERROR, "Unable to start helper thread");
             }
+#endif
             yDringWakeUpSocket(&yContext->nethub[i]->wuce, 1, errmsg);
         }
         yLeaveCriticalSection(&yContext->enum_cs);
@@ -3202,11 +3402,18 @@ static YRETCODE yapiTestHub_internal(const char* url, int mstimeout, char* errms
                     yapiFreeHub(hubst);
                     return (YRETCODE)res;
                 }
+#ifdef YAPI_USE_EPOLL
+                if (YISERR(res = yNetLoopAddHub(hubst, ws_step, errmsg))) {
+                    yapiFreeHub(hubst);
+                    return (YRETCODE)res;
+                }
+#else
                 //yThreadCreate will not create a new thread if there is already one running
                 if (yThreadCreate(&hubst->net_thread, ws_thread, (void*)hubst) < 0) {
                     yapiFreeHub(hubst);
                     return YERRMSG(YAPI_IO_ERROR, "Unable to start helper thread");
                 }
+#endif
                 yDringWakeUpSocket(&hubst->wuce, 1, errmsg);
 
                 // ensure the thread has been able to connect to the hub
@@ -3229,7 +3436,11 @@ static YRETCODE yapiTestHub_internal(const char* url, int mstimeout, char* errms
                 yThreadRequestEnd(&hubst->net_thread);
                 yDringWakeUpSocket(&hubst->wuce, 0, errmsg);
                 // wait for the helper thread to stop monitoring these devices
+#ifdef YAPI_USE_EPOLL
+                yNetLoopRemoveHub(hubst);
+#else
                 yThreadKill(&hubst->net_thread);
+#endif
             } else {
                 res = pingURLOnhub(hubst, "GET /api/module/firmwareRelease.json \r\n\r\n", mstimeout, errmsg);
             }
@@ -3375,6 +3586,19 @@ static YRETCODE yapiSleep_internal(int ms_duration, char* errmsg)
     return err;
 }
 
+// Block until a device packet or a hub notification has been received, or
+// until ms_duration expires. Unlike yapiSleep_internal, it returns as soon as
+// the first event is signaled, so that the caller can dispatch it right away.
+static YRETCODE yapiWaitForEvents_internal(int ms_duration, char* errmsg)
+{
+    if (!yContext)
+        return YERR(YAPI_NOT_INITIALIZED);
+    if (ms_duration > 0) {
+        yWaitForEvent(&yContext->exitSleepEvent, ms_duration);
+    }
+    return yapiHandleEvents_internal(errmsg);
+}
+
 #ifdef WINDOWS_API
 static int tickUseHiRes = -1;
 static u64 tickOffset = 0;
@@ -3808,6 +4032,38 @@ static int yapiRequestOpenHTTP(YIOHDL_internal* iohdl, HubSt* hub, YAPI_DEVICE d
     return YAPI_SUCCESS;
 }
 
+/*
+ * Returns the devydx of the device targeted by a request sent through a hub.
+ * Requests to the devices connected to a hub are sent to the hub itself,
+ * with a /bySerial/ prefix.
+ */
+static int yapiGetRequestDevYdx(int devydx, const char* request, int reqlen)
+{
+    const char* p = request;
+    const char* end = request + reqlen;
+    const char* serial;
+    yHash serialref;
+
+    // skip the method
+    while (p < end && *p != ' ' && *p != '\r') p++;
+    if (end - p < 11 || memcmp(p, " /bySerial/", 11) != 0) {
+        return devydx;
+    }
+    p += 11;
+    serial = p;
+    while (p < end && *p != '/' && *p != ' ' && *p != '\r') p++;
+    if (p - serial >= YOCTO_SERIAL_LEN) {
+        return devydx;
+    }
+    serialref = yHashTestBuf((const u8*)serial, (u16)(p - serial));
+    if (serialref == INVALID_HASH_IDX) {
+        return devydx;
+    }
+    serialref = wpGetDevYdx((yStrRef)serialref);
+    return serialref < 0 ? devydx : serialref;
+}
+
+
 static int yapiRequestOpenWS(YIOHDL_internal* iohdl, HubSt* hub, YAPI_DEVICE dev, int tcpchan, const char* request, int reqlen, u64 mstimeout, yapiRequestAsyncCallback callback, void* context, RequestProgress progress_cb, void* progress_ctx, char* errmsg)
 {
     YRETCODE res;
@@ -3846,6 +4102,8 @@ static int yapiRequestOpenWS(YIOHDL_internal* iohdl, HubSt* hub, YAPI_DEVICE dev
         return YERRMSG(YAPI_TIMEOUT, "hub is not ready");
     }
 
+    // keep the requests to the same device in order on the same channel
+    req->ws.devydx = yapiGetRequestDevYdx(devydx, request, reqlen);
     res = (YRETCODE)yReqOpen(req, 2 * YIO_DEFAULT_TCP_TIMEOUT, tcpchan, request, reqlen, mstimeout, callback, context, progress_cb, progress_ctx, errmsg);
     if (res != YAPI_SUCCESS) {
         return res;
@@ -4839,6 +5097,10 @@ typedef enum
     trcFreeMem,
     trcGetSubDevcies,
     trcRegisterDeviceConfigChangeCallback,
+    trcWaitForEvents,
+    trcSetHTTPPoolSize,
+    trcGetHTTPPoolSize,
+    trcGetHTTPPoolStats,
 } TRC_FUN;
 
 static const char * trc_funname[] =
@@ -4899,6 +5161,10 @@ static const char * trc_funname[] =
     "freemem",
     "getsubdev",
     "RegDeviceConfChg",
+    "WaitEvents",
+    "SetHTTPPool",
+    "GetHTTPPool",
+    "GetHTTPPoolStats",
 };
 
 static const char *dlltracefile = YDLL_TRACE_FILE;
@@ -4984,6 +5250,32 @@ int YAPI_FUNCTION_EXPORT yapiGetNetDevListValidity(void)
 }
 
 
+void YAPI_FUNCTION_EXPORT yapiSetHTTPPoolSize(int poolSize)
+{
+    YDLL_CALL_ENTER(trcSetHTTPPoolSize);
+    yapiSetHTTPPoolSize_internal(poolSize);
+    YDLL_CALL_LEAVEVOID();
+}
+
+int YAPI_FUNCTION_EXPORT yapiGetHTTPPoolSize(void)
+{
+    int res;
+    YDLL_CALL_ENTER(trcGetHTTPPoolSize);
+    res = yapiGetHTTPPoolSize_internal();
+    YDLL_CALL_LEAVE(res);
+    return res;
+}
+
+YRETCODE YAPI_FUNCTION_EXPORT yapiGetHTTPPoolStats(const char* url, int* hits, int* misses, int* idle, char* errmsg)
+{
+    YRETCODE res;
+    YDLL_CALL_ENTER(trcGetHTTPPoolStats);
+    res = yapiGetHTTPPoolStats_internal(url, hits, misses, idle, errmsg);
+    YDLL_CALL_LEAVE(res);
+    return res;
+}
+
+
 void YAPI_FUNCTION_EXPORT yapiRegisterLogFunction(yapiLogFunction logfun)
 {
     YDLL_CALL_ENTER(trcRegisterLogFunction);
@@ -5151,6 +5443,15 @@ YRETCODE YAPI_FUNCTION_EXPORT yapiSleep(int ms_duration, char* errmsg)
     return res;
 }
 
+YRETCODE YAPI_FUNCTION_EXPORT yapiWaitForEvents(int ms_duration, char* errmsg)
+{
+    YRETCODE res;
+    YDLL_CALL_ENTER(trcWaitForEvents);
+    res = yapiWaitForEvents_internal(ms_duration, errmsg);
+    YDLL_CALL_LEAVE(res);
+    return res;
+}
+
 int YAPI_FUNCTION_EXPORT yapiCheckLogicalName(const char* name)
 {
     int res;
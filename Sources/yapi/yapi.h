@@ -169,6 +169,36 @@ void YAPI_FUNCTION_EXPORT yapiSetNetDevListValidity(int sValidity);
 int YAPI_FUNCTION_EXPORT yapiGetNetDevListValidity(void);
 
 
+/*****************************************************************************
+Function:
+void YAPI_FUNCTION_EXPORT yapiSetHTTPPoolSize(int poolSize);
+int YAPI_FUNCTION_EXPORT yapiGetHTTPPoolSize(void);
+YRETCODE YAPI_FUNCTION_EXPORT yapiGetHTTPPoolStats(const char *url, int *hits, int *misses, int *idle, char *errmsg);
+
+Description:
+Requests sent to a plain HTTP hub with the keep-alive suffix leave their
+connection open once the reply is received. These connections are kept in
+a pool per hub, shared by all the devices of the hub, and reused by the next
+requests instead of opening a new TCP connection. Connections idle for more
+than HTTP_POOL_IDLE_TIMEOUT_MS or closed by the hub are dropped.
+
+yapiSetHTTPPoolSize changes the maximum number of idle connections kept per
+hub (4 by default, at most HTTP_POOL_MAX). Use 0 to close every connection
+after its request.
+
+yapiGetHTTPPoolStats returns the number of requests sent on a pooled
+connection (hits), the number of requests that had to open a new
+connection (misses) and the current number of idle connections of a
+registered HTTP hub.
+
+Note: the YAPI must be allready initalized otherwise the value will be discarded.
+
+***************************************************************************/
+void YAPI_FUNCTION_EXPORT yapiSetHTTPPoolSize(int poolSize);
+int YAPI_FUNCTION_EXPORT yapiGetHTTPPoolSize(void);
+YRETCODE YAPI_FUNCTION_EXPORT yapiGetHTTPPoolStats(const char *url, int *hits, int *misses, int *idle, char *errmsg);
+
+
 /*****************************************************************************
   Function:
     void  yapiRegisterLogFunction(yapiLogFunction logfun);
@@ -481,6 +511,31 @@ YRETCODE YAPI_FUNCTION_EXPORT yapiHandleEvents(char *errmsg);
 YRETCODE YAPI_FUNCTION_EXPORT yapiSleep(int duration_ms, char *errmsg);
 
 
+/*****************************************************************************
+ Function:
+ YRETCODE yapiWaitForEvents(int duration_ms,char *errmsg)
+
+ Description:
+ Block the calling thread until a packet is received from a USB device, a
+ notification is received from a hub or an asynchronous request to a hub
+ completes, or until duration_ms expires, then perform the same tasks as
+ yapiHandleEvents. Contrary to yapiSleep, this function returns as soon as
+ something has been received.
+
+ Parameters:
+ duration_ms: maximum time to wait, in milliseconds
+ errmsg: a pointer to a buffer of YOCTO_ERRMSG_LEN bytes to store any error message
+
+ Returns:
+ on ERROR   : error code
+ on SUCCESS : YAPI_SUCCESS
+
+ Remarks:
+
+ ***************************************************************************/
+YRETCODE YAPI_FUNCTION_EXPORT yapiWaitForEvents(int duration_ms, char *errmsg);
+
+
 /*****************************************************************************
  Function:
  u64 yGetTickCount()
@@ -52,7 +52,9 @@ __eds__ __attribute__((far, __section__(".yfar1"))) YHashSlot yHashTable[NB_MAX_
 #include <Windows.h>
 #endif
 #define __eds__
-static YHashSlot yHashTable[NB_MAX_HASH_ENTRIES];
+// The hash table is made of fixed-size chunks allocated on demand, so that
+// entries never move once created and can be read without taking a lock
+static YHashSlot* yHashChunks[YHASH_MAX_CHUNKS];
 yCRITICAL_SECTION yHashMutex;
 yCRITICAL_SECTION yFreeMutex;
 yCRITICAL_SECTION yWpMutex;
@@ -73,6 +75,27 @@ static u16 nextDevYdx = 0;
 static u8 nextCatYdx = 1;
 static u16 nextHashEntry = 256;
 
+#ifdef MICROCHIP_API
+#define HSLOT(idx)  (yHashTable[idx])
+#else
+#define HSLOT(idx)  (yHashChunks[(idx) >> YHASH_CHUNK_POW][(idx) & (YHASH_CHUNK_SIZE - 1)])
+
+// Open-addressed lookup index from string content to yHash. Each cell packs
+// a 16-bit tag of the string hash with (yHash + 1), 0 meaning an empty cell.
+// When the index is full it is rebuilt at twice the size; previous
+// generations are kept until yHashFree() since lock-free readers may still
+// be probing them.
+typedef struct {
+    u32             mask;
+    volatile s32    cells[1];
+} yHashIndex;
+
+static yHashIndex* yHashIndexGen[YHASH_INDEX_MAXGEN + 1];
+static volatile s32 yHashIndexCurGen = 0;
+static u16 yHashIndexCount = 0;
+static yHashIndex* yHashNewIndex(u16 pow);
+#endif
+
 static yBlkHdl devYdxPtr[NB_MAX_DEVICES];
 static yBlkHdl funYdxPtr[NB_MAX_DEVICES];
 
@@ -88,7 +111,7 @@ yBlkHdl yYpListHead = INVALID_BLK_HDL;
 //   Small block (16 bytes) allocator, for white pages and yellow pages
 // =======================================================================
 
-#define BLK(hdl)    (yHashTable[(hdl)>>1].blk[(hdl)&1])
+#define BLK(hdl)    (HSLOT((hdl)>>1).blk[(hdl)&1])
 #define WP(hdl)     (BLK(hdl).wpEntry)
 #define YC(hdl)     (BLK(hdl).ypCateg)
 #define YP(hdl)     (BLK(hdl).ypEntry)
@@ -96,6 +119,25 @@ yBlkHdl yYpListHead = INVALID_BLK_HDL;
 
 yBlkHdl freeBlks = INVALID_BLK_HDL;
 
+// Reserve the next unused hash table entry, must be called with yHashMutex held
+static yHash yHashNewSlot(void)
+{
+#ifndef MICROCHIP_API
+    u16 chunk = nextHashEntry >> YHASH_CHUNK_POW;
+
+    YASSERT(nextHashEntry < NB_MAX_HASH_ENTRIES);
+    if (yHashChunks[chunk] == NULL) {
+        YHashSlot* newchunk = (YHashSlot*)yMalloc(YHASH_CHUNK_SIZE * sizeof(YHashSlot));
+        memset(newchunk, 0, YHASH_CHUNK_SIZE * sizeof(YHashSlot));
+        yHashChunks[chunk] = newchunk;
+        HLOGF(("yHash table grows to %d entries\n", (chunk + 1) * YHASH_CHUNK_SIZE));
+    }
+#else
+    YASSERT(nextHashEntry < NB_MAX_HASH_ENTRIES);
+#endif
+    return nextHashEntry++;
+}
+
 static yBlkHdl yBlkAlloc(void)
 {
     yBlkHdl res;
@@ -106,8 +148,7 @@ static yBlkHdl yBlkAlloc(void)
         freeBlks = BLK(freeBlks).nextPtr;
     } else {
         yEnterCriticalSection(&yHashMutex);
-        YASSERT(nextHashEntry < NB_MAX_HASH_ENTRIES);
-        res = ((nextHashEntry++) << 1) + 1;
+        res = (yHashNewSlot() << 1) + 1;
         yLeaveCriticalSection(&yHashMutex);
         BLK(res).blkId = 0;
         BLK(res).nextPtr = INVALID_BLK_HDL;
@@ -192,8 +233,18 @@ void yHashInit(void)
     u16 i;
 
     HLOGF(("yHashInit\n"));
+#ifdef MICROCHIP_API
     for (i = 0; i < 256; i++)
         yHashTable[i].next = 0;
+#else
+    nextHashEntry = 0;
+    freeBlks = INVALID_BLK_HDL;
+    yHashNewSlot();
+    nextHashEntry = 256;
+    yHashIndexGen[0] = yHashNewIndex(YHASH_INDEX_POW);
+    yHashIndexCurGen = 0;
+    yHashIndexCount = 0;
+#endif
     for (i = 0; i < NB_MAX_DEVICES; i++)
         devYdxPtr[i] = INVALID_BLK_HDL;
     for (i = 0; i < NB_MAX_DEVICES; i++)
@@ -239,7 +290,21 @@ void yHashInit(void)
 #ifndef MICROCHIP_API
 void yHashFree(void)
 {
+    u16 i;
+
     HLOGF(("yHashFree\n"));
+    for (i = 0; i < YHASH_MAX_CHUNKS; i++) {
+        if (yHashChunks[i]) {
+            yFree(yHashChunks[i]);
+            yHashChunks[i] = NULL;
+        }
+    }
+    for (i = 0; i <= YHASH_INDEX_MAXGEN; i++) {
+        if (yHashIndexGen[i]) {
+            yFree(yHashIndexGen[i]);
+            yHashIndexGen[i] = NULL;
+        }
+    }
     yDeleteCriticalSection(&yHashMutex);
     yDeleteCriticalSection(&yFreeMutex);
     yDeleteCriticalSection(&yWpMutex);
@@ -247,6 +312,8 @@ void yHashFree(void)
 }
 #endif
 
+#ifdef MICROCHIP_API
+
 static yHash yHashPut(const u8* buf, u16 len, u8 testonly)
 {
     u16 hash, i;
@@ -258,12 +325,12 @@ static yHash yHashPut(const u8* buf, u16 len, u8 testonly)
 
     yEnterCriticalSection(&yHashMutex);
 
-    if (yHashTable[yhash].next != 0) {
+    if (HSLOT(yhash).next != 0) {
         // first entry is allocated, search chain
         do {
-            if (yHashTable[yhash].hash == hash) {
+            if (HSLOT(yhash).hash == hash) {
                 // hash match, perform exact comparison
-                p = yHashTable[yhash].buff;
+                p = HSLOT(yhash).buff;
                 for (i = 0; i < len; i++) if (p[i] != buf[i]) break;
                 if (i == len) {
                     // data match, verify padding zeroes for a full match
@@ -277,7 +344,7 @@ static yHash yHashPut(const u8* buf, u16 len, u8 testonly)
             }
             // not a match, try next entry in chain
             prevhash = yhash;
-            yhash = yHashTable[yhash].next;
+            yhash = HSLOT(yhash).next;
         } while (yhash != -1);
         // not found in chain
         if (testonly) goto exit_error;
@@ -294,13 +361,13 @@ static yHash yHashPut(const u8* buf, u16 len, u8 testonly)
     }
 
     // create new entry
-    yHashTable[yhash].hash = hash;
-    yHashTable[yhash].next = -1;
-    p = yHashTable[yhash].buff;
+    HSLOT(yhash).hash = hash;
+    HSLOT(yhash).next = -1;
+    p = HSLOT(yhash).buff;
     for (i = 0; i < len; i++) p[i] = buf[i];
     while (i < HASH_BUF_SIZE) p[i++] = 0;
     if (prevhash != INVALID_HASH_IDX) {
-        yHashTable[prevhash].next = yhash;
+        HSLOT(prevhash).next = yhash;
     }
     HLOGF(("yHash added at 0x%x\n", yhash));
 
@@ -309,6 +376,146 @@ exit_ok:
     return yhash;
 }
 
+#else
+
+// 32-bit hash of a zero-padded hash buffer (murmur3 mixing)
+static u32 yHashMix(const u32* words)
+{
+    u32 h = 0x9747b28c;
+    u32 k;
+    u16 i;
+
+    for (i = 0; i < HASH_BUF_SIZE / 4; i++) {
+        k = words[i] * 0xcc9e2d51;
+        k = (k << 15) | (k >> 17);
+        h ^= k * 0x1b873593;
+        h = (h << 13) | (h >> 19);
+        h = h * 5 + 0xe6546b64;
+    }
+    h ^= HASH_BUF_SIZE;
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+static yHashIndex* yHashNewIndex(u16 pow)
+{
+    u32 size = (u32)1 << pow;
+    yHashIndex* idx = (yHashIndex*)yMalloc(sizeof(yHashIndex) + (size - 1) * sizeof(s32));
+
+    memset(idx, 0, sizeof(yHashIndex) + (size - 1) * sizeof(s32));
+    idx->mask = size - 1;
+    return idx;
+}
+
+// Store a reference in the first free cell of the probe sequence. The cell
+// is written with a full barrier, after the hash table entry has been filled.
+static void yHashIndexInsert(yHashIndex* idx, u32 h, yHash yhash)
+{
+    u32 pos = h & idx->mask;
+
+    while (idx->cells[pos] != 0) {
+        pos = (pos + 1) & idx->mask;
+    }
+    yAtomicStore(&idx->cells[pos], (s32)((h & 0xffff0000) | (u16)(yhash + 1)));
+}
+
+// Lock-free search of a zero-padded buffer, returns INVALID_HASH_IDX if not found
+static yHash yHashIndexSearch(const u32* words, u32 h)
+{
+    // entries are never removed nor modified once published, and the
+    // index generation is switched only after the new one is complete
+    yHashIndex* idx = yHashIndexGen[yHashIndexCurGen];
+    u32 pos = h & idx->mask;
+    s32 cell;
+
+    while ((cell = idx->cells[pos]) != 0) {
+        if (((u32)cell & 0xffff0000) == (h & 0xffff0000)) {
+            yHash yhash = (yHash)((cell & 0xffff) - 1);
+            if (memcmp(HSLOT(yhash).buff, words, HASH_BUF_SIZE) == 0) {
+                return yhash;
+            }
+        }
+        pos = (pos + 1) & idx->mask;
+    }
+    return INVALID_HASH_IDX;
+}
+
+// Rebuild the index at twice the size, must be called with yHashMutex held
+static void yHashIndexGrow(void)
+{
+    yHashIndex* cur = yHashIndexGen[yHashIndexCurGen];
+    yHashIndex* bigger;
+    u32 i;
+
+    YASSERT(yHashIndexCurGen < YHASH_INDEX_MAXGEN);
+    bigger = yHashNewIndex(YHASH_INDEX_POW + yHashIndexCurGen + 1);
+    for (i = 0; i <= cur->mask; i++) {
+        s32 cell = cur->cells[i];
+        if (cell != 0) {
+            yHash yhash = (yHash)((cell & 0xffff) - 1);
+            yHashIndexInsert(bigger, yHashMix((u32*)HSLOT(yhash).buff), yhash);
+        }
+    }
+    yHashIndexGen[yHashIndexCurGen + 1] = bigger;
+    yAtomicStore(&yHashIndexCurGen, yHashIndexCurGen + 1);
+    HLOGF(("yHash index grows to %d cells\n", bigger->mask + 1));
+}
+
+static yHash yHashPut(const u8* buf, u16 len, u8 testonly)
+{
+    u32 words[HASH_BUF_SIZE / 4];
+    u32 h;
+    yHash yhash;
+    __eds__ u8* p;
+
+    memset(words, 0, HASH_BUF_SIZE);
+    memcpy(words, buf, len);
+    h = yHashMix(words);
+
+    // fast path: no lock needed to find an existing entry
+    yhash = yHashIndexSearch(words, h);
+    if (yhash != INVALID_HASH_IDX) {
+        HLOGF(("yHash found at 0x%x\n", yhash));
+        return yhash;
+    }
+    if (testonly) {
+        HLOGF(("yHash entry not found\n"));
+        return INVALID_HASH_IDX;
+    }
+
+    yEnterCriticalSection(&yHashMutex);
+    // search again, in case the entry has been added by another thread
+    yhash = yHashIndexSearch(words, h);
+    if (yhash != INVALID_HASH_IDX) {
+        yLeaveCriticalSection(&yHashMutex);
+        return yhash;
+    }
+    // the first string using a given fletcher16 root bucket gets the bucket
+    // index as reference, to keep the well-known references (YSTRREF_xxx)
+    yhash = fletcher16(buf, len, HASH_BUF_SIZE) & 0xff;
+    if (HSLOT(yhash).next != 0) {
+        yhash = yHashNewSlot();
+    }
+    HSLOT(yhash).hash = (u16)(h >> 16);
+    HSLOT(yhash).next = -1;
+    p = HSLOT(yhash).buff;
+    memcpy(p, words, HASH_BUF_SIZE);
+    if ((u32)(yHashIndexCount + 1) * 2 > yHashIndexGen[yHashIndexCurGen]->mask + 1) {
+        yHashIndexGrow();
+    }
+    yHashIndexInsert(yHashIndexGen[yHashIndexCurGen], h, yhash);
+    yHashIndexCount++;
+    HLOGF(("yHash added at 0x%x\n", yhash));
+    yLeaveCriticalSection(&yHashMutex);
+    return yhash;
+}
+
+#endif
+
 yHash yHashPutBuf(const u8* buf, u16 len)
 {
     if (len > HASH_BUF_SIZE) len = HASH_BUF_SIZE;
@@ -346,17 +553,17 @@ void yHashGetBuf(yHash yhash, u8* destbuf, u16 bufsize)
     HLOGF(("yHashGetBuf(0x%x)\n",yhash));
     YASSERT(yhash >= 0);
 #ifdef MICROCHIP_API
-    if(yhash >= nextHashEntry || yHashTable[yhash].next == 0) {
+    if(yhash >= nextHashEntry || HSLOT(yhash).next == 0) {
         // should never happen !
         memset(destbuf, 0, bufsize);
         return;
     }
 #else
     YASSERT(yhash < nextHashEntry);
-    YASSERT(yHashTable[yhash].next != 0); // 0 means unallocated, -1 means end of chain
+    YASSERT(HSLOT(yhash).next != 0); // 0 means unallocated, -1 means end of chain
 #endif
     if (bufsize > HASH_BUF_SIZE) bufsize = HASH_BUF_SIZE;
-    p = yHashTable[yhash].buff;
+    p = HSLOT(yhash).buff;
     while (bufsize-- > 0) {
         *destbuf++ = *p++;
     }
@@ -383,18 +590,18 @@ u16 yHashGetStrLen(yHash yhash)
     HLOGF(("yHashGetStrLen(0x%x)\n",yhash));
     YASSERT(yhash >= 0);
 #ifdef MICROCHIP_API
-    if(yhash >= nextHashEntry || yHashTable[yhash].next == 0) {
+    if(yhash >= nextHashEntry || HSLOT(yhash).next == 0) {
         // should never happen
         return 0;
     }
     for(i = 0; i < HASH_BUF_SIZE; i++) {
-        if(!yHashTable[yhash].buff[i]) break;
+        if(!HSLOT(yhash).buff[i]) break;
     }
     return i;
 #else
     YASSERT(yhash < nextHashEntry);
-    YASSERT(yHashTable[yhash].next != 0); // 0 means unallocated
-    return (u16)YSTRLEN((char *)yHashTable[yhash].buff);
+    YASSERT(HSLOT(yhash).next != 0); // 0 means unallocated
+    return (u16)YSTRLEN((char *)HSLOT(yhash).buff);
 #endif
 }
 
@@ -407,17 +614,17 @@ char* yHashGetStrPtr(yHash yhash)
     HLOGF(("yHashGetStrPtr(0x%x)\n",yhash));
     YASSERT(yhash >= 0);
     YASSERT(yhash < nextHashEntry);
-    YASSERT(yHashTable[yhash].next != 0); // 0 means unallocated
+    YASSERT(HSLOT(yhash).next != 0); // 0 means unallocated
 #ifdef MICROCHIP_API
     for(i = 0; i < HASH_BUF_SIZE; i++) {
-        char c = yHashTable[yhash].buff[i];
+        char c = HSLOT(yhash).buff[i];
         if(!c) break;
         shared_hashbuf[i] = c;
     }
     shared_hashbuf[i] = 0;
     return shared_hashbuf;
 #else
-    return (char *)yHashTable[yhash].buff;
+    return (char *)HSLOT(yhash).buff;
 #endif
 }
 
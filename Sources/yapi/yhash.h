@@ -55,8 +55,13 @@ extern "C" {
 #define NB_MAX_HASH_ENTRIES 1023     /* keep hash table size <32KB on Yocto-Hub */
 #define NB_MAX_DEVICES        80     /* base hub + up to 15 shields (up to 4 slave ports) */
 #else
-#define NB_MAX_HASH_ENTRIES 8192
+#define NB_MAX_HASH_ENTRIES 0x7fff   /* upper bound of yHash, the table grows on demand */
 #define NB_MAX_DEVICES       256
+#define YHASH_CHUNK_POW       10     /* hash table is allocated by chunks of 1024 entries */
+#define YHASH_CHUNK_SIZE     (1 << YHASH_CHUNK_POW)
+#define YHASH_MAX_CHUNKS     ((NB_MAX_HASH_ENTRIES >> YHASH_CHUNK_POW) + 1)
+#define YHASH_INDEX_POW       11     /* initial size of the lookup index (log2) */
+#define YHASH_INDEX_MAXGEN     5     /* number of times the lookup index can double */
 #endif
 
 #define YSTRREF_EMPTY_STRING   0x00ff /* yStrRef value for the empty string    */
@@ -449,170 +449,296 @@ static void rd_callback(struct libusb_transfer *transfer);
 static void wr_callback(struct libusb_transfer *transfer);
 
 
+// Submit a write transfer for each queued packet that has not yet been handed
+// to libusb, as long as there is a free transfer in the write ring
 static int sendNextPkt(yInterfaceSt *iface, char *errmsg)
 {
     pktItem *pktitem;
-    yPktQueuePeekH2D(iface, &pktitem);
-    if (pktitem != NULL) {
-        int res;
-        memcpy(&iface->wrTr->tmppkt, &pktitem->pkt, sizeof(USB_Packet));
-        libusb_fill_interrupt_transfer( iface->wrTr->tr,
+    linRdTr *lintr;
+    int i, res;
+
+    yEnterCriticalSection(&iface->trCS);
+    while (1) {
+        yPktQueuePeekNextH2D(iface, iface->wrLast, &pktitem);
+        if (pktitem == NULL) {
+            break;
+        }
+        lintr = NULL;
+        for (i = 0; i < NB_LINUX_USB_TR; i++) {
+            if (!iface->wrTr[i].busy && !iface->wrTr[i].done) {
+                lintr = &iface->wrTr[i];
+                break;
+            }
+        }
+        if (lintr == NULL) {
+            // the packet will be sent by wr_callback
+            iface->wrRingFull++;
+            break;
+        }
+        memcpy(&lintr->tmppkt, &pktitem->pkt, sizeof(USB_Packet));
+        libusb_fill_interrupt_transfer( lintr->tr,
                                 iface->hdl,
                                 iface->wrendp,
-                                (u8*)&iface->wrTr->tmppkt,
+                                (u8*)&lintr->tmppkt,
                                 sizeof(USB_Packet),
                                 wr_callback,
-                                iface->wrTr,
+                                lintr,
                                 2000);
-        res = libusb_submit_transfer(iface->wrTr->tr);
+        res = libusb_submit_transfer(lintr->tr);
         if (res < 0) {
+            yLeaveCriticalSection(&iface->trCS);
             return yLinSetErr("libusb_submit_transfer(WR) failed", res, errmsg);
         }
+        lintr->item = pktitem;
+        lintr->seq = iface->wrSubmitSeq++;
+        lintr->busy = 1;
+        iface->wrPending++;
+        iface->wrLast = pktitem;
     }
+    yLeaveCriticalSection(&iface->trCS);
     return YAPI_SUCCESS;
 }
 
 
-static int submitReadPkt(yInterfaceSt *iface, char *errmsg)
+// must be called with iface->trCS held
+static int submitReadPkt(yInterfaceSt *iface, linRdTr *lintr, char *errmsg)
 {
     int res;
-    libusb_fill_interrupt_transfer( iface->rdTr->tr,
+    libusb_fill_interrupt_transfer( lintr->tr,
                                     iface->hdl,
                                     iface->rdendp,
-                                    (u8*)&iface->rdTr->tmppkt,
+                                    (u8*)&lintr->tmppkt,
                                     sizeof(USB_Packet),
                                     rd_callback,
-                                    iface->rdTr,
+                                    lintr,
                                     0);
-    res = libusb_submit_transfer(iface->rdTr->tr);
+    res = libusb_submit_transfer(lintr->tr);
     if (res < 0) {
         return yLinSetErr("libusb_submit_transfer(RD) failed", res, errmsg);
     }
+    lintr->seq = iface->rdSubmitSeq++;
+    lintr->busy = 1;
+    iface->rdPending++;
     return YAPI_SUCCESS;
 }
 
 
-static void rd_callback(struct libusb_transfer *transfer)
+// Handle a completed read transfer, return 1 if it must be submitted again
+static int processReadPkt(yInterfaceSt *iface, linRdTr *lintr)
 {
     int res;
-    linRdTr      *lintr = (linRdTr*)transfer->user_data;
-    yInterfaceSt *iface = lintr->iface;
-    char          errmsg[YOCTO_ERRMSG_LEN];
 
-    if (lintr == NULL){
-        HALLOG("CBrd:drop invalid ypkt rd_callback (lintr is null)\n");
-        return;
-    }
-    if (iface == NULL){
-        HALLOG("CBrd:drop invalid ypkt rd_callback (iface is null)\n");
-        return;
-    }
-
-    switch(transfer->status){
+    switch(lintr->status){
     case LIBUSB_TRANSFER_COMPLETED:
-        //HALLOG("%s:%d pkt_arrived (len=%d)\n",iface->serial,iface->ifaceno,transfer->actual_length);
+        //HALLOG("%s:%d pkt_arrived (len=%d)\n",iface->serial,iface->ifaceno,lintr->length);
         yPktQueuePushD2H(iface,&lintr->tmppkt,NULL);
-        break;
+        return 1;
     case LIBUSB_TRANSFER_ERROR:
         iface->ioError++;
-        HALLOG("CBrd:%s pkt error (len=%d nbError:%d)\n",iface->serial, transfer->actual_length,  iface->ioError);
-        break;
+        HALLOG("CBrd:%s pkt error (len=%d nbError:%d)\n",iface->serial, lintr->length,  iface->ioError);
+        return 1;
     case LIBUSB_TRANSFER_TIMED_OUT :
         HALLOG("CBrd:%s pkt timeout\n",iface->serial);
-        break;
+        return 1;
     case LIBUSB_TRANSFER_CANCELLED:
-        HALLOG("CBrd:%s pkt_cancelled (len=%d) \n",iface->serial, transfer->actual_length);
-        if (iface->flags.yyySetupDone && transfer->actual_length == 64) {
+        HALLOG("CBrd:%s pkt_cancelled (len=%d) \n",iface->serial, lintr->length);
+        if (iface->flags.yyySetupDone && lintr->length == 64) {
             yPktQueuePushD2H(iface, &lintr->tmppkt, NULL);
         }
-        return;
+        return 0;
     case LIBUSB_TRANSFER_STALL:
         HALLOG("CBrd:%s pkt stall\n",iface->serial );
         res = libusb_cancel_transfer(lintr->tr);
         HALLOG("CBrd:%s libusb_cancel_transfer returned %d\n",iface->serial, res);
         res = libusb_clear_halt(iface->hdl, iface->rdendp);
         HALLOG("CBrd:%s libusb_clear_hal returned %d\n",iface->serial, res);
-        break;
+        return res != LIBUSB_ERROR_NO_DEVICE;
     case LIBUSB_TRANSFER_NO_DEVICE:
-        HALLOG("CBrd:%s no_device (len=%d)\n",iface->serial, transfer->actual_length);
-        return;
+        HALLOG("CBrd:%s no_device (len=%d)\n",iface->serial, lintr->length);
+        return 0;
     case LIBUSB_TRANSFER_OVERFLOW:
-        HALLOG("CBrd:%s pkt_overflow (len=%d)\n",iface->serial, transfer->actual_length);
-        return;
+        HALLOG("CBrd:%s pkt_overflow (len=%d)\n",iface->serial, lintr->length);
+        return 0;
     default:
-        HALLOG("CBrd:%s unknown state %X\n",iface->serial, transfer->status);
-        return;
+        HALLOG("CBrd:%s unknown state %X\n",iface->serial, lintr->status);
+        return 0;
     }
+}
 
-    if (iface->flags.yyySetupDone) {
-        res = submitReadPkt(iface, errmsg);
-        if (res < 0) {
-            HALLOG("CBrd:%s libusb_submit_transfer errror %X\n", iface->serial, res);
-        }
+
+static void rd_callback(struct libusb_transfer *transfer)
+{
+    int res, i;
+    linRdTr      *lintr = (linRdTr*)transfer->user_data;
+    yInterfaceSt *iface;
+    char          errmsg[YOCTO_ERRMSG_LEN];
+
+    if (lintr == NULL){
+        HALLOG("CBrd:drop invalid ypkt rd_callback (lintr is null)\n");
+        return;
+    }
+    iface = lintr->iface;
+    if (iface == NULL){
+        HALLOG("CBrd:drop invalid ypkt rd_callback (iface is null)\n");
+        return;
     }
 
+    yEnterCriticalSection(&iface->trCS);
+    lintr->busy = 0;
+    lintr->done = 1;
+    lintr->status = transfer->status;
+    lintr->length = transfer->actual_length;
+    iface->rdPending--;
+    if (iface->rdPending == 0 && iface->flags.yyySetupDone) {
+        // no read was posted anymore: the device had to wait for us
+        iface->rdRingDry++;
+    }
+    // deliver completed transfers in submission order, then post them again
+    do {
+        lintr = NULL;
+        for (i = 0; i < NB_LINUX_USB_TR; i++) {
+            if (iface->rdTr[i].done && iface->rdTr[i].seq == iface->rdDeliverSeq) {
+                lintr = &iface->rdTr[i];
+                break;
+            }
+        }
+        if (lintr) {
+            lintr->done = 0;
+            iface->rdDeliverSeq++;
+            if (processReadPkt(iface, lintr) && iface->flags.yyySetupDone) {
+                res = submitReadPkt(iface, lintr, errmsg);
+                if (res < 0) {
+                    HALLOG("CBrd:%s libusb_submit_transfer errror %X\n", iface->serial, res);
+                }
+            }
+        }
+    } while (lintr);
+    yLeaveCriticalSection(&iface->trCS);
 }
 
 static void wr_callback(struct libusb_transfer *transfer)
 {
     linRdTr      *lintr = (linRdTr*)transfer->user_data;
-    yInterfaceSt *iface = lintr->iface;
+    yInterfaceSt *iface;
     char          errmsg[YOCTO_ERRMSG_LEN];
     pktItem *pktitem;
-    int res;
+    int res, i, inflight;
+    int sendnext = 0;
 
     if (lintr == NULL) {
         HALLOG("CBwr:drop invalid ypkt wr_callback (lintr is null)\n");
         return;
     }
-
+    iface = lintr->iface;
     if (iface == NULL){
         HALLOG("CBwr:drop invalid ypkt wr_callback (iface is null)\n");
         return;
     }
     YASSERT(transfer == lintr->tr);
 
-    switch(transfer->status) {
-    case LIBUSB_TRANSFER_COMPLETED:
-        //HALLOG("CBwr:%s pkt_sent (len=%d)\n",iface->serial, transfer->actual_length);
-        // remove sent packet
-        yPktQueuePopH2D(iface, &pktitem);
-        yFree(pktitem);
-#if 0
-        // following code make no sense and failed on very slow computer
-        // (the main thread queue a new packet durring the yFree(pktitem);
-        res = sendNextPkt(iface, errmsg);
-        if (res < 0) {
-            HALLOG("send of next pkt item failed:%d:%s\n", res, errmsg);
+    yEnterCriticalSection(&iface->trCS);
+    lintr->busy = 0;
+    lintr->done = 1;
+    lintr->status = transfer->status;
+    lintr->length = transfer->actual_length;
+    iface->wrPending--;
+    // acknowledge completed transfers in submission order
+    do {
+        lintr = NULL;
+        for (i = 0; i < NB_LINUX_USB_TR; i++) {
+            if (iface->wrTr[i].done && iface->wrTr[i].seq == iface->wrDoneSeq) {
+                lintr = &iface->wrTr[i];
+                break;
+            }
         }
-#endif
-        return;
-    case LIBUSB_TRANSFER_ERROR:
-        iface->ioError++;
-        HALLOG("CBwr:%s pkt error (len=%d nbError:%d)\n",iface->serial, transfer->actual_length,  iface->ioError);
+        if (lintr == NULL) {
+            break;
+        }
+        lintr->done = 0;
+        iface->wrDoneSeq++;
+        if (lintr->stale) {
+            lintr->stale = 0;
+            continue;
+        }
+        if (lintr->status == LIBUSB_TRANSFER_COMPLETED) {
+            //HALLOG("CBwr:%s pkt_sent (len=%d)\n",iface->serial, lintr->length);
+            // check the head of the queue before removing it: popped
+            // packets are copied out of the queue ring
+            yPktQueuePeekH2D(iface, &pktitem);
+            if (pktitem != lintr->item) {
+                HALLOG("CBwr:%s out of order pkt completion\n", iface->serial);
+            }
+            if (pktitem == iface->wrLast) {
+                iface->wrLast = NULL;
+            }
+            // remove sent packet
+            yPktQueuePopH2D(iface, &pktitem);
+            if (pktitem) {
+                yPktQueueFreeItem(&iface->txQueue, pktitem);
+            }
+            sendnext = 1;
+            continue;
+        }
+        switch(lintr->status) {
+        case LIBUSB_TRANSFER_ERROR:
+            iface->ioError++;
+            HALLOG("CBwr:%s pkt error (len=%d nbError:%d)\n",iface->serial, lintr->length,  iface->ioError);
+            break;
+        case LIBUSB_TRANSFER_TIMED_OUT :
+            HALLOG("CBwr:%s pkt timeout\n",iface->serial);
+            sendnext = 1;
+            break;
+        case LIBUSB_TRANSFER_CANCELLED:
+            HALLOG("CBwr:%s pkt_cancelled (len=%d) \n",iface->serial, lintr->length);
+            break;
+        case LIBUSB_TRANSFER_STALL:
+            HALLOG("CBwr:%s pkt stall\n",iface->serial );
+            break;
+        case LIBUSB_TRANSFER_NO_DEVICE:
+            HALLOG("CBwr:%s pkt_cancelled (len=%d)\n",iface->serial, lintr->length);
+            break;
+        case LIBUSB_TRANSFER_OVERFLOW:
+            HALLOG("CBwr:%s pkt_overflow (len=%d)\n",iface->serial, lintr->length);
+            break;
+        default:
+            HALLOG("CBwr:%s unknown state %X\n",iface->serial, lintr->status);
+            break;
+        }
+        // the transfers still in flight are cancelled and ignored
+        inflight = 0;
+        for (i = 0; i < NB_LINUX_USB_TR; i++) {
+            if (iface->wrTr[i].busy || iface->wrTr[i].done) {
+                iface->wrTr[i].stale = 1;
+                inflight++;
+            }
+        }
+        for (i = 0; i < NB_LINUX_USB_TR; i++) {
+            if (iface->wrTr[i].busy) {
+                libusb_cancel_transfer(iface->wrTr[i].tr);
+            }
+        }
+        if (inflight == 0) {
+            // nothing was sent after this packet: it stays at the head
+            // of the queue and will be sent again
+            iface->wrLast = NULL;
+            continue;
+        }
+        // some of the next packets may already have reached the device:
+        // sending this one again would reorder the stream, so report an
+        // I/O error to get the interface reset
+        HALLOG("CBwr:%s write failed with %d pkt in flight\n", iface->serial, inflight);
+        yPktQueueSetError(&iface->txQueue, YAPI_IO_ERROR, "USB write failed");
+        yPktQueueSetError(&iface->rxQueue, YAPI_IO_ERROR, "USB write failed");
+        sendnext = 0;
         break;
-    case LIBUSB_TRANSFER_TIMED_OUT :
-        HALLOG("CBwr:%s pkt timeout\n",iface->serial);
+    } while (lintr);
+    yLeaveCriticalSection(&iface->trCS);
+
+    if (sendnext && iface->flags.yyySetupDone) {
         res = sendNextPkt(iface, errmsg);
         if (res < 0) {
-            HALLOG("retry of next pkt item failed:%d:%s\n", res, errmsg);
+            HALLOG("send of next pkt item failed:%d:%s\n", res, errmsg);
         }
-        break;
-    case LIBUSB_TRANSFER_CANCELLED:
-        HALLOG("CBwr:%s pkt_cancelled (len=%d) \n",iface->serial, transfer->actual_length);
-        break;
-    case LIBUSB_TRANSFER_STALL:
-        HALLOG("CBwr:%s pkt stall\n",iface->serial );
-        break;
-    case LIBUSB_TRANSFER_NO_DEVICE:
-        HALLOG("CBwr:%s pkt_cancelled (len=%d)\n",iface->serial, transfer->actual_length);
-        return;
-    case LIBUSB_TRANSFER_OVERFLOW:
-        HALLOG("CBwr:%s pkt_overflow (len=%d)\n",iface->serial, transfer->actual_length);
-        break;
-    default:
-        HALLOG("CBwr:%s unknown state %X\n",iface->serial, transfer->status);
-        break;
     }
 }
 
@@ -685,16 +811,31 @@ int yyySetup(yInterfaceSt *iface,char *errmsg)
 
     yPktQueueInit(&iface->rxQueue);
     yPktQueueInit(&iface->txQueue);
-    iface->rdTr = yMalloc(sizeof(linRdTr));
-    iface->wrTr = yMalloc(sizeof(linRdTr));
-    HALLOG("allocate linRdTr=%p linWrTr\n", iface->rdTr, iface->wrTr);
-    iface->wrTr->iface = iface;
-    iface->wrTr->tr = libusb_alloc_transfer(0);
-    iface->rdTr->iface = iface;
-    iface->rdTr->tr = libusb_alloc_transfer(0);
+    yInitializeCriticalSection(&iface->trCS);
+    iface->rdTr = yMalloc(NB_LINUX_USB_TR * sizeof(linRdTr));
+    iface->wrTr = yMalloc(NB_LINUX_USB_TR * sizeof(linRdTr));
+    memset(iface->rdTr, 0, NB_LINUX_USB_TR * sizeof(linRdTr));
+    memset(iface->wrTr, 0, NB_LINUX_USB_TR * sizeof(linRdTr));
+    HALLOG("allocate linRdTr=%p linWrTr=%p\n", iface->rdTr, iface->wrTr);
+    for (j = 0; j < NB_LINUX_USB_TR; j++) {
+        iface->wrTr[j].iface = iface;
+        iface->wrTr[j].tr = libusb_alloc_transfer(0);
+        iface->rdTr[j].iface = iface;
+        iface->rdTr[j].tr = libusb_alloc_transfer(0);
+    }
+    iface->rdSubmitSeq = iface->rdDeliverSeq = 0;
+    iface->wrSubmitSeq = iface->wrDoneSeq = 0;
+    iface->rdPending = iface->wrPending = 0;
+    iface->wrLast = NULL;
+    iface->rdRingDry = iface->wrRingFull = 0;
     iface->flags.yyySetupDone = 1;
-    HALLOG("%s both libusbTR allocated (%p /%p)\n",iface->serial, iface->rdTr->tr, iface->wrTr->tr);
-    res = submitReadPkt(iface, errmsg);
+    HALLOG("%s %d read and write libusbTR allocated\n",iface->serial, NB_LINUX_USB_TR);
+    res = YAPI_SUCCESS;
+    yEnterCriticalSection(&iface->trCS);
+    for (j = 0; j < NB_LINUX_USB_TR && res >= 0; j++) {
+        res = submitReadPkt(iface, &iface->rdTr[j], errmsg);
+    }
+    yLeaveCriticalSection(&iface->trCS);
     if (res < 0) {
         return res;
     }
@@ -716,22 +857,32 @@ int yyySignalOutPkt(yInterfaceSt *iface, char *errmsg)
 
 
 
+// cancel a pending transfer and wait (at most 10ms) for its callback
+static void cancelTransfer(linRdTr *lintr)
+{
+    int count = 10;
+
+    if (lintr->tr && lintr->busy && libusb_cancel_transfer(lintr->tr) == 0) {
+        while (count && lintr->busy) {
+            usleep(1000);
+            count--;
+        }
+    }
+}
+
+
 void yyyPacketShutdown(yInterfaceSt  *iface)
 {
     if (iface && iface->hdl) {
-        int res;
+        int res, i;
         iface->flags.yyySetupDone = 0;
         HALLOG("%s:%d cancel all transfer\n",iface->serial,iface->ifaceno);
-        if (iface->rdTr->tr) {
-            int count = 10;
-            int res =libusb_cancel_transfer(iface->rdTr->tr);
-            if(res == 0){
-                while(count && iface->rdTr->tr->status != LIBUSB_TRANSFER_CANCELLED){
-                        usleep(1000);
-                    count--;
-                }
-            }
+        for (i = 0; i < NB_LINUX_USB_TR; i++) {
+            cancelTransfer(&iface->rdTr[i]);
+            cancelTransfer(&iface->wrTr[i]);
         }
+        HALLOG("%s:%d read ring ran dry %u times, write ring full %u times\n", iface->serial, iface->ifaceno,
+               iface->rdRingDry, iface->wrRingFull);
         HALLOG("%s:%d libusb relase iface\n",iface->serial,iface->ifaceno);
         res = libusb_release_interface(iface->hdl,iface->ifaceno);
         if(res != 0 && res!=LIBUSB_ERROR_NOT_FOUND && res!=LIBUSB_ERROR_NO_DEVICE){
@@ -745,12 +896,20 @@ void yyyPacketShutdown(yInterfaceSt  *iface)
         libusb_close(iface->hdl);
         iface->hdl = NULL;
 
-        if (iface->rdTr->tr) {
-            HALLOG("%s:%d libusb_TR free\n", iface->serial, iface->ifaceno);
-            libusb_free_transfer(iface->rdTr->tr);
-            iface->rdTr->tr = NULL;
+        HALLOG("%s:%d libusb_TR free\n", iface->serial, iface->ifaceno);
+        for (i = 0; i < NB_LINUX_USB_TR; i++) {
+            if (iface->rdTr[i].tr) {
+                libusb_free_transfer(iface->rdTr[i].tr);
+                iface->rdTr[i].tr = NULL;
+            }
+            if (iface->wrTr[i].tr) {
+                libusb_free_transfer(iface->wrTr[i].tr);
+                iface->wrTr[i].tr = NULL;
+            }
         }
         yFree(iface->rdTr);
+        yFree(iface->wrTr);
+        yDeleteCriticalSection(&iface->trCS);
         yPktQueueFree(&iface->rxQueue);
         yPktQueueFree(&iface->txQueue);
     }
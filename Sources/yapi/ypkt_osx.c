@@ -484,14 +484,14 @@ int yyySignalOutPkt(yInterfaceSt *iface, char *errmsg)
     yPktQueuePopH2D(iface, &pktitem);
     while (pktitem!=NULL){
         if(iface->devref==NULL){
-            yFree(pktitem);
+            yPktQueueFreeItem(&iface->txQueue, pktitem);
             return YERR(YAPI_IO_ERROR);
         }
         res = IOHIDDeviceSetReport(iface->devref,
                                    kIOHIDReportTypeOutput,
                                    0, /* Report ID*/
                                    (u8*)&pktitem->pkt, sizeof(USB_Packet));
-        yFree(pktitem);
+        yPktQueueFreeItem(&iface->txQueue, pktitem);
         if (res != kIOReturnSuccess) {
             dbglog("IOHIDDeviceSetReport failed with 0x%x\n", res);
             return YERRMSG(YAPI_IO_ERROR,"IOHIDDeviceSetReport failed");;
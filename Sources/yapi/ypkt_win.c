@@ -884,7 +884,7 @@ static void* yyyUsbIoThread(void* thread_void)
             }
             YASSERT(timeAfterWrite >= 0 && timeAfterWrite < 50);
 #endif
-            yFree(pktItem);
+            yPktQueueFreeItem(&iface->txQueue, pktItem);
             yPktQueuePeekH2D(iface, &pktItem);
         }
 
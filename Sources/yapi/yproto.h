@@ -496,9 +496,17 @@ typedef struct{
 
 
 #if defined(LINUX_API)
+// one pre-allocated libusb transfer of the per-interface read or write ring
 typedef struct {
     struct _yInterfaceSt    *iface;
     struct libusb_transfer  *tr;
+    u32                     seq;        // submission order, used to process completions in order
+    u8                      busy;       // submitted to libusb and not yet completed
+    u8                      done;       // completed, waiting for the previous transfers
+    u8                      stale;      // write superseded by a retry from the head of the queue
+    int                     status;     // libusb status of the completed transfer
+    int                     length;     // actual length of the completed transfer
+    struct _pktItem         *item;      // write only: queued packet carried by the transfer
     USB_Packet              tmppkt;
 } linRdTr;
 #endif
@@ -514,13 +522,30 @@ typedef struct _pktItem{
 } pktItem;
 
 
+// number of packets held in the lock-free ring of a queue (must be a power of two)
+#ifndef PKT_QUEUE_SIZE
+#define PKT_QUEUE_SIZE      128
+#endif
+// number of popped items kept for reuse by the consumer of a queue
+#define PKT_QUEUE_MAX_FREE  8
+
+// single producer / single consumer packet queue: packets are copied into
+// a preallocated ring, and only spill to the first/last list (under cs)
+// when the consumer is more than PKT_QUEUE_SIZE packets late
 typedef struct {
+    pktItem             *ring;          // PKT_QUEUE_SIZE slots
+    volatile s32        head;           // next slot to write (producer)
+    volatile s32        tail;           // next slot to read (consumer)
+    volatile s32        spilled;        // number of packets in the first/last list
+    volatile s32        waitNotEmpty;   // consumer is waiting on notEmptyEvent
+    volatile s32        waitEmpty;      // producer is waiting on emptyEvent
     pktItem             *first;
     pktItem             *last;
-    int                 count;
+    pktItem             *freeItems;     // items released by the consumer
+    int                 nbFree;
     u64                 totalPush;
     u64                 totalPop;
-    YRETCODE            status;
+    volatile YRETCODE   status;
     char                errmsg[YOCTO_ERRMSG_LEN];
     yCRITICAL_SECTION   cs;
     yEvent              notEmptyEvent;
@@ -531,6 +556,7 @@ typedef struct {
 void yPktQueueInit(pktQueue  *q);
 void yPktQueueFree(pktQueue  *q);
 void yPktQueueSetError(pktQueue  *q,YRETCODE code, const char * msg);
+void yPktQueueFreeItem(pktQueue *q, pktItem *item);
 
 #ifdef OSX_API
 
@@ -554,7 +580,9 @@ typedef struct _uwp_enum_item {
 #define NBMAX_USB_DEVICE_CONNECTED  256
 #define WIN_DEVICE_PATH_LEN         512
 #define HTTP_RAW_BUFF_SIZE          (8*1024)
-#define NB_LINUX_USB_TR             1
+#ifndef NB_LINUX_USB_TR
+#define NB_LINUX_USB_TR             4   // number of read and write transfers kept in flight per interface
+#endif
 
 #define YWIN_EVENT_READ     0
 #define YWIN_EVENT_INTERRUPT 1
@@ -590,8 +618,18 @@ typedef struct _yInterfaceSt {
     libusb_device_handle    *hdl;
     u8                      rdendp;
     u8                      wrendp;
-    linRdTr                 *rdTr;
-    linRdTr                 *wrTr;
+    yCRITICAL_SECTION       trCS;       // protects the transfer rings below
+    linRdTr                 *rdTr;      // ring of NB_LINUX_USB_TR read transfers
+    linRdTr                 *wrTr;      // ring of NB_LINUX_USB_TR write transfers
+    u32                     rdSubmitSeq;
+    u32                     rdDeliverSeq;
+    u32                     wrSubmitSeq;
+    u32                     wrDoneSeq;
+    int                     rdPending;  // read transfers currently submitted to libusb
+    int                     wrPending;  // write transfers currently submitted to libusb
+    struct _pktItem         *wrLast;    // last queued packet handed to a write transfer
+    u32                     rdRingDry;  // times a read completed while no other read was pending
+    u32                     wrRingFull; // times a packet had to wait for a free write transfer
     int                     ioError;
 #endif
 } yInterfaceSt;
@@ -601,6 +639,7 @@ YRETCODE    yPktQueueWaitAndPopD2H(yInterfaceSt *iface,pktItem **pkt,int ms,char
 YRETCODE    yPktQueuePushH2D(yInterfaceSt *iface,const USB_Packet *pkt, char * errmsg);
 YRETCODE    yPktQueuePeekH2D(yInterfaceSt *iface,pktItem **pkt);
 YRETCODE    yPktQueuePopH2D(yInterfaceSt *iface,pktItem **pkt);
+YRETCODE    yPktQueuePeekNextH2D(yInterfaceSt *iface,pktItem *prev,pktItem **pkt);
 
 #define NBMAX_INTERFACE_PER_DEV     1
 typedef enum
@@ -733,6 +772,15 @@ typedef enum {
 
 #define NET_HUB_NOT_CONNECTION_TIMEOUT   (6*1024)
 
+// maximum number of idle keep-alive connections kept per HTTP hub
+#ifndef HTTP_POOL_MAX
+#define HTTP_POOL_MAX                   16
+#endif
+// default number of idle keep-alive connections kept per HTTP hub
+#define DEFAULT_HTTP_POOL_SIZE          4
+// idle keep-alive connections are closed after this delay (in ms)
+#define HTTP_POOL_IDLE_TIMEOUT_MS       4000
+
 typedef struct _HTTPNetHubSt {
     // the following fields are for the notification helper thread only
     struct _RequestSt    *notReq;
@@ -746,6 +794,12 @@ typedef struct _HTTPNetHubSt {
     char                *s_opaque;
     u8                  s_ha1[16];        // computed when realm is received if pwd is not NULL
     u32                 nc;             // reset each time a new nonce is received
+                                        // idle keep-alive connections shared by all requests to the hub, require mutex access
+    YSOCKET             pool_skt[HTTP_POOL_MAX];
+    u64                 pool_tm[HTTP_POOL_MAX];  // time at which each connection became idle (in ms)
+    int                 pool_count;
+    u32                 pool_hits;      // requests sent on a pooled connection
+    u32                 pool_misses;    // requests that had to open a new connection
 } HTTPNetHub;
 
 
@@ -759,11 +813,18 @@ enum WS_BASE_STATE
     WS_BASE_CONNECTED,
 };
 
+// priority classes of requests sent to a WebSocket hub
+#define WS_PRIO_INTERACTIVE 0   // attribute reads and changes
+#define WS_PRIO_BULK        1   // file transfers, datalogger and firmware requests, large uploads
+
 typedef struct _WSChanSt {
     u32 lastUploadAckBytes;
     u64 lastUploadAckTime;
     u32 lastUploadRateBytes;
     u64 lastUploadRateTime;
+    u64 next_transmit_tm;       // next transmission on this channel, when an upload is throttled
+    int pending;                // requests queued on this channel and not yet closed (hub access mutex)
+    int bulk;                   // number of these requests that are WS_PRIO_BULK (hub access mutex)
     yCRITICAL_SECTION access;
     struct _RequestSt* requests;
 }WSChanSt;
@@ -785,14 +846,19 @@ typedef struct _WSNetHubSt {
     u64 bws_open_tm;
     u64 bws_timeout_tm;
     u64 bws_read_tm;
-    u64 next_transmit_tm;
+    u64 next_transmit_tm;       // earliest next_transmit_tm of all channels
     u64 connectionTime;
     u32 tcpRoundTripTime;
     u32 tcpMaxWindowSize;
     u32 uploadRate;
     WSChanSt chan[MAX_ASYNC_TCPCHAN];
+    u8 dev_chan[ALLOC_YDX_PER_HUB];     // channel used by the pending requests of each device (hub access mutex)
+    u16 dev_pending[ALLOC_YDX_PER_HUB]; // number of pending requests of each device (hub access mutex)
     u8* fifo_buffer;
     struct _RequestSt *openRequests;
+    char frame_buf[2048];       // incoming frame reassembly buffer
+    int frame_ofs;
+    u64 reconnect_tm;           // next connection attempt (event loop mode)
 } WSNetHub;
 
 
@@ -815,6 +881,7 @@ typedef struct _HubSt {
     u8 not_buffer[1024]; // buffer for the fifo
     int retryCount;
     u32 notifAbsPos;
+    int notifReopen;    // set once the notification connection has been opened
     u64 lastAttempt;    // time of the last connection attempt (in ms)
     u64 attemptDelay;   // delay until next attemps (in ms)
     u64 devListExpires;
@@ -839,12 +906,13 @@ typedef struct _HubSt {
 
 typedef struct _HTTPReqSt {
     YSOCKET             skt;            // socket used to talk to the device
-    YSOCKET             reuseskt;       // socket to reuse for next query, when keepalive is true
 } HTTPReqSt;
 
 typedef struct _WSReqSt
 {
     int channel;
+    int devydx;         // target device, used to keep its requests in order on the same channel (-1 if unknown)
+    int prio;           // WS_PRIO_INTERACTIVE or WS_PRIO_BULK
     int asyncId;
     u32 iohdl;
     struct _RequestSt *next;
@@ -863,20 +931,34 @@ typedef enum
 typedef void(*RequestProgress)(void *context, u32 acked, u32 totalbytes);
 
 
+// reply data of a request is stored in a chain of fixed-size segments that
+// are recycled through a pool, so that large replies never need to be moved
+#define YREQ_SEG_SIZE   4096
+
+typedef struct _yReqSeg {
+    struct _yReqSeg     *next;
+    int                 len;            // number of bytes used in data
+    u8                  data[YREQ_SEG_SIZE];
+} yReqSeg;
+
 typedef struct _RequestSt {
     HubSt               *hub;           // pointer to the NetHubSt handling the device
     yCRITICAL_SECTION   access;
     yEvent              finished;       // event seted when this request can be reused
-    RequestState        state;          // state of the request (fixme: currenty only use by WS)
+    // buffers below are kept when the request is recycled by yReqFree
     char                *headerbuf;     // Used to store all lines of the HTTP header (with the double \r\n)
     int                 headerbufsize;  // allocated size of requestbuf
     char                *bodybuf;       // Used to store the body of the POST request
     int                 bodybufsize;    // allocated size of the body of the POST request
+    u8                  *replyflat;     // contiguous copy of the reply, built only when requested
+    int                 replyflatsize;  // allocated size of replyflat
+    // all fields starting from state are cleared when the request is recycled
+    RequestState        state;          // state of the request (fixme: currenty only use by WS)
     int                 bodysize;       // effective size of the body of the POST request
-    u8                  *replybuf;      // Used to buffer request result
-    int                 replybufsize;   // allocated size of replybuf
-    int                 replysize;      // write pointer within replybuf
-    int                 replypos;       // read pointer within replybuf; -1 when not ready to start reading
+    yReqSeg             *replyhead;     // first segment of the reply (read side)
+    yReqSeg             *replytail;     // last segment of the reply (write side)
+    int                 replysize;      // number of bytes stored in all reply segments
+    int                 replypos;       // read pointer within replyhead; -1 when not ready to start reading
     int                 retryCount;     // number of authorization attempts
     int                 errcode;        // in case an error occured
     char                errmsg[YOCTO_ERRMSG_LEN];
@@ -946,6 +1028,7 @@ typedef struct{
     YIOHDL_internal     *yiohdl_first;
     u32                 io_counter;
     u64                 deviceListValidityMs;
+    int                 httpPoolSize;   // idle keep-alive connections kept per HTTP hub
     // network discovery info
     HubSt*              nethub[NBMAX_NET_HUB];
     RequestSt*          tcpreq[ALLOC_YDX_PER_HUB];  // indexed by our own DevYdx
@@ -919,45 +919,120 @@ static void dumpPktSummary(char *prefix, int iface,int isInput,const USB_Packet
 }
 #endif
 
+/*****************************************************************************
+  Packet queues
+
+  Each queue has exactly one producer and one consumer (the USB I/O thread
+  on one side, the thread sending requests or handling replies on the other
+  side). Packets are copied into a preallocated ring without taking any lock,
+  and are copied out into an item taken from a small free list when popped,
+  so that the ring slot is released at once. Popped items must be given back
+  with yPktQueueFreeItem(). When the consumer is more than PKT_QUEUE_SIZE
+  packets late, new packets are appended to an overflow list protected by
+  the critical section until the consumer has caught up.
+  Events are only signaled when the other side has announced that it waits
+  on them, so that the common path does not require any system call.
+ *****************************************************************************/
+
+#define PKT_QUEUE_MASK  (PKT_QUEUE_SIZE - 1)
+
 void yPktQueueInit(pktQueue *q)
 {
     memset(q,0,sizeof(pktQueue));
     q->status = YAPI_SUCCESS;
+    q->ring = (pktItem*) yMalloc(PKT_QUEUE_SIZE * sizeof(pktItem));
     yInitializeCriticalSection(&q->cs);
     yCreateManualEvent(&q->notEmptyEvent,0);
     yCreateManualEvent(&q->emptyEvent,0);
 }
 
-void yPktQueueFree(pktQueue *q)
+static void yPktItemListFree(pktItem *p)
 {
-    pktItem *p,*t;
+    pktItem *t;
 
-    p=q->first;
     while(p){
         t=p;
         p=p->next;
         yFree(t);
     }
+}
+
+void yPktQueueFree(pktQueue *q)
+{
+    yPktItemListFree(q->first);
+    yPktItemListFree(q->freeItems);
+    yFree(q->ring);
     yDeleteCriticalSection(&q->cs);
     yCloseEvent(&q->notEmptyEvent);
     yCloseEvent(&q->emptyEvent);
     memset(q,0xca,sizeof(pktQueue));
 }
 
-static YRETCODE  yPktQueuePushEx(pktQueue *q,const USB_Packet *pkt, char * errmsg)
+// return an item to the queue it was popped from (consumer side only)
+void yPktQueueFreeItem(pktQueue *q, pktItem *item)
+{
+    if (q->nbFree < PKT_QUEUE_MAX_FREE) {
+        item->next = q->freeItems;
+        q->freeItems = item;
+        q->nbFree++;
+    } else {
+        yFree(item);
+    }
+}
+
+static pktItem* yPktQueueAllocItem(pktQueue *q)
+{
+    pktItem *item = q->freeItems;
+
+    if (item) {
+        q->freeItems = item->next;
+        q->nbFree--;
+    } else {
+        item = (pktItem*) yMalloc(sizeof(pktItem));
+    }
+    return item;
+}
+
+static YRETCODE yPktQueueGetError(pktQueue *q, char * errmsg)
 {
-    pktItem *newpkt;
     YRETCODE res;
+
     yEnterCriticalSection(&q->cs);
+    res = q->status;
+    if(errmsg)
+        YSTRCPY(errmsg,YOCTO_ERRMSG_LEN,q->errmsg);
+    yLeaveCriticalSection(&q->cs);
+    return res;
+}
+
+static int yPktQueueIsEmptyEx(pktQueue *q)
+{
+    return yAtomicLoad(&q->head) == yAtomicLoad(&q->tail) && yAtomicLoad(&q->spilled) == 0;
+}
+
+static YRETCODE  yPktQueuePushEx(pktQueue *q,const USB_Packet *pkt, char * errmsg)
+{
+    pktItem *newpkt;
+    u32     head;
 
     if (q->status != YAPI_SUCCESS) {
-        res = q->status;
-        if(errmsg)
-            YSTRCPY(errmsg,YOCTO_ERRMSG_LEN,q->errmsg);
         //dbglog("%X:yPktQueuePush drop pkt\n",q);
+        return yPktQueueGetError(q, errmsg);
+    }
+    head = (u32) q->head;
+    if (yAtomicLoad(&q->spilled) == 0 && head - (u32)yAtomicLoad(&q->tail) < PKT_QUEUE_SIZE) {
+        newpkt = &q->ring[head & PKT_QUEUE_MASK];
+        memcpy(&newpkt->pkt,pkt,sizeof(USB_Packet));
+#ifdef DEBUG_PKT_TIMING
+        newpkt->time = yapiGetTickCount();
+        newpkt->ospktno = q->totalPush;
+#endif
+        newpkt->next = NULL;
+        // publish the slot to the consumer
+        yAtomicStore(&q->head, (s32)(head + 1));
     } else {
-        res = YAPI_SUCCESS;
-         // allocate new buffer
+        // the ring is full: keep the packet in the overflow list, and keep
+        // using the list until the consumer has emptied it to preserve order
         newpkt= ( pktItem *) yMalloc(sizeof(pktItem));
         memcpy(&newpkt->pkt,pkt,sizeof(USB_Packet));
 #ifdef DEBUG_PKT_TIMING
@@ -965,24 +1040,23 @@ static YRETCODE  yPktQueuePushEx(pktQueue *q,const USB_Packet *pkt, char * errms
         newpkt->ospktno = q->totalPush;
 #endif
         newpkt->next = NULL;
-        //lock the queue acces
+        yEnterCriticalSection(&q->cs);
         if (q->first == NULL) {
-            //empty queue
             q->first = newpkt;
-            q->last = newpkt;
-            yResetEvent(&q->emptyEvent);
-            //dbglog("%X:yPktQueuePush First pkt\n",q);
         } else {
             q->last->next = newpkt;
-            q->last = newpkt;
-            //dbglog("%X:yPktQueuePush a pkt\n",q);
         }
-        q->count++;
-        q->totalPush++;
+        q->last = newpkt;
+        yAtomicAdd(&q->spilled, 1);
+        yLeaveCriticalSection(&q->cs);
     }
+    q->totalPush++;
+    // the store above is a full barrier: a consumer that has set waitNotEmpty
+    // before finding the queue empty is always seen here
+    if (yAtomicLoad(&q->waitNotEmpty)) {
         ySetEvent(&q->notEmptyEvent);
-        yLeaveCriticalSection(&q->cs);
-    return res;
+    }
+    return YAPI_SUCCESS;
 }
 
 void  yPktQueueSetError(pktQueue *q, YRETCODE code, const char * msg)
@@ -1000,87 +1074,112 @@ void  yPktQueueSetError(pktQueue *q, YRETCODE code, const char * msg)
 
 static int yPktQueueIsEmpty(pktQueue *q, char * errmsg)
 {
-    int retval;
-
-    yEnterCriticalSection(&q->cs);
-    retval = q->status;
-    if(retval !=YAPI_SUCCESS){
+    if (q->status != YAPI_SUCCESS) {
         //dbglog("%X:yPktQueuePop error %d:%s\n",q,q->status,q->errmsg);
-        if(errmsg)
-            YSTRCPY(errmsg,YOCTO_ERRMSG_LEN,q->errmsg);
-    }else{
-        if(q->first==NULL)
-            retval=1;
+        return yPktQueueGetError(q, errmsg);
     }
-    yLeaveCriticalSection(&q->cs);
-    return retval;
+    return yPktQueueIsEmptyEx(q);
 }
 
-static YRETCODE yPktQueuePeek(pktQueue *q, pktItem **pkt, char * errmsg)
+// return the packet queued after prev (or the first one if prev is NULL)
+// without removing it. When prev is a ring slot, it must not have been
+// popped yet.
+static YRETCODE yPktQueuePeekNext(pktQueue *q, pktItem *prev, pktItem **pkt, char * errmsg)
 {
-    YRETCODE retval;
+    u32 head, tail, idx;
 
-    yEnterCriticalSection(&q->cs);
-    retval = q->status;
-    if(retval !=YAPI_SUCCESS){
-        //dbglog("%X:yPktQueuePop error %d:%s\n",q,q->status,q->errmsg);
-        *pkt = NULL;
-        if(errmsg)
-            YSTRCPY(errmsg,YOCTO_ERRMSG_LEN,q->errmsg);
-    }else{
+    *pkt = NULL;
+    if (q->status != YAPI_SUCCESS) {
+        return yPktQueueGetError(q, errmsg);
+    }
+    if (prev != NULL && (prev < q->ring || prev >= q->ring + PKT_QUEUE_SIZE)) {
+        // prev is in the overflow list
+        yEnterCriticalSection(&q->cs);
+        *pkt = prev->next;
+        yLeaveCriticalSection(&q->cs);
+        return YAPI_SUCCESS;
+    }
+    tail = (u32) yAtomicLoad(&q->tail);
+    head = (u32) yAtomicLoad(&q->head);
+    if (prev == NULL) {
+        idx = tail;
+    } else {
+        idx = tail + (((u32)(prev - q->ring) - tail) & PKT_QUEUE_MASK) + 1;
+    }
+    if (idx - tail < head - tail) {
+        *pkt = &q->ring[idx & PKT_QUEUE_MASK];
+    } else if (yAtomicLoad(&q->spilled)) {
+        // continue with the overflow list
+        yEnterCriticalSection(&q->cs);
         *pkt = q->first;
+        yLeaveCriticalSection(&q->cs);
     }
-    yLeaveCriticalSection(&q->cs);
-    return retval;
+    return YAPI_SUCCESS;
+}
+
+static YRETCODE yPktQueuePeek(pktQueue *q, pktItem **pkt, char * errmsg)
+{
+    return yPktQueuePeekNext(q, NULL, pkt, errmsg);
 }
 
 
 
 static YRETCODE yPktQueuePop(pktQueue *q, pktItem **pkt, char * errmsg)
 {
-    YRETCODE retval;
+    pktItem *item;
+    u32     tail;
 
-    yEnterCriticalSection(&q->cs);
-    retval = q->status;
-    if(retval !=YAPI_SUCCESS){
+    *pkt = NULL;
+    if (q->status != YAPI_SUCCESS) {
         //dbglog("%X:yPktQueuePop error %d:%s\n",q,q->status,q->errmsg);
-        *pkt = NULL;
-        if(errmsg)
-            YSTRCPY(errmsg,YOCTO_ERRMSG_LEN,q->errmsg);
-    }else{
-        *pkt = q->first;
-        if(q->first!=NULL){
-           if(q->first == q->last){
-                q->first=NULL;
-                q->last=NULL;
-                //dbglog("%X:yPktQueuePop last pkt\n",q);
-                yResetEvent(&q->notEmptyEvent);
-                ySetEvent(&q->emptyEvent);
-            }else{
-                //dbglog("%X:yPktQueuePop a pkt\n",q);
-                q->first = q->first->next;
-            }
-            q->count--;
-            q->totalPop++;
+        return yPktQueueGetError(q, errmsg);
+    }
+    tail = (u32) q->tail;
+    if ((u32)yAtomicLoad(&q->head) != tail) {
+        item = yPktQueueAllocItem(q);
+        memcpy(item, &q->ring[tail & PKT_QUEUE_MASK], sizeof(pktItem));
+        item->next = NULL;
+        // release the slot to the producer
+        yAtomicStore(&q->tail, (s32)(tail + 1));
+    } else if (yAtomicLoad(&q->spilled)) {
+        // the ring has been emptied, the overflow list comes next
+        yEnterCriticalSection(&q->cs);
+        item = q->first;
+        q->first = item->next;
+        if (q->first == NULL) {
+            q->last = NULL;
         }
+        item->next = NULL;
+        yAtomicAdd(&q->spilled, -1);
+        yLeaveCriticalSection(&q->cs);
+    } else {
+        return YAPI_SUCCESS;
     }
-    yLeaveCriticalSection(&q->cs);
-    return retval;
+    q->totalPop++;
+    if (yAtomicLoad(&q->waitEmpty) && yPktQueueIsEmptyEx(q)) {
+        ySetEvent(&q->emptyEvent);
+    }
+    *pkt = item;
+    return YAPI_SUCCESS;
 }
 
-
 static void yPktQueueDup(pktQueue *q, int expected_pkt_no, const char *file, int line)
 {
     int verifcount = 0;
+    int count;
+    u32 idx, head;
     pktItem *pkt;
 
     yEnterCriticalSection(&q->cs);
-    dbglogf(file, line, "PKTs: %dpkts (%lld in / %lld out)\n", q->count, q->totalPush, q->totalPop);
-    dbglogf(file, line, "PKTs: start %x stop =%X\n", q->first, q->last);
+    idx = (u32) q->tail;
+    head = (u32) q->head;
+    count = (int)(head - idx) + q->spilled;
+    dbglogf(file, line, "PKTs: %dpkts (%lld in / %lld out)\n", count, q->totalPush, q->totalPop);
+    dbglogf(file, line, "PKTs: ring %u-%u overflow %x-%x\n", idx, head, q->first, q->last);
     if (q->status != YAPI_SUCCESS) {
         dbglogf(file, line, "PKTs: state = %s\n", q->status, q->errmsg);
     }
-    pkt = q->first;
+    pkt = (idx != head ? &q->ring[idx & PKT_QUEUE_MASK] : q->first);
     while (pkt != NULL){
         if (expected_pkt_no != pkt->pkt.first_stream.pktno) {
             dbglogf(file, line, "PKTs: invalid pkt %d (no=%d should be %d\n", verifcount, pkt->pkt.first_stream.pktno, expected_pkt_no);
@@ -1088,10 +1187,15 @@ static void yPktQueueDup(pktQueue *q, int expected_pkt_no, const char *file, int
 
         verifcount++;
         expected_pkt_no = NEXT_YPKT_NO(expected_pkt_no);
-        pkt = pkt->next;
+        if (pkt >= q->ring && pkt < q->ring + PKT_QUEUE_SIZE) {
+            idx++;
+            pkt = (idx != head ? &q->ring[idx & PKT_QUEUE_MASK] : q->first);
+        } else {
+            pkt = pkt->next;
+        }
     }
-    if (verifcount != q->count) {
-        dbglogf(file, line, "PKTs: invalid pkt count has %d report %d\n", verifcount, q->count);
+    if (verifcount != count) {
+        dbglogf(file, line, "PKTs: invalid pkt count has %d report %d\n", verifcount, count);
     }
     yLeaveCriticalSection(&q->cs);
 }
@@ -1099,6 +1203,8 @@ static void yPktQueueDup(pktQueue *q, int expected_pkt_no, const char *file, int
 
 YRETCODE  yPktQueuePushD2H(yInterfaceSt *iface,const USB_Packet *pkt, char * errmsg)
 {
+    YRETCODE res;
+
 #ifdef DUMP_USB_PKT_SHORT
     dumpPktSummary(iface->serial, iface->ifaceno,1,pkt);
 #endif
@@ -1107,7 +1213,13 @@ YRETCODE  yPktQueuePushD2H(yInterfaceSt *iface,const USB_Packet *pkt, char * err
         int mustdump = 0;
         yEnterCriticalSection(&iface->rxQueue.cs);
         if (pkt->first_stream.pkt != YPKT_CONF) {
-            pktItem *p = iface->rxQueue.last;
+            pktItem *p = NULL;
+            u32 head = (u32) iface->rxQueue.head;
+            if (iface->rxQueue.spilled) {
+                p = iface->rxQueue.last;
+            } else if (head != (u32) yAtomicLoad(&iface->rxQueue.tail)) {
+                p = &iface->rxQueue.ring[(head - 1) & PKT_QUEUE_MASK];
+            }
             if (p != NULL && p->pkt.first_stream.pkt == YPKT_CONF) {
                 int pktno = p->pkt.first_stream.pktno + 1;
                 if (pktno > 7)
@@ -1125,23 +1237,30 @@ YRETCODE  yPktQueuePushD2H(yInterfaceSt *iface,const USB_Packet *pkt, char * err
     }
 #endif
 
-    return yPktQueuePushEx(&iface->rxQueue,pkt,errmsg);
+    res = yPktQueuePushEx(&iface->rxQueue,pkt,errmsg);
+    // wake up the thread waiting in yapiSleep() or yapiWaitForEvents()
+    ySetEvent(&yContext->exitSleepEvent);
+    return res;
 }
 
 YRETCODE yPktQueueWaitAndPopD2H(yInterfaceSt *iface,pktItem **pkt, int ms, char * errmsg)
 {
-
+    pktQueue *q = &iface->rxQueue;
     YRETCODE res;
-    *pkt = NULL;
-    res= yPktQueuePop(&iface->rxQueue,pkt,errmsg);
-    if(res != YAPI_SUCCESS || ms == 0){
+
+    res= yPktQueuePop(q,pkt,errmsg);
+    if(res != YAPI_SUCCESS || ms == 0 || *pkt != NULL){
         return  res;
     }
-    if (*pkt == NULL) {
-        yWaitForEvent(&iface->rxQueue.notEmptyEvent, ms);
-        return  yPktQueuePop(&iface->rxQueue,pkt, errmsg);
+    // announce that we wait before checking the queue again, so that
+    // the producer cannot miss us (see yPktQueuePushEx)
+    yResetEvent(&q->notEmptyEvent);
+    yAtomicStore(&q->waitNotEmpty, 1);
+    if (q->status == YAPI_SUCCESS && yPktQueueIsEmptyEx(q)) {
+        yWaitForEvent(&q->notEmptyEvent, ms);
     }
-    return res;
+    yAtomicStore(&q->waitNotEmpty, 0);
+    return  yPktQueuePop(q,pkt, errmsg);
 }
 
 
@@ -1153,10 +1272,17 @@ YRETCODE  yPktQueuePushH2D(yInterfaceSt *iface,const USB_Packet *pkt, char * err
 // return 1 if empty, 0 if not empty, or an error code
 static int yPktQueueWaitEmptyH2D(yInterfaceSt *iface,int ms, char * errmsg)
 {
+    pktQueue *q = &iface->txQueue;
+
     if (ms > 0) {
-        yWaitForEvent(&iface->txQueue.emptyEvent, ms);
+        yResetEvent(&q->emptyEvent);
+        yAtomicStore(&q->waitEmpty, 1);
+        if (q->status == YAPI_SUCCESS && !yPktQueueIsEmptyEx(q)) {
+            yWaitForEvent(&q->emptyEvent, ms);
+        }
+        yAtomicStore(&q->waitEmpty, 0);
     }
-    return yPktQueueIsEmpty(&iface->txQueue,errmsg);
+    return yPktQueueIsEmpty(q,errmsg);
 }
 
 
@@ -1176,6 +1302,13 @@ YRETCODE yPktQueuePeekH2D(yInterfaceSt *iface,pktItem **pkt)
 #endif
 }
 
+// return the packet queued after prev (or the first one if prev is NULL)
+// without removing it, so that several packets can be sent at once
+YRETCODE yPktQueuePeekNextH2D(yInterfaceSt *iface,pktItem *prev,pktItem **pkt)
+{
+    return yPktQueuePeekNext(&iface->txQueue, prev, pkt, NULL);
+}
+
 YRETCODE yPktQueuePopH2D(yInterfaceSt *iface,pktItem **pkt)
 {
 
@@ -1271,7 +1404,7 @@ static int yyWaitOnlyConfPkt(yInterfaceSt *iface, u8 cmdtowait,pktItem **rpkt,u3
             }
 #endif
             dropcount++;
-            yFree(tmp);
+            yPktQueueFreeItem(&iface->rxQueue, tmp);
         }
     } while(timeout> yapiGetTickCount());
 
@@ -1346,7 +1479,7 @@ static int ySendStart(yPrivDeviceSt *dev,char *errmsg)
         dbglog("Activate USB pkt ack (%dms)\n", dev->pktAckDelay);
     }
     dev->lastpktno = rpkt->pkt.first_stream.pktno;
-    yFree(rpkt);
+    yPktQueueFreeItem(&dev->iface.rxQueue, rpkt);
     if(nextiface!=0 ){
         return YERRMSG(YAPI_VERSION_MISMATCH,"Device has not been started correctly");
     }
@@ -1382,7 +1515,7 @@ static int yPacketSetup(yPrivDeviceSt *dev,char *errmsg)
         goto error;
     }
     dev->iface.ifaceno = 0;
-    yFree(rpkt);
+    yPktQueueFreeItem(&dev->iface.rxQueue, rpkt);
     rpkt = NULL;
 
     if(!YISERR(res=ySendStart(dev,errmsg))){
@@ -1390,7 +1523,7 @@ static int yPacketSetup(yPrivDeviceSt *dev,char *errmsg)
      }
 error:
     if (rpkt) {
-        yFree(rpkt);
+        yPktQueueFreeItem(&dev->iface.rxQueue, rpkt);
     }
     //shutdown all previously started interfaces;
     dbglog("Closing partially opened device %s\n",dev->infos.serial);
@@ -1429,7 +1562,7 @@ again:
         if (dev->pktAckDelay > 0) {
             res = yAckPkt(iface, item->pkt.first_stream.pktno, errmsg);
             if (YISERR(res)){
-                yFree(item);
+                yPktQueueFreeItem(&iface->rxQueue, item);
                 return res;
             }
         }
@@ -1438,7 +1571,7 @@ again:
 #ifdef DEBUG_DUMP_PKT
             dumpAnyPacket("Drop Late config pkt",iface->ifaceno,&item->pkt);
 #endif
-            yFree(item);
+            yPktQueueFreeItem(&iface->rxQueue, item);
             dropcount++;
             if(dropcount >10){
                 dbglog("Too many packets dropped, disable %s\n",dev->infos.serial);
@@ -1448,7 +1581,7 @@ again:
         }
         if (item->pkt.first_stream.pktno == dev->lastpktno) {
             //late retry : drop it since we allready have the packet.
-            yFree(item);
+            yPktQueueFreeItem(&iface->rxQueue, item);
             goto again;
         }
 
@@ -1461,7 +1594,7 @@ again:
             return YAPI_SUCCESS;
         } else {
             yPktQueueDup(&iface->rxQueue, nextpktno, __FILE_ID__, __LINE__);
-            yFree(item);
+            yPktQueueFreeItem(&iface->rxQueue, item);
             return YERRMSG(YAPI_IO_ERROR, "Missing Packet");
         }
     }
@@ -1518,7 +1651,7 @@ static int yStreamReceived(yPrivDeviceSt *dev, u8 *stream, u8 **data, u8 *size,
     if (dev->curxofs >= USB_PKT_SIZE - sizeof(YSTREAM_Head)) {
         // look if we have the next packet on a interface
         if (dev->currxpkt) {
-            yFree(dev->currxpkt);
+            yPktQueueFreeItem(&dev->iface.rxQueue, dev->currxpkt);
             dev->currxpkt=NULL;
         }
         res = yGetNextPktEx(dev, &dev->currxpkt, blockUntilTime, errmsg);
@@ -76,6 +76,11 @@ typedef int socklen_t;
     #include <fcntl.h>
     #include <netdb.h>
 #endif
+#ifdef YAPI_USE_EPOLL
+#include <sys/epoll.h>
+static yCRITICAL_SECTION yNetLoopsCS;
+static void yNetLoopStop(void);
+#endif
 
 
 //#define DEBUG_SLOW_TCP
@@ -356,6 +361,224 @@ static u32 resolveDNSCache(yUrlRef url, char* errmsg)
 }
 
 
+/********************************************************************************
+* Request and reply buffer pools
+*******************************************************************************/
+
+// number of idle RequestSt kept for reuse
+#define YREQ_POOL_MAX       32
+// number of idle reply segments kept for reuse
+#define YREQ_SEG_POOL_MAX   64
+// a new segment is started when the last one has less free space than this
+#define YREQ_SEG_MIN_FREE   256
+
+static yCRITICAL_SECTION yReqPoolCS;
+static RequestSt* yReqPool[YREQ_POOL_MAX];
+static int yReqPoolCount = 0;
+static yReqSeg* yReqSegPool = NULL;
+static int yReqSegPoolCount = 0;
+
+
+static yReqSeg* yReqSegAlloc(void)
+{
+    yReqSeg* seg;
+
+    yEnterCriticalSection(&yReqPoolCS);
+    seg = yReqSegPool;
+    if (seg) {
+        yReqSegPool = seg->next;
+        yReqSegPoolCount--;
+    }
+    yLeaveCriticalSection(&yReqPoolCS);
+    if (seg == NULL) {
+        seg = (yReqSeg*)yMalloc(sizeof(yReqSeg));
+    }
+    seg->next = NULL;
+    seg->len = 0;
+    return seg;
+}
+
+
+static void yReqSegFree(yReqSeg* seg)
+{
+    yEnterCriticalSection(&yReqPoolCS);
+    if (yReqSegPoolCount < YREQ_SEG_POOL_MAX) {
+        seg->next = yReqSegPool;
+        yReqSegPool = seg;
+        yReqSegPoolCount++;
+        seg = NULL;
+    }
+    yLeaveCriticalSection(&yReqPoolCS);
+    if (seg) {
+        yFree(seg);
+    }
+}
+
+
+/*
+ * Drop all data stored in the reply of a request. When keepOne is set, the
+ * first segment is kept (empty) to receive the next reply.
+ */
+static void yReqReplyClear(RequestSt* req, int keepOne)
+{
+    yReqSeg* seg = req->replyhead;
+
+    if (seg && keepOne) {
+        seg->len = 0;
+        req->replytail = seg;
+        seg = seg->next;
+        req->replyhead->next = NULL;
+    } else {
+        req->replyhead = req->replytail = NULL;
+    }
+    while (seg) {
+        yReqSeg* next = seg->next;
+        yReqSegFree(seg);
+        seg = next;
+    }
+    req->replysize = 0;
+}
+
+
+/*
+ * Return a pointer to the free space at the end of the reply, starting a new
+ * segment when the last one is (almost) full. The caller must add the number
+ * of bytes actually written to replytail->len and replysize.
+ */
+static u8* yReqReplyReserve(RequestSt* req, int* avail)
+{
+    yReqSeg* seg = req->replytail;
+
+    if (seg == NULL || YREQ_SEG_SIZE - seg->len < YREQ_SEG_MIN_FREE) {
+        seg = yReqSegAlloc();
+        if (req->replytail) {
+            req->replytail->next = seg;
+        } else {
+            req->replyhead = seg;
+        }
+        req->replytail = seg;
+    }
+    *avail = YREQ_SEG_SIZE - seg->len;
+    return seg->data + seg->len;
+}
+
+
+static void yReqReplyAppend(RequestSt* req, const u8* data, int len)
+{
+    while (len > 0) {
+        int avail;
+        u8* ptr = yReqReplyReserve(req, &avail);
+        if (avail > len) {
+            avail = len;
+        }
+        memcpy(ptr, data, avail);
+        req->replytail->len += avail;
+        req->replysize += avail;
+        data += avail;
+        len -= avail;
+    }
+}
+
+
+/*
+ * Return a contiguous view of the unread part of the reply. When all the data
+ * is within the first segment, the segment itself is returned. Otherwise the
+ * data is copied into the (reused) replyflat buffer, which is NUL-terminated.
+ */
+static u8* yReqReplyView(RequestSt* req)
+{
+    yReqSeg* seg = req->replyhead;
+    int ofs = req->replypos < 0 ? 0 : req->replypos;
+    int len = req->replysize - ofs;
+    u8* d;
+
+    if (seg && len > 0 && seg->len - ofs >= len) {
+        return seg->data + ofs;
+    }
+    if (req->replyflatsize < len + 1) {
+        if (req->replyflat) yFree(req->replyflat);
+        req->replyflatsize = len + 1 + (len >> 1);
+        req->replyflat = (u8*)yMalloc(req->replyflatsize);
+    }
+    d = req->replyflat;
+    while (seg) {
+        memcpy(d, seg->data + ofs, seg->len - ofs);
+        d += seg->len - ofs;
+        ofs = 0;
+        seg = seg->next;
+    }
+    *d = 0;
+    return req->replyflat;
+}
+
+
+/*
+ * Copy (if buffer is not NULL) and consume len bytes of the reply. Fully read
+ * segments are released, except the last one which is reused.
+ */
+static void yReqReplyConsume(RequestSt* req, u8* buffer, int len)
+{
+    while (len > 0) {
+        yReqSeg* seg = req->replyhead;
+        int chunk = seg->len - req->replypos;
+        if (chunk > len) {
+            chunk = len;
+        }
+        if (buffer) {
+            memcpy(buffer, seg->data + req->replypos, chunk);
+            buffer += chunk;
+        }
+        req->replypos += chunk;
+        len -= chunk;
+        if (req->replypos == seg->len && seg != req->replytail) {
+            req->replyhead = seg->next;
+            req->replysize -= seg->len;
+            req->replypos = 0;
+            yReqSegFree(seg);
+        }
+    }
+    if (req->replypos == req->replysize) {
+        yReqReplyClear(req, 1);
+        req->replypos = 0;
+    }
+}
+
+
+static void yReqPoolInit(void)
+{
+    yInitializeCriticalSection(&yReqPoolCS);
+    yReqPoolCount = 0;
+    yReqSegPool = NULL;
+    yReqSegPoolCount = 0;
+}
+
+
+static void yReqDestroy(RequestSt* req)
+{
+    if (req->headerbuf) yFree(req->headerbuf);
+    if (req->bodybuf) yFree(req->bodybuf);
+    if (req->replyflat) yFree(req->replyflat);
+    yCloseEvent(&req->finished);
+    yDeleteCriticalSection(&req->access);
+    yFree(req);
+}
+
+
+static void yReqPoolFree(void)
+{
+    while (yReqPoolCount > 0) {
+        yReqDestroy(yReqPool[--yReqPoolCount]);
+    }
+    while (yReqSegPool) {
+        yReqSeg* next = yReqSegPool->next;
+        yFree(yReqSegPool);
+        yReqSegPool = next;
+    }
+    yReqSegPoolCount = 0;
+    yDeleteCriticalSection(&yReqPoolCS);
+}
+
+
 /********************************************************************************
 * Pure TCP funtions
 *******************************************************************************/
@@ -375,12 +598,21 @@ int yTcpInit(char* errmsg)
     for (i = 0; i < YDNS_CACHE_SIZE; i++) {
         dnsCache[i].url = INVALID_HASH_IDX;
     }
+    yReqPoolInit();
+#ifdef YAPI_USE_EPOLL
+    yInitializeCriticalSection(&yNetLoopsCS);
+#endif
     return YAPI_SUCCESS;
 }
 
 void yTcpShutdown(void)
 {
     TCPLOG("yTcpShutdown\n");
+#ifdef YAPI_USE_EPOLL
+    yNetLoopStop();
+    yDeleteCriticalSection(&yNetLoopsCS);
+#endif
+    yReqPoolFree();
 #ifdef PERF_TCP_FUNCTIONS
     dumpYTcpPerf();
 #endif
@@ -927,13 +1159,95 @@ static int yTcpCheckReqTimeout(struct _RequestSt* req, char* errmsg)
 *******************************************************************************/
 
 
+/*
+ * Close the idle keep-alive connections of a hub that have been unused for
+ * more than HTTP_POOL_IDLE_TIMEOUT_MS, or all of them if all is set.
+ * The oldest connections are at the bottom of the pool.
+ */
+void yHTTPPoolExpire(struct _HubSt* hub, int all)
+{
+    int i, nexp;
+    u64 now = yapiGetTickCount();
+
+    yEnterCriticalSection(&hub->access);
+    for (nexp = 0; nexp < hub->http.pool_count; nexp++) {
+        if (!all && now - hub->http.pool_tm[nexp] <= HTTP_POOL_IDLE_TIMEOUT_MS) {
+            break;
+        }
+        yTcpClose(hub->http.pool_skt[nexp]);
+    }
+    if (nexp > 0) {
+        hub->http.pool_count -= nexp;
+        for (i = 0; i < hub->http.pool_count; i++) {
+            hub->http.pool_skt[i] = hub->http.pool_skt[i + nexp];
+            hub->http.pool_tm[i] = hub->http.pool_tm[i + nexp];
+        }
+    }
+    yLeaveCriticalSection(&hub->access);
+}
+
+
+/*
+ * Take an idle keep-alive connection from the pool of the hub, most recently
+ * used first. Connections closed by the hub in the meantime are dropped.
+ * Returns INVALID_SOCKET if no usable connection is available.
+ */
+static YSOCKET yHTTPPoolTake(struct _HubSt* hub)
+{
+    YSOCKET skt;
+
+    yHTTPPoolExpire(hub, 0);
+    yEnterCriticalSection(&hub->access);
+    while (hub->http.pool_count > 0) {
+        skt = hub->http.pool_skt[--hub->http.pool_count];
+        // yTcpCheckSocketStillValid closes the socket if it is not usable anymore
+        if (yTcpCheckSocketStillValid(skt, NULL) == 1) {
+            hub->http.pool_hits++;
+            yLeaveCriticalSection(&hub->access);
+            return skt;
+        }
+    }
+    hub->http.pool_misses++;
+    yLeaveCriticalSection(&hub->access);
+    return INVALID_SOCKET;
+}
+
+
+// Give back a keep-alive connection to the pool of the hub, or close it if the pool is full
+static void yHTTPPoolPut(struct _HubSt* hub, YSOCKET skt)
+{
+    yEnterCriticalSection(&hub->access);
+    if (hub->http.pool_count < yContext->httpPoolSize && hub->http.pool_count < HTTP_POOL_MAX) {
+        hub->http.pool_skt[hub->http.pool_count] = skt;
+        hub->http.pool_tm[hub->http.pool_count] = yapiGetTickCount();
+        hub->http.pool_count++;
+        skt = INVALID_SOCKET;
+    }
+    yLeaveCriticalSection(&hub->access);
+    if (skt != INVALID_SOCKET) {
+        yTcpClose(skt);
+    }
+}
+
+
+// Read the keep-alive connection statistics of a hub
+void yHTTPPoolGetStats(struct _HubSt* hub, int* hits, int* misses, int* idle)
+{
+    yEnterCriticalSection(&hub->access);
+    if (hits) *hits = (int)hub->http.pool_hits;
+    if (misses) *misses = (int)hub->http.pool_misses;
+    if (idle) *idle = hub->http.pool_count;
+    yLeaveCriticalSection(&hub->access);
+}
+
+
 // access mutex taken by caller
 static int yHTTPOpenReqEx(struct _RequestSt* req, u64 mstimout, char* errmsg)
 {
     char buffer[YOCTO_HOSTNAME_NAME], *p, *last, *end;
     u32 ip;
     u16 port;
-    int res;
+    int res, reused;
 
     YASSERT(req->proto == PROTO_AUTO || req->proto == PROTO_HTTP);
 
@@ -954,19 +1268,16 @@ static int yHTTPOpenReqEx(struct _RequestSt* req, u64 mstimout, char* errmsg)
         TCPLOG("yTcpOpenReqEx error%p[%x]\n", req, req->http.skt);
         return res;
     }
-    TCPLOG("yTcpOpenReqEx %p [%x:%x %d]\n", req, req->http.skt, req->http.reuseskt, mstimout);
+    TCPLOG("yTcpOpenReqEx %p [%x %d]\n", req, req->http.skt, mstimout);
 
     req->replypos = -1; // not ready to consume until header found
-    req->replysize = 0;
-    memset(req->replybuf, 0, req->replybufsize);
+    yReqReplyClear(req, 1);
     req->errcode = YAPI_SUCCESS;
 
 
-    if (req->http.reuseskt != INVALID_SOCKET && (res = yTcpCheckSocketStillValid(req->http.reuseskt, NULL)) == 1) {
-        req->http.skt = req->http.reuseskt;
-        req->http.reuseskt = INVALID_SOCKET;
-    } else {
-        req->http.reuseskt = INVALID_SOCKET;
+    req->http.skt = yHTTPPoolTake(req->hub);
+    reused = (req->http.skt != INVALID_SOCKET);
+    if (!reused) {
         res = yTcpOpen(&req->http.skt, ip, port, mstimout, errmsg);
         if (YISERR(res)) {
             // yTcpOpen has reset the socket to INVALID
@@ -1025,6 +1336,14 @@ static int yHTTPOpenReqEx(struct _RequestSt* req, u64 mstimout, char* errmsg)
     }
     //write header
     res = yTcpWrite(req->http.skt, req->headerbuf, (int)strlen(req->headerbuf), errmsg);
+    if (YISERR(res) && reused) {
+        // the hub has closed the pooled connection in the meantime, retry once on a new one
+        yTcpClose(req->http.skt);
+        res = yTcpOpen(&req->http.skt, ip, port, mstimout, errmsg);
+        if (!YISERR(res)) {
+            res = yTcpWrite(req->http.skt, req->headerbuf, (int)strlen(req->headerbuf), errmsg);
+        }
+    }
     if (YISERR(res)) {
         yTcpClose(req->http.skt);
         req->http.skt = INVALID_SOCKET;
@@ -1058,7 +1377,7 @@ static void yHTTPCloseReqEx(struct _RequestSt* req, int canReuseSocket)
     req->flags &= ~TCPREQ_KEEPALIVE;
     if (req->callback) {
         u32 len = req->replysize - req->replypos;
-        u8* ptr = req->replybuf + req->replypos;
+        u8* ptr = yReqReplyView(req);
         if (req->errcode == YAPI_NO_MORE_DATA) {
             req->callback(req->context, ptr, len, YAPI_SUCCESS, "");
         } else {
@@ -1067,11 +1386,13 @@ static void yHTTPCloseReqEx(struct _RequestSt* req, int canReuseSocket)
         req->callback = NULL;
         // ASYNC Request are automaticaly released
         req->flags &= ~TCPREQ_IN_USE;
+        // wake up the thread waiting for the reply in yapiWaitForEvents()
+        ySetEvent(&yContext->exitSleepEvent);
     }
 
     if (req->http.skt != INVALID_SOCKET) {
         if (canReuseSocket) {
-            req->http.reuseskt = req->http.skt;
+            yHTTPPoolPut(req->hub, req->http.skt);
         } else {
             yTcpClose(req->http.skt);
         }
@@ -1081,6 +1402,102 @@ static void yHTTPCloseReqEx(struct _RequestSt* req, int canReuseSocket)
 }
 
 
+/*
+ * Read the data available on the socket of a HTTP request into its reply
+ * buffer, and process the reply header. Returns the number of bytes read,
+ * 0 if there was nothing to read or a negative error code.
+ */
+static int yHTTPReadReqData(struct _RequestSt* req, char* errmsg)
+{
+    int res, avail;
+    u8* ptr;
+
+    yEnterCriticalSection(&req->access);
+    ptr = yReqReplyReserve(req, &avail);
+    res = yTcpRead(req->http.skt, ptr, avail, errmsg);
+    //dbglog("check %x:%x:%X\n", check, check2, size);
+
+    req->read_tm = yapiGetTickCount();
+    if (res < 0) {
+        // any connection closed by peer ends up with YAPI_NO_MORE_DATA
+        if (req->replypos < 0) {
+            // header never completed, let the caller read what we have
+            req->replypos = 0;
+        }
+        req->errcode = YERRTO((YRETCODE) res,req->errmsg);
+        TCPLOG("yHTTPSelectReq %p[%x] connection closed by peer\n",req,req->http.skt);
+        yHTTPCloseReqEx(req, 0);
+    } else if (res > 0) {
+        req->replytail->len += res;
+        req->replysize += res;
+        if (req->replypos < 0) {
+            // Need to analyze http headers (the first segment always holds the start of the reply)
+            u8* replybuf = req->replyhead->data;
+            if (req->replysize == 8 && !memcmp(replybuf, "0K\r\n\r\n\r\n", 8)) {
+                TCPLOG("yHTTPSelectReq %p[%x] untrashort reply\n",req,req->http.skt);
+                // successful abbreviated reply (keepalive)
+                req->replypos = 0;
+                replybuf[0] = 'O';
+                req->errcode = YERRTO(YAPI_NO_MORE_DATA, req->errmsg);
+                yHTTPCloseReqEx(req, 1);
+            } else if (req->replysize >= 4 && !memcmp(replybuf, "OK\r\n", 4)) {
+                // successful short reply, let it go through
+                req->replypos = 0;
+            } else if (req->replysize >= 12) {
+                if (memcmp(replybuf, "HTTP/1.1 401", 12) != 0) {
+                    // no authentication required, let it go through
+                    req->replypos = 0;
+                } else {
+                    // authentication required, process authentication headers
+                    char *method = NULL, *realm = NULL, *qop = NULL, *nonce = NULL, *opaque = NULL;
+
+                    if (!req->hub->http.s_user || req->retryCount++ > 3) {
+                        // No credential provided, give up immediately
+                        req->replypos = 0;
+                        yReqReplyClear(req, 1);
+                        req->errcode = YERRTO(YAPI_UNAUTHORIZED, req->errmsg);
+                        yHTTPCloseReqEx(req, 0);
+                    } else if (yParseWWWAuthenticate((char*)yReqReplyView(req), req->replysize, &method, &realm, &qop, &nonce, &opaque) >= 0) {
+                        // Authentication header fully received, we can close the connection
+                        if (!strcmp(method, "Digest") && !strcmp(qop, "auth")) {
+                            // partial close to reopen with authentication settings
+                            yTcpClose(req->http.skt);
+                            req->http.skt = INVALID_SOCKET;
+                            // device requests Digest qop-authentication, good
+                            yEnterCriticalSection(&req->hub->access);
+                            yDupSet(&req->hub->http.s_realm, realm);
+                            yDupSet(&req->hub->http.s_nonce, nonce);
+                            yDupSet(&req->hub->http.s_opaque, opaque);
+                            if (req->hub->http.s_user && req->hub->http.s_pwd) {
+                                ComputeAuthHA1(req->hub->http.s_ha1, req->hub->http.s_user, req->hub->http.s_pwd, req->hub->http.s_realm);
+                            }
+                            req->hub->http.nc = 0;
+                            yLeaveCriticalSection(&req->hub->access);
+                            // reopen connection with proper auth parameters
+                            // callback and context parameters are preserved
+                            req->errcode = yHTTPOpenReqEx(req, req->timeout_tm, req->errmsg);
+                            if (YISERR(req->errcode)) {
+                                yHTTPCloseReqEx(req, 0);
+                            }
+                        } else {
+                            // unsupported authentication method for devices, give up
+                            req->replypos = 0;
+                            req->errcode = YERRTO(YAPI_UNAUTHORIZED, req->errmsg);
+                            yHTTPCloseReqEx(req, 0);
+                        }
+                    }
+                }
+            }
+        }
+        if (req->errcode == YAPI_SUCCESS) {
+            req->errcode = yTcpCheckReqTimeout(req, req->errmsg);
+        }
+    }
+    yLeaveCriticalSection(&req->access);
+    return res;
+}
+
+
 static int yHTTPMultiSelectReq(struct _RequestSt** reqs, int size, u64 ms, WakeUpSocket* wuce, char* errmsg)
 {
     fd_set fds;
@@ -1140,91 +1557,7 @@ static int yHTTPMultiSelectReq(struct _RequestSt** reqs, int size, u64 ms, WakeU
             struct _RequestSt* req;
             req = reqs[i];
             if (FD_ISSET(req->http.skt, &fds)) {
-                yEnterCriticalSection(&req->access);
-                if (req->replysize >= req->replybufsize - 256) {
-                    // need to grow receive buffer
-                    int newsize = req->replybufsize << 1;
-                    u8* newbuf = (u8*)yMalloc(newsize);
-                    memcpy(newbuf, req->replybuf, req->replysize);
-                    yFree(req->replybuf);
-                    req->replybuf = newbuf;
-                    req->replybufsize = newsize;
-                }
-                res = yTcpRead(req->http.skt, req->replybuf + req->replysize, req->replybufsize - req->replysize, errmsg);
-                //dbglog("check %x:%x:%X\n", check, check2, size);
-
-                req->read_tm = yapiGetTickCount();
-                if (res < 0) {
-                    // any connection closed by peer ends up with YAPI_NO_MORE_DATA
-                    req->replypos = 0;
-                    req->errcode = YERRTO((YRETCODE) res,req->errmsg);
-                    TCPLOG("yHTTPSelectReq %p[%x] connection closed by peer\n",req,req->http.skt);
-                    yHTTPCloseReqEx(req, 0);
-                } else if (res > 0) {
-                    req->replysize += res;
-                    if (req->replypos < 0) {
-                        // Need to analyze http headers
-                        if (req->replysize == 8 && !memcmp(req->replybuf, "0K\r\n\r\n\r\n", 8)) {
-                            TCPLOG("yHTTPSelectReq %p[%x] untrashort reply\n",req,req->http.skt);
-                            // successful abbreviated reply (keepalive)
-                            req->replypos = 0;
-                            req->replybuf[0] = 'O';
-                            req->errcode = YERRTO(YAPI_NO_MORE_DATA, req->errmsg);
-                            yHTTPCloseReqEx(req, 1);
-                        } else if (req->replysize >= 4 && !memcmp(req->replybuf, "OK\r\n", 4)) {
-                            // successful short reply, let it go through
-                            req->replypos = 0;
-                        } else if (req->replysize >= 12) {
-                            if (memcmp(req->replybuf, "HTTP/1.1 401", 12) != 0) {
-                                // no authentication required, let it go through
-                                req->replypos = 0;
-                            } else {
-                                // authentication required, process authentication headers
-                                char *method = NULL, *realm = NULL, *qop = NULL, *nonce = NULL, *opaque = NULL;
-
-                                if (!req->hub->http.s_user || req->retryCount++ > 3) {
-                                    // No credential provided, give up immediately
-                                    req->replypos = 0;
-                                    req->replysize = 0;
-                                    req->errcode = YERRTO(YAPI_UNAUTHORIZED, req->errmsg);
-                                    yHTTPCloseReqEx(req, 0);
-                                } else if (yParseWWWAuthenticate((char*)req->replybuf, req->replysize, &method, &realm, &qop, &nonce, &opaque) >= 0) {
-                                    // Authentication header fully received, we can close the connection
-                                    if (!strcmp(method, "Digest") && !strcmp(qop, "auth")) {
-                                        // partial close to reopen with authentication settings
-                                        yTcpClose(req->http.skt);
-                                        req->http.skt = INVALID_SOCKET;
-                                        // device requests Digest qop-authentication, good
-                                        yEnterCriticalSection(&req->hub->access);
-                                        yDupSet(&req->hub->http.s_realm, realm);
-                                        yDupSet(&req->hub->http.s_nonce, nonce);
-                                        yDupSet(&req->hub->http.s_opaque, opaque);
-                                        if (req->hub->http.s_user && req->hub->http.s_pwd) {
-                                            ComputeAuthHA1(req->hub->http.s_ha1, req->hub->http.s_user, req->hub->http.s_pwd, req->hub->http.s_realm);
-                                        }
-                                        req->hub->http.nc = 0;
-                                        yLeaveCriticalSection(&req->hub->access);
-                                        // reopen connection with proper auth parameters
-                                        // callback and context parameters are preserved
-                                        req->errcode = yHTTPOpenReqEx(req, req->timeout_tm, req->errmsg);
-                                        if (YISERR(req->errcode)) {
-                                            yHTTPCloseReqEx(req, 0);
-                                        }
-                                    } else {
-                                        // unsupported authentication method for devices, give up
-                                        req->replypos = 0;
-                                        req->errcode = YERRTO(YAPI_UNAUTHORIZED, req->errmsg);
-                                        yHTTPCloseReqEx(req, 0);
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    if (req->errcode == YAPI_SUCCESS) {
-                        req->errcode = yTcpCheckReqTimeout(req, req->errmsg);
-                    }
-                }
-                yLeaveCriticalSection(&req->access);
+                yHTTPReadReqData(req, errmsg);
             }
         }
     }
@@ -1268,12 +1601,126 @@ static void dumpbin(char *out, u8* buffer, int pktlen)
 }
 #endif
 
+// requests with a larger body are considered as bulk transfers
+#define WS_BULK_BODY_SIZE 2048
+// size of the first chunk of a throttled upload: first multiple of full frames above 2KB
+#define WS_UPLOAD_FIRST_CHUNK   2108
+// weight of a pending bulk request when choosing the channel of an interactive request
+#define WS_BULK_WEIGHT    100
+
+// requests that can keep a channel busy for a long time
+static const char* ws_bulkRequests[] = {
+    "/files.json", "/logger.json", "/flash.json", "/upload.html", NULL
+};
+
+static int ws_getRequestPrio(struct _RequestSt* req)
+{
+    char* eol;
+    int i, res = WS_PRIO_INTERACTIVE;
+
+    if (req->bodysize > WS_BULK_BODY_SIZE) {
+        return WS_PRIO_BULK;
+    }
+    // only look at the first line of the request
+    eol = strchr(req->headerbuf, '\r');
+    if (eol) {
+        *eol = 0;
+    }
+    for (i = 0; ws_bulkRequests[i]; i++) {
+        if (strstr(req->headerbuf, ws_bulkRequests[i])) {
+            res = WS_PRIO_BULK;
+            break;
+        }
+    }
+    if (eol) {
+        *eol = '\r';
+    }
+    return res;
+}
+
+
+/*
+ * Choose the channel of a new request. Requests to a device that still has
+ * pending requests stay on the same channel, so that the hub processes them
+ * in order. Other requests sent on channel 0 go to the least loaded channel:
+ * bulk requests leave the last channel free for interactive requests, and
+ * interactive requests avoid the channels busy with bulk transfers.
+ * Requests explicitly sent to another channel, or to a hub that predates
+ * upload throttling, are kept on their channel. Large uploads also stay on
+ * channel 0, the only one on which uploads are throttled (see ws_mustHoldUpload).
+ * hub access mutex taken by caller
+ */
+static int ws_selectChannel(HubSt* hub, struct _RequestSt* req, int tcpchan)
+{
+    int i, nchan, score, best = -1;
+    int devydx = req->ws.devydx;
+
+    if (tcpchan != 0 || hub->ws.remoteVersion < USB_META_WS_PROTO_V2) {
+        return tcpchan;
+    }
+    if (devydx >= 0 && hub->ws.dev_pending[devydx] > 0) {
+        return hub->ws.dev_chan[devydx];
+    }
+    if (req->ws.requestsize > WS_UPLOAD_FIRST_CHUNK) {
+        return 0;
+    }
+    nchan = (req->ws.prio == WS_PRIO_BULK ? MAX_ASYNC_TCPCHAN - 1 : MAX_ASYNC_TCPCHAN);
+    for (i = 0; i < nchan; i++) {
+        score = hub->ws.chan[i].pending;
+        if (req->ws.prio == WS_PRIO_INTERACTIVE) {
+            score += WS_BULK_WEIGHT * hub->ws.chan[i].bulk;
+        }
+        if (best < 0 || score < best) {
+            best = score;
+            tcpchan = i;
+        }
+    }
+    return tcpchan;
+}
+
+
+// A large upload must be sent on channel 0 to be throttled, but it would then
+// overtake the requests of the same device still pending on another channel:
+// it has to wait until these requests are done.
+// hub access mutex taken by caller
+static int ws_mustHoldUpload(HubSt* hub, struct _RequestSt* req, int tcpchan)
+{
+    int devydx = req->ws.devydx;
+
+    if (tcpchan != 0 || hub->ws.remoteVersion < USB_META_WS_PROTO_V2 || req->ws.requestsize <= WS_UPLOAD_FIRST_CHUNK) {
+        return 0;
+    }
+    return devydx >= 0 && hub->ws.dev_pending[devydx] > 0 && hub->ws.dev_chan[devydx] != 0;
+}
+
+
+// account for a request added to (delta=1) or removed from (delta=-1) its channel
+// hub access mutex taken by caller
+static void ws_updatePending(HubSt* hub, struct _RequestSt* req, int delta)
+{
+    WSChanSt* chan = &hub->ws.chan[req->ws.channel];
+
+    chan->pending += delta;
+    if (req->ws.prio == WS_PRIO_BULK) {
+        chan->bulk += delta;
+    }
+    if (req->ws.devydx >= 0) {
+        // the channel of the device only changes once all its requests are done
+        if (delta > 0 && hub->ws.dev_pending[req->ws.devydx] == 0) {
+            hub->ws.dev_chan[req->ws.devydx] = (u8)req->ws.channel;
+        }
+        hub->ws.dev_pending[req->ws.devydx] += delta;
+    }
+}
+
+
 static int yWSOpenReqEx(struct _RequestSt* req, int tcpchan, u64 mstimeout, char* errmsg)
 {
     HubSt* hub = req->hub;
     RequestSt* r;
     int headlen;
     u8* p;
+    u64 start;
     YASSERT(req->proto == PROTO_WEBSOCKET);
 
 
@@ -1294,17 +1741,31 @@ static int yWSOpenReqEx(struct _RequestSt* req, int tcpchan, u64 mstimeout, char
     } else {
         memcpy(p, "\r\n\r\n", 4);
     }
-    if (req->callback) {
+    req->ws.prio = ws_getRequestPrio(req);
+    start = yapiGetTickCount();
+    yEnterCriticalSection(&hub->access);
+    while (ws_mustHoldUpload(hub, req, tcpchan)) {
+        yLeaveCriticalSection(&hub->access);
+        if ((u64)(yapiGetTickCount() - start) > mstimeout) {
+            yFree(req->ws.requestbuf);
+            req->ws.requestbuf = NULL;
+            return YERRMSG(YAPI_TIMEOUT, "Previous requests to the device are still pending (WebSocket)");
+        }
+        yApproximateSleep(1);
         yEnterCriticalSection(&hub->access);
+    }
+    if (req->callback) {
         req->ws.asyncId = hub->ws.s_next_async_id++;
         if (hub->ws.s_next_async_id >= 127) {
             hub->ws.s_next_async_id = 48;
         }
-        yLeaveCriticalSection(&hub->access);
     }
+    tcpchan = ws_selectChannel(hub, req, tcpchan);
+    YASSERT(tcpchan < MAX_ASYNC_TCPCHAN);
     req->ws.channel = tcpchan;
+    ws_updatePending(hub, req, 1);
+    yLeaveCriticalSection(&hub->access);
     req->timeout_tm = mstimeout;
-    YASSERT(tcpchan < MAX_ASYNC_TCPCHAN);
     yEnterCriticalSection(&hub->ws.chan[tcpchan].access);
     req->ws.next = NULL; // just in case
     if (hub->ws.chan[tcpchan].requests) {
@@ -1363,13 +1824,15 @@ static void yWSCloseReqEx(struct _RequestSt* req, int takeCS)
     if (req->callback) {
         // async close
         len = req->replysize - req->replypos;
-        ptr = req->replybuf + req->replypos;
+        ptr = yReqReplyView(req);
         if (req->errcode == YAPI_NO_MORE_DATA) {
             req->callback(req->context, ptr, len, YAPI_SUCCESS, "");
         } else {
             req->callback(req->context, ptr, len, req->errcode, req->errmsg);
         }
         req->callback = NULL;
+        // wake up the thread waiting for the reply in yapiWaitForEvents()
+        ySetEvent(&yContext->exitSleepEvent);
     }
 
 
@@ -1392,6 +1855,9 @@ static void yWSCloseReqEx(struct _RequestSt* req, int takeCS)
         } else {
             p->ws.next = r->ws.next;
         }
+        yEnterCriticalSection(&hub->access);
+        ws_updatePending(hub, req, -1);
+        yLeaveCriticalSection(&hub->access);
     }
     if (takeCS) {
         yLeaveCriticalSection(&hub->ws.chan[tcpchan].access);
@@ -1448,7 +1914,7 @@ static void dumpTCPReq(const char *fileid, int lineno, struct _RequestSt *req)
         case PROTO_WEBSOCKET: proto ="PROTO_WEBSOCKET"; break;
         default: proto ="unk"; break;
     }
-    dbglog("proto=%s socket=%x (reuse=%x) flags=%x\n", proto, req->http.skt, req->http.reuseskt, req->flags);
+    dbglog("proto=%s socket=%x flags=%x\n", proto, req->http.skt, req->flags);
     dbglog("time open=%"FMTx64" last read=%"FMTx64" last write=%"FMTx64"  timeout=%"FMTx64"\n", req->open_tm, req->read_tm, req->write_tm, req->timeout_tm);
     dbglog("readed=%d (readpos=%d)\n", req->replysize, req->replysize);
     dbglog("callback=%p context=%p\n", req->callback, req->context);
@@ -1469,22 +1935,30 @@ static void dumpTCPReq(const char *fileid, int lineno, struct _RequestSt *req)
 
 struct _RequestSt* yReqAlloc(struct _HubSt* hub)
 {
-    struct _RequestSt* req = yMalloc(sizeof(struct _RequestSt));
-    memset(req, 0, sizeof(struct _RequestSt));
+    struct _RequestSt* req = NULL;
+
+    // reuse a recycled request (with its critical section, event and buffers) when possible
+    yEnterCriticalSection(&yReqPoolCS);
+    if (yReqPoolCount > 0) {
+        req = yReqPool[--yReqPoolCount];
+    }
+    yLeaveCriticalSection(&yReqPoolCS);
+    if (req == NULL) {
+        req = yMalloc(sizeof(struct _RequestSt));
+        memset(req, 0, sizeof(struct _RequestSt));
+        yInitializeCriticalSection(&req->access);
+        yCreateManualEvent(&req->finished, 1);
+    }
     yHashGetUrlPort(hub->url, NULL, NULL, &req->proto, NULL, NULL, NULL);
     TCPLOG("yTcpInitReq %p[%x:%x]\n", req, hub->url, req->proto);
-    req->replybufsize = 1500;
-    req->replybuf = (u8*)yMalloc(req->replybufsize);
-    yInitializeCriticalSection(&req->access);
-    yCreateManualEvent(&req->finished, 1);
     req->hub = hub;
     switch (req->proto) {
     case PROTO_AUTO:
     case PROTO_HTTP:
-        req->http.reuseskt = INVALID_SOCKET;
         req->http.skt = INVALID_SOCKET;
         break;
     case PROTO_WEBSOCKET:
+        req->ws.devydx = -1;
         break;
     }
     return req;
@@ -1614,6 +2088,24 @@ int yReqMultiSelect(struct _RequestSt** tcpreq, int size, u64 ms, WakeUpSocket*
     return yHTTPMultiSelectReq(tcpreq, size, ms, wuce, errmsg);
 }
 
+#ifdef YAPI_USE_EPOLL
+/*
+ * Read all data already received on the sockets of a list of HTTP requests,
+ * without waiting. Sockets are drained until they would block, as required
+ * by edge-triggered polling.
+ */
+void yReqPoll(struct _RequestSt** tcpreq, int size, char* errmsg)
+{
+    int i;
+
+    for (i = 0; i < size; i++) {
+        struct _RequestSt* req = tcpreq[i];
+        YASSERT(req->proto == PROTO_AUTO || req->proto == PROTO_HTTP);
+        while (req->http.skt != INVALID_SOCKET && yHTTPReadReqData(req, errmsg) > 0);
+    }
+}
+#endif
+
 
 int yReqIsEof(struct _RequestSt* req, char* errmsg)
 {
@@ -1645,7 +2137,7 @@ int yReqGet(struct _RequestSt* req, u8** buffer)
     } else {
         avail = req->replysize - req->replypos;
         if (buffer) {
-            *buffer = req->replybuf + req->replypos;
+            *buffer = yReqReplyView(req);
         }
     }
     yLeaveCriticalSection(&req->access);
@@ -1668,20 +2160,13 @@ int yReqRead(struct _RequestSt* req, u8* buffer, int len)
         if (len > avail) {
             len = avail;
         }
-        if (len && buffer) {
-            memcpy(buffer, req->replybuf + req->replypos, len);
-        }
-        if (req->replypos + len == req->replysize) {
-            req->replypos = 0;
-            req->replysize = 0;
+        yReqReplyConsume(req, buffer, len);
+        if (req->replypos == req->replysize) {
             if (req->proto == PROTO_WEBSOCKET) {
                 if (req->state == REQ_CLOSED || req->state == REQ_CLOSED_BY_HUB) {
                     req->errcode = YAPI_NO_MORE_DATA;
                 }
             }
-
-        } else {
-            req->replypos += len;
         }
     }
     yLeaveCriticalSection(&req->access);
@@ -1742,19 +2227,23 @@ void yReqFree(struct _RequestSt* req)
         if (req->http.skt != INVALID_SOCKET) {
             yTcpClose(req->http.skt);
         }
-        if (req->http.reuseskt != INVALID_SOCKET) {
-            yTcpClose(req->http.reuseskt);
-        }
     } else {
         if (req->ws.requestbuf) yFree(req->ws.requestbuf);
     }
-    if (req->headerbuf) yFree(req->headerbuf);
-    if (req->bodybuf) yFree(req->bodybuf);
-    if (req->replybuf) yFree(req->replybuf);
-    yCloseEvent(&req->finished);
-    yDeleteCriticalSection(&req->access);
-    yFree(req);
-    //memset(req, 0, sizeof(struct _RequestSt));
+    yReqReplyClear(req, 0);
+    // clear everything but the critical section, the event and the reusable buffers
+    memset(&req->state, 0, sizeof(struct _RequestSt) - (size_t)((u8*)&req->state - (u8*)req));
+    req->hub = NULL;
+    ySetEvent(&req->finished);
+    yEnterCriticalSection(&yReqPoolCS);
+    if (yReqPoolCount < YREQ_POOL_MAX) {
+        yReqPool[yReqPoolCount++] = req;
+        req = NULL;
+    }
+    yLeaveCriticalSection(&yReqPoolCS);
+    if (req) {
+        yReqDestroy(req);
+    }
 }
 
 
@@ -2038,17 +2527,7 @@ static int ws_sendAuthenticationMeta(HubSt* hub, char* errmsg)
 static void ws_appendTCPData(RequestSt* req, u8* buffer, int pktlen, int isClose)
 {
     if (pktlen) {
-        if (req->replybufsize < req->replysize + pktlen) {
-            u8* newbuff;
-            req->replybufsize <<= 1;
-            newbuff = yMalloc(req->replybufsize);
-            memcpy(newbuff, req->replybuf, req->replysize);
-            yFree(req->replybuf);
-            req->replybuf = newbuff;
-        }
-
-        memcpy(req->replybuf + req->replysize, buffer, pktlen);
-        req->replysize += pktlen;
+        yReqReplyAppend(req, buffer, pktlen);
     }
     req->read_tm = yapiGetTickCount();
     if (isClose) {
@@ -2349,135 +2828,177 @@ static RequestSt* getNextReqToSend(HubSt* hub, int tcpchan)
     return req;
 }
 
+// maximum number of bytes sent on a channel before serving the other channels
+#define WS_SEND_QUANTUM         (8 * WS_MAX_DATA_LEN)
+
 /*
-*   look through all pending request if there is some data that we can send
-*
+*   send the pending requests of a channel whose next request has the given
+*   priority, up to WS_SEND_QUANTUM bytes. *more is set when data is left
+*   that can be sent right away.
+*   channel access mutex taken by caller
 */
-static int ws_processRequests(HubSt* hub, char* errmsg)
+static int ws_processChannel(HubSt* hub, int tcpchan, int prio, int* more, char* errmsg)
 {
-    int tcpchan;
-    int res;
-
-    if (hub->ws.next_transmit_tm && hub->ws.next_transmit_tm > yapiGetTickCount()) {
-        //u64 wait = hub->ws.next_transmit_tm - yapiGetTickCount();
-        //WSLOG("skip reqProcess for %"FMTu64" ms\n", wait);
-        return YAPI_SUCCESS;
-    }
-
-    for (tcpchan = 0; tcpchan < MAX_ASYNC_TCPCHAN; tcpchan++) {
-        yEnterCriticalSection(&hub->ws.chan[tcpchan].access);
-        if (hub->ws.chan[tcpchan].requests) {
-            RequestSt* req;
-            while ((req = getNextReqToSend(hub, tcpchan)) != NULL) {
-                int throttle_start = req->ws.requestpos;
-                int throttle_end = req->ws.requestsize;
-                if (throttle_end > 2108 && hub->ws.remoteVersion >= USB_META_WS_PROTO_V2 && tcpchan == 0) {
-                    // Perform throttling on large uploads
-                    if (req->ws.requestpos == 0) {
-                        // First chunk is always first multiple of full window (124 bytes) above 2KB
-                        throttle_end = 2108;
-                        // Prepare to compute effective transfer rate
-                        hub->ws.chan[tcpchan].lastUploadAckBytes = 0;
-                        hub->ws.chan[tcpchan].lastUploadAckTime = 0;
-                        // Start with initial RTT based estimate
-                        hub->ws.uploadRate = hub->ws.tcpMaxWindowSize * 1000 / hub->ws.tcpRoundTripTime;
-                    } else if (hub->ws.chan[tcpchan].lastUploadAckTime == 0) {
-                        // first block not yet acked, wait more
-                        //WSLOG("wait for first ack");
-                        throttle_end = 0;
-                    } else {
-                        // adapt window frame to available bandwidth
-                        int bytesOnTheAir = req->ws.requestpos - hub->ws.chan[tcpchan].lastUploadAckBytes;
-                        u32 uploadRate = hub->ws.uploadRate;
-                        u64 timeOnTheAir = (yapiGetTickCount() - hub->ws.chan[tcpchan].lastUploadAckTime);
-                        u64 toBeSent = 2 * uploadRate + 1024 - bytesOnTheAir + (uploadRate * timeOnTheAir / 1000);
-                        if (toBeSent + bytesOnTheAir > DEFAULT_TCP_MAX_WINDOW_SIZE) {
-                            toBeSent = DEFAULT_TCP_MAX_WINDOW_SIZE - bytesOnTheAir;
-                        }
-                        WSLOG("throttling: %d bytes/s (%"FMTu64" + %d = %"FMTu64")\n", hub->ws.uploadRate, toBeSent, bytesOnTheAir, bytesOnTheAir + toBeSent);
-                        if (toBeSent < 64) {
-                            u64 waitTime = 1000 * (128 - toBeSent) / hub->ws.uploadRate;
-                            if (waitTime < 2) waitTime = 2;
-                            hub->ws.next_transmit_tm = yapiGetTickCount() + waitTime;
-                            WSLOG("WS: %d sent %"FMTu64"ms ago, waiting %"FMTu64"ms...\n", bytesOnTheAir, timeOnTheAir, waitTime);
-                            throttle_end = 0;
-                        }
-                        if (throttle_end > req->ws.requestpos + toBeSent) {
-                            // when sending partial content, round up to full frames
-                            if (toBeSent > 124) {
-                                toBeSent = (toBeSent / 124) * 124;
-                            }
-                            throttle_end = req->ws.requestpos + (u32)toBeSent;
-                        }
-                    }
+    WSChanSt* chan = &hub->ws.chan[tcpchan];
+    RequestSt* req;
+    int res, quantum = WS_SEND_QUANTUM;
+
+    while ((req = getNextReqToSend(hub, tcpchan)) != NULL && req->ws.prio == prio) {
+        int throttle_start = req->ws.requestpos;
+        int throttle_end = req->ws.requestsize;
+        if (throttle_end > WS_UPLOAD_FIRST_CHUNK && hub->ws.remoteVersion >= USB_META_WS_PROTO_V2 && tcpchan == 0) {
+            // Perform throttling on large uploads
+            if (req->ws.requestpos < WS_UPLOAD_FIRST_CHUNK) {
+                // First chunk is always sent at once
+                throttle_end = WS_UPLOAD_FIRST_CHUNK;
+                if (req->ws.requestpos == 0) {
+                    // Prepare to compute effective transfer rate
+                    chan->lastUploadAckBytes = 0;
+                    chan->lastUploadAckTime = 0;
+                    // Start with initial RTT based estimate
+                    hub->ws.uploadRate = hub->ws.tcpMaxWindowSize * 1000 / hub->ws.tcpRoundTripTime;
                 }
-                while (req->ws.requestpos < throttle_end) {
-                    int stream = YSTREAM_TCP;
-                    int datalen = throttle_end - req->ws.requestpos;
-                    if (datalen > WS_MAX_DATA_LEN) {
-                        datalen = WS_MAX_DATA_LEN;
-                    }
-                    if (req->ws.requestpos == 0) {
-                        req->ws.first_write_tm = yapiGetTickCount();
+            } else if (chan->lastUploadAckTime == 0) {
+                // first block not yet acked, wait more
+                //WSLOG("wait for first ack");
+                throttle_end = 0;
+            } else {
+                // adapt window frame to available bandwidth
+                int bytesOnTheAir = req->ws.requestpos - chan->lastUploadAckBytes;
+                u32 uploadRate = hub->ws.uploadRate;
+                u64 timeOnTheAir = (yapiGetTickCount() - chan->lastUploadAckTime);
+                u64 toBeSent = 2 * uploadRate + 1024 - bytesOnTheAir + (uploadRate * timeOnTheAir / 1000);
+                if (toBeSent + bytesOnTheAir > DEFAULT_TCP_MAX_WINDOW_SIZE) {
+                    toBeSent = DEFAULT_TCP_MAX_WINDOW_SIZE - bytesOnTheAir;
+                }
+                WSLOG("throttling: %d bytes/s (%"FMTu64" + %d = %"FMTu64")\n", hub->ws.uploadRate, toBeSent, bytesOnTheAir, bytesOnTheAir + toBeSent);
+                if (toBeSent < 64) {
+                    u64 waitTime = 1000 * (128 - toBeSent) / hub->ws.uploadRate;
+                    if (waitTime < 2) waitTime = 2;
+                    chan->next_transmit_tm = yapiGetTickCount() + waitTime;
+                    WSLOG("WS: %d sent %"FMTu64"ms ago, waiting %"FMTu64"ms...\n", bytesOnTheAir, timeOnTheAir, waitTime);
+                    throttle_end = 0;
+                }
+                if (throttle_end > req->ws.requestpos + toBeSent) {
+                    // when sending partial content, round up to full frames
+                    if (toBeSent > 124) {
+                        toBeSent = (toBeSent / 124) * 124;
                     }
+                    throttle_end = req->ws.requestpos + (u32)toBeSent;
+                }
+            }
+        }
+        while (req->ws.requestpos < throttle_end && quantum > 0) {
+            int stream = YSTREAM_TCP;
+            int datalen = throttle_end - req->ws.requestpos;
+            if (datalen > WS_MAX_DATA_LEN) {
+                datalen = WS_MAX_DATA_LEN;
+            }
+            if (req->ws.requestpos == 0) {
+                req->ws.first_write_tm = yapiGetTickCount();
+            }
 
-                    if (req->ws.asyncId && (req->ws.requestpos + datalen == req->ws.requestsize)) {
-                        // last frame of an async request
-                        u8 tmp_data[128];
-
-                        if (datalen == WS_MAX_DATA_LEN) {
-                            // last frame is already full we must send the async close in another one
-                            res = ws_sendFrame(hub, stream, tcpchan, req->ws.requestbuf + req->ws.requestpos, datalen, errmsg);
-                            if (YISERR(res)) {
-                                req->errcode = res;
-                                YSTRCPY(req->errmsg, YOCTO_ERRMSG_LEN, errmsg);
-                                yLeaveCriticalSection(&hub->ws.chan[tcpchan].access);
-                                ySetEvent(&req->finished);
-                                return res;
-                            }
-                            WSLOG("ws_req:%p: send %d bytes on chan%d (%d/%d)\n", req, datalen, tcpchan, req->ws.requestpos, req->ws.requestsize);
-                            req->ws.requestpos += datalen;
-                            datalen = 0;
-                        }
-                        stream = YSTREAM_TCP_ASYNCCLOSE;
-                        if (datalen) {
-                            memcpy(tmp_data, req->ws.requestbuf + req->ws.requestpos, datalen);
-                        }
-                        tmp_data[datalen] = req->ws.asyncId;
-                        res = ws_sendFrame(hub, stream, tcpchan, tmp_data, datalen + 1, errmsg);
-                        WSLOG("req(%s:%p) sent async close %d\n", req->hub->name, req, req->ws.asyncId);
-                        req->ws.last_write_tm = yapiGetTickCount();
-                    } else {
-                        res = ws_sendFrame(hub, stream, tcpchan, req->ws.requestbuf + req->ws.requestpos, datalen, errmsg);
-                        req->ws.last_write_tm = yapiGetTickCount();
-                        //WSLOG("ws_req:%p: sent %d bytes on chan%d (%d/%d)\n", req, datalen, tcpchan, req->ws.requestpos, req->ws.requestsize);
-                    }
+            if (req->ws.asyncId && (req->ws.requestpos + datalen == req->ws.requestsize)) {
+                // last frame of an async request
+                u8 tmp_data[128];
+
+                if (datalen == WS_MAX_DATA_LEN) {
+                    // last frame is already full we must send the async close in another one
+                    res = ws_sendFrame(hub, stream, tcpchan, req->ws.requestbuf + req->ws.requestpos, datalen, errmsg);
                     if (YISERR(res)) {
                         req->errcode = res;
                         YSTRCPY(req->errmsg, YOCTO_ERRMSG_LEN, errmsg);
-                        yLeaveCriticalSection(&hub->ws.chan[tcpchan].access);
                         ySetEvent(&req->finished);
                         return res;
                     }
+                    WSLOG("ws_req:%p: send %d bytes on chan%d (%d/%d)\n", req, datalen, tcpchan, req->ws.requestpos, req->ws.requestsize);
                     req->ws.requestpos += datalen;
+                    datalen = 0;
                 }
-                if (req->ws.requestpos < req->ws.requestsize) {
-                    int sent = req->ws.requestpos - throttle_start;
-                    // not completely sent, cannot do more for now
-                    if (sent && hub->ws.uploadRate > 0) {
-                        u64 waitTime = 1000 * sent / hub->ws.uploadRate;
-                        if (waitTime < 2) waitTime = 2;
-                        hub->ws.next_transmit_tm = yapiGetTickCount() + waitTime;
-                        WSLOG("Sent %dbytes, waiting %"FMTu64"ms...\n", sent, waitTime);
-                    } else {
-                        hub->ws.next_transmit_tm = yapiGetTickCount() + 100;
-                    }
-                    break;
+                stream = YSTREAM_TCP_ASYNCCLOSE;
+                if (datalen) {
+                    memcpy(tmp_data, req->ws.requestbuf + req->ws.requestpos, datalen);
                 }
+                tmp_data[datalen] = req->ws.asyncId;
+                res = ws_sendFrame(hub, stream, tcpchan, tmp_data, datalen + 1, errmsg);
+                WSLOG("req(%s:%p) sent async close %d\n", req->hub->name, req, req->ws.asyncId);
+                req->ws.last_write_tm = yapiGetTickCount();
+            } else {
+                res = ws_sendFrame(hub, stream, tcpchan, req->ws.requestbuf + req->ws.requestpos, datalen, errmsg);
+                req->ws.last_write_tm = yapiGetTickCount();
+                //WSLOG("ws_req:%p: sent %d bytes on chan%d (%d/%d)\n", req, datalen, tcpchan, req->ws.requestpos, req->ws.requestsize);
+            }
+            if (YISERR(res)) {
+                req->errcode = res;
+                YSTRCPY(req->errmsg, YOCTO_ERRMSG_LEN, errmsg);
+                ySetEvent(&req->finished);
+                return res;
             }
+            req->ws.requestpos += datalen;
+            quantum -= datalen;
         }
-        yLeaveCriticalSection(&hub->ws.chan[tcpchan].access);
+        if (req->ws.requestpos < throttle_end) {
+            // quantum exhausted, let the other channels send their data
+            *more = 1;
+            break;
+        }
+        if (req->ws.requestpos < req->ws.requestsize) {
+            int sent = req->ws.requestpos - throttle_start;
+            // not completely sent, cannot do more for now
+            if (sent && hub->ws.uploadRate > 0) {
+                u64 waitTime = 1000 * sent / hub->ws.uploadRate;
+                if (waitTime < 2) waitTime = 2;
+                chan->next_transmit_tm = yapiGetTickCount() + waitTime;
+                WSLOG("Sent %dbytes, waiting %"FMTu64"ms...\n", sent, waitTime);
+            } else {
+                chan->next_transmit_tm = yapiGetTickCount() + 100;
+            }
+            break;
+        }
+    }
+    return YAPI_SUCCESS;
+}
+
+/*
+*   look through all pending request if there is some data that we can send.
+*   Channels are served in turn, WS_SEND_QUANTUM bytes at a time, so that a
+*   large upload does not delay the requests of the other channels, and the
+*   interactive requests are served before the bulk ones in each round.
+*/
+static int ws_processRequests(HubSt* hub, char* errmsg)
+{
+    int tcpchan, prio, more;
+    int res;
+    u64 now = yapiGetTickCount();
+
+    do {
+        more = 0;
+        for (prio = WS_PRIO_INTERACTIVE; prio <= WS_PRIO_BULK; prio++) {
+            for (tcpchan = 0; tcpchan < MAX_ASYNC_TCPCHAN; tcpchan++) {
+                if (hub->ws.chan[tcpchan].next_transmit_tm > now) {
+                    //WSLOG("skip reqProcess on chan%d\n", tcpchan);
+                    continue;
+                }
+                yEnterCriticalSection(&hub->ws.chan[tcpchan].access);
+                res = YAPI_SUCCESS;
+                if (hub->ws.chan[tcpchan].requests) {
+                    res = ws_processChannel(hub, tcpchan, prio, &more, errmsg);
+                }
+                yLeaveCriticalSection(&hub->ws.chan[tcpchan].access);
+                if (YISERR(res)) {
+                    return res;
+                }
+            }
+        }
+    } while (more);
 
+    // wake up for the next throttled transmission
+    hub->ws.next_transmit_tm = 0;
+    for (tcpchan = 0; tcpchan < MAX_ASYNC_TCPCHAN; tcpchan++) {
+        u64 tm = hub->ws.chan[tcpchan].next_transmit_tm;
+        if (tm > now && (hub->ws.next_transmit_tm == 0 || tm < hub->ws.next_transmit_tm)) {
+            hub->ws.next_transmit_tm = tm;
+        }
     }
     return YAPI_SUCCESS;
 }
@@ -2598,6 +3119,27 @@ static void ws_closeBaseSocket(struct _WSNetHubSt* base_req)
 }
 
 
+/*
+*   read available data of the base socket into the main fifo
+*/
+static int ws_threadRead(struct _WSNetHubSt* base_req, char* errmsg)
+{
+    int avail = yFifoGetFree(&base_req->mainfifo);
+    int readed = 0;
+    if (avail) {
+        u8 buffer[2048];
+        if (avail > 2048) {
+            avail = 2048;
+        }
+        readed = yTcpRead(base_req->skt, buffer, avail, errmsg);
+        if (readed > 0) {
+            yPushFifo(&base_req->mainfifo, buffer, readed);
+        }
+    }
+    return readed;
+}
+
+
 /*
 *   select used by background thread
 */
@@ -2647,19 +3189,7 @@ static int ws_thread_select(struct _WSNetHubSt* base_req, u64 ms, WakeUpSocket*
             YPROPERR(signal);
         }
         if (FD_ISSET(base_req->skt, &fds)) {
-            int avail = yFifoGetFree(&base_req->mainfifo);
-            int readed = 0;
-            if (avail) {
-                u8 buffer[2048];
-                if (avail > 2048) {
-                    avail = 2048;
-                }
-                readed = yTcpRead(base_req->skt, buffer, avail, errmsg);
-                if (readed > 0) {
-                    yPushFifo(&base_req->mainfifo, buffer, readed);
-                }
-            }
-            return readed;
+            return ws_threadRead(base_req, errmsg);
         }
     }
     return YAPI_SUCCESS;
@@ -2678,20 +3208,249 @@ static void ws_threadUpdateRetryCount(HubSt* hub)
 #endif
 }
 
+/*
+*   Open the base socket of a WebSocket hub and reset the connection state
+*/
+static int ws_threadConnect(HubSt* hub, char* errmsg)
+{
+    int res;
+
+    res = ws_openBaseSocket(hub, 1, 1000, errmsg);
+    hub->lastAttempt = yapiGetTickCount();
+    if (YISERR(res)) {
+        yEnterCriticalSection(&hub->access);
+        hub->errcode = ySetErr(res, hub->errmsg, errmsg, NULL, 0);
+        yLeaveCriticalSection(&hub->access);
+        ws_threadUpdateRetryCount(hub);
+        return res;
+    }
+    WSLOG("hub(%s) base socket opened (skt=%x)\n", hub->name, hub->ws.skt);
+    hub->state = NET_HUB_TRYING;
+    hub->ws.base_state = WS_BASE_HEADER_SENT;
+    hub->ws.connectionTime = 0;
+    hub->ws.tcpRoundTripTime = DEFAULT_TCP_ROUND_TRIP_TIME;
+    hub->ws.tcpMaxWindowSize = DEFAULT_TCP_MAX_WINDOW_SIZE;
+    errmsg[0] = 0;
+    return YAPI_SUCCESS;
+}
+
+/*
+*   Parse the data received on the base socket (res is the number of bytes
+*   just read, or an error code), then send pending requests
+*/
+static int ws_threadProcess(HubSt* hub, int res, char* errmsg)
+{
+    char* p;
+    u8 header[8];
+
+    if (res > 0) {
+        int need_more_data = 0;
+        int avail, rw;
+        int hdrlen;
+        u32 mask;
+        int websocket_ok = 0;
+        int pktlen;
+        do {
+            u16 pos;
+            //something to handle;
+            switch (hub->ws.base_state) {
+            case WS_BASE_HEADER_SENT:
+                pos = ySeekFifo(&hub->ws.mainfifo, (const u8*)"\r\n\r\n", 4, 0, 0, 0);
+                if (pos == 0xffff) {
+                    if ((u64)(yapiGetTickCount() - hub->lastAttempt) > WS_CONNEXION_TIMEOUT) {
+                        res = YERR(YAPI_TIMEOUT);
+                    } else {
+                        need_more_data = 1;
+                    }
+                    break;
+                } else if (pos >= 2044) {
+                    res = YERRMSG(YAPI_IO_ERROR, "Bad reply header");
+                    // fatal error do not retry to reconnect
+                    hub->state = NET_HUB_TOCLOSE;
+                    break;
+                }
+                pos = ySeekFifo(&hub->ws.mainfifo, (const u8*)"\r\n", 2, 0, 0, 0);
+                yPopFifo(&hub->ws.mainfifo, (u8*)hub->ws.frame_buf, pos + 2);
+                if (YSTRNCMP(hub->ws.frame_buf, "HTTP/1.1 ", 9) != 0) {
+                    res = YERRMSG(YAPI_IO_ERROR, "Bad reply header");
+                    // fatal error do not retry to reconnect
+                    hub->state = NET_HUB_TOCLOSE;
+                    break;
+                }
+                p = hub->ws.frame_buf + 9;
+                if (YSTRNCMP(p, "101", 3) != 0) {
+                    res = YERRMSG(YAPI_IO_ERROR, "hub does not support WebSocket");
+                    // fatal error do not retry to reconnect
+                    hub->state = NET_HUB_TOCLOSE;
+                    break;
+                }
+                websocket_ok = 0;
+                pos = ySeekFifo(&hub->ws.mainfifo, (const u8*)"\r\n", 2, 0, 0, 0);
+                while (pos != 0) {
+                    yPopFifo(&hub->ws.mainfifo, (u8*)hub->ws.frame_buf, pos + 2);
+                    if (pos > 22 && YSTRNICMP(hub->ws.frame_buf, "Sec-WebSocket-Accept: ", 22) == 0) {
+                        if (!VerifyWebsocketKey(hub->ws.frame_buf + 22, pos, hub->ws.websocket_key, hub->ws.websocket_key_len)) {
+                            websocket_ok = 1;
+                        } else {
+                            res = YERRMSG(YAPI_IO_ERROR, "hub does not use same WebSocket protocol");
+                            // fatal error do not retry to reconnect
+                            hub->state = NET_HUB_TOCLOSE;
+                            break;
+                        }
+                    }
+                    if ((u64)(yapiGetTickCount() - hub->lastAttempt) > WS_CONNEXION_TIMEOUT) {
+                        res = YERR(YAPI_TIMEOUT);
+                        break;
+                    }
+                    pos = ySeekFifo(&hub->ws.mainfifo, (const u8*)"\r\n", 2, 0, 0, 0);
+                }
+                yPopFifo(&hub->ws.mainfifo, NULL, 2);
+                if (websocket_ok) {
+                    hub->ws.base_state = WS_BASE_SOCKET_UPGRADED;
+                    hub->ws.frame_ofs = 0;
+                } else {
+                    res = YERRMSG(YAPI_IO_ERROR, "Invalid WebSocket header");
+                    // fatal error do not retry to reconnect
+                    hub->state = NET_HUB_TOCLOSE;
+                }
+                break;
+            case WS_BASE_SOCKET_UPGRADED:
+            case WS_BASE_AUTHENTICATING:
+            case WS_BASE_CONNECTED:
+
+                avail = yFifoGetUsed(&hub->ws.mainfifo);
+                if (avail < 2) {
+                    need_more_data = 1;
+                    break;
+                }
+                rw = (avail < 7 ? avail : 7);
+                yPeekFifo(&hub->ws.mainfifo, header, rw, 0);
+                pktlen = header[1] & 0x7f;
+                if (pktlen > 125) {
+                    // Unsupported long frame, drop all incoming data (probably 1+ frame(s))
+                    res = YERRMSG(YAPI_IO_ERROR, "Unsupported long websocket frame");
+                    break;
+                }
+
+                if (header[1] & 0x80) {
+                    // masked frame
+                    hdrlen = 6;
+                    if (avail < hdrlen + pktlen) {
+                        need_more_data = 1;
+                        break;
+                    }
+                    memcpy(&mask, header + 2, sizeof(u32));
+                } else {
+                    // plain frame
+                    hdrlen = 2;
+                    if (avail < hdrlen + pktlen) {
+                        need_more_data = 1;
+                        break;
+                    }
+                    mask = 0;
+                }
+
+                if ((header[0] & 0x7f) != 0x02) {
+                    // Non-data frame
+                    if (header[0] == 0x88) {
+                        //if (USBTCPIsPutReady(sock) < 8) return;
+                        // websocket close, reply with a close
+                        header[0] = 0x88;
+                        header[1] = 0x82;
+                        mask = YRand32();
+                        memcpy(header + 2, &mask, sizeof(u32));
+                        header[6] = 0x03 ^ ((u8 *)&mask)[0];
+                        header[7] = 0xe8 ^ ((u8 *)&mask)[1];
+                        res = yTcpWrite(hub->ws.skt, (char*)header, 8, errmsg);
+                        if (YISERR(res)) {
+                            break;
+                        }
+                        res = YAPI_NO_MORE_DATA;
+                        YSTRCPY(errmsg, YOCTO_ERRMSG_LEN,"WebSocket connection close received");
+                        hub->ws.base_state = WS_BASE_OFFLINE;
+#ifdef DEBUG_WEBSOCKET
+                        dbglog("WS: io error on base socket of %s(%X): %s\n", hub->name, hub->url, errmsg);
+#endif
+                    } else {
+                        // unhandled packet
+                        dbglog("unhandled packet:%x%x\n", header[0], header[1]);
+                    }
+                    yPopFifo(&hub->ws.mainfifo, NULL, hdrlen + pktlen);
+                    break;
+                }
+                // drop frame header
+                yPopFifo(&hub->ws.mainfifo, NULL, hdrlen);
+                // append
+                yPopFifo(&hub->ws.mainfifo, (u8*)hub->ws.frame_buf + hub->ws.frame_ofs, pktlen);
+                if (mask) {
+                    int i;
+                    for (i = 0; i < (pktlen + 1 + 3) >> 2; i++) {
+                        hub->ws.frame_buf[hub->ws.frame_ofs + i] ^= mask;
+                    }
+                }
+
+                if (header[0] == 0x02) {
+                    //  fragmented binary frame
+                    WSStreamHead strym;
+                    strym.encaps = hub->ws.frame_buf[hub->ws.frame_ofs];
+                    if (strym.stream == YSTREAM_META) {
+                        // unsupported fragmented META stream, should never happen
+                        dbglog("Warning:fragmented META\n");
+                        break;
+                    }
+                    hub->ws.frame_ofs += pktlen;
+                    break;
+                }
+                request_pending_logs(hub);
+                res = ws_parseIncommingFrame(hub, (u8*)hub->ws.frame_buf, hub->ws.frame_ofs + pktlen, errmsg);
+                if (YISERR(res)) {
+                    WSLOG("hub(%s) ws_parseIncommingFrame error %d:%s\n", hub->name, res, errmsg);
+                    break;
+                }
+                hub->ws.frame_ofs = 0;
+                break;
+            case WS_BASE_OFFLINE:
+                break;
+            }
+        } while (!need_more_data && !YISERR(res));
+    }
+    if (!YISERR(res)) {
+        res = ws_processRequests(hub, errmsg);
+        if (YISERR(res)) {
+            WSLOG("hub(%s) ws_processRequests error %d:%s\n", hub->name, res, errmsg);
+        }
+    }
+    return res;
+}
+
+/*
+*   Record the error that ended the connection and close the base socket
+*/
+static void ws_threadDisconnect(HubSt* hub, int res, char* errmsg)
+{
+    if (YISERR(res)) {
+        WSLOG("hub(%s) io error %d:%s\n", hub->name,res, errmsg);
+        yEnterCriticalSection(&hub->access);
+        hub->errcode = ySetErr(res, hub->errmsg, errmsg, NULL, 0);
+        yLeaveCriticalSection(&hub->access);
+        ws_threadUpdateRetryCount(hub);
+    }
+    WSLOG("hub(%s) close base socket %d:%s\n", hub->name, res, errmsg);
+    ws_closeBaseSocket(&hub->ws);
+    if (hub->state != NET_HUB_TOCLOSE) {
+        hub->state = NET_HUB_DISCONNECTED;
+    }
+}
+
 /**
  *   Background  thread for WebSocket Hub
  */
 void* ws_thread(void* ctx)
 {
-    char* p;
     yThread* thread = (yThread*)ctx;
     char errmsg[YOCTO_ERRMSG_LEN];
     HubSt* hub = (HubSt*)thread->ctx;
     int res;
-    int first_notification_connection = 1;
-    u8 header[8];
-    char buffer[2048];
-    int buffer_ofs = 0;
     int continue_processing;
 
 
@@ -2711,22 +3470,10 @@ void* ws_thread(void* ctx)
         if (hub->state == NET_HUB_TOCLOSE) {
             break;
         }
-        res = ws_openBaseSocket(hub, first_notification_connection, 1000, errmsg);
-        hub->lastAttempt = yapiGetTickCount();
+        res = ws_threadConnect(hub, errmsg);
         if (YISERR(res)) {
-            yEnterCriticalSection(&hub->access);
-            hub->errcode = ySetErr(res, hub->errmsg, errmsg, NULL, 0);
-            yLeaveCriticalSection(&hub->access);
-            ws_threadUpdateRetryCount(hub);
             continue;
         }
-        WSLOG("hub(%s) base socket opened (skt=%x)\n", hub->name, hub->ws.skt);
-        hub->state = NET_HUB_TRYING;
-        hub->ws.base_state = WS_BASE_HEADER_SENT;
-        hub->ws.connectionTime = 0;
-        hub->ws.tcpRoundTripTime = DEFAULT_TCP_ROUND_TRIP_TIME;
-        hub->ws.tcpMaxWindowSize = DEFAULT_TCP_MAX_WINDOW_SIZE;
-        errmsg[0] = 0;
         continue_processing = 1;
         do {
             u64 wait;
@@ -2741,210 +3488,370 @@ void* ws_thread(void* ctx)
             if (YISERR(res)) {
                 WSLOG("hub(%s) ws_thread_select error %d:%s\n", hub->name, res, errmsg);
             }
+            res = ws_threadProcess(hub, res, errmsg);
+            if (YISERR(res)) {
+                continue_processing = 0;
+            } else if ((yThreadMustEnd(thread) || hub->state == NET_HUB_TOCLOSE) && !ws_requestStillPending(hub)) {
+                continue_processing = 0;
+            }
+        } while (continue_processing);
+        ws_threadDisconnect(hub, res, errmsg);
+    }
+    WSLOG("hub(%s) exit thread \n", hub->name);
+    hub->state = NET_HUB_CLOSED;
+    yThreadSignalEnd(thread);
+    return NULL;
+}
 
-            if (res > 0) {
-                int need_more_data = 0;
-                int avail, rw;
-                int hdrlen;
-                u32 mask;
-                int websocket_ok = 0;
-                int pktlen;
-                do {
-                    u16 pos;
-                    //something to handle;
-                    switch (hub->ws.base_state) {
-                    case WS_BASE_HEADER_SENT:
-                        pos = ySeekFifo(&hub->ws.mainfifo, (const u8*)"\r\n\r\n", 4, 0, 0, 0);
-                        if (pos == 0xffff) {
-                            if ((u64)(yapiGetTickCount() - hub->lastAttempt) > WS_CONNEXION_TIMEOUT) {
-                                res = YERR(YAPI_TIMEOUT);
-                            } else {
-                                need_more_data = 1;
-                            }
-                            break;
-                        } else if (pos >= 2044) {
-                            res = YERRMSG(YAPI_IO_ERROR, "Bad reply header");
-                            // fatal error do not retry to reconnect
-                            hub->state = NET_HUB_TOCLOSE;
-                            break;
-                        }
-                        pos = ySeekFifo(&hub->ws.mainfifo, (const u8*)"\r\n", 2, 0, 0, 0);
-                        yPopFifo(&hub->ws.mainfifo, (u8*)buffer, pos + 2);
-                        if (YSTRNCMP(buffer, "HTTP/1.1 ", 9) != 0) {
-                            res = YERRMSG(YAPI_IO_ERROR, "Bad reply header");
-                            // fatal error do not retry to reconnect
-                            hub->state = NET_HUB_TOCLOSE;
-                            break;
-                        }
-                        p = buffer + 9;
-                        if (YSTRNCMP(p, "101", 3) != 0) {
-                            res = YERRMSG(YAPI_IO_ERROR, "hub does not support WebSocket");
-                            // fatal error do not retry to reconnect
-                            hub->state = NET_HUB_TOCLOSE;
-                            break;
-                        }
-                        websocket_ok = 0;
-                        pos = ySeekFifo(&hub->ws.mainfifo, (const u8*)"\r\n", 2, 0, 0, 0);
-                        while (pos != 0) {
-                            yPopFifo(&hub->ws.mainfifo, (u8*)buffer, pos + 2);
-                            if (pos > 22 && YSTRNICMP(buffer, "Sec-WebSocket-Accept: ", 22) == 0) {
-                                if (!VerifyWebsocketKey(buffer + 22, pos, hub->ws.websocket_key, hub->ws.websocket_key_len)) {
-                                    websocket_ok = 1;
-                                } else {
-                                    res = YERRMSG(YAPI_IO_ERROR, "hub does not use same WebSocket protocol");
-                                    // fatal error do not retry to reconnect
-                                    hub->state = NET_HUB_TOCLOSE;
-                                    break;
-                                }
-                            }
-                            if ((u64)(yapiGetTickCount() - hub->lastAttempt) > WS_CONNEXION_TIMEOUT) {
-                                res = YERR(YAPI_TIMEOUT);
-                                break;
-                            }
-                            pos = ySeekFifo(&hub->ws.mainfifo, (const u8*)"\r\n", 2, 0, 0, 0);
-                        }
-                        yPopFifo(&hub->ws.mainfifo, NULL, 2);
-                        if (websocket_ok) {
-                            hub->ws.base_state = WS_BASE_SOCKET_UPGRADED;
-                            buffer_ofs = 0;
-                        } else {
-                            res = YERRMSG(YAPI_IO_ERROR, "Invalid WebSocket header");
-                            // fatal error do not retry to reconnect
-                            hub->state = NET_HUB_TOCLOSE;
-                        }
-                        break;
-                    case WS_BASE_SOCKET_UPGRADED:
-                    case WS_BASE_AUTHENTICATING:
-                    case WS_BASE_CONNECTED:
+#ifdef YAPI_USE_EPOLL
 
-                        avail = yFifoGetUsed(&hub->ws.mainfifo);
-                        if (avail < 2) {
-                            need_more_data = 1;
-                            break;
-                        }
-                        rw = (avail < 7 ? avail : 7);
-                        yPeekFifo(&hub->ws.mainfifo, header, rw, 0);
-                        pktlen = header[1] & 0x7f;
-                        if (pktlen > 125) {
-                            // Unsupported long frame, drop all incoming data (probably 1+ frame(s))
-                            res = YERRMSG(YAPI_IO_ERROR, "Unsupported long websocket frame");
-                            break;
-                        }
+/**
+ *   One iteration of the WebSocket hub I/O, used by the event loops in
+ *   place of ws_thread
+ */
+int ws_step(HubSt* hub, int mode, YSOCKET* skts, int* nbskts, char* errmsg)
+{
+    int res, readed;
+    u64 now;
 
-                        if (header[1] & 0x80) {
-                            // masked frame
-                            hdrlen = 6;
-                            if (avail < hdrlen + pktlen) {
-                                need_more_data = 1;
-                                break;
-                            }
-                            memcpy(&mask, header + 2, sizeof(u32));
-                        } else {
-                            // plain frame
-                            hdrlen = 2;
-                            if (avail < hdrlen + pktlen) {
-                                need_more_data = 1;
-                                break;
-                            }
-                            mask = 0;
-                        }
+    if (mode == YNET_STEP_ABORT) {
+        if (hub->ws.skt != INVALID_SOCKET) {
+            ws_closeBaseSocket(&hub->ws);
+        }
+        hub->state = NET_HUB_CLOSED;
+        return -1;
+    }
+    if (hub->ws.skt == INVALID_SOCKET) {
+        if (mode == YNET_STEP_END || hub->state == NET_HUB_TOCLOSE) {
+            hub->state = NET_HUB_CLOSED;
+            return -1;
+        }
+        now = yapiGetTickCount();
+        if (hub->retryCount > 0 && hub->ws.reconnect_tm > now) {
+            return (int)(hub->ws.reconnect_tm - now);
+        }
+        WSLOG("hub(%s) try to open base socket (%d/%dms/%d)\n", hub->name, hub->retryCount, hub->attemptDelay, hub->state);
+        if (YISERR(ws_threadConnect(hub, errmsg))) {
+            hub->ws.reconnect_tm = yapiGetTickCount() + hub->attemptDelay;
+            return (int)hub->attemptDelay;
+        }
+    }
+    // the socket is polled in edge-triggered mode, read until it would block
+    do {
+        readed = ws_threadRead(&hub->ws, errmsg);
+        res = ws_threadProcess(hub, readed, errmsg);
+    } while (readed > 0 && !YISERR(res));
+
+    if (YISERR(res) || ((mode == YNET_STEP_END || hub->state == NET_HUB_TOCLOSE) && !ws_requestStillPending(hub))) {
+        ws_threadDisconnect(hub, res, errmsg);
+        if (mode == YNET_STEP_END || hub->state == NET_HUB_TOCLOSE) {
+            hub->state = NET_HUB_CLOSED;
+            return -1;
+        }
+        hub->ws.reconnect_tm = yapiGetTickCount() + hub->attemptDelay;
+        return (int)hub->attemptDelay;
+    }
+    skts[(*nbskts)++] = hub->ws.skt;
+    now = yapiGetTickCount();
+    if (hub->ws.next_transmit_tm >= now) {
+        return (int)(hub->ws.next_transmit_tm - now);
+    }
+    return 1000;
+}
 
-                        if ((header[0] & 0x7f) != 0x02) {
-                            // Non-data frame
-                            if (header[0] == 0x88) {
-                                //if (USBTCPIsPutReady(sock) < 8) return;
-                                // websocket close, reply with a close
-                                header[0] = 0x88;
-                                header[1] = 0x82;
-                                mask = YRand32();
-                                memcpy(header + 2, &mask, sizeof(u32));
-                                header[6] = 0x03 ^ ((u8 *)&mask)[0];
-                                header[7] = 0xe8 ^ ((u8 *)&mask)[1];
-                                res = yTcpWrite(hub->ws.skt, (char*)header, 8, errmsg);
-                                if (YISERR(res)) {
-                                    break;
-                                }
-                                res = YAPI_NO_MORE_DATA;
-                                YSTRCPY(errmsg, YOCTO_ERRMSG_LEN,"WebSocket connection close received");
-                                hub->ws.base_state = WS_BASE_OFFLINE;
-#ifdef DEBUG_WEBSOCKET
-                                dbglog("WS: io error on base socket of %s(%X): %s\n", hub->name, hub->url, errmsg);
-#endif
-                            } else {
-                                // unhandled packet
-                                dbglog("unhandled packet:%x%x\n", header[0], header[1]);
-                            }
-                            yPopFifo(&hub->ws.mainfifo, NULL, hdrlen + pktlen);
-                            break;
-                        }
-                        // drop frame header
-                        yPopFifo(&hub->ws.mainfifo, NULL, hdrlen);
-                        // append
-                        yPopFifo(&hub->ws.mainfifo, (u8*)buffer + buffer_ofs, pktlen);
-                        if (mask) {
-                            int i;
-                            for (i = 0; i < (pktlen + 1 + 3) >> 2; i++) {
-                                buffer[buffer_ofs + i] ^= mask;
-                            }
-                        }
 
-                        if (header[0] == 0x02) {
-                            //  fragmented binary frame
-                            WSStreamHead strym;
-                            strym.encaps = buffer[buffer_ofs];
-                            if (strym.stream == YSTREAM_META) {
-                                // unsupported fragmented META stream, should never happen
-                                dbglog("Warning:fragmented META\n");
-                                break;
-                            }
-                            buffer_ofs += pktlen;
-                            break;
-                        }
-                        request_pending_logs(hub);
-                        res = ws_parseIncommingFrame(hub, (u8*)buffer, buffer_ofs + pktlen, errmsg);
-                        if (YISERR(res)) {
-                            WSLOG("hub(%s) ws_parseIncommingFrame error %d:%s\n", hub->name, res, errmsg);
-                            break;
-                        }
-                        buffer_ofs = 0;
-                        break;
-                    case WS_BASE_OFFLINE:
-                        break;
-                    }
-                } while (!need_more_data && !YISERR(res));
+/********************************************************************************
+ * Event loops driving the network hubs (epoll)
+ *******************************************************************************/
+
+#define YNET_LOOP_MAX_EVENTS 64
+
+typedef struct {
+    HubSt*          hub;
+    yNetHubStep     step;
+    u64             next_tm;    // next time the hub must be stepped even without I/O
+    int             ready;      // I/O occured on one of the hub sockets
+    int             done;       // the step function has closed the hub
+    int             busy;       // the hub is being stepped, outside of the loop lock
+} yNetLoopHub;
+
+typedef struct {
+    yThread             thread;
+    int                 epfd;
+    WakeUpSocket        wuce;
+    yCRITICAL_SECTION   access;
+    int                 nbhubs;
+    yNetLoopHub         hubs[NBMAX_NET_HUB];
+} yNetLoopSt;
+
+static yNetLoopSt yNetLoops[YAPI_NET_LOOP_COUNT];
+static int yNetLoopsStarted = 0;
+
+
+static int yNetLoopWatch(yNetLoopSt* loop, YSOCKET skt, void* ptr)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = ptr;
+    // sockets stay registered until they are closed
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, skt, &ev) < 0 && errno != EEXIST) {
+        return -1;
+    }
+    return 0;
+}
+
+static void yNetLoopStepHub(yNetLoopSt* loop, yNetLoopHub* lh)
+{
+    YSOCKET skts[YNET_HUB_MAX_SKT];
+    char errmsg[YOCTO_ERRMSG_LEN];
+    u8 signal[16];
+    int i, nbskts = 0, delay;
+    HubSt* hub = lh->hub;
+
+    lh->ready = 0;
+    // drain the hub wake-up socket
+    while (yrecv(hub->wuce.listensock, (char*)signal, sizeof(signal), MSG_DONTWAIT) > 0);
+    delay = lh->step(hub, yThreadMustEnd(&hub->net_thread) ? YNET_STEP_END : YNET_STEP_RUN, skts, &nbskts, errmsg);
+    if (delay < 0) {
+        lh->done = 1;
+        lh->next_tm = (u64)-1;
+        yThreadSignalEnd(&hub->net_thread);
+        return;
+    }
+    for (i = 0; i < nbskts; i++) {
+        if (yNetLoopWatch(loop, skts[i], lh) < 0) {
+            dbglog("hub(%s) unable to watch socket %d (errno=%d)\n", hub->name, skts[i], errno);
+        }
+    }
+    lh->next_tm = yapiGetTickCount() + delay;
+}
+
+static void* yNetLoop_thread(void* ctx)
+{
+    yThread* thread = (yThread*)ctx;
+    yNetLoopSt* loop = (yNetLoopSt*)thread->ctx;
+    struct epoll_event events[YNET_LOOP_MAX_EVENTS];
+    yNetLoopHub* tostep[NBMAX_NET_HUB];
+    u8 signal[16];
+    int i, nbev, nbstep, timeout;
+    u64 now, next;
+
+    yThreadSignalStart(thread);
+    while (!yThreadMustEnd(thread)) {
+        yEnterCriticalSection(&loop->access);
+        now = yapiGetTickCount();
+        next = now + 1000;
+        for (i = 0; i < NBMAX_NET_HUB; i++) {
+            if (loop->hubs[i].hub && loop->hubs[i].next_tm < next) {
+                next = loop->hubs[i].next_tm;
             }
-            if (!YISERR(res)) {
-                res = ws_processRequests(hub, errmsg);
-                if (YISERR(res)) {
-                    WSLOG("hub(%s) ws_processRequests error %d:%s\n", hub->name, res, errmsg);
-                }
+        }
+        yLeaveCriticalSection(&loop->access);
+        timeout = (next > now ? (int)(next - now) : 0);
+        nbev = epoll_wait(loop->epfd, events, YNET_LOOP_MAX_EVENTS, timeout);
+        if (nbev < 0) {
+            if (errno != EINTR) {
+                dbglog("epoll_wait failed (errno=%d)\n", errno);
+                yApproximateSleep(100);
             }
-
-            if (YISERR(res)) {
-                continue_processing = 0;
-            } else if ((yThreadMustEnd(thread) || hub->state == NET_HUB_TOCLOSE) && !ws_requestStillPending(hub)) {
-                continue_processing = 0;
+            continue;
+        }
+        yEnterCriticalSection(&loop->access);
+        for (i = 0; i < nbev; i++) {
+            yNetLoopHub* lh = (yNetLoopHub*)events[i].data.ptr;
+            if (lh == NULL) {
+                while (yrecv(loop->wuce.listensock, (char*)signal, sizeof(signal), MSG_DONTWAIT) > 0);
+            } else {
+                lh->ready = 1;
+            }
+        }
+        now = yapiGetTickCount();
+        nbstep = 0;
+        for (i = 0; i < NBMAX_NET_HUB; i++) {
+            yNetLoopHub* lh = &loop->hubs[i];
+            if (lh->hub && !lh->done && (lh->ready || lh->next_tm <= now)) {
+                lh->busy = 1;
+                tostep[nbstep++] = lh;
             }
-        } while (continue_processing);
-        if (YISERR(res)) {
-            WSLOG("hub(%s) io error %d:%s\n", hub->name,res, errmsg);
-            yEnterCriticalSection(&hub->access);
-            hub->errcode = ySetErr(res, hub->errmsg, errmsg, NULL, 0);
-            yLeaveCriticalSection(&hub->access);
-            ws_threadUpdateRetryCount(hub);
         }
-        WSLOG("hub(%s) close base socket %d:%s\n", hub->name, res, errmsg);
-        ws_closeBaseSocket(&hub->ws);
-        if (hub->state != NET_HUB_TOCLOSE) {
-            hub->state = NET_HUB_DISCONNECTED;
+        yLeaveCriticalSection(&loop->access);
+        // step functions may block (connect, handshake), so they run without
+        // the loop lock; busy hubs cannot be removed meanwhile
+        for (i = 0; i < nbstep; i++) {
+            yNetLoopStepHub(loop, tostep[i]);
+        }
+        if (nbstep > 0) {
+            yEnterCriticalSection(&loop->access);
+            for (i = 0; i < nbstep; i++) {
+                tostep[i]->busy = 0;
+            }
+            yLeaveCriticalSection(&loop->access);
         }
     }
-    WSLOG("hub(%s) exit thread \n", hub->name);
-    hub->state = NET_HUB_CLOSED;
     yThreadSignalEnd(thread);
     return NULL;
 }
 
+static int yNetLoopStart(char* errmsg)
+{
+    int i, flags;
+
+    for (i = 0; i < YAPI_NET_LOOP_COUNT; i++) {
+        yNetLoopSt* loop = &yNetLoops[i];
+        memset(loop, 0, sizeof(yNetLoopSt));
+        yInitWakeUpSocket(&loop->wuce);
+        loop->epfd = epoll_create(NBMAX_NET_HUB);
+        if (loop->epfd < 0) {
+            return yNetSetErr();
+        }
+        YPROPERR(yStartWakeUpSocket(&loop->wuce, errmsg));
+        flags = fcntl(loop->wuce.listensock, F_GETFL, 0);
+        fcntl(loop->wuce.listensock, F_SETFL, flags | O_NONBLOCK);
+        if (yNetLoopWatch(loop, loop->wuce.listensock, NULL) < 0) {
+            return yNetSetErr();
+        }
+        yInitializeCriticalSection(&loop->access);
+        if (yThreadCreate(&loop->thread, yNetLoop_thread, loop) < 0) {
+            yDeleteCriticalSection(&loop->access);
+            return YERRMSG(YAPI_IO_ERROR, "Unable to start event loop thread");
+        }
+    }
+    yNetLoopsStarted = 1;
+    return YAPI_SUCCESS;
+}
+
+static void yNetLoopStop(void)
+{
+    int i;
+    char errmsg[YOCTO_ERRMSG_LEN];
+
+    if (!yNetLoopsStarted) {
+        return;
+    }
+    for (i = 0; i < YAPI_NET_LOOP_COUNT; i++) {
+        yNetLoopSt* loop = &yNetLoops[i];
+        u64 timeref = yapiGetTickCount();
+        yThreadRequestEnd(&loop->thread);
+        yDringWakeUpSocket(&loop->wuce, 0, errmsg);
+        while (yThreadIsRunning(&loop->thread) && (yapiGetTickCount() - timeref < YIO_DEFAULT_TCP_TIMEOUT)) {
+            yApproximateSleep(10);
+        }
+        yThreadKill(&loop->thread);
+        yDeleteCriticalSection(&loop->access);
+        yFreeWakeUpSocket(&loop->wuce);
+        close(loop->epfd);
+    }
+    yNetLoopsStarted = 0;
+}
+
+/*
+ *   Have a hub driven by the least loaded event loop. The hub wake-up socket
+ *   must be started. The hub net_thread state is maintained as if the hub had
+ *   its own thread, so that yThreadRequestEnd() and yThreadIsRunning() work
+ *   the same.
+ */
+int yNetLoopAddHub(HubSt* hub, yNetHubStep step, char* errmsg)
+{
+    yNetLoopSt* loop;
+    yNetLoopHub* lh = NULL;
+    int i, flags, nbhubs, minhubs = 0, res = YAPI_SUCCESS;
+
+    yEnterCriticalSection(&yNetLoopsCS);
+    if (!yNetLoopsStarted) {
+        res = yNetLoopStart(errmsg);
+    }
+    yLeaveCriticalSection(&yNetLoopsCS);
+    YPROPERR(res);
+
+    loop = NULL;
+    for (i = 0; i < YAPI_NET_LOOP_COUNT; i++) {
+        yEnterCriticalSection(&yNetLoops[i].access);
+        nbhubs = yNetLoops[i].nbhubs;
+        yLeaveCriticalSection(&yNetLoops[i].access);
+        if (loop == NULL || nbhubs < minhubs) {
+            loop = &yNetLoops[i];
+            minhubs = nbhubs;
+        }
+    }
+    flags = fcntl(hub->wuce.listensock, F_GETFL, 0);
+    fcntl(hub->wuce.listensock, F_SETFL, flags | O_NONBLOCK);
+
+    yEnterCriticalSection(&loop->access);
+    for (i = 0; i < NBMAX_NET_HUB; i++) {
+        if (loop->hubs[i].hub == NULL) {
+            lh = &loop->hubs[i];
+            break;
+        }
+    }
+    if (lh == NULL) {
+        yLeaveCriticalSection(&loop->access);
+        return YERRMSG(YAPI_IO_ERROR, "Too many hubs on event loop");
+    }
+    lh->hub = hub;
+    lh->step = step;
+    lh->next_tm = 0;
+    lh->ready = 0;
+    lh->done = 0;
+    hub->net_thread.st = YTHREAD_RUNNING;
+    if (yNetLoopWatch(loop, hub->wuce.listensock, lh) < 0) {
+        res = yNetSetErr();
+        lh->hub = NULL;
+        hub->net_thread.st = YTHREAD_NOT_STARTED;
+    } else {
+        loop->nbhubs++;
+    }
+    yLeaveCriticalSection(&loop->access);
+    if (!YISERR(res)) {
+        yDringWakeUpSocket(&loop->wuce, 1, errmsg);
+    }
+    return res;
+}
+
+/*
+ *   Detach a hub from its event loop. If the hub is not yet closed, its
+ *   connection is closed immediately. The hub can be freed afterward.
+ */
+void yNetLoopRemoveHub(HubSt* hub)
+{
+    YSOCKET skts[YNET_HUB_MAX_SKT];
+    char errmsg[YOCTO_ERRMSG_LEN];
+    int i, j, nbskts = 0;
+
+    if (!yNetLoopsStarted) {
+        return;
+    }
+    for (i = 0; i < YAPI_NET_LOOP_COUNT; i++) {
+        yNetLoopSt* loop = &yNetLoops[i];
+        yEnterCriticalSection(&loop->access);
+        for (j = 0; j < NBMAX_NET_HUB; j++) {
+            yNetLoopHub* lh = &loop->hubs[j];
+            if (lh->hub == hub) {
+                // wait for the loop thread to be done with the hub
+                while (lh->busy) {
+                    yLeaveCriticalSection(&loop->access);
+                    yApproximateSleep(1);
+                    yEnterCriticalSection(&loop->access);
+                }
+                if (!lh->done) {
+                    lh->step(hub, YNET_STEP_ABORT, skts, &nbskts, errmsg);
+                    yThreadSignalEnd(&hub->net_thread);
+                }
+                memset(lh, 0, sizeof(yNetLoopHub));
+                loop->nbhubs--;
+                break;
+            }
+        }
+        yLeaveCriticalSection(&loop->access);
+        if (j < NBMAX_NET_HUB) {
+            break;
+        }
+    }
+}
+
+#endif
+
 
 /********************************************************************************
  * UDP funtions
@@ -87,6 +87,15 @@ int yNetSetErrEx(u32 line,unsigned err,char *errmsg);
 
 #define YTCP_REMOTE_CLOSE 1
 
+// Uncomment (or define on the command line) to drive all network hubs from a
+// small pool of epoll event loops instead of one helper thread per hub.
+// Only available on Linux.
+//#define YAPI_USE_EPOLL
+#if defined(YAPI_USE_EPOLL) && !defined(LINUX_API)
+#undef YAPI_USE_EPOLL
+#endif
+#define YAPI_NET_LOOP_COUNT     2       // number of event loop threads
+
 struct _HubSt;
 struct _RequestSt;
 
@@ -120,10 +129,31 @@ int  yReqRead(struct _RequestSt *rcoreq, u8 *buffer, int len);
 void yReqClose(struct _RequestSt *tcpreq);
 void yReqFree(struct _RequestSt *tcpreq);
 int  yReqHasPending(struct _HubSt *hub);
+void yHTTPPoolExpire(struct _HubSt *hub, int all);
+void yHTTPPoolGetStats(struct _HubSt *hub, int *hits, int *misses, int *idle);
 
 
 void* ws_thread(void* ctx);
 
+#ifdef YAPI_USE_EPOLL
+void yReqPoll(struct _RequestSt **tcpreq, int size, char *errmsg);
+
+// modes of a hub step function
+#define YNET_STEP_RUN       0   // process pending I/O
+#define YNET_STEP_END       1   // the hub must stop once pending requests are done
+#define YNET_STEP_ABORT     2   // the hub is removed, release its connection now
+#define YNET_HUB_MAX_SKT    (2 + 256)   // max sockets watched per hub
+
+// Hub step function: process pending I/O without waiting, store in skts the
+// sockets to watch until the next call, and return the max delay in ms before
+// the next call, or -1 once the hub is closed.
+typedef int (*yNetHubStep)(struct _HubSt *hub, int mode, YSOCKET *skts, int *nbskts, char *errmsg);
+
+int  ws_step(struct _HubSt *hub, int mode, YSOCKET *skts, int *nbskts, char *errmsg);
+int  yNetLoopAddHub(struct _HubSt *hub, yNetHubStep step, char *errmsg);
+void yNetLoopRemoveHub(struct _HubSt *hub);
+#endif
+
 
 #include "ythread.h"
 
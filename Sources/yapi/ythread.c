@@ -142,6 +142,11 @@ int    yThreadIndex(void)
     }
 }
 
+int    yThreadId(void)
+{
+    return (int)GetCurrentThreadId();
+}
+
 #else
 #include <sys/time.h>
 #include <pthread.h>
@@ -149,11 +154,14 @@ int    yThreadIndex(void)
 
 static pthread_once_t yInitKeyOnce = PTHREAD_ONCE_INIT;
 static pthread_key_t yTsdKey;
+static pthread_key_t yIdTsdKey;
 static unsigned yNextThreadIdx = 1;
+static volatile s32 yNextThreadId = 0;
 
 static void initTsdKey()
 {
     pthread_key_create(&yTsdKey, NULL);
+    pthread_key_create(&yIdTsdKey, NULL);
 }
 
 void yCreateEvent(yEvent *ev)
@@ -276,6 +284,19 @@ int    yThreadIndex(void)
     return res;
 }
 
+int    yThreadId(void)
+{
+    int res;
+
+    pthread_once(&yInitKeyOnce, initTsdKey);
+    res = (int)((u8 *)pthread_getspecific(yIdTsdKey) - (u8 *)NULL);
+    if (!res) {
+        res = yAtomicAdd(&yNextThreadId, 1);
+        pthread_setspecific(yIdTsdKey, (void*)((u8 *)NULL + res));
+    }
+    return res;
+}
+
 #endif
 
 
@@ -358,6 +379,52 @@ void yThreadKill(yThread *yth)
 }
 
 
+/*********************************************************************
+ * ATOMIC FUNCTION
+ *********************************************************************/
+
+#ifdef WINDOWS_API
+
+s32 yAtomicCompareExchange(volatile s32 *dst, s32 exchange, s32 comparand)
+{
+    return (s32)InterlockedCompareExchange((volatile LONG*)dst, (LONG)exchange, (LONG)comparand);
+}
+
+s32 yAtomicAdd(volatile s32 *dst, s32 value)
+{
+    return (s32)InterlockedExchangeAdd((volatile LONG*)dst, (LONG)value) + value;
+}
+
+#else
+
+s32 yAtomicCompareExchange(volatile s32 *dst, s32 exchange, s32 comparand)
+{
+    return __sync_val_compare_and_swap(dst, comparand, exchange);
+}
+
+s32 yAtomicAdd(volatile s32 *dst, s32 value)
+{
+    return __sync_add_and_fetch(dst, value);
+}
+
+#endif
+
+s32 yAtomicLoad(volatile s32 *src)
+{
+    // a compare-exchange with identical values acts as a full barrier read
+    return yAtomicCompareExchange(src, 0, 0);
+}
+
+void yAtomicStore(volatile s32 *dst, s32 value)
+{
+    s32 old = *dst;
+    s32 prev;
+    while ((prev = yAtomicCompareExchange(dst, value, old)) != old) {
+        old = prev;
+    }
+}
+
+
 #ifdef DEBUG_CRITICAL_SECTION
 
 //#include "yproto.h"
@@ -113,6 +113,17 @@ void   yThreadRequestEnd(yThread *yth);
 int    yThreadMustEnd(yThread *yth);
 void   yThreadKill(yThread *yth);
 int    yThreadIndex(void);
+// unlike yThreadIndex, which is only meant for debug logs, two running
+// threads never get the same id
+int    yThreadId(void);
+
+/*********************************************************************
+ * ATOMIC FUNCTION
+ *********************************************************************/
+s32    yAtomicCompareExchange(volatile s32 *dst, s32 exchange, s32 comparand);
+s32    yAtomicAdd(volatile s32 *dst, s32 value);
+s32    yAtomicLoad(volatile s32 *src);
+void   yAtomicStore(volatile s32 *dst, s32 value);
 
 #ifdef  __cplusplus
 }
@@ -399,11 +399,17 @@ int YAccelerometer::_invokeTimedReportCallback(YMeasure value)
 YAccelerometer *YAccelerometer::nextAccelerometer(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Accelerometer", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YAccelerometer::FindAccelerometer(hwid);
+    if (next == NULL) {
+        next = YAccelerometer::FindAccelerometer(hwid);
+        YFunction::_AddToCache("Accelerometer", nextdescr, next);
+    }
+    return (YAccelerometer*)next;
 }
 
 YAccelerometer* YAccelerometer::FirstAccelerometer(void)
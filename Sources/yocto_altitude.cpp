@@ -323,11 +323,17 @@ int YAltitude::_invokeTimedReportCallback(YMeasure value)
 YAltitude *YAltitude::nextAltitude(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Altitude", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YAltitude::FindAltitude(hwid);
+    if (next == NULL) {
+        next = YAltitude::FindAltitude(hwid);
+        YFunction::_AddToCache("Altitude", nextdescr, next);
+    }
+    return (YAltitude*)next;
 }
 
 YAltitude* YAltitude::FirstAltitude(void)
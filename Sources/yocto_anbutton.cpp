@@ -679,11 +679,17 @@ int YAnButton::resetCounter(void)
 YAnButton *YAnButton::nextAnButton(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("AnButton", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YAnButton::FindAnButton(hwid);
+    if (next == NULL) {
+        next = YAnButton::FindAnButton(hwid);
+        YFunction::_AddToCache("AnButton", nextdescr, next);
+    }
+    return (YAnButton*)next;
 }
 
 YAnButton* YAnButton::FirstAnButton(void)
@@ -60,12 +60,17 @@
 #define YMEMORY_ALLOW_MALLOC
 #include "yapi/yproto.h"
 #include <iostream>
+#include <algorithm>
+#include <new>
+#include <deque>
 
 static yCRITICAL_SECTION _updateDeviceList_CS;
 static yCRITICAL_SECTION _handleEvent_CS;
 
 static std::vector<YFunction*> _FunctionCallbacks;
 static std::vector<YFunction*> _TimedReportCallbackList;
+static YFunctionCallbackIndex _ValueCallbackIndex;
+static YFunctionCallbackIndex _TimedReportCallbackIndex;
 static std::map<YModule*, int> _moduleCallbackList;
 
 const string YFunction::HARDWAREID_INVALID = YAPI_INVALID_STRING;
@@ -101,6 +106,101 @@ vector<string> _strsplit(const string& str, char delimiter)
 }
 
 
+#define YJSON_ARENA_ALIGN       8
+#define YJSON_ARENA_MIN_CHUNK   4096
+
+YJSONDocument::YJSONDocument(const char* data, int len): _refcount(1), _length(len), _chunks(NULL)
+{
+    _buffer = new char[len + 1];
+    if (len > 0) {
+        memcpy(_buffer, data, len);
+    }
+    _buffer[len] = 0;
+    // a typical api.json tree needs a few times the size of its source text
+    _nextChunkSize = YJSON_ARENA_MIN_CHUNK;
+    while (_nextChunkSize < (size_t)len * 4) {
+        _nextChunkSize *= 2;
+    }
+}
+
+YJSONDocument::~YJSONDocument()
+{
+    // arena nodes own no heap memory, so their destructors are not called
+    for (unsigned i = 0; i < _adopted.size(); i++) {
+        delete _adopted[i];
+    }
+    _adopted.clear();
+    while (_chunks) {
+        Chunk* next = _chunks->next;
+        delete[] (char*)_chunks;
+        _chunks = next;
+    }
+    delete[] _buffer;
+}
+
+void YJSONDocument::retain(void)
+{
+    _refcount++;
+}
+
+void YJSONDocument::release(void)
+{
+    if (--_refcount == 0) {
+        delete this;
+    }
+}
+
+void* YJSONDocument::alloc(size_t size)
+{
+    size_t hdrsize = (sizeof(Chunk) + YJSON_ARENA_ALIGN - 1) & ~(size_t)(YJSON_ARENA_ALIGN - 1);
+    size = (size + YJSON_ARENA_ALIGN - 1) & ~(size_t)(YJSON_ARENA_ALIGN - 1);
+    if (_chunks == NULL || _chunks->used + size > _chunks->size) {
+        size_t chunksize = _nextChunkSize;
+        while (chunksize < size) {
+            chunksize *= 2;
+        }
+        Chunk* chunk = (Chunk*)new char[hdrsize + chunksize];
+        chunk->next = _chunks;
+        chunk->size = chunksize;
+        chunk->used = 0;
+        _chunks = chunk;
+        _nextChunkSize = chunksize * 2;
+    }
+    void* res = (char*)_chunks + hdrsize + _chunks->used;
+    _chunks->used += size;
+    return res;
+}
+
+const char* YJSONDocument::copyString(const char* str, int len)
+{
+    char* res = (char*)alloc(len + 1);
+    if (len > 0) {
+        memcpy(res, str, len);
+    }
+    res[len] = 0;
+    return res;
+}
+
+// Take ownership of the root node of another document
+void YJSONDocument::adopt(YJSONContent* root)
+{
+    _adopted.push_back(root);
+}
+
+// Delete a root node previously adopted, returns false if the node was not adopted
+bool YJSONDocument::drop(YJSONContent* root)
+{
+    for (unsigned i = 0; i < _adopted.size(); i++) {
+        if (_adopted[i] == root) {
+            _adopted.erase(_adopted.begin() + i);
+            delete root;
+            return true;
+        }
+    }
+    return false;
+}
+
+
 YJSONContent* YJSONContent::ParseJson(const string& data, int start, int stop)
 {
     int cur_pos = YJSONContent::SkipGarbage(data, start, stop);
@@ -114,26 +214,53 @@ YJSONContent* YJSONContent::ParseJson(const string& data, int start, int stop)
     } else {
         res = new YJSONNumber(data, start, stop);
     }
-    res->parse();
+    try {
+        res->parse();
+    } catch (std::exception&) {
+        delete res;
+        throw;
+    }
     return res;
 }
 
+// Root node: creates a new document holding a copy of the source text
 YJSONContent::YJSONContent(const string& data, int start, int stop, YJSONType type)
 {
-    _data = data;
+    _doc = new YJSONDocument(data.data(), (int)data.length());
+    _isRoot = true;
+    _data_start = start;
+    _data_len = 0;
+    _data_boundary = stop;
+    _type = type;
+}
+
+// Inner node: allocated from the arena of an existing document
+YJSONContent::YJSONContent(YJSONDocument* doc, int start, int stop, YJSONType type)
+{
+    _doc = doc;
+    _isRoot = false;
     _data_start = start;
+    _data_len = 0;
     _data_boundary = stop;
     _type = type;
 }
 
 YJSONContent::YJSONContent(YJSONType type)
 {
-    _data = ""; //todo: check not null
+    _doc = new YJSONDocument("", 0);
+    _isRoot = true;
+    _data_start = 0;
+    _data_len = 0;
+    _data_boundary = 0;
+    _type = type;
 }
 
+// New root node sharing the document of the reference node
 YJSONContent::YJSONContent(YJSONContent* ref)
 {
-    _data = ref->_data;
+    _doc = ref->_doc;
+    _doc->retain();
+    _isRoot = true;
     _data_start = ref->_data_start;
     _data_boundary = ref->_data_boundary;
     _data_len = ref->_data_len;
@@ -143,7 +270,10 @@ YJSONContent::YJSONContent(YJSONContent* ref)
 
 YJSONContent::~YJSONContent()
 {
-    _data = "";
+    if (_isRoot) {
+        _doc->release();
+    }
+    _doc = NULL;
 }
 
 YJSONType YJSONContent::getJSONType()
@@ -156,8 +286,12 @@ int YJSONContent::SkipGarbage(const string& data, int start, int stop)
     if (data.length() <= (unsigned)start) {
         return start;
     }
-    char sti = data[start];
-    while (start < stop && (sti == '\n' || sti == '\r' || sti == ' ')) {
+    return SkipGarbage(data.data(), start, stop);
+}
+
+int YJSONContent::SkipGarbage(const char* data, int start, int stop)
+{
+    while (start < stop && (data[start] == '\n' || data[start] == '\r' || data[start] == ' ')) {
         start++;
     }
     return start;
@@ -171,115 +305,111 @@ string YJSONContent::FormatError(const string& errmsg, int cur_pos)
         ststart = 0;
     if (stend > _data_boundary)
         stend = _data_boundary;
-    if (_data == "") {
-        //todo: check not null
+    if (stend > _doc->length())
+        stend = _doc->length();
+    if (_doc->length() == 0 || ststart >= stend) {
         return errmsg;
     }
-    return errmsg + " near " + _data.substr(ststart, cur_pos - ststart) + _data.substr(cur_pos, stend - cur_pos);
+    return errmsg + " near " + string(_doc->buffer() + ststart, stend - ststart);
+}
+
+// Allocate and parse the value starting at cur_pos in the document arena.
+// Returns NULL if the character at cur_pos cannot start a value.
+YJSONContent* YJSONContent::_parseValue(int cur_pos, int& len)
+{
+    YJSONContent* res;
+    char sti = _doc->buffer()[cur_pos];
+
+    if (sti == '{') {
+        res = new(_doc->alloc(sizeof(YJSONObject))) YJSONObject(_doc, cur_pos, _data_boundary);
+    } else if (sti == '[') {
+        res = new(_doc->alloc(sizeof(YJSONArray))) YJSONArray(_doc, cur_pos, _data_boundary);
+    } else if (sti == '"') {
+        res = new(_doc->alloc(sizeof(YJSONString))) YJSONString(_doc, cur_pos, _data_boundary);
+    } else if (sti == '-' || (sti >= '0' && sti <= '9')) {
+        res = new(_doc->alloc(sizeof(YJSONNumber))) YJSONNumber(_doc, cur_pos, _data_boundary);
+    } else {
+        return NULL;
+    }
+    len = res->parse();
+    return res;
 }
 
 
-YJSONArray::YJSONArray(const string& data, int start, int stop) : YJSONContent(data, start, stop, ARRAY)
+YJSONArray::YJSONArray(const string& data, int start, int stop) : YJSONContent(data, start, stop, ARRAY), _items(NULL), _count(0), _size(0)
+{ }
+
+YJSONArray::YJSONArray(YJSONDocument* doc, int start, int stop) : YJSONContent(doc, start, stop, ARRAY), _items(NULL), _count(0), _size(0)
 { }
 
+YJSONArray::YJSONArray(const string& data) : YJSONContent(data, 0, (int)data.length(), ARRAY), _items(NULL), _count(0), _size(0)
+{ }
 
-YJSONArray::YJSONArray() : YJSONContent(ARRAY)
+YJSONArray::YJSONArray() : YJSONContent(ARRAY), _items(NULL), _count(0), _size(0)
 { }
 
-YJSONArray::YJSONArray(YJSONArray* ref) : YJSONContent(ref)
+YJSONArray::YJSONArray(YJSONArray* ref) : YJSONContent(ref), _items(NULL), _count(0), _size(0)
 {
-    for (unsigned i = 0; i < ref->_arrayValue.size(); i++) {
-        YJSONType type = ref->_arrayValue[i]->getJSONType();
-        switch (type) {
-        case ARRAY: {
-            YJSONArray* tmp = new YJSONArray((YJSONArray*)ref->_arrayValue[i]);
-            _arrayValue.push_back(tmp);
-        }
-        break;
-        case NUMBER: {
-            YJSONNumber* tmp = new YJSONNumber((YJSONNumber*)ref->_arrayValue[i]);
-            _arrayValue.push_back(tmp);
-        }
-        break;
-        case STRING: {
-            YJSONString* tmp = new YJSONString((YJSONString*)ref->_arrayValue[i]);
-            _arrayValue.push_back(tmp);
-        }
-        break;
-        case OBJECT: {
-            YJSONObject* tmp = new YJSONObject((YJSONObject*)ref->_arrayValue[i]);
-            _arrayValue.push_back(tmp);
-        }
-        break;
-        }
+    // items are immutable and live in the shared document
+    for (int i = 0; i < ref->_count; i++) {
+        _append(ref->_items[i]);
     }
 }
 
 
 YJSONArray::~YJSONArray()
 {
-    for (unsigned i = 0; i < _arrayValue.size(); i++) {
-        delete _arrayValue[i];
+    // items are released with the document arena
+}
+
+void YJSONArray::_append(YJSONContent* item)
+{
+    if (_count == _size) {
+        int newsize = (_size ? _size * 2 : 8);
+        YJSONContent** newitems = (YJSONContent**)_doc->alloc(newsize * sizeof(YJSONContent*));
+        if (_count > 0) {
+            memcpy(newitems, _items, _count * sizeof(YJSONContent*));
+        }
+        _items = newitems;
+        _size = newsize;
     }
-    _arrayValue.clear();
+    _items[_count++] = item;
 }
 
 int YJSONArray::length()
 {
-    return (int)_arrayValue.size();
+    return _count;
 }
 
 int YJSONArray::parse()
 {
-    int cur_pos = SkipGarbage(_data, _data_start, _data_boundary);
+    const char* data = _doc->buffer();
+    int cur_pos = SkipGarbage(data, _data_start, _data_boundary);
 
-    if (_data[cur_pos] != '[') {
+    if (cur_pos >= _data_boundary || data[cur_pos] != '[') {
         throw YAPI_Exception(YAPI_IO_ERROR, FormatError("Opening braces was expected", cur_pos));
     }
     cur_pos++;
     Tjstate state = JWAITFORDATA;
 
     while (cur_pos < _data_boundary) {
-        char sti = _data[cur_pos];
+        char sti = data[cur_pos];
         switch (state) {
         case JWAITFORDATA:
-            if (sti == '{') {
-                YJSONObject* jobj = new YJSONObject(_data, cur_pos, _data_boundary);
-                int len = jobj->parse();
-                cur_pos += len;
-                _arrayValue.push_back(jobj);
-                state = JWAITFORNEXTARRAYITEM;
-                //cur_pos is already incremented
-                continue;
-            } else if (sti == '[') {
-                YJSONArray* jobj = new YJSONArray(_data, cur_pos, _data_boundary);
-                int len = jobj->parse();
-                cur_pos += len;
-                _arrayValue.push_back(jobj);
-                state = JWAITFORNEXTARRAYITEM;
-                //cur_pos is already incremented
-                continue;
-            } else if (sti == '"') {
-                YJSONString* jobj = new YJSONString(_data, cur_pos, _data_boundary);
-                int len = jobj->parse();
-                cur_pos += len;
-                _arrayValue.push_back(jobj);
-                state = JWAITFORNEXTARRAYITEM;
-                //cur_pos is already incremented
-                continue;
-            } else if (sti == '-' || (sti >= '0' && sti <= '9')) {
-                YJSONNumber* jobj = new YJSONNumber(_data, cur_pos, _data_boundary);
-                int len = jobj->parse();
+            if (sti == ']') {
+                _data_len = cur_pos + 1 - _data_start;
+                return _data_len;
+            } else if (sti != ' ' && sti != '\n' && sti != '\r') {
+                int len;
+                YJSONContent* jobj = _parseValue(cur_pos, len);
+                if (jobj == NULL) {
+                    throw YAPI_Exception(YAPI_IO_ERROR, FormatError("invalid char: was expecting  \",0..9,t or f", cur_pos));
+                }
                 cur_pos += len;
-                _arrayValue.push_back(jobj);
+                _append(jobj);
                 state = JWAITFORNEXTARRAYITEM;
                 //cur_pos is already incremented
                 continue;
-            } else if (sti == ']') {
-                _data_len = cur_pos + 1 - _data_start;
-                return _data_len;
-            } else if (sti != ' ' && sti != '\n' && sti != '\r') {
-                throw YAPI_Exception(YAPI_IO_ERROR, FormatError("invalid char: was expecting  \",0..9,t or f", cur_pos));
             }
             break;
         case JWAITFORNEXTARRAYITEM:
@@ -304,51 +434,51 @@ int YJSONArray::parse()
 
 YJSONObject* YJSONArray::getYJSONObject(int i)
 {
-    return (YJSONObject*)_arrayValue[i];
+    return (YJSONObject*)_items[i];
 }
 
 string YJSONArray::getString(int i)
 {
-    YJSONString* ystr = (YJSONString*)_arrayValue[i];
+    YJSONString* ystr = (YJSONString*)_items[i];
     return ystr->getString();
 }
 
 YJSONContent* YJSONArray::get(int i)
 {
-    return _arrayValue[i];
+    return _items[i];
 }
 
 YJSONArray* YJSONArray::getYJSONArray(int i)
 {
-    return (YJSONArray*)_arrayValue[i];
+    return (YJSONArray*)_items[i];
 }
 
 int YJSONArray::getInt(int i)
 {
-    YJSONNumber* ystr = (YJSONNumber*)_arrayValue[i];
+    YJSONNumber* ystr = (YJSONNumber*)_items[i];
     return ystr->getInt();
 }
 
 s64 YJSONArray::getLong(int i)
 {
-    YJSONNumber* ystr = (YJSONNumber*)_arrayValue[i];
+    YJSONNumber* ystr = (YJSONNumber*)_items[i];
     return ystr->getLong();
 }
 
 void YJSONArray::put(const string& flatAttr)
 {
-    YJSONString* strobj = new YJSONString();
+    YJSONString* strobj = new(_doc->alloc(sizeof(YJSONString))) YJSONString(_doc, 0, 0);
     strobj->setContent(flatAttr);
-    _arrayValue.push_back(strobj);
+    _append(strobj);
 }
 
 string YJSONArray::toJSON()
 {
     string res = "[";
     string sep = "";
-    unsigned int i;
-    for (i = 0; i < _arrayValue.size(); i++) {
-        YJSONContent* yjsonContent = _arrayValue[i];
+    int i;
+    for (i = 0; i < _count; i++) {
+        YJSONContent* yjsonContent = _items[i];
         string subres = yjsonContent->toJSON();
         res += sep;
         res += subres;
@@ -362,9 +492,9 @@ string YJSONArray::toString()
 {
     string res = "[";
     string sep = "";
-    unsigned int i;
-    for (i = 0; i < _arrayValue.size(); i++) {
-        YJSONContent* yjsonContent = _arrayValue[i];
+    int i;
+    for (i = 0; i < _count; i++) {
+        YJSONContent* yjsonContent = _items[i];
         string subres = yjsonContent->toString();
         res += sep;
         res += subres;
@@ -375,40 +505,60 @@ string YJSONArray::toString()
 }
 
 
-YJSONString::YJSONString(const string& data, int start, int stop) : YJSONContent(data, start, stop, STRING)
+YJSONString::YJSONString(const string& data, int start, int stop) : YJSONContent(data, start, stop, STRING), _str(""), _strlen(0)
+{ }
+
+YJSONString::YJSONString(YJSONDocument* doc, int start, int stop) : YJSONContent(doc, start, stop, STRING), _str(""), _strlen(0)
 { }
 
-YJSONString::YJSONString() : YJSONContent(STRING)
+YJSONString::YJSONString() : YJSONContent(STRING), _str(""), _strlen(0)
 { }
 
 YJSONString::YJSONString(YJSONString* ref) : YJSONContent(ref)
 {
-    _stringValue = ref->_stringValue;
+    _str = ref->_str;
+    _strlen = ref->_strlen;
 }
 
 int YJSONString::parse()
 {
-    string value = "";
-    int cur_pos = SkipGarbage(_data, _data_start, _data_boundary);
+    const char* data = _doc->buffer();
+    int cur_pos = SkipGarbage(data, _data_start, _data_boundary);
 
-    if (_data[cur_pos] != '"') {
+    if (cur_pos >= _data_boundary || data[cur_pos] != '"') {
         throw YAPI_Exception(YAPI_IO_ERROR, FormatError("double quote was expected", cur_pos));
     }
     cur_pos++;
     int str_start = cur_pos;
+    bool escaped = false;
     Tjstate state = JWAITFORSTRINGVALUE;
 
     while (cur_pos < _data_boundary) {
-        unsigned char sti = _data[cur_pos];
+        unsigned char sti = data[cur_pos];
         switch (state) {
         case JWAITFORSTRINGVALUE:
             if (sti == '\\') {
-                value += _data.substr(str_start, cur_pos - str_start);
-                str_start = cur_pos;
+                escaped = true;
                 state = JWAITFORSTRINGVALUE_ESC;
             } else if (sti == '"') {
-                value += _data.substr(str_start, cur_pos - str_start);
-                _stringValue = value;
+                if (!escaped) {
+                    // point directly into the document buffer
+                    _str = data + str_start;
+                    _strlen = cur_pos - str_start;
+                } else {
+                    // unescape into the document arena
+                    char* value = (char*)_doc->alloc(cur_pos - str_start + 1);
+                    int len = 0;
+                    for (int i = str_start; i < cur_pos; i++) {
+                        if (data[i] == '\\') {
+                            i++;
+                        }
+                        value[len++] = data[i];
+                    }
+                    value[len] = 0;
+                    _str = value;
+                    _strlen = len;
+                }
                 _data_len = (cur_pos + 1) - _data_start;
                 return _data_len;
             } else if (sti < 32) {
@@ -416,9 +566,7 @@ int YJSONString::parse()
             }
             break;
         case JWAITFORSTRINGVALUE_ESC:
-            value += sti;
             state = JWAITFORSTRINGVALUE;
-            str_start = cur_pos + 1;
             break;
         default:
             throw YAPI_Exception(YAPI_IO_ERROR, FormatError("invalid state for YJSONObject", cur_pos));
@@ -431,8 +579,9 @@ int YJSONString::parse()
 string YJSONString::toJSON()
 {
     string res = "\"";
-    const char* c = _stringValue.c_str();
-    while (*c) {
+    const char* c = _str;
+    const char* end = _str + _strlen;
+    while (c < end) {
         switch (*c) {
         case '"':
             res += "\\\"";
@@ -470,23 +619,27 @@ string YJSONString::toJSON()
 
 string YJSONString::getString()
 {
-    return _stringValue;
+    return string(_str, _strlen);
 }
 
 string YJSONString::toString()
 {
-    return _stringValue;
+    return string(_str, _strlen);
 }
 
 void YJSONString::setContent(const string& value)
 {
-    _stringValue = value;
+    _str = _doc->copyString(value.data(), (int)value.length());
+    _strlen = (int)value.length();
 }
 
 
 YJSONNumber::YJSONNumber(const string& data, int start, int stop) : YJSONContent(data, start, stop, NUMBER), _intValue(0), _doubleValue(0), _isFloat(false)
 { }
 
+YJSONNumber::YJSONNumber(YJSONDocument* doc, int start, int stop) : YJSONContent(doc, start, stop, NUMBER), _intValue(0), _doubleValue(0), _isFloat(false)
+{ }
+
 YJSONNumber::YJSONNumber(YJSONNumber* ref) : YJSONContent(ref)
 {
     _intValue = ref->_intValue;
@@ -500,31 +653,32 @@ int YJSONNumber::parse()
     bool neg = false;
     int start;
     char sti;
-    int cur_pos = SkipGarbage(_data, _data_start, _data_boundary);
-    sti = _data[cur_pos];
+    const char* data = _doc->buffer();
+    int cur_pos = SkipGarbage(data, _data_start, _data_boundary);
+    sti = data[cur_pos];
     if (sti == '-') {
         neg = true;
         cur_pos++;
     }
     start = cur_pos;
     while (cur_pos < _data_boundary) {
-        sti = _data[cur_pos];
+        sti = data[cur_pos];
         if (sti == '.' && _isFloat == false) {
-            string int_part = _data.substr(start, cur_pos - start);
-            _intValue = yatoi((int_part).c_str());
             _isFloat = true;
         } else if (sti < '0' || sti > '9') {
-            string numberpart = _data.substr(start, cur_pos - start);
+            // the document buffer is null-terminated, the conversion stops at the first non-digit
             if (_isFloat) {
-                _doubleValue = atof((numberpart).c_str());
+                _doubleValue = atof(data + start);
+                _intValue = (s64)_doubleValue;
             } else {
-                _intValue = yatoi((numberpart).c_str());
+                _intValue = yatoi(data + start);
             }
             if (neg) {
                 _doubleValue = 0 - _doubleValue;
                 _intValue = 0 - _intValue;
             }
-            return cur_pos - _data_start;
+            _data_len = cur_pos - _data_start;
+            return _data_len;
         }
         cur_pos++;
     }
@@ -572,59 +726,124 @@ string YJSONNumber::toString()
 }
 
 
-YJSONObject::YJSONObject(const string& data) : YJSONContent(data, 0, (int)data.length(), OBJECT)
+YJSONObject::YJSONObject(const string& data) : YJSONContent(data, 0, (int)data.length(), OBJECT), _members(NULL), _index(NULL), _count(0), _size(0)
 { }
 
-YJSONObject::YJSONObject(const string& data, int start, int len) : YJSONContent(data, start, len, OBJECT)
+YJSONObject::YJSONObject(const string& data, int start, int len) : YJSONContent(data, start, len, OBJECT), _members(NULL), _index(NULL), _count(0), _size(0)
 { }
 
-YJSONObject::YJSONObject(YJSONObject* ref) : YJSONContent(ref)
+YJSONObject::YJSONObject(YJSONDocument* doc, int start, int stop) : YJSONContent(doc, start, stop, OBJECT), _members(NULL), _index(NULL), _count(0), _size(0)
+{ }
+
+YJSONObject::YJSONObject(YJSONObject* ref) : YJSONContent(ref), _members(NULL), _index(NULL), _count(0), _size(0)
 {
-    for (unsigned i = 0; i < ref->_keys.size(); i++) {
-        string key = ref->_keys[i];
-        _keys.push_back(key);
-        YJSONType type = ref->_parsed[key]->getJSONType();
-        switch (type) {
-        case ARRAY:
-            _parsed[key] = new YJSONArray((YJSONArray*)ref->_parsed[key]);
-            break;
-        case NUMBER:
-            _parsed[key] = new YJSONNumber((YJSONNumber*)ref->_parsed[key]);
-            break;
-        case STRING:
-            _parsed[key] = new YJSONString((YJSONString*)ref->_parsed[key]);
-            break;
-        case OBJECT:
-            _parsed[key] = new YJSONObject((YJSONObject*)ref->_parsed[key]);
-            break;
-        }
+    // member values are immutable and live in the shared document
+    for (int i = 0; i < ref->_count; i++) {
+        _append(ref->_members[i].key, ref->_members[i].keylen, ref->_members[i].value);
     }
+    _buildIndex();
 }
 
 YJSONObject::~YJSONObject()
 {
-    //printf("relase YJSONObject\n");
-    for (unsigned i = 0; i < _keys.size(); i++) {
-        delete _parsed[_keys[i]];
+    // members are released with the document arena
+}
+
+void YJSONObject::_append(const char* key, int keylen, YJSONContent* value)
+{
+    if (_count == _size) {
+        int newsize = (_size ? _size * 2 : 16);
+        YJSONMember* newmembers = (YJSONMember*)_doc->alloc(newsize * sizeof(YJSONMember));
+        if (_count > 0) {
+            memcpy(newmembers, _members, _count * sizeof(YJSONMember));
+        }
+        _members = newmembers;
+        _size = newsize;
+    }
+    _members[_count].key = key;
+    _members[_count].keylen = keylen;
+    _members[_count].value = value;
+    _count++;
+    _index = NULL;
+}
+
+static int _keycmp(const char* a, int alen, const char* b, int blen)
+{
+    int res = memcmp(a, b, (alen < blen ? alen : blen));
+    if (res == 0) {
+        res = alen - blen;
+    }
+    return res;
+}
+
+class YJSONMemberLess
+{
+    const YJSONMember* _members;
+public:
+    YJSONMemberLess(const YJSONMember* members): _members(members) {}
+    bool operator()(int a, int b) const
+    {
+        return _keycmp(_members[a].key, _members[a].keylen, _members[b].key, _members[b].keylen) < 0;
+    }
+};
+
+void YJSONObject::_buildIndex(void)
+{
+    int* index = (int*)_doc->alloc((_count ? _count : 1) * sizeof(int));
+    for (int i = 0; i < _count; i++) {
+        index[i] = i;
     }
-    _parsed.clear();
-    _keys.clear();
+    std::sort(index, index + _count, YJSONMemberLess(_members));
+    _index = index;
+}
+
+// Binary search in the sorted key index, returns the member index or -1
+int YJSONObject::_find(const string& key)
+{
+    int lo = 0, hi = _count - 1;
+    if (_index == NULL) {
+        _buildIndex();
+    }
+    while (lo <= hi) {
+        int mid = (lo + hi) >> 1;
+        const YJSONMember* m = _members + _index[mid];
+        int cmp = _keycmp(m->key, m->keylen, key.data(), (int)key.length());
+        if (cmp == 0) {
+            return _index[mid];
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return -1;
+}
+
+YJSONContent* YJSONObject::_lookup(const string& key)
+{
+    int idx = _find(key);
+    if (idx < 0) {
+        throw YAPI_Exception(YAPI_INVALID_ARGUMENT, "No member named " + key);
+    }
+    return _members[idx].value;
 }
 
 int YJSONObject::parse()
 {
-    string current_name = "";
+    const char* data = _doc->buffer();
+    const char* current_name = NULL;
+    int current_len = 0;
     int name_start = _data_start;
-    int cur_pos = SkipGarbage(_data, _data_start, _data_boundary);
+    int cur_pos = SkipGarbage(data, _data_start, _data_boundary);
 
-    if (_data.length() <= (unsigned)cur_pos || _data[cur_pos] != '{') {
+    if (cur_pos >= _data_boundary || data[cur_pos] != '{') {
         throw YAPI_Exception(YAPI_IO_ERROR, FormatError("Opening braces was expected", cur_pos));
     }
     cur_pos++;
     Tjstate state = JWAITFORNAME;
 
     while (cur_pos < _data_boundary) {
-        char sti = _data[cur_pos];
+        char sti = data[cur_pos];
         switch (state) {
         case JWAITFORNAME:
             if (sti == '"') {
@@ -632,6 +851,7 @@ int YJSONObject::parse()
                 name_start = cur_pos + 1;
             } else if (sti == '}') {
                 _data_len = cur_pos + 1 - _data_start;
+                _buildIndex();
                 return _data_len;
             } else {
                 if (sti != ' ' && sti != '\n' && sti != '\r') {
@@ -641,7 +861,8 @@ int YJSONObject::parse()
             break;
         case JWAITFORENDOFNAME:
             if (sti == '"') {
-                current_name = _data.substr(name_start, cur_pos - name_start);
+                current_name = data + name_start;
+                current_len = cur_pos - name_start;
                 state = JWAITFORCOLON;
 
             } else {
@@ -660,44 +881,17 @@ int YJSONObject::parse()
             }
             break;
         case JWAITFORDATA:
-            if (sti == '{') {
-                YJSONObject* jobj = new YJSONObject(_data, cur_pos, _data_boundary);
-                int len = jobj->parse();
-                cur_pos += len;
-                _parsed[current_name] = jobj;
-                _keys.push_back(current_name);
-                state = JWAITFORNEXTSTRUCTMEMBER;
-                //cur_pos is already incremented
-                continue;
-            } else if (sti == '[') {
-                YJSONArray* jobj = new YJSONArray(_data, cur_pos, _data_boundary);
-                int len = jobj->parse();
-                cur_pos += len;
-                _parsed[current_name] = jobj;
-                _keys.push_back(current_name);
-                state = JWAITFORNEXTSTRUCTMEMBER;
-                //cur_pos is already incremented
-                continue;
-            } else if (sti == '"') {
-                YJSONString* jobj = new YJSONString(_data, cur_pos, _data_boundary);
-                int len = jobj->parse();
-                cur_pos += len;
-                _parsed[current_name] = jobj;
-                _keys.push_back(current_name);
-                state = JWAITFORNEXTSTRUCTMEMBER;
-                //cur_pos is already incremented
-                continue;
-            } else if (sti == '-' || (sti >= '0' && sti <= '9')) {
-                YJSONNumber* jobj = new YJSONNumber(_data, cur_pos, _data_boundary);
-                int len = jobj->parse();
+            if (sti != ' ' && sti != '\n' && sti != '\r') {
+                int len;
+                YJSONContent* jobj = _parseValue(cur_pos, len);
+                if (jobj == NULL) {
+                    throw YAPI_Exception(YAPI_IO_ERROR, FormatError("invalid char: was expecting  \",0..9,t or f", cur_pos));
+                }
                 cur_pos += len;
-                _parsed[current_name] = jobj;
-                _keys.push_back(current_name);
+                _append(current_name, current_len, jobj);
                 state = JWAITFORNEXTSTRUCTMEMBER;
                 //cur_pos is already incremented
                 continue;
-            } else if (sti != ' ' && sti != '\n' && sti != '\r') {
-                throw YAPI_Exception(YAPI_IO_ERROR, FormatError("invalid char: was expecting  \",0..9,t or f", cur_pos));
             }
             break;
         case JWAITFORNEXTSTRUCTMEMBER:
@@ -706,6 +900,7 @@ int YJSONObject::parse()
                 name_start = cur_pos + 1;
             } else if (sti == '}') {
                 _data_len = cur_pos + 1 - _data_start;
+                _buildIndex();
                 return _data_len;
             } else {
                 if (sti != ' ' && sti != '\n' && sti != '\r') {
@@ -723,83 +918,101 @@ int YJSONObject::parse()
 
 bool YJSONObject::has(const string& key)
 {
-    if (_parsed.find(key) == _parsed.end()) {
-        return false;
-    } else {
-        return true;
-    }
+    return _find(key) >= 0;
 }
 
 YJSONObject* YJSONObject::getYJSONObject(const string& key)
 {
-    return (YJSONObject*)_parsed[key];
+    return (YJSONObject*)_lookup(key);
 }
 
 YJSONString* YJSONObject::getYJSONString(const string& key)
 {
-    return (YJSONString*)_parsed[key];
+    return (YJSONString*)_lookup(key);
 }
 
 YJSONArray* YJSONObject::getYJSONArray(const string& key)
 {
-    return (YJSONArray*)_parsed[key];
+    return (YJSONArray*)_lookup(key);
 }
 
 vector<string> YJSONObject::keys()
 {
     vector<string> v;
-    for (map<string, YJSONContent*>::iterator it = _parsed.begin(); it != _parsed.end(); ++it) {
-        v.push_back(it->first);
+    if (_index == NULL) {
+        _buildIndex();
+    }
+    for (int i = 0; i < _count; i++) {
+        const YJSONMember* m = _members + _index[i];
+        v.push_back(string(m->key, m->keylen));
     }
     return v;
 }
 
 YJSONNumber* YJSONObject::getYJSONNumber(const string& key)
 {
-    return (YJSONNumber*)_parsed[key];
+    return (YJSONNumber*)_lookup(key);
 }
 
 string YJSONObject::getString(const string& key)
 {
-    YJSONString* ystr = (YJSONString*)_parsed[key];
+    YJSONString* ystr = (YJSONString*)_lookup(key);
     return ystr->getString();
 }
 
 int YJSONObject::getInt(const string& key)
 {
-    YJSONNumber* yint = (YJSONNumber*)_parsed[key];
+    YJSONNumber* yint = (YJSONNumber*)_lookup(key);
     return yint->getInt();
 }
 
 YJSONContent* YJSONObject::get(const string& key)
 {
-    return _parsed[key];
+    int idx = _find(key);
+    return (idx < 0 ? NULL : _members[idx].value);
 }
 
 s64 YJSONObject::getLong(const string& key)
 {
-    YJSONNumber* yint = (YJSONNumber*)_parsed[key];
+    YJSONNumber* yint = (YJSONNumber*)_lookup(key);
     return yint->getLong();
 }
 
 double YJSONObject::getDouble(const string& key)
 {
-    YJSONNumber* yint = (YJSONNumber*)_parsed[key];
+    YJSONNumber* yint = (YJSONNumber*)_lookup(key);
     return yint->getDouble();
 }
 
+// Set the value of a member. The value must either be a node of the same
+// document, or a root node that will then be owned by this document.
+void YJSONObject::put(const string& key, YJSONContent* value)
+{
+    int idx = _find(key);
+    if (value->_doc != _doc && value->_isRoot) {
+        _doc->adopt(value);
+    }
+    if (idx >= 0) {
+        // keep the original key order, since it is used to decode yzon replies
+        _doc->drop(_members[idx].value);
+        _members[idx].value = value;
+    } else {
+        _append(_doc->copyString(key.data(), (int)key.length()), (int)key.length(), value);
+        _buildIndex();
+    }
+}
+
 string YJSONObject::toJSON()
 {
     string res = "{";
     string sep = "";
-    unsigned int i;
-    for (i = 0; i < _keys.size(); i++) {
-        string key = _keys[i];
-        YJSONContent* subContent = _parsed[key];
+    int i;
+    for (i = 0; i < _count; i++) {
+        YJSONContent* subContent = _members[i].value;
         string subres = subContent->toJSON();
         res += sep;
         res += '"';
-        res += key;
+        res.append(_members[i].key, _members[i].keylen);
         res += "\":";
         res += subres;
         sep = ",";
@@ -812,14 +1025,13 @@ string YJSONObject::toString()
 {
     string res = "{";
     string sep = "";
-    unsigned int i;
-    for (i = 0; i < _keys.size(); i++) {
-        string key = _keys[i];
-        YJSONContent* subContent = _parsed[key];
+    int i;
+    for (i = 0; i < _count; i++) {
+        YJSONContent* subContent = _members[i].value;
         string subres = subContent->toString();
         res += sep;
         res += '"';
-        res += key;
+        res.append(_members[i].key, _members[i].keylen);
         res += "\":";
         res += subres;
         sep = ",";
@@ -833,12 +1045,15 @@ void YJSONObject::parseWithRef(YJSONObject* reference)
 {
     if (reference != NULL) {
         try {
-            YJSONArray* yzon = new YJSONArray(_data, _data_start, _data_boundary);
+            // the yzon array is parsed in our own arena, so its items can be used as is
+            YJSONArray* yzon = new(_doc->alloc(sizeof(YJSONArray))) YJSONArray(_doc, _data_start, _data_boundary);
             yzon->parse();
             convert(reference, yzon);
-            delete yzon;
             return;
-        } catch (std::exception) { }
+        } catch (std::exception&) {
+            _count = 0;
+            _index = NULL;
+        }
     }
     this->parse();
 }
@@ -846,42 +1061,66 @@ void YJSONObject::parseWithRef(YJSONObject* reference)
 void YJSONObject::convert(YJSONObject* reference, YJSONArray* newArray)
 {
     int length = newArray->length();
+    if (length > reference->_count) {
+        throw YAPI_Exception(YAPI_IO_ERROR, "Unable to convert yzon struct");
+    }
     for (int i = 0; i < length; i++) {
-        string key = reference->getKeyFromIdx(i);
+        const YJSONMember* ref_member = reference->_members + i;
+        const char* key = _doc->copyString(ref_member->key, ref_member->keylen);
         YJSONContent* item = newArray->get(i);
-        YJSONContent* reference_item = reference->get(key);
+        YJSONContent* reference_item = ref_member->value;
         YJSONType type = item->getJSONType();
         if (type == reference_item->getJSONType()) {
-            switch (type) {
-            case ARRAY:
-                _parsed[key] = new YJSONArray((YJSONArray*)item);
-                break;
-            case NUMBER:
-                _parsed[key] = new YJSONNumber((YJSONNumber*)item);
-                break;
-            case STRING:
-                _parsed[key] = new YJSONString((YJSONString*)item);
-                break;
-            case OBJECT:
-                _parsed[key] = new YJSONObject((YJSONObject*)item);
-                break;
-            }
-            _keys.push_back(key);
+            _append(key, ref_member->keylen, item);
         } else if (type == ARRAY && reference_item->getJSONType() == OBJECT) {
-            YJSONObject* jobj = new YJSONObject(item->_data, item->_data_start, reference_item->_data_boundary);
+            YJSONObject* jobj = new(_doc->alloc(sizeof(YJSONObject))) YJSONObject(_doc, item->_data_start, item->_data_boundary);
             jobj->convert((YJSONObject*)reference_item, (YJSONArray*)item);
-            _parsed[key] = jobj;
-            _keys.push_back(key);
+            _append(key, ref_member->keylen, jobj);
         } else {
             throw YAPI_Exception(YAPI_IO_ERROR, "Unable to convert yzon struct");
 
         }
     }
+    _buildIndex();
 }
 
 string YJSONObject::getKeyFromIdx(int i)
 {
-    return _keys[i];
+    return string(_members[i].key, _members[i].keylen);
+}
+
+
+// n-point linear error correction, same result as YAPI::LinearCalibrationHandler
+// but working on plain arrays, so that it can be applied without vector copies
+static double yLinearCalibration(double rawValue, const double* calRaw, const double* calRef, int npt)
+{
+    double x = calRaw[0];
+    double adj = calRef[0] - x;
+    int i = 0;
+
+    while (rawValue > calRaw[i] && ++i < npt) {
+        double x2 = x;
+        double adj2 = adj;
+
+        x = calRaw[i];
+        adj = calRef[i] - x;
+        if (rawValue < x && x > x2) {
+            adj = adj2 + (adj - adj2) * (rawValue - x2) / (x - x2);
+        }
+    }
+    return rawValue + adj;
+}
+
+// 32-bit values are sent as two 16-bit words, low word first. Averages
+// have the sign bit of the high word inverted.
+static inline int yDecodeStreamVal(int lo, int hi)
+{
+    return (int)((unsigned)lo + ((unsigned)hi << 16));
+}
+
+static inline int yDecodeStreamAvg(int lo, int hi)
+{
+    return (int)((unsigned)lo + ((unsigned)(hi ^ 0x8000) << 16));
 }
 
 
@@ -903,6 +1142,7 @@ YDataStream::YDataStream(YFunction* parent):
     ,_maxVal(0.0)
     ,_caltyp(0)
 //--- (end of generated code: YDataStream initialization)
+    ,_calhdl(NULL)
 {
     _parent = parent;
 }
@@ -927,6 +1167,7 @@ YDataStream::YDataStream(YFunction* parent, YDataSet& dataset, const vector<int>
     ,_maxVal(0.0)
     ,_caltyp(0)
 //--- (end of generated code: YDataStream initialization)
+    ,_calhdl(NULL)
 {
     _parent = parent;
     this->_initFromDataSet(&dataset, encoded);
@@ -939,7 +1180,9 @@ YDataStream::~YDataStream()
     _calpar.clear();
     _calraw.clear();
     _calref.clear();
-    _values.clear();
+    _minColumn.clear();
+    _avgColumn.clear();
+    _maxColumn.clear();
 }
 
 // YDataSet constructor, when instantiated directly by a function
@@ -1022,7 +1265,7 @@ int YDataSet::_parse(const string& json)
             double streamStartTime, startTime = 0x7fffffff;
             _streams = vector<YDataStream*>();
             _preview = vector<YMeasure>();
-            _measures = vector<YMeasure>();
+            this->_clearMeasures();
             if (yJsonParse(&j) != YJSON_PARSE_AVAIL || j.token[0] != '[') {
                 return YAPI_NOT_SUPPORTED;
             }
@@ -1435,37 +1678,12 @@ int YDataStream::_initFromDataSet(YDataSet* dataset,vector<int> encoded)
 
 int YDataStream::_parseStream(string sdata)
 {
-    int idx = 0;
-    vector<int> udat;
-    vector<double> dat;
     if ((int)(sdata).size() == 0) {
         _nRows = 0;
         return YAPI_SUCCESS;
     }
 
-    udat = YAPI::_decodeWords(_parent->_json_get_string(sdata));
-    _values.clear();
-    idx = 0;
-    if (_isAvg) {
-        while (idx + 3 < (int)udat.size()) {
-            dat.clear();
-            dat.push_back(this->_decodeVal(udat[idx + 2] + (((udat[idx + 3]) << (16)))));
-            dat.push_back(this->_decodeAvg(udat[idx] + (((((udat[idx + 1]) ^ (0x8000))) << (16))), 1));
-            dat.push_back(this->_decodeVal(udat[idx + 4] + (((udat[idx + 5]) << (16)))));
-            idx = idx + 6;
-            _values.push_back(dat);
-        }
-    } else {
-        while (idx + 1 < (int)udat.size()) {
-            dat.clear();
-            dat.push_back(this->_decodeAvg(udat[idx] + (((((udat[idx + 1]) ^ (0x8000))) << (16))), 1));
-            _values.push_back(dat);
-            idx = idx + 2;
-        }
-    }
-
-    _nRows = (int)_values.size();
-    return YAPI_SUCCESS;
+    return this->_decodeStream(_parent->_json_get_string(sdata));
 }
 
 string YDataStream::_get_url(void)
@@ -1478,7 +1696,15 @@ string YDataStream::_get_url(void)
 
 int YDataStream::loadStream(void)
 {
-    return this->_parseStream(_parent->_download(this->_get_url()));
+    string data;
+    int res;
+    if (this->_loadCache(data)) {
+        return this->_parseStream(data);
+    }
+    data = _parent->_download(this->_get_url());
+    res = this->_parseStream(data);
+    this->_saveCache(data);
+    return res;
 }
 
 double YDataStream::_decodeVal(int w)
@@ -1507,6 +1733,77 @@ double YDataStream::_decodeAvg(int dw,int count)
     return val;
 }
 
+// Name of the local copy of the stream in the history cache, or an empty
+// string when the cache is disabled or when the stream may still grow
+string YDataStream::_get_cachePath(void)
+{
+    string dir, hwid;
+    if (!_isClosed) {
+        return "";
+    }
+    dir = YAPI::GetHistoryCacheDir();
+    if (dir == "") {
+        return "";
+    }
+    if (_cacheFile == "") {
+        hwid = _parent->get_hardwareId();
+        if (hwid == YFunction::HARDWAREID_INVALID) {
+            return "";
+        }
+        _cacheFile = YapiWrapper::ysprintf("%s_%d_%u.ystream", hwid.c_str(), _runNo, _utcStamp);
+    }
+    if (dir[dir.size() - 1] != '/' && dir[dir.size() - 1] != '\\') {
+        dir += "/";
+    }
+    return dir + _cacheFile;
+}
+
+// Load the content of a closed stream from the history cache
+bool YDataStream::_loadCache(string& data)
+{
+    string path = this->_get_cachePath();
+    FILE* f;
+    long size;
+    bool ok = false;
+
+    if (path == "" || (f = fopen(path.c_str(), "rb")) == NULL) {
+        return false;
+    }
+    if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > 2 && fseek(f, 0, SEEK_SET) == 0) {
+        data.resize(size);
+        ok = (fread(&data[0], 1, size, f) == (size_t)size && data[0] == '"');
+    }
+    fclose(f);
+    return ok;
+}
+
+// Save the content of a closed stream downloaded from the device to the
+// history cache. The file is written under a temporary name first, so that
+// a partial file is never used.
+void YDataStream::_saveCache(const string& data)
+{
+    string path, tmppath;
+    FILE* f;
+    bool ok;
+
+    if (data.size() <= 2 || data[0] != '"' || _nRows <= 0) {
+        return;
+    }
+    path = this->_get_cachePath();
+    if (path == "") {
+        return;
+    }
+    tmppath = YapiWrapper::ysprintf("%s.%p.tmp", path.c_str(), this);
+    if ((f = fopen(tmppath.c_str(), "wb")) == NULL) {
+        return;
+    }
+    ok = (fwrite(data.data(), 1, data.size(), f) == data.size());
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmppath.c_str(), path.c_str()) != 0) {
+        remove(tmppath.c_str());
+    }
+}
+
 bool YDataStream::isClosed(void)
 {
     return _isClosed;
@@ -1734,10 +2031,10 @@ double YDataStream::get_realDuration(void)
  */
 vector< vector<double> > YDataStream::get_dataRows(void)
 {
-    if (((int)_values.size() == 0) || !(_isClosed)) {
+    if (((int)_avgColumn.size() == 0) || !(_isClosed)) {
         this->loadStream();
     }
-    return _values;
+    return this->_getDataRows();
 }
 
 /**
@@ -1758,39 +2055,163 @@ vector< vector<double> > YDataStream::get_dataRows(void)
  */
 double YDataStream::get_data(int row,int col)
 {
-    if (((int)_values.size() == 0) || !(_isClosed)) {
+    const double* values;
+    if (((int)_avgColumn.size() == 0) || !(_isClosed)) {
         this->loadStream();
     }
-    if (row >= (int)_values.size()) {
-        return Y_DATA_INVALID;
-    }
-    if (col >= (int)_values[row].size()) {
+    if (row >= this->_getColumnData(col, values)) {
         return Y_DATA_INVALID;
     }
-    return _values[row][col];
+    return values[row];
 }
 //--- (end of generated code: YDataStream implementation)
 
-YMeasure::YMeasure(double start, double end, double minVal, double avgVal, double maxVal):
-    //--- (generated code: YMeasure initialization)
-    _start(0.0)
-    ,_end(0.0)
-    ,_minVal(0.0)
-    ,_avgVal(0.0)
-    ,_maxVal(0.0)
-//--- (end of generated code: YMeasure initialization)
+// Decode all the rows of a stream at once into the min/avg/max columns,
+// then apply the calibration to each column in a single pass
+int YDataStream::_decodeStream(const string& sval)
 {
-    _start = start;
-    _end = end;
-    _minVal = minVal;
-    _avgVal = avgVal;
-    _maxVal = maxVal;
-    _startTime_t = (time_t)(start + 0.5);
-    _stopTime_t = (time_t)(end + 0.5);
-}
+    vector<int> udat;
+    const int *w;
+    int nwords, nrows, i;
 
-YMeasure::YMeasure():
-    //--- (generated code: YMeasure initialization)
+    // the buffer never needs more than one word per char
+    udat.resize(sval.size() + 1);
+    nwords = YAPI::_decodeWords(sval.data(), (int)sval.size(), &udat[0]);
+    w = &udat[0];
+    if (_isAvg) {
+        nrows = nwords / 6;
+        _minColumn.resize(nrows);
+        _avgColumn.resize(nrows);
+        _maxColumn.resize(nrows);
+        for (i = 0; i < nrows; i++, w += 6) {
+            _minColumn[i] = yDecodeStreamVal(w[2], w[3]) / 1000.0;
+            _avgColumn[i] = yDecodeStreamAvg(w[0], w[1]) / 1000.0;
+            _maxColumn[i] = yDecodeStreamVal(w[4], w[5]) / 1000.0;
+        }
+        this->_calibrateColumn(_minColumn);
+        this->_calibrateColumn(_avgColumn);
+        this->_calibrateColumn(_maxColumn);
+    } else {
+        nrows = nwords / 2;
+        _minColumn.clear();
+        _maxColumn.clear();
+        _avgColumn.resize(nrows);
+        for (i = 0; i < nrows; i++, w += 2) {
+            _avgColumn[i] = yDecodeStreamAvg(w[0], w[1]) / 1000.0;
+        }
+        this->_calibrateColumn(_avgColumn);
+    }
+
+    _nRows = nrows;
+    return YAPI_SUCCESS;
+}
+
+// Apply the stream calibration to a whole column of decoded values, in place.
+// The standard linear handler is applied directly on the calibration points,
+// any other handler is called for each value.
+void YDataStream::_calibrateColumn(vector<double>& values)
+{
+    int count = (int)values.size();
+    int npt, i;
+
+    if (_caltyp == 0 || _calhdl == NULL || count == 0) {
+        return;
+    }
+    npt = (int)_calraw.size();
+    if (_calhdl == YAPI::LinearCalibrationHandler && npt > 0 && npt == (int)_calref.size()) {
+        const double *calRaw = &_calraw[0];
+        const double *calRef = &_calref[0];
+        double *val = &values[0];
+
+        if (_caltyp < YOCTO_CALIB_TYPE_OFS && _caltyp % 10 < npt) {
+            npt = _caltyp % 10;
+        }
+        for (i = 0; i < count; i++) {
+            val[i] = yLinearCalibration(val[i], calRaw, calRef, npt);
+        }
+    } else {
+        for (i = 0; i < count; i++) {
+            values[i] = _calhdl(values[i], _caltyp, _calpar, _calraw, _calref);
+        }
+    }
+}
+
+// Rebuild the rows of the stream from the decoded columns
+vector< vector<double> > YDataStream::_getDataRows(void)
+{
+    vector< vector<double> > rows;
+    vector<double> row;
+
+    rows.reserve(_avgColumn.size());
+    for (unsigned ii = 0; ii < _avgColumn.size(); ii++) {
+        row.clear();
+        if (_isAvg) {
+            row.push_back(_minColumn[ii]);
+            row.push_back(_avgColumn[ii]);
+            row.push_back(_maxColumn[ii]);
+        } else {
+            row.push_back(_avgColumn[ii]);
+        }
+        rows.push_back(row);
+    }
+    return rows;
+}
+
+int YDataStream::_getColumnData(int col, const double*& values)
+{
+    vector<double>* column;
+
+    values = NULL;
+    if (_isAvg) {
+        if (col == 0) {
+            column = &_minColumn;
+        } else if (col == 1) {
+            column = &_avgColumn;
+        } else if (col == 2) {
+            column = &_maxColumn;
+        } else {
+            return 0;
+        }
+    } else if (col == 0) {
+        column = &_avgColumn;
+    } else {
+        return 0;
+    }
+    if (column->size() == 0) {
+        return 0;
+    }
+    values = &(*column)[0];
+    return (int)column->size();
+}
+
+int YDataStream::get_columnData(int col, const double*& values)
+{
+    if (((int)_avgColumn.size() == 0) || !(_isClosed)) {
+        this->loadStream();
+    }
+    return this->_getColumnData(col, values);
+}
+
+YMeasure::YMeasure(double start, double end, double minVal, double avgVal, double maxVal):
+    //--- (generated code: YMeasure initialization)
+    _start(0.0)
+    ,_end(0.0)
+    ,_minVal(0.0)
+    ,_avgVal(0.0)
+    ,_maxVal(0.0)
+//--- (end of generated code: YMeasure initialization)
+{
+    _start = start;
+    _end = end;
+    _minVal = minVal;
+    _avgVal = avgVal;
+    _maxVal = maxVal;
+    _startTime_t = (time_t)(start + 0.5);
+    _stopTime_t = (time_t)(end + 0.5);
+}
+
+YMeasure::YMeasure():
+    //--- (generated code: YMeasure initialization)
     _start(0.0)
     ,_end(0.0)
     ,_minVal(0.0)
@@ -1899,17 +2320,7 @@ vector<int> YDataSet::_get_calibration(void)
 int YDataSet::processMore(int progress,string data)
 {
     YDataStream* stream = NULL;
-    vector< vector<double> > dataRows;
     string strdata;
-    double tim = 0.0;
-    double itv = 0.0;
-    double fitv = 0.0;
-    double end_ = 0.0;
-    int nCols = 0;
-    int minCol = 0;
-    int avgCol = 0;
-    int maxCol = 0;
-    bool firstMeasure = 0;
 
     if (progress != _progress) {
         return _progress;
@@ -1924,48 +2335,8 @@ int YDataSet::processMore(int progress,string data)
     }
     stream = _streams[_progress];
     stream->_parseStream(data);
-    dataRows = stream->get_dataRows();
     _progress = _progress + 1;
-    if ((int)dataRows.size() == 0) {
-        return this->get_progress();
-    }
-    tim = stream->get_realStartTimeUTC();
-    fitv = stream->get_firstDataSamplesInterval();
-    itv = stream->get_dataSamplesInterval();
-    if (fitv == 0) {
-        fitv = itv;
-    }
-    if (tim < itv) {
-        tim = itv;
-    }
-    nCols = (int)dataRows[0].size();
-    minCol = 0;
-    if (nCols > 2) {
-        avgCol = 1;
-    } else {
-        avgCol = 0;
-    }
-    if (nCols > 2) {
-        maxCol = 2;
-    } else {
-        maxCol = 0;
-    }
-
-    firstMeasure = true;
-    for (unsigned ii = 0; ii < dataRows.size(); ii++) {
-        if (firstMeasure) {
-            end_ = tim + fitv;
-            firstMeasure = false;
-        } else {
-            end_ = tim + itv;
-        }
-        if ((tim >= _startTime) && ((_endTime == 0) || (end_ <= _endTime))) {
-            _measures.push_back(YMeasure(tim , end_,
-            dataRows[ii][minCol],
-            dataRows[ii][avgCol],dataRows[ii][maxCol]));
-        }
-        tim = end_;
-    }
+    this->_appendMeasures(stream, true, _measureStart, _measureEnd, _measureMin, _measureAvg, _measureMax);
     return this->get_progress();
 }
 
@@ -2101,6 +2472,8 @@ int YDataSet::get_progress(void)
 int YDataSet::loadMore(void)
 {
     string url;
+    string data;
+    int res;
     YDataStream* stream = NULL;
     if (_progress < 0) {
         url = YapiWrapper::ysprintf("logger.json?id=%s",_functionId.c_str());
@@ -2115,15 +2488,24 @@ int YDataSet::loadMore(void)
             return 100;
         } else {
             stream = _streams[_progress];
+            if (stream->_loadCache(data)) {
+                return this->processMore(_progress, data);
+            }
             url = stream->_get_url();
         }
     }
     try {
-        return this->processMore(_progress, _parent->_download(url));
+        data = _parent->_download(url);
+        res = this->processMore(_progress, data);
     } catch (std::exception& e) {
         e.what();
-        return this->processMore(_progress, _parent->_download(url));
+        data = _parent->_download(url);
+        res = this->processMore(_progress, data);
     }
+    if (stream != NULL) {
+        stream->_saveCache(data);
+    }
+    return res;
 }
 
 /**
@@ -2185,15 +2567,7 @@ vector<YMeasure> YDataSet::get_measuresAt(YMeasure measure)
 {
     double startUtc = 0.0;
     YDataStream* stream = NULL;
-    vector< vector<double> > dataRows;
     vector<YMeasure> measures;
-    double tim = 0.0;
-    double itv = 0.0;
-    double end_ = 0.0;
-    int nCols = 0;
-    int minCol = 0;
-    int avgCol = 0;
-    int maxCol = 0;
 
     startUtc = measure.get_startTimeUTC();
     stream = NULL;
@@ -2205,38 +2579,7 @@ vector<YMeasure> YDataSet::get_measuresAt(YMeasure measure)
     if (stream == NULL) {
         return measures;
     }
-    dataRows = stream->get_dataRows();
-    if ((int)dataRows.size() == 0) {
-        return measures;
-    }
-    tim = stream->get_realStartTimeUTC();
-    itv = stream->get_dataSamplesInterval();
-    if (tim < itv) {
-        tim = itv;
-    }
-    nCols = (int)dataRows[0].size();
-    minCol = 0;
-    if (nCols > 2) {
-        avgCol = 1;
-    } else {
-        avgCol = 0;
-    }
-    if (nCols > 2) {
-        maxCol = 2;
-    } else {
-        maxCol = 0;
-    }
-
-    for (unsigned ii = 0; ii < dataRows.size(); ii++) {
-        end_ = tim + itv;
-        if ((tim >= _startTime) && ((_endTime == 0) || (end_ <= _endTime))) {
-            measures.push_back(YMeasure(tim, end_,
-            dataRows[ii][minCol],
-            dataRows[ii][avgCol],dataRows[ii][maxCol]));
-        }
-        tim = end_;
-    }
-    return measures;
+    return this->_getStreamMeasures(stream);
 }
 
 /**
@@ -2266,15 +2609,324 @@ vector<YMeasure> YDataSet::get_measuresAt(YMeasure measure)
  */
 vector<YMeasure> YDataSet::get_measures(void)
 {
-    return _measures;
+    return this->_getMeasures(_measureStart, _measureEnd, _measureMin, _measureAvg, _measureMax);
 }
 //--- (end of generated code: YDataSet implementation)
 
+void YDataSet::_clearMeasures(void)
+{
+    // release the memory, not only the content
+    vector<double>().swap(_measureStart);
+    vector<double>().swap(_measureEnd);
+    vector<double>().swap(_measureMin);
+    vector<double>().swap(_measureAvg);
+    vector<double>().swap(_measureMax);
+}
+
+// Append the measures of a loaded stream that are within the time range
+// of the dataset to the given columns. Streams of single measures use the
+// same value for min, avg and max.
+void YDataSet::_appendMeasures(YDataStream* stream, bool useFirstDuration, vector<double>& start,
+                               vector<double>& end, vector<double>& minVal, vector<double>& avgVal, vector<double>& maxVal)
+{
+    const double* minCol;
+    const double* avgCol;
+    const double* maxCol;
+    double tim, itv, fitv, end_;
+    int nRows;
+
+    nRows = stream->_getColumnData(0, minCol);
+    if (nRows == 0) {
+        return;
+    }
+    if (stream->_getColumnData(1, avgCol) != nRows || stream->_getColumnData(2, maxCol) != nRows) {
+        avgCol = minCol;
+        maxCol = minCol;
+    }
+    tim = stream->get_realStartTimeUTC();
+    itv = stream->get_dataSamplesInterval();
+    fitv = (useFirstDuration ? stream->get_firstDataSamplesInterval() : itv);
+    if (fitv == 0) {
+        fitv = itv;
+    }
+    if (tim < itv) {
+        tim = itv;
+    }
+    for (int ii = 0; ii < nRows; ii++) {
+        end_ = tim + (ii == 0 ? fitv : itv);
+        if ((tim >= _startTime) && ((_endTime == 0) || (end_ <= _endTime))) {
+            start.push_back(tim);
+            end.push_back(end_);
+            minVal.push_back(minCol[ii]);
+            avgVal.push_back(avgCol[ii]);
+            maxVal.push_back(maxCol[ii]);
+        }
+        tim = end_;
+    }
+}
+
+// Build YMeasure objects from measures stored by field
+vector<YMeasure> YDataSet::_getMeasures(const vector<double>& start, const vector<double>& end,
+                                        const vector<double>& minVal, const vector<double>& avgVal, const vector<double>& maxVal)
+{
+    vector<YMeasure> measures;
+
+    measures.reserve(start.size());
+    for (unsigned ii = 0; ii < start.size(); ii++) {
+        measures.push_back(YMeasure(start[ii], end[ii], minVal[ii], avgVal[ii], maxVal[ii]));
+    }
+    return measures;
+}
+
+// Load a stream if needed and return its measures that are within the
+// time range of the dataset
+vector<YMeasure> YDataSet::_getStreamMeasures(YDataStream* stream)
+{
+    const double* values;
+    vector<double> start, end, minVal, avgVal, maxVal;
+
+    if (stream->get_columnData(0, values) == 0) {
+        return vector<YMeasure>();
+    }
+    this->_appendMeasures(stream, false, start, end, minVal, avgVal, maxVal);
+    return this->_getMeasures(start, end, minVal, avgVal, maxVal);
+}
+
+int YDataSet::get_measureCount(void)
+{
+    return (int)_measureStart.size();
+}
+
+YMeasureColumns YDataSet::get_measureColumns(void)
+{
+    YMeasureColumns columns;
+
+    columns.count = (int)_measureStart.size();
+    if (columns.count == 0) {
+        columns.startTime = columns.endTime = NULL;
+        columns.minValue = columns.averageValue = columns.maxValue = NULL;
+    } else {
+        columns.startTime = &_measureStart[0];
+        columns.endTime = &_measureEnd[0];
+        columns.minValue = &_measureMin[0];
+        columns.averageValue = &_measureAvg[0];
+        columns.maxValue = &_measureMax[0];
+    }
+    return columns;
+}
+
+int YDataSet::takeMeasureColumns(vector<double>& start, vector<double>& end,
+                                 vector<double>& minVal, vector<double>& avgVal, vector<double>& maxVal)
+{
+    int count = (int)_measureStart.size();
+
+    start.swap(_measureStart);
+    end.swap(_measureEnd);
+    minVal.swap(_measureMin);
+    avgVal.swap(_measureAvg);
+    maxVal.swap(_measureMax);
+    this->_clearMeasures();
+    return count;
+}
+
+// Shared state of the stream downloads issued by YDataSet::loadMoreParallel.
+// As for YBatchLoad, the structure is reference counted so that downloads
+// still in progress when the load is abandoned can complete safely.
+class YDataSetLoad {
+public:
+    struct Reply {
+        YDataSetLoad*   load;
+        bool            done;
+        bool            cached;
+        YRETCODE        retcode;
+        string          data;
+        string          errmsg;
+    };
+
+    yCRITICAL_SECTION   cs;
+    volatile s32        refcount;
+    vector<Reply*>      replies;
+
+    YDataSetLoad() : refcount(1)
+    {
+        yInitializeCriticalSection(&cs);
+    }
+
+    ~YDataSetLoad()
+    {
+        for (size_t i = 0; i < replies.size(); i++) {
+            delete replies[i];
+        }
+        yDeleteCriticalSection(&cs);
+    }
+
+    void addRef(void)
+    {
+        yAtomicAdd(&refcount, 1);
+    }
+
+    void release(void)
+    {
+        if (yAtomicAdd(&refcount, -1) == 0) {
+            delete this;
+        }
+    }
+};
+
+
+static void yDataSetLoadCallback(YDevice* device, void* context, YRETCODE returnval, const string& result, string& errmsg)
+{
+    YDataSetLoad::Reply* reply = (YDataSetLoad::Reply*)context;
+    YDataSetLoad* load = reply->load;
+
+    yEnterCriticalSection(&load->cs);
+    reply->retcode = returnval;
+    reply->data = result;
+    reply->errmsg = errmsg;
+    reply->done = true;
+    yLeaveCriticalSection(&load->cs);
+    load->release();
+}
+
+
+int YDataSet::loadMoreParallel(int maxStreams, int maxPending, YDataSetProgressCallback callback, void* context)
+{
+    YDataSetLoad* load;
+    YDataSetLoad::Reply* reply;
+    YDataStream* stream;
+    YRETCODE res = YAPI_SUCCESS;
+    string errmsg;
+    string data;
+    char errbuf[YOCTO_ERRMSG_LEN];
+    int first, last, next, r;
+    int devPending = 0;
+    int* devPendingPtr = &devPending;
+    size_t found;
+    bool done;
+    u64 deadline, now;
+
+    if (_progress < 0) {
+        // the list of streams must be known first
+        r = this->loadMore();
+        if (YISERR(r)) {
+            return r;
+        }
+        if (callback) {
+            callback(this, this->get_progress(), context);
+        }
+    }
+    first = _progress;
+    last = (int)_streams.size();
+    if (maxStreams > 0 && first + maxStreams < last) {
+        last = first + maxStreams;
+    }
+    if (maxPending < 1) {
+        maxPending = 1;
+    }
+
+    load = new YDataSetLoad();
+    next = first;
+    try {
+        deadline = YAPI::GetTickCount() + YIO_DEFAULT_TCP_TIMEOUT;
+        while (_progress < last) {
+            // keep up to maxPending downloads in progress
+            while (next < last && next - _progress < maxPending) {
+                reply = new YDataSetLoad::Reply();
+                reply->load = load;
+                reply->done = false;
+                reply->cached = false;
+                reply->retcode = YAPI_SUCCESS;
+                load->replies.push_back(reply);
+                if (_streams[next]->_loadCache(reply->data)) {
+                    // closed stream already available locally
+                    reply->cached = true;
+                    reply->done = true;
+                    next++;
+                    continue;
+                }
+                load->addRef();
+                // the kind of connection is only checked for the first request
+                if (YISERR(_parent->_downloadAsync(_streams[next]->_get_url(), yDataSetLoadCallback, reply,
+                                                   devPendingPtr, errmsg))) {
+                    // the callback is not invoked when the request could not be sent:
+                    // the stream is downloaded synchronously when it is its turn
+                    reply->retcode = YAPI_IO_ERROR;
+                    reply->done = true;
+                    load->release();
+                }
+                devPendingPtr = NULL;
+                if (devPending > 0) {
+                    maxPending = devPending;
+                }
+                next++;
+            }
+            // decode the next stream in order as soon as it has been received
+            reply = load->replies[_progress - first];
+            yEnterCriticalSection(&load->cs);
+            done = reply->done;
+            yLeaveCriticalSection(&load->cs);
+            now = YAPI::GetTickCount();
+            if (!done) {
+                if (now >= deadline) {
+                    res = YAPI_TIMEOUT;
+                    errmsg = "Timeout while loading data streams";
+                    break;
+                }
+                // completed network requests wake up yapiWaitForEvents, and
+                // replies from USB devices are processed by yapiHandleEvents
+                if (YISERR(res = yapiWaitForEvents((int)(deadline - now), errbuf))) {
+                    errmsg = errbuf;
+                    break;
+                }
+                continue;
+            }
+            data.swap(reply->data);
+            stream = _streams[_progress];
+            if (!reply->cached) {
+                found = data.find("\r\n\r\n");
+                if (YISERR(reply->retcode) || found == string::npos ||
+                    (data.compare(0, 4, "OK\r\n") != 0 && data.compare(0, 17, "HTTP/1.1 200 OK\r\n") != 0)) {
+                    // retry the failed download synchronously, as loadMore does,
+                    // so that an HTTP error is reported as such
+                    data = _parent->_download(stream->_get_url());
+                } else {
+                    data.erase(0, found + 4);
+                }
+            }
+            r = this->processMore(_progress, data);
+            if (!reply->cached) {
+                stream->_saveCache(data);
+            }
+            if (callback) {
+                callback(this, r, context);
+            }
+            deadline = YAPI::GetTickCount() + YIO_DEFAULT_TCP_TIMEOUT;
+        }
+    } catch (std::exception&) {
+        load->release();
+        throw;
+    }
+    load->release();
+    if (YISERR(res)) {
+        _parent->_throw(res, errmsg);
+        return res;
+    }
+    return this->get_progress();
+}
+
+
+int YDataSet::loadAll(YDataSetProgressCallback callback, void* context)
+{
+    return this->loadMoreParallel(0, YDATASET_MAX_PENDING, callback, context);
+}
+
 
 YAPIContext::YAPIContext():
     //--- (generated code: YAPIContext initialization)
     _defaultCacheValidity(5)
 //--- (end of generated code: YAPIContext initialization)
+    ,_functionScopedLoad(false)
+    ,_historyCacheDir("")
 {}
 
 YAPIContext::~YAPIContext()
@@ -2350,11 +3002,41 @@ u64 YAPIContext::GetCacheValidity(void)
 }
 //--- (end of generated code: YAPIContext implementation)
 
+void YAPIContext::SetFunctionScopedLoad(bool enabled)
+{
+    _functionScopedLoad = enabled;
+}
+
+bool YAPIContext::GetFunctionScopedLoad(void)
+{
+    return _functionScopedLoad;
+}
+
+void YAPIContext::SetHistoryCacheDir(const string& directory)
+{
+    _historyCacheDir = directory;
+}
+
+string YAPIContext::GetHistoryCacheDir(void)
+{
+    return _historyCacheDir;
+}
+
+void YAPIContext::SetHTTPPoolSize(int poolSize)
+{
+    yapiSetHTTPPoolSize(poolSize);
+}
+
+int YAPIContext::GetHTTPPoolSize(void)
+{
+    return yapiGetHTTPPoolSize();
+}
+
 //--- (generated code: YAPIContext functions)
 //--- (end of generated code: YAPIContext functions)
 
 
-std::map<string, YFunction*> YFunction::_cache;
+YFunctionRegistry YFunction::_cache;
 
 
 // Constructor is protected. Use the device-specific factory function to instantiate
@@ -2383,26 +3065,34 @@ YFunction::~YFunction()
 
 
 // function cache methods
-YFunction* YFunction::_FindFromCache(const string& classname, const string& func)
+YFunction* YFunction::_FindFromCache(const char* classname, const string& func)
+{
+    return _cache.find(classname, func);
+}
+
+// Find a function object previously indexed by its hardware descriptor
+YFunction* YFunction::_FindFromCache(const char* classname, YFUN_DESCR fundescr)
 {
-    if (_cache.find(classname + "_" + func) != _cache.end())
-        return _cache[classname + "_" + func];
-    return NULL;
+    return _cache.find(classname, fundescr);
 }
 
-void YFunction::_AddToCache(const string& classname, const string& func, YFunction* obj)
+void YFunction::_AddToCache(const char* classname, const string& func, YFunction* obj)
 {
-    _cache[classname + "_" + func] = obj;
+    _cache.add(classname, func, obj);
+}
+
+void YFunction::_AddToCache(const char* classname, YFUN_DESCR fundescr, YFunction* obj)
+{
+    _cache.add(classname, fundescr, obj);
 }
 
 void YFunction::_ClearCache()
 {
-    for (std::map<string, YFunction*>::iterator cache_iterator = _cache.begin();
-         cache_iterator != _cache.end(); ++cache_iterator) {
-        delete cache_iterator->second;
-    }
     _cache.clear();
-    _cache = std::map<string, YFunction*>();
+    _FunctionCallbacks.clear();
+    _TimedReportCallbackList.clear();
+    _ValueCallbackIndex.clear();
+    _TimedReportCallbackIndex.clear();
 }
 
 
@@ -2674,11 +3364,17 @@ int YFunction::_parserHelper(void)
 YFunction *YFunction::nextFunction(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Function", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YFunction::FindFunction(hwid);
+    if (next == NULL) {
+        next = YFunction::FindFunction(hwid);
+        YFunction::_AddToCache("Function", nextdescr, next);
+    }
+    return (YFunction*)next;
 }
 
 YFunction* YFunction::FirstFunction(void)
@@ -2727,7 +3423,13 @@ YRETCODE YFunction::_getDescriptor(YFUN_DESCR& fundescr, string& errmsg)
             return (YRETCODE)tmp_fundescr;
         }
     }
-    _fundescr = fundescr = tmp_fundescr;
+    if (_fundescr != tmp_fundescr) {
+        YFUN_DESCR olddescr = _fundescr;
+        _fundescr = tmp_fundescr;
+        _ValueCallbackIndex.rebind(this, olddescr);
+        _TimedReportCallbackIndex.rebind(this, olddescr);
+    }
+    fundescr = tmp_fundescr;
     return YAPI_SUCCESS;
 }
 
@@ -2754,6 +3456,19 @@ YRETCODE YFunction::_getDevice(YDevice*& dev, string& errmsg)
 
 // Return the next known function of current class listed in the yellow pages
 YRETCODE YFunction::_nextFunction(string& hwid)
+{
+    YFUN_DESCR nextdescr;
+    YFunction* next;
+
+    return _nextFunction(NULL, nextdescr, next, hwid);
+}
+
+// Method used to find the next instance of our function, without building its
+// hardware id when an object of the given class is already indexed for it.
+// On return, next is that object if found, otherwise hwid is the hardware id of the
+// next function (or an empty string if there is none). A NULL classname skips the
+// cache lookup, so that hwid is always set.
+YRETCODE YFunction::_nextFunction(const char* classname, YFUN_DESCR& nextdescr, YFunction*& next, string& hwid)
 {
     vector<YFUN_DESCR> v_fundescr;
     YFUN_DESCR fundescr;
@@ -2761,6 +3476,9 @@ YRETCODE YFunction::_nextFunction(string& hwid)
     string serial, funcId, funcName, funcVal, errmsg;
     int res;
 
+    next = NULL;
+    hwid = "";
+    nextdescr = Y_FUNCTIONDESCRIPTOR_INVALID;
     res = _getDescriptor(fundescr, errmsg);
     if (YISERR(res)) {
         _throw((YRETCODE)res, errmsg);
@@ -2772,10 +3490,16 @@ YRETCODE YFunction::_nextFunction(string& hwid)
         return (YRETCODE)res;
     }
     if (v_fundescr.size() == 0) {
-        hwid = "";
         return YAPI_SUCCESS;
     }
-    res = YapiWrapper::getFunctionInfo(v_fundescr[0], devdescr, serial, funcId, funcName, funcVal, errmsg);
+    nextdescr = v_fundescr[0];
+    if (classname != NULL) {
+        next = YFunction::_FindFromCache(classname, nextdescr);
+        if (next != NULL) {
+            return YAPI_SUCCESS;
+        }
+    }
+    res = YapiWrapper::getFunctionInfo(nextdescr, devdescr, serial, funcId, funcName, funcVal, errmsg);
     if (YISERR(res)) {
         _throw((YRETCODE)res, errmsg);
         return (YRETCODE)res;
@@ -3012,9 +3736,14 @@ int YFunction::_parse(YJSONObject* j)
 {
     this->_parseAttr(j);
     this->_parserHelper();
+    this->_parsedHook();
     return 0;
 }
 
+void YFunction::_parsedHook(void)
+{
+}
+
 // Set an attribute in the function, and parse the resulting new function state
 YRETCODE YFunction::_setAttr(string attrname, string newvalue)
 {
@@ -3022,6 +3751,10 @@ YRETCODE YFunction::_setAttr(string attrname, string newvalue)
     int res;
     YDevice* dev;
 
+    // changes made while a YDeviceBatch is recording are sent by YDeviceBatch::commit
+    if (YDeviceBatch::_Record(this, attrname, newvalue)) {
+        return YAPI_SUCCESS;
+    }
     // Execute http request
     res = _buildSetRequest(attrname, &newvalue, request, errmsg);
     if (YISERR(res)) {
@@ -3117,10 +3850,42 @@ string YFunction::_download(const string& url)
 }
 
 
-// Method used to upload a file to the device
-YRETCODE YFunction::_uploadWithProgress(const string& path, const string& content, yapiRequestProgressCallback callback, void* context)
+// Method used to send an asynchronous http request to the device (not the function).
+// The raw reply, including the http header, is passed to the callback, which is
+// only invoked if the request could be sent. When maxPending is not NULL, it is set
+// to 1 unless the device is reached through a websocket hub: USB devices and HTTP
+// connections process one request at a time
+YRETCODE YFunction::_downloadAsync(const string& url, HTTPRequestCallback callback, void* context, int* maxPending, string& errmsg)
 {
-    string request, buffer;
+    YDevice* dev;
+    YRETCODE res;
+    string request;
+    string path;
+
+    yEnterCriticalSection(&_this_cs);
+    res = _getDevice(dev, errmsg);
+    yLeaveCriticalSection(&_this_cs);
+    if (YISERR(res)) {
+        return res;
+    }
+    if (maxPending) {
+        res = dev->getDevicePath(path, errmsg);
+        if (YISERR(res)) {
+            return res;
+        }
+        if (path.compare(0, 5, "ws://") != 0) {
+            *maxPending = 1;
+        }
+    }
+    request = "GET /" + url + " HTTP/1.1\r\n\r\n";
+    return dev->HTTPGetAsync(0, request, callback, context, errmsg);
+}
+
+
+// Method used to upload a file to the device
+YRETCODE YFunction::_uploadWithProgress(const string& path, const string& content, yapiRequestProgressCallback callback, void* context)
+{
+    string request, buffer;
     string boundary;
     size_t found;
 
@@ -3374,52 +4139,104 @@ bool YFunction::isOnline(void)
     return true;
 }
 
+// Resolve the serial number and function identifier of the function.
+YRETCODE YFunction::_getFunctionIds(char* serial, char* funcId, string& errmsg)
+{
+    YFUN_DESCR fundescr;
+    int res;
+    char errbuf[YOCTO_ERRMSG_LEN];
+
+    fundescr = YapiWrapper::getFunction(_className, _func, errmsg);
+    if (YISERR(fundescr)) {
+        return (YRETCODE)fundescr;
+    }
+    res = yapiGetFunctionInfo(fundescr, NULL, serial, funcId, NULL, NULL, errbuf);
+    if (YISERR(res)) {
+        errmsg = errbuf;
+        return (YRETCODE)res;
+    }
+    return YAPI_SUCCESS;
+}
+
+
+// Load the function attributes from the api.json structure of its device.
+YRETCODE YFunction::_loadFromAPI_unsafe(YJSONObject* apires, u64 msValidity, string& errmsg)
+{
+    int res;
+    char serial[YOCTO_SERIAL_LEN];
+    char funcId[YOCTO_FUNCTION_LEN];
+
+    res = _getFunctionIds(serial, funcId, errmsg);
+    if (YISERR(res)) {
+        return (YRETCODE)res;
+    }
+    if (!apires->has(funcId)) {
+        errmsg = "unexpected JSON structure: missing function " + string(funcId);
+        return YAPI_IO_ERROR;
+    }
+    _cacheExpiration = yapiGetTickCount() + msValidity;
+    _serial = serial;
+    _funId = funcId;
+    _hwId = _serial + '.' + _funId;
+    _parse(apires->getYJSONObject(funcId));
+    return YAPI_SUCCESS;
+}
+
+
 YRETCODE YFunction::_load_unsafe(u64 msValidity)
 {
     YJSONObject *j, *node;
     YDevice* dev;
     string errmsg;
-    YFUN_DESCR fundescr;
     int res;
-    char errbuf[YOCTO_ERRMSG_LEN];
     char serial[YOCTO_SERIAL_LEN];
     char funcId[YOCTO_FUNCTION_LEN];
 
-    // Resolve our reference to our device, load REST API
+    // Resolve our reference to our device
     res = _getDevice(dev, errmsg);
     if (YISERR(res)) {
         _throw((YRETCODE)res, errmsg);
         return (YRETCODE)res;
     }
-    res = dev->requestAPI(j, errmsg);
+
+    // Load REST API, either for the whole device or only for this function
+    if (!YAPI::_yapiContext.GetFunctionScopedLoad()) {
+        res = dev->retainAPI(j, errmsg);
+        if (!YISERR(res)) {
+            try {
+                res = _loadFromAPI_unsafe(j, msValidity, errmsg);
+            } catch (std::exception) {
+                dev->releaseAPI(j);
+                throw;
+            }
+            dev->releaseAPI(j);
+        }
+        if (YISERR(res)) {
+            _throw((YRETCODE)res, errmsg);
+        }
+        return (YRETCODE)res;
+    }
+    res = _getFunctionIds(serial, funcId, errmsg);
     if (YISERR(res)) {
         _throw((YRETCODE)res, errmsg);
         return (YRETCODE)res;
     }
-
-    // Get our function Id
-    fundescr = YapiWrapper::getFunction(_className, _func, errmsg);
-    if (YISERR(fundescr)) {
-        _throw((YRETCODE)fundescr, errmsg);
-        return (YRETCODE)fundescr;
-    }
-    res = yapiGetFunctionInfo(fundescr, NULL, serial, funcId, NULL, NULL, errbuf);
+    res = dev->retainFunctionAPI(funcId, node, errmsg);
     if (YISERR(res)) {
-        _throw((YRETCODE)res, errbuf);
+        _throw((YRETCODE)res, errmsg);
         return (YRETCODE)res;
     }
     _cacheExpiration = yapiGetTickCount() + msValidity;
     _serial = serial;
     _funId = funcId;
     _hwId = _serial + '.' + _funId;
-
     try {
-        node = j->getYJSONObject(funcId);
-    } catch (std::exception ex) {
-        _throw(YAPI_IO_ERROR, "unexpected JSON structure: missing function " + _funId);
-        return YAPI_IO_ERROR;
+        _parse(node);
+    } catch (std::exception) {
+        dev->releaseAPI(node);
+        throw;
     }
-    _parse(node);
+    dev->releaseAPI(node);
     return YAPI_SUCCESS;
 }
 
@@ -3453,445 +4270,2505 @@ YRETCODE YFunction::load(int msValidity)
 }
 
 
-/**
- * Invalidates the cache. Invalidates the cache of the function attributes. Forces the
- * next call to get_xxx() or loadxxx() to use values that come from the device.
- *
- * @noreturn
- */
-void YFunction::clearCache()
+// Shared state of a batched load (see YFunction::_LoadMany). The structure is
+// reference-counted, since an asynchronous reply may arrive after the caller
+// has given up waiting for it.
+class YBatchLoad
 {
-    YDevice* dev;
-    string errmsg, apires;
+public:
+    struct Reply {
+        YBatchLoad*     batch;
+        size_t          devidx;
+        bool            done;           // set by the callback
+        bool            processed;      // set by the caller once the reply is handled
+        YRETCODE        retcode;
+        string          data;
+        string          errmsg;
+    };
+    yCRITICAL_SECTION   cs;
+    yEvent              replyEvent;
+    volatile s32        refcount;
+    vector<Reply*>      replies;
 
+    YBatchLoad() : refcount(1)
+    {
+        yInitializeCriticalSection(&cs);
+        yCreateEvent(&replyEvent);
+    }
 
-    yEnterCriticalSection(&_this_cs);
-    // Resolve our reference to our device, load REST API
-    int res = _getDevice(dev, errmsg);
-    if (YISERR(res)) {
-        yLeaveCriticalSection(&_this_cs);
-        return;
+    ~YBatchLoad()
+    {
+        for (size_t i = 0; i < replies.size(); i++) {
+            delete replies[i];
+        }
+        yCloseEvent(&replyEvent);
+        yDeleteCriticalSection(&cs);
     }
-    dev->clearCache(false);
-    if (_cacheExpiration) {
-        _cacheExpiration = yapiGetTickCount();
+
+    void addRef(void)
+    {
+        yAtomicAdd(&refcount, 1);
     }
-    yLeaveCriticalSection(&_this_cs);
-}
 
+    void release(void)
+    {
+        if (yAtomicAdd(&refcount, -1) == 0) {
+            delete this;
+        }
+    }
+};
 
-/**
- * Gets the YModule object for the device on which the function is located.
- * If the function cannot be located on any module, the returned instance of
- * YModule is not shown as on-line.
- *
- * @return an instance of YModule
- */
-YModule* YFunction::get_module(void)
+
+static void yBatchLoadCallback(void* context, const u8* result, u32 resultlen, int retcode, const char* errmsg)
 {
-    YFUN_DESCR fundescr;
-    YDEV_DESCR devdescr;
-    string errmsg, serial, funcId, funcName, funcValue;
+    YBatchLoad::Reply* reply = (YBatchLoad::Reply*)context;
+    YBatchLoad* batch = reply->batch;
 
-    yEnterCriticalSection(&_this_cs);
-    fundescr = YapiWrapper::getFunction(_className, _func, errmsg);
-    if (!YISERR(fundescr)) {
-        if (!YISERR(YapiWrapper::getFunctionInfo(fundescr, devdescr, serial, funcId, funcName, funcValue, errmsg))) {
-            yLeaveCriticalSection(&_this_cs);
-            return yFindModule(serial + ".module");
-        }
+    yEnterCriticalSection(&batch->cs);
+    reply->retcode = (YRETCODE)retcode;
+    if (result && resultlen) {
+        reply->data.assign((const char*)result, resultlen);
     }
-    // return a true YModule object even if it is not a module valid for communicating
-    yLeaveCriticalSection(&_this_cs);
-    return yFindModule(string("module_of_") + _className + "_" + _func);
+    if (errmsg) {
+        reply->errmsg = errmsg;
+    }
+    reply->done = true;
+    ySetEvent(&batch->replyEvent);
+    yLeaveCriticalSection(&batch->cs);
+    batch->release();
 }
 
 
-/**
- * Returns the value of the userData attribute, as previously stored using method
- * set_userData.
- * This attribute is never touched directly by the API, and is at disposal of the caller to
- * store a context.
- *
- * @return the object stored previously by the caller.
- */
-void* YFunction::get_userData(void)
+// Load the attributes of a list of functions hosted by the same device,
+// from the api.json structure of the device.
+YRETCODE YFunction::_LoadFromAPI(const vector<YFunction*>& functions, YJSONObject* apires, u64 msValidity, string& errmsg)
 {
-    void* res;
-    yEnterCriticalSection(&_this_cs);
-    res = _userData;
-    yLeaveCriticalSection(&_this_cs);
+    YRETCODE res = YAPI_SUCCESS;
+    string tmperr;
+
+    for (size_t i = 0; i < functions.size(); i++) {
+        YFunction* fun = functions[i];
+        YRETCODE r;
+        yEnterCriticalSection(&fun->_this_cs);
+        try {
+            r = fun->_loadFromAPI_unsafe(apires, msValidity, tmperr);
+        } catch (std::exception) {
+            yLeaveCriticalSection(&fun->_this_cs);
+            throw;
+        }
+        yLeaveCriticalSection(&fun->_this_cs);
+        if (YISERR(r) && res == YAPI_SUCCESS) {
+            res = r;
+            errmsg = tmperr;
+        }
+    }
     return res;
 }
 
 
-/**
- * Stores a user context provided as argument in the userData attribute of the function.
- * This attribute is never touched by the API, and is at disposal of the caller to store a context.
- *
- * @param data : any kind of object to be stored
- * @noreturn
- */
-void YFunction::set_userData(void* data)
+// Same as _LoadFromAPI, then give back the retained device tree
+YRETCODE YFunction::_LoadFromAPIRelease(YDevice* dev, const vector<YFunction*>& functions, YJSONObject* apires, u64 msValidity, string& errmsg)
 {
-    yEnterCriticalSection(&_this_cs);
-    _userData = data;
-    yLeaveCriticalSection(&_this_cs);
-}
-
+    YRETCODE res;
 
-/**
- * Returns a unique identifier of type YFUN_DESCR corresponding to the function.
- * This identifier can be used to test if two instances of YFunction reference the same
- * physical function on the same physical device.
- *
- * @return an identifier of type YFUN_DESCR.
- *
- * If the function has never been contacted, the returned value is Y_FUNCTIONDESCRIPTOR_INVALID.
- */
-YFUN_DESCR YFunction::get_functionDescriptor(void)
-{
-    // do not take CS un purpose
-    return _fundescr;
+    try {
+        res = _LoadFromAPI(functions, apires, msValidity, errmsg);
+    } catch (std::exception) {
+        dev->releaseAPI(apires);
+        throw;
+    }
+    dev->releaseAPI(apires);
+    return res;
 }
 
-void YFunction::_UpdateValueCallbackList(YFunction* func, bool add)
+
+YRETCODE YFunction::_LoadMany(const vector<YFunction*>& functions, u64 msValidity, string& errmsg)
 {
-    if (add) {
-        func->isOnline();
-        vector<YFunction*>::iterator it;
-        for (it = _FunctionCallbacks.begin(); it < _FunctionCallbacks.end(); it++) {
-            if (*it == func)
-                return;
-        }
-        _FunctionCallbacks.push_back(func);
-    } else {
-        vector<YFunction*>::iterator it;
-        for (it = _FunctionCallbacks.begin(); it < _FunctionCallbacks.end(); it++) {
-            if (*it == func) {
-                _FunctionCallbacks.erase(it);
-                break;
+    vector<YDevice*> devices;
+    vector< vector<YFunction*> > devFunctions;
+    vector<size_t> syncDevices;
+    YBatchLoad* batch;
+    YJSONObject* apires;
+    YRETCODE res = YAPI_SUCCESS;
+    YRETCODE r;
+    string tmperr;
+    size_t i, k;
+    int pending = 0;
+    u64 deadline;
+
+    // group functions by device
+    for (i = 0; i < functions.size(); i++) {
+        YFunction* fun = functions[i];
+        YDevice* dev;
+        yEnterCriticalSection(&fun->_this_cs);
+        r = fun->_getDevice(dev, tmperr);
+        yLeaveCriticalSection(&fun->_this_cs);
+        if (YISERR(r)) {
+            if (res == YAPI_SUCCESS) {
+                res = r;
+                errmsg = tmperr;
             }
+            continue;
         }
+        for (k = 0; k < devices.size() && devices[k] != dev; k++);
+        if (k == devices.size()) {
+            devices.push_back(dev);
+            devFunctions.push_back(vector<YFunction*>());
+        }
+        devFunctions[k].push_back(fun);
     }
-}
 
-
-void YFunction::_UpdateTimedReportCallbackList(YFunction* func, bool add)
-{
-    if (add) {
-        func->isOnline();
-        vector<YFunction*>::iterator it;
-        for (it = _TimedReportCallbackList.begin(); it < _TimedReportCallbackList.end(); it++) {
-            if (*it == func)
-                return;
+    // send one asynchronous api.json request to each network device whose cache has expired
+    batch = new YBatchLoad();
+    for (k = 0; k < devices.size(); k++) {
+        YBatchLoad::Reply* reply;
+        if (devices[k]->isAPICacheValid()) {
+            syncDevices.push_back(k);
+            continue;
         }
-        _TimedReportCallbackList.push_back(func);
-    } else {
-        vector<YFunction*>::iterator it;
-        for (it = _TimedReportCallbackList.begin(); it < _TimedReportCallbackList.end(); it++) {
-            if (*it == func) {
-                _TimedReportCallbackList.erase(it);
-                break;
-            }
+        reply = new YBatchLoad::Reply();
+        reply->batch = batch;
+        reply->devidx = k;
+        reply->done = false;
+        reply->processed = false;
+        reply->retcode = YAPI_SUCCESS;
+        yEnterCriticalSection(&batch->cs);
+        batch->replies.push_back(reply);
+        yLeaveCriticalSection(&batch->cs);
+        batch->addRef();
+        if (YISERR(devices[k]->requestAPIAsync(yBatchLoadCallback, reply, tmperr))) {
+            // the callback is not invoked when the request could not be sent
+            // (USB devices for instance): load this device synchronously
+            reply->processed = true;
+            batch->release();
+            syncDevices.push_back(k);
+        } else {
+            pending++;
         }
     }
-}
-
 
-void YModule::_updateModuleCallbackList(YModule* module, bool add)
-{
-    map<YModule*, int>::iterator entry = _moduleCallbackList.find(module);
-    if (add) {
-        module->isOnline();
-        if (entry != _moduleCallbackList.end()) {
-            _moduleCallbackList[module]++;
-        } else {
-            _moduleCallbackList[module] = 1;
+    try {
+        // load the other devices while the network requests are in progress
+        for (i = 0; i < syncDevices.size(); i++) {
+            k = syncDevices[i];
+            r = devices[k]->retainAPI(apires, tmperr);
+            if (!YISERR(r)) {
+                r = _LoadFromAPIRelease(devices[k], devFunctions[k], apires, msValidity, tmperr);
+            }
+            if (YISERR(r) && res == YAPI_SUCCESS) {
+                res = r;
+                errmsg = tmperr;
+            }
         }
-    } else {
-        if (entry != _moduleCallbackList.end()) {
-            if (_moduleCallbackList[module] > 0) {
-                _moduleCallbackList[module]--;
+
+        // process network replies as they arrive, while the device cache is still fresh
+        deadline = YAPI::GetTickCount() + YIO_DEFAULT_TCP_TIMEOUT;
+        while (pending > 0) {
+            vector<YBatchLoad::Reply*> ready;
+            u64 now;
+
+            yEnterCriticalSection(&batch->cs);
+            for (i = 0; i < batch->replies.size(); i++) {
+                YBatchLoad::Reply* reply = batch->replies[i];
+                if (reply->done && !reply->processed) {
+                    ready.push_back(reply);
+                }
+            }
+            yLeaveCriticalSection(&batch->cs);
+            for (i = 0; i < ready.size(); i++) {
+                YBatchLoad::Reply* reply = ready[i];
+                k = reply->devidx;
+                reply->processed = true;
+                pending--;
+                r = reply->retcode;
+                tmperr = reply->errmsg;
+                if (!YISERR(r)) {
+                    r = devices[k]->parseAPIReply(reply->data, apires, tmperr);
+                    if (!YISERR(r)) {
+                        r = _LoadFromAPIRelease(devices[k], devFunctions[k], apires, msValidity, tmperr);
+                    }
+                }
+                if (YISERR(r) && res == YAPI_SUCCESS) {
+                    res = r;
+                    errmsg = tmperr;
+                }
+            }
+            now = YAPI::GetTickCount();
+            if (pending > 0) {
+                if (now >= deadline) {
+                    if (res == YAPI_SUCCESS) {
+                        res = YAPI_TIMEOUT;
+                        errmsg = "Timeout while loading function attributes";
+                    }
+                    break;
+                }
+                yWaitForEvent(&batch->replyEvent, (int)(deadline - now));
             }
         }
+    } catch (std::exception) {
+        batch->release();
+        throw;
     }
+    batch->release();
+    return res;
 }
 
 
-// This is the internal device cache object
-vector<YDevice*> YDevice::_devCache;
+// Write-combining of attribute changes (see YDeviceBatch). The batches that
+// record set_xxx() calls are indexed by thread. The count of recording batches
+// spares the lookup to _setAttr when no batch is recording.
+static yCRITICAL_SECTION _deviceBatch_CS;
+static std::map<int, YDeviceBatch*> _recordingBatches;
+static volatile s32 _recordingCount = 0;
 
-YDevice::YDevice(YDEV_DESCR devdesc): _devdescr(devdesc), _cacheStamp(0), _cacheJson(NULL), _subpath(NULL)
+
+static void yDeviceBatchCallback(YDevice* device, void* context, YRETCODE returnval, const string& result, string& errmsg)
 {
-    yInitializeCriticalSection(&_lock);
-};
+    YBatchLoad::Reply* reply = (YBatchLoad::Reply*)context;
+    YBatchLoad* batch = reply->batch;
+
+    yEnterCriticalSection(&batch->cs);
+    reply->retcode = returnval;
+    reply->errmsg = errmsg;
+    reply->done = true;
+    ySetEvent(&batch->replyEvent);
+    yLeaveCriticalSection(&batch->cs);
+    batch->release();
+}
 
 
-YDevice::~YDevice() // destructor
+YDeviceBatch::YDeviceBatch():
+    _pending(false), _skipUnchanged(false), _thread(-1), _coalesced(0), _skipped(0), _sent(0)
+{}
+
+YDeviceBatch::~YDeviceBatch()
 {
-    clearCache(true);
-    yDeleteCriticalSection(&_lock);
+    _stopRecording();
 }
 
-void YDevice::ClearCache()
+void YDeviceBatch::_Init(void)
 {
-    for (unsigned int idx = 0; idx < YDevice::_devCache.size(); idx++) {
-        delete _devCache[idx];
-    }
-    _devCache.clear();
-    _devCache = vector<YDevice*>();
+    yInitializeCriticalSection(&_deviceBatch_CS);
 }
 
+void YDeviceBatch::_Free(void)
+{
+    _recordingBatches.clear();
+    _recordingCount = 0;
+    yDeleteCriticalSection(&_deviceBatch_CS);
+}
 
-YDevice* YDevice::getDevice(YDEV_DESCR devdescr)
+void YDeviceBatch::_stopRecording(void)
 {
-    // Search in cache
-    yEnterCriticalSection(&YAPI::_global_cs);
-    for (unsigned int idx = 0; idx < YDevice::_devCache.size(); idx++) {
-        if (YDevice::_devCache[idx]->_devdescr == devdescr) {
-            yLeaveCriticalSection(&YAPI::_global_cs);
-            return YDevice::_devCache[idx];
+    if (_thread < 0) {
+        return;
+    }
+    if (YAPI::_apiInitialized) {
+        yEnterCriticalSection(&_deviceBatch_CS);
+        if (_recordingBatches.erase(_thread) > 0) {
+            yAtomicAdd(&_recordingCount, -1);
         }
+        yLeaveCriticalSection(&_deviceBatch_CS);
     }
+    _thread = -1;
+}
 
-    // Not found, add new entry
-    YDevice* dev = new YDevice(devdescr);
-    YDevice::_devCache.push_back(dev);
-    yLeaveCriticalSection(&YAPI::_global_cs);
+YRETCODE YDeviceBatch::begin(string& errmsg)
+{
+    std::map<int, YDeviceBatch*>::iterator it;
+    int thread = yThreadId();
 
-    return dev;
+    if (!YAPI::_apiInitialized) {
+        errmsg = "API not initialized";
+        return YAPI_NOT_INITIALIZED;
+    }
+    yEnterCriticalSection(&_deviceBatch_CS);
+    it = _recordingBatches.find(thread);
+    if (it != _recordingBatches.end() && it->second != this) {
+        yLeaveCriticalSection(&_deviceBatch_CS);
+        errmsg = "Another batch is already recording on this thread";
+        return YAPI_INVALID_ARGUMENT;
+    }
+    if (it == _recordingBatches.end()) {
+        _recordingBatches[thread] = this;
+        yAtomicAdd(&_recordingCount, 1);
+    }
+    yLeaveCriticalSection(&_deviceBatch_CS);
+    _thread = thread;
+    if (!_pending) {
+        _changes.clear();
+        _index.clear();
+        _coalesced = 0;
+    }
+    return YAPI_SUCCESS;
 }
 
+YRETCODE YDeviceBatch::set(YFunction* function, const string& attrName, const string& value)
+{
+    std::map<ChangeKey, size_t>::iterator it;
+    ChangeKey key(function, attrName);
+    Change change;
+
+    if (!_pending) {
+        // first change after a commit
+        _changes.clear();
+        _index.clear();
+        _pending = true;
+    }
+    it = _index.find(key);
+    if (it != _index.end()) {
+        _changes[it->second].value = value;
+        _coalesced++;
+        return YAPI_SUCCESS;
+    }
+    change.function = function;
+    change.attrName = attrName;
+    change.value = value;
+    change.status = YAPI_SUCCESS;
+    _index[key] = _changes.size();
+    _changes.push_back(change);
+    return YAPI_SUCCESS;
+}
 
-YRETCODE YDevice::HTTPRequestPrepare(const string& request, string& fullrequest, char* errbuff)
+bool YDeviceBatch::_Record(YFunction* function, const string& attrName, const string& value)
 {
-    YRETCODE res;
-    size_t pos;
-    // mutex allready taken by caller
-    if (_subpath == NULL) {
-        int neededsize;
-        res = yapiGetDevicePath(_devdescr, _rootdevice, NULL, 0, &neededsize, errbuff);
-        if (YISERR(res)) return res;
-        _subpath = new char[neededsize];
-        res = yapiGetDevicePath(_devdescr, _rootdevice, _subpath, neededsize, NULL, errbuff);
-        if (YISERR(res)) return res;
+    std::map<int, YDeviceBatch*>::iterator it;
+    YDeviceBatch* batch = NULL;
+
+    if (_recordingCount == 0 || !YAPI::_apiInitialized) {
+        return false;
     }
-    pos = request.find_first_of('/');
-    fullrequest = request.substr(0, pos) + (string)_subpath + request.substr(pos + 1);
+    yEnterCriticalSection(&_deviceBatch_CS);
+    it = _recordingBatches.find(yThreadId());
+    if (it != _recordingBatches.end()) {
+        batch = it->second;
+    }
+    yLeaveCriticalSection(&_deviceBatch_CS);
+    if (batch == NULL) {
+        return false;
+    }
+    batch->set(function, attrName, value);
+    return true;
+}
 
-    return YAPI_SUCCESS;
+void YDeviceBatch::cancel(void)
+{
+    _stopRecording();
+    _changes.clear();
+    _index.clear();
+    _pending = false;
 }
 
+void YDeviceBatch::set_skipUnchanged(bool skip)
+{
+    _skipUnchanged = skip;
+}
 
-YRETCODE YDevice::HTTPRequest_unsafe(int channel, const string& request, string& buffer, yapiRequestProgressCallback callback, void* context, string& errmsg)
+const vector<YDeviceBatch::Change>& YDeviceBatch::get_changes(void)
 {
-    char errbuff[YOCTO_ERRMSG_LEN] = "";
-    YRETCODE res;
-    YIOHDL iohdl;
-    string fullrequest;
-    char* reply;
-    int replysize = 0;
+    return _changes;
+}
 
-    if (YISERR(res = HTTPRequestPrepare(request, fullrequest, errbuff))) {
-        errmsg = (string)errbuff;
-        return res;
+int YDeviceBatch::get_coalescedCount(void)
+{
+    return _coalesced;
+}
+
+int YDeviceBatch::get_skippedCount(void)
+{
+    return _skipped;
+}
+
+int YDeviceBatch::get_sentCount(void)
+{
+    return _sent;
+}
+
+// Send all changes without waiting for the replies, so that the requests to the
+// same device are queued back to back (websocket hubs multiplex them, HTTP hubs
+// use several keep-alive connections), then collect the replies.
+YRETCODE YDeviceBatch::commit(string& errmsg)
+{
+    std::map<ChangeKey, string>::iterator last;
+    YBatchLoad* batch;
+    YBatchLoad::Reply* reply;
+    YRETCODE res = YAPI_SUCCESS;
+    YRETCODE r;
+    YRETCODE waitres = YAPI_SUCCESS;
+    string request, tmperr, waiterr;
+    char errbuf[YOCTO_ERRMSG_LEN];
+    size_t i;
+    int pending = 0;
+    u64 deadline, now;
+
+    _stopRecording();
+    _skipped = 0;
+    _sent = 0;
+    if (!_pending) {
+        _changes.clear();
+        _index.clear();
+        return YAPI_SUCCESS;
     }
-    if (YISERR(res = yapiHTTPRequestSyncStartOutOfBand(&iohdl, channel, _rootdevice, fullrequest.data(), (int)fullrequest.size(), &reply, &replysize, callback, context, errbuff))) {
-        errmsg = (string)errbuff;
-        return res;
+    _pending = false;
+    _index.clear();
+
+    batch = new YBatchLoad();
+    try {
+        for (i = 0; i < _changes.size(); i++) {
+            Change& change = _changes[i];
+            YFunction* fun = change.function;
+            YDevice* dev = NULL;
+            if (_skipUnchanged) {
+                last = _committed.find(ChangeKey(fun, change.attrName));
+                if (last != _committed.end() && last->second == change.value) {
+                    change.status = YAPI_SUCCESS;
+                    _skipped++;
+                    continue;
+                }
+            }
+            yEnterCriticalSection(&fun->_this_cs);
+            try {
+                r = fun->_buildSetRequest(change.attrName, &change.value, request, tmperr);
+                if (!YISERR(r)) {
+                    r = fun->_getDevice(dev, tmperr);
+                }
+                fun->_cacheExpiration = 0;
+            } catch (std::exception) {
+                yLeaveCriticalSection(&fun->_this_cs);
+                throw;
+            }
+            yLeaveCriticalSection(&fun->_this_cs);
+            if (!YISERR(r)) {
+                reply = new YBatchLoad::Reply();
+                reply->batch = batch;
+                reply->devidx = i;
+                reply->done = false;
+                reply->processed = false;
+                reply->retcode = YAPI_SUCCESS;
+                yEnterCriticalSection(&batch->cs);
+                batch->replies.push_back(reply);
+                yLeaveCriticalSection(&batch->cs);
+                batch->addRef();
+                r = dev->HTTPRequestAsync(0, request, yDeviceBatchCallback, reply, tmperr);
+                if (YISERR(r)) {
+                    // the callback is not invoked when the request could not be sent
+                    reply->processed = true;
+                    batch->release();
+                } else {
+                    pending++;
+                    _sent++;
+                }
+            }
+            change.status = r;
+            change.errmsg = (YISERR(r) ? tmperr : "");
+        }
+
+        // collect the replies
+        deadline = YAPI::GetTickCount() + YIO_DEFAULT_TCP_TIMEOUT;
+        while (pending > 0) {
+            yEnterCriticalSection(&batch->cs);
+            for (i = 0; i < batch->replies.size(); i++) {
+                reply = batch->replies[i];
+                if (reply->done && !reply->processed) {
+                    Change& change = _changes[reply->devidx];
+                    reply->processed = true;
+                    pending--;
+                    change.status = reply->retcode;
+                    change.errmsg = reply->errmsg;
+                }
+            }
+            yLeaveCriticalSection(&batch->cs);
+            now = YAPI::GetTickCount();
+            if (pending > 0) {
+                if (now >= deadline) {
+                    break;
+                }
+                // completed network requests wake up yapiWaitForEvents, and
+                // replies from USB devices are processed by yapiHandleEvents
+                waitres = yapiWaitForEvents((int)(deadline - now), errbuf);
+                if (YISERR(waitres)) {
+                    waiterr = errbuf;
+                    break;
+                }
+            }
+        }
+        yEnterCriticalSection(&batch->cs);
+        for (i = 0; i < batch->replies.size(); i++) {
+            reply = batch->replies[i];
+            if (!reply->processed) {
+                Change& change = _changes[reply->devidx];
+                if (YISERR(waitres)) {
+                    change.status = waitres;
+                    change.errmsg = waiterr;
+                } else {
+                    change.status = YAPI_TIMEOUT;
+                    change.errmsg = "Timeout while waiting for the attribute change";
+                }
+            }
+        }
+        yLeaveCriticalSection(&batch->cs);
+    } catch (std::exception) {
+        batch->release();
+        throw;
     }
-    if (replysize > 0 && reply != NULL) {
-        buffer = string(reply, replysize);
-    } else {
-        buffer = "";
+    batch->release();
+
+    for (i = 0; i < _changes.size(); i++) {
+        Change& change = _changes[i];
+        ChangeKey key(change.function, change.attrName);
+        if (YISERR(change.status)) {
+            _committed.erase(key);
+            if (res == YAPI_SUCCESS) {
+                res = change.status;
+                errmsg = change.errmsg;
+            }
+        } else {
+            _committed[key] = change.value;
+        }
     }
-    if (YISERR(res = yapiHTTPRequestSyncDone(&iohdl, errbuff))) {
-        errmsg = (string)errbuff;
-        return res;
+    return res;
+}
+
+
+// Local receive streams of serial and SPI ports (see YRxStream). Each active
+// stream is referenced by _rxStreams until it is stopped.
+#define YRXSTREAM_CHUNK     1024
+#define YRXSTREAM_POLL_MS   100
+static yCRITICAL_SECTION _rxStreams_CS;
+static vector<YRxStream*> _rxStreams;
+
+
+static void yRxStreamCallback(YDevice* device, void* context, YRETCODE returnval, const string& result, string& errmsg)
+{
+    YRxStream* stream = (YRxStream*)context;
+
+    stream->_received(returnval, result);
+    stream->release();
+}
+
+
+YRxStream::YRxStream(YFunction* port, int startpos, int bufferSize, int highWaterMark, YRxStreamCallback callback, void* context):
+    _port(port), _refcount(1), _head(0), _count(0), _devpos(startpos), _seq(0), _reqSeq(0),
+    _highWater(highWaterMark), _pollInterval(YRXSTREAM_POLL_MS), _nextPoll(0), _inFlight(false), _newData(false),
+    _stopped(false), _callback(callback), _context(context)
+{
+    if (bufferSize < YRXSTREAM_CHUNK) {
+        bufferSize = YRXSTREAM_CHUNK;
+    }
+    if (_highWater < 1) {
+        _highWater = 1;
+    } else if (_highWater > bufferSize) {
+        _highWater = bufferSize;
     }
+    _ring.resize(bufferSize);
+    yInitializeCriticalSection(&_lock);
+    // the registry holds its own reference until the stream is stopped
+    this->addRef();
+    yEnterCriticalSection(&_rxStreams_CS);
+    _rxStreams.push_back(this);
+    yLeaveCriticalSection(&_rxStreams_CS);
+}
 
-    return YAPI_SUCCESS;
+YRxStream::~YRxStream()
+{
+    yDeleteCriticalSection(&_lock);
 }
 
+void YRxStream::_Init(void)
+{
+    yInitializeCriticalSection(&_rxStreams_CS);
+}
 
-YRETCODE YDevice::HTTPRequestAsync(int channel, const string& request, HTTPRequestCallback callback, void* context, string& errmsg)
+void YRxStream::_Free(void)
 {
-    char errbuff[YOCTO_ERRMSG_LEN] = "";
-    YRETCODE res = YAPI_SUCCESS;
-    string fullrequest;
-    yEnterCriticalSection(&_lock);
-    _cacheStamp = YAPI::GetTickCount(); //invalidate cache
-    if (YISERR(res=HTTPRequestPrepare(request, fullrequest, errbuff)) ||
-        YISERR(res=yapiHTTPRequestAsyncOutOfBand(channel, _rootdevice, fullrequest.c_str(), (int)fullrequest.length(), NULL, NULL, errbuff))) {
-        errmsg = (string)errbuff;
+    for (size_t i = 0; i < _rxStreams.size(); i++) {
+        _rxStreams[i]->release();
     }
-    yLeaveCriticalSection(&_lock);
-    return res;
+    _rxStreams.clear();
+    yDeleteCriticalSection(&_rxStreams_CS);
+}
+
+void YRxStream::addRef(void)
+{
+    yAtomicAdd(&_refcount, 1);
 }
 
+void YRxStream::release(void)
+{
+    if (yAtomicAdd(&_refcount, -1) == 0) {
+        delete this;
+    }
+}
 
-YRETCODE YDevice::HTTPRequest(int channel, const string& request, string& buffer, yapiRequestProgressCallback callback, void* context, string& errmsg)
+void YRxStream::stop(void)
 {
-    YRETCODE res;
-    int locked = 0;
-    int i;
+    bool registered = false;
 
-    for (i = 0; !locked && i < 5; i++) {
-        locked = yTryEnterCriticalSection(&_lock);
-        if (!locked) {
-            yApproximateSleep(50);
+    yEnterCriticalSection(&_lock);
+    _stopped = true;
+    _port = NULL;
+    yLeaveCriticalSection(&_lock);
+    yEnterCriticalSection(&_rxStreams_CS);
+    for (size_t i = 0; i < _rxStreams.size(); i++) {
+        if (_rxStreams[i] == this) {
+            _rxStreams.erase(_rxStreams.begin() + i);
+            registered = true;
+            break;
         }
     }
-    if (!locked) {
-        yEnterCriticalSection(&_lock);
+    yLeaveCriticalSection(&_rxStreams_CS);
+    if (registered) {
+        this->release();
     }
-    res = HTTPRequest_unsafe(channel, request, buffer, callback, context, errmsg);
-    yLeaveCriticalSection(&_lock);
-    return res;
 }
 
+void YRxStream::signal(void)
+{
+    yEnterCriticalSection(&_lock);
+    _nextPoll = 0;
+    yLeaveCriticalSection(&_lock);
+}
 
-YRETCODE YDevice::requestAPI(YJSONObject*& apires, string& errmsg)
+// Invoked from the io thread with the raw reply to a rxdata.bin request
+void YRxStream::_received(YRETCODE retcode, const string& reply)
 {
-    yJsonStateMachine j;
-    string rootdev, buffer;
-    string request = "GET /api.json \r\n\r\n";
-    string json_str;
-    int res;
+    const char* p;
+    size_t found;
+    int len, endpos, fact, tail;
 
     yEnterCriticalSection(&_lock);
-
-    // Check if we have a valid cache value
-    if (_cacheStamp > YAPI::GetTickCount()) {
-        apires = _cacheJson;
+    _inFlight = false;
+    if (_stopped || _reqSeq != _seq) {
+        // position changed meanwhile, request again from the new position
+        _nextPoll = 0;
         yLeaveCriticalSection(&_lock);
-        return YAPI_SUCCESS;
+        return;
     }
-    if (_cacheJson == NULL) {
-        request = "GET /api.json \r\n\r\n";
-    } else {
-        string fw_release = _cacheJson->getYJSONObject("module")->getString("firmwareRelease");
-        fw_release = __escapeAttr(fw_release);
-        request = "GET /api.json?fw=" + fw_release + " \r\n\r\n";
+    _nextPoll = yapiGetTickCount() + _pollInterval;
+    found = reply.find("\r\n\r\n");
+    if (YISERR(retcode) || string::npos == found ||
+        (0 != reply.find("OK\r\n") && 0 != reply.find("HTTP/1.1 200 OK\r\n"))) {
+        yLeaveCriticalSection(&_lock);
+        return;
     }
-    // send request, without HTTP/1.1 suffix to get light headers
-    res = this->HTTPRequest_unsafe(0, request, buffer, NULL, NULL, errmsg);
-    if (YISERR(res)) {
+    // the data is followed by '@' and the device position after the data
+    p = reply.data() + found + 4;
+    len = (int)(reply.size() - found - 4);
+    endpos = 0;
+    fact = 1;
+    while (len > 0 && p[len - 1] != '@') {
+        len--;
+        if (p[len] >= '0' && p[len] <= '9') {
+            endpos += (p[len] - '0') * fact;
+            fact *= 10;
+        }
+    }
+    if (len == 0) {
         yLeaveCriticalSection(&_lock);
-        // Check if an update of the device list does not solve the issue
-        res = YapiWrapper::updateDeviceList(true, errmsg);
-        if (YISERR(res)) {
-            return (YRETCODE)res;
+        return;
+    }
+    len--;
+    if (len > (int)_ring.size() - _count) {
+        len = (int)_ring.size() - _count;
+        endpos = _devpos + len;
+    }
+    tail = (_head + _count) % (int)_ring.size();
+    for (int i = 0; i < len; i++) {
+        _ring[tail] = (u8)p[i];
+        if (++tail == (int)_ring.size()) {
+            tail = 0;
         }
-        yEnterCriticalSection(&_lock);
-        // send request, without HTTP/1.1 suffix to get light headers
-        res = this->HTTPRequest_unsafe(0, request, buffer, NULL, NULL, errmsg);
-        if (YISERR(res)) {
-            yLeaveCriticalSection(&_lock);
-            return (YRETCODE)res;
+    }
+    _count += len;
+    _devpos = endpos;
+    if (len > 0) {
+        _newData = true;
+        if (len >= YRXSTREAM_CHUNK) {
+            // more data are probably waiting in the device buffer
+            _nextPoll = 0;
         }
     }
+    yLeaveCriticalSection(&_lock);
+}
 
-    // Parse HTTP header
-    j.src = buffer.data();
-    j.end = j.src + buffer.size();
-    j.st = YJSON_HTTP_START;
-    if (yJsonParse(&j) != YJSON_PARSE_AVAIL || j.st != YJSON_HTTP_READ_CODE) {
-        errmsg = "Failed to parse HTTP header";
-        if (!YAPI::ExceptionsDisabled) {
-            throw YAPI_Exception(YAPI_IO_ERROR, errmsg);
-        }
+// Invoke the user callback and send the next request when needed
+void YRxStream::_pump(void)
+{
+    YFunction* port;
+    YRxStreamCallback callback = NULL;
+    void* context = NULL;
+    string url, errmsg;
+    int avail = 0;
+    int len;
+    u64 now;
+
+    yEnterCriticalSection(&_lock);
+    if (!_stopped && _newData && _count >= _highWater) {
+        _newData = false;
+        callback = _callback;
+        context = _context;
+        avail = _count;
+    }
+    port = _port;
+    yLeaveCriticalSection(&_lock);
+    if (callback && port) {
+        callback(port, avail, context);
+    }
+
+    yEnterCriticalSection(&_lock);
+    now = yapiGetTickCount();
+    len = (int)_ring.size() - _count;
+    if (len > YRXSTREAM_CHUNK) {
+        len = YRXSTREAM_CHUNK;
+    }
+    if (_stopped || _inFlight || len == 0 || now < _nextPoll) {
         yLeaveCriticalSection(&_lock);
-        return YAPI_IO_ERROR;
+        return;
+    }
+    port = _port;
+    url = YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _devpos, len);
+    _inFlight = true;
+    _reqSeq = _seq;
+    yLeaveCriticalSection(&_lock);
+    this->addRef();
+    if (YISERR(port->_downloadAsync(url, yRxStreamCallback, this, NULL, errmsg))) {
+        yEnterCriticalSection(&_lock);
+        _inFlight = false;
+        _nextPoll = now + _pollInterval;
+        yLeaveCriticalSection(&_lock);
+        this->release();
+    }
+}
+
+void YRxStream::_HandleStreams(void)
+{
+    vector<YRxStream*> streams;
+    size_t i;
+
+    yEnterCriticalSection(&_rxStreams_CS);
+    for (i = 0; i < _rxStreams.size(); i++) {
+        _rxStreams[i]->addRef();
+        streams.push_back(_rxStreams[i]);
+    }
+    yLeaveCriticalSection(&_rxStreams_CS);
+    for (i = 0; i < streams.size(); i++) {
+        try {
+            streams[i]->_pump();
+        } catch (std::exception) {
+            for (; i < streams.size(); i++) {
+                streams[i]->release();
+            }
+            throw;
+        }
+        streams[i]->release();
+    }
+}
+
+int YRxStream::readByte(void)
+{
+    int res = YAPI_NO_MORE_DATA;
+
+    yEnterCriticalSection(&_lock);
+    if (_count > 0) {
+        res = _ring[_head];
+        _head = (_head + 1) % (int)_ring.size();
+        _count--;
+    }
+    yLeaveCriticalSection(&_lock);
+    return res;
+}
+
+string YRxStream::readData(int len)
+{
+    string res;
+    int n, pos;
+
+    yEnterCriticalSection(&_lock);
+    if (len > _count) {
+        len = _count;
+    }
+    if (len > 0) {
+        res.reserve(len + 12);
+        n = (int)_ring.size() - _head;
+        if (n > len) {
+            n = len;
+        }
+        res.append((const char*)&_ring[_head], n);
+        if (n < len) {
+            res.append((const char*)&_ring[0], len - n);
+        }
+        _head = (_head + len) % (int)_ring.size();
+        _count -= len;
+    }
+    pos = _devpos - _count;
+    yLeaveCriticalSection(&_lock);
+    res += YapiWrapper::ysprintf("@%d", pos);
+    return res;
+}
+
+string YRxStream::readLine(void)
+{
+    string res;
+    int i, idx, len, skip;
+
+    yEnterCriticalSection(&_lock);
+    idx = _head;
+    for (i = 0; i < _count; i++) {
+        if (_ring[idx] == '\n') {
+            break;
+        }
+        if (++idx == (int)_ring.size()) {
+            idx = 0;
+        }
+    }
+    len = -1;
+    skip = 0;
+    if (i < _count) {
+        len = i;
+        skip = 1;
+    } else if (_count == (int)_ring.size()) {
+        // a line longer than the buffer would stop the stream forever,
+        // return the whole buffer so that reception can resume
+        len = _count;
+    }
+    if (len >= 0) {
+        idx = _head;
+        res.reserve(len);
+        for (i = 0; i < len; i++) {
+            res += (char)_ring[idx];
+            if (++idx == (int)_ring.size()) {
+                idx = 0;
+            }
+        }
+        _head = (idx + skip) % (int)_ring.size();
+        _count -= len + skip;
+        if (skip && len > 0 && res[len - 1] == '\r') {
+            res.resize(len - 1);
+        }
+    }
+    yLeaveCriticalSection(&_lock);
+    return res;
+}
+
+int YRxStream::avail(void)
+{
+    int res;
+
+    yEnterCriticalSection(&_lock);
+    res = _count;
+    yLeaveCriticalSection(&_lock);
+    return res;
+}
+
+int YRxStream::tell(void)
+{
+    int res;
+
+    yEnterCriticalSection(&_lock);
+    res = _devpos - _count;
+    yLeaveCriticalSection(&_lock);
+    return res;
+}
+
+void YRxStream::seek(int absPos)
+{
+    yEnterCriticalSection(&_lock);
+    _head = 0;
+    _count = 0;
+    _devpos = absPos;
+    _seq++;
+    _newData = false;
+    _nextPoll = 0;
+    yLeaveCriticalSection(&_lock);
+}
+
+int YRxStream::get_pollInterval(void)
+{
+    return _pollInterval;
+}
+
+void YRxStream::set_pollInterval(int msInterval)
+{
+    _pollInterval = msInterval;
+}
+
+int YRxStream::get_highWaterMark(void)
+{
+    return _highWater;
+}
+
+void YRxStream::set_highWaterMark(int highWaterMark)
+{
+    yEnterCriticalSection(&_lock);
+    if (highWaterMark < 1) {
+        highWaterMark = 1;
+    } else if (highWaterMark > (int)_ring.size()) {
+        highWaterMark = (int)_ring.size();
+    }
+    _highWater = highWaterMark;
+    yLeaveCriticalSection(&_lock);
+}
+
+
+// Asynchronous requests (see YFunction::loadAsync). Requests are queued per
+// device and sent one at a time, since a second request to a busy USB or HTTP
+// device would block the caller until the first one completes. Websocket hubs
+// multiplex requests, so up to YFUNCTION_ASYNC_MAX_PENDING are kept in flight.
+// The io callback only records the reply: replies are processed and completion
+// handlers invoked by YAPI::HandleEvents, in the application thread.
+#define YASYNC_LOAD         0
+#define YASYNC_DOWNLOAD     1
+#define YASYNC_SET          2
+
+class YAsyncRequest
+{
+public:
+    YFunction*              func;
+    YDevice*                dev;
+    int                     kind;
+    string                  request;
+    u64                     msValidity;
+    YFunctionAsyncCallback  callback;
+    YDownloadAsyncCallback  dlCallback;
+    void*                   context;
+    volatile s32            done;       // set once the reply has been received
+    YRETCODE                retcode;
+    string                  data;
+    string                  errmsg;
+};
+
+typedef struct {
+    int                         window;     // max requests in flight
+    int                         inFlight;
+    std::deque<YAsyncRequest*>  waiting;
+} YAsyncDeviceQueue;
+
+static yCRITICAL_SECTION _asyncRequests_CS;
+static std::map<YDevice*, YAsyncDeviceQueue> _asyncQueues;
+static std::vector<YAsyncRequest*> _asyncSent;
+static int _asyncPending = 0;
+
+
+static void yAsyncRequestCallback(YDevice* device, void* context, YRETCODE returnval, const string& result, string& errmsg)
+{
+    YAsyncRequest* req = (YAsyncRequest*)context;
+
+    req->retcode = returnval;
+    req->data = result;
+    req->errmsg = errmsg;
+    yAtomicStore(&req->done, 1);
+}
+
+
+// Pick the queued requests of a device that the device can accept now. Must be
+// called with _asyncRequests_CS held: the requests are sent by yAsyncSend once
+// the lock is released, since sending may block on a busy device.
+static void yAsyncPickQueued(YAsyncDeviceQueue& queue, vector<YAsyncRequest*>& tosend)
+{
+    YAsyncRequest* req;
+
+    while (queue.inFlight < queue.window && !queue.waiting.empty()) {
+        req = queue.waiting.front();
+        queue.waiting.pop_front();
+        queue.inFlight++;
+        _asyncSent.push_back(req);
+        tosend.push_back(req);
+    }
+}
+
+
+// Send the requests picked by yAsyncPickQueued, without holding _asyncRequests_CS.
+// A request may be completed and freed by HandleEvents as soon as it is sent.
+static void yAsyncSend(const vector<YAsyncRequest*>& tosend)
+{
+    YAsyncRequest* req;
+    YDevice* dev;
+    YRETCODE res;
+    string request, errmsg;
+
+    for (size_t i = 0; i < tosend.size(); i++) {
+        req = tosend[i];
+        dev = req->dev;
+        request = req->request;
+        if (req->kind == YASYNC_SET) {
+            res = dev->HTTPRequestAsync(0, request, yAsyncRequestCallback, req, errmsg);
+        } else {
+            res = dev->HTTPGetAsync(0, request, yAsyncRequestCallback, req, errmsg);
+        }
+        if (YISERR(res)) {
+            // the callback is not invoked when the request could not be sent:
+            // report the error at the next call to HandleEvents
+            req->retcode = res;
+            req->errmsg = errmsg;
+            yAtomicStore(&req->done, 1);
+        }
+    }
+}
+
+
+YRETCODE YFunction::_queueAsync(int kind, const string& request, u64 msValidity, YFunctionAsyncCallback callback,
+                                YDownloadAsyncCallback dlCallback, void* context)
+{
+    std::map<YDevice*, YAsyncDeviceQueue>::iterator it;
+    vector<YAsyncRequest*> tosend;
+    YAsyncRequest* req;
+    YDevice* dev;
+    YRETCODE res;
+    string errmsg, path;
+
+    yEnterCriticalSection(&_this_cs);
+    res = _getDevice(dev, errmsg);
+    yLeaveCriticalSection(&_this_cs);
+    if (YISERR(res)) {
+        _throw(res, errmsg);
+        return res;
+    }
+    req = new YAsyncRequest();
+    req->func = this;
+    req->dev = dev;
+    req->kind = kind;
+    req->request = request;
+    req->msValidity = msValidity;
+    req->callback = callback;
+    req->dlCallback = dlCallback;
+    req->context = context;
+    req->done = 0;
+    req->retcode = YAPI_SUCCESS;
+
+    yEnterCriticalSection(&_asyncRequests_CS);
+    it = _asyncQueues.find(dev);
+    if (it == _asyncQueues.end()) {
+        YAsyncDeviceQueue queue;
+        queue.window = 1;
+        queue.inFlight = 0;
+        if (!YISERR(dev->getDevicePath(path, errmsg)) && path.compare(0, 5, "ws://") == 0) {
+            queue.window = YFUNCTION_ASYNC_MAX_PENDING;
+        }
+        it = _asyncQueues.insert(std::make_pair(dev, queue)).first;
+    }
+    it->second.waiting.push_back(req);
+    _asyncPending++;
+    yAsyncPickQueued(it->second, tosend);
+    yLeaveCriticalSection(&_asyncRequests_CS);
+    yAsyncSend(tosend);
+    return YAPI_SUCCESS;
+}
+
+
+// Process the replies received so far and invoke their completion handlers,
+// then send the requests that were waiting for their device (see YAPI::HandleEvents)
+void YFunction::_HandleAsyncRequests(void)
+{
+    std::map<YDevice*, YAsyncDeviceQueue>::iterator it;
+    vector<YAsyncRequest*> completed;
+    vector<YAsyncRequest*> tosend;
+    YAsyncRequest* req;
+    size_t i, k;
+
+    yEnterCriticalSection(&_asyncRequests_CS);
+    for (i = k = 0; i < _asyncSent.size(); i++) {
+        req = _asyncSent[i];
+        if (yAtomicLoad(&req->done)) {
+            _asyncQueues[req->dev].inFlight--;
+            completed.push_back(req);
+        } else {
+            _asyncSent[k++] = req;
+        }
+    }
+    _asyncSent.resize(k);
+    if (!completed.empty()) {
+        for (it = _asyncQueues.begin(); it != _asyncQueues.end(); it++) {
+            yAsyncPickQueued(it->second, tosend);
+        }
+    }
+    yLeaveCriticalSection(&_asyncRequests_CS);
+    yAsyncSend(tosend);
+
+    for (i = 0; i < completed.size(); i++) {
+        YFunction* func;
+        YFunctionAsyncCallback callback;
+        YDownloadAsyncCallback dlCallback;
+        void* context;
+        int kind;
+        YRETCODE res;
+        string errmsg, content;
+
+        req = completed[i];
+        func = req->func;
+        callback = req->callback;
+        dlCallback = req->dlCallback;
+        context = req->context;
+        kind = req->kind;
+        res = req->retcode;
+        errmsg = req->errmsg;
+        if (kind == YASYNC_LOAD && !YISERR(res)) {
+            char serial[YOCTO_SERIAL_LEN];
+            char funcId[YOCTO_FUNCTION_LEN];
+            string json_str;
+            YJSONObject* node = NULL;
+
+            res = YDevice::_extractJSON(req->data, json_str, errmsg);
+            if (!YISERR(res)) {
+                node = new YJSONObject(json_str, 0, (int)json_str.length());
+                try {
+                    node->parse();
+                } catch (std::exception ex) {
+                    errmsg = "unexpected JSON structure: " + string(ex.what());
+                    res = YAPI_IO_ERROR;
+                }
+            }
+            if (!YISERR(res)) {
+                yEnterCriticalSection(&func->_this_cs);
+                res = func->_getFunctionIds(serial, funcId, errmsg);
+                if (!YISERR(res)) {
+                    func->_cacheExpiration = yapiGetTickCount() + req->msValidity;
+                    func->_serial = serial;
+                    func->_funId = funcId;
+                    func->_hwId = func->_serial + '.' + func->_funId;
+                    func->_parse(node);
+                }
+                yLeaveCriticalSection(&func->_this_cs);
+            }
+            if (node) {
+                delete node;
+            }
+        } else if (kind == YASYNC_DOWNLOAD && !YISERR(res)) {
+            size_t found = req->data.find("\r\n\r\n");
+            if (found == string::npos || (req->data.compare(0, 4, "OK\r\n") != 0 &&
+                                          req->data.compare(0, 17, "HTTP/1.1 200 OK\r\n") != 0)) {
+                res = YAPI_IO_ERROR;
+                errmsg = "http request failed";
+            } else {
+                content = req->data.substr(found + 4);
+            }
+        } else if (kind == YASYNC_SET) {
+            yEnterCriticalSection(&func->_this_cs);
+            if (func->_cacheExpiration != 0) {
+                func->_cacheExpiration = 0;
+            }
+            yLeaveCriticalSection(&func->_this_cs);
+        }
+        delete req;
+        yEnterCriticalSection(&_asyncRequests_CS);
+        _asyncPending--;
+        yLeaveCriticalSection(&_asyncRequests_CS);
+        if (YISERR(res)) {
+            func->_lastErrorType = res;
+            func->_lastErrorMsg = errmsg;
+        }
+        if (kind == YASYNC_DOWNLOAD) {
+            dlCallback(context, func, res, content);
+        } else if (callback) {
+            callback(context, func, res);
+        }
+    }
+}
+
+
+int YFunction::_PendingAsyncRequests(void)
+{
+    int res;
+
+    if (!YAPI::_apiInitialized) {
+        return 0;
+    }
+    yEnterCriticalSection(&_asyncRequests_CS);
+    res = _asyncPending;
+    yLeaveCriticalSection(&_asyncRequests_CS);
+    return res;
+}
+
+
+// Drop all asynchronous requests (use only on YAPI::FreeAPI, once yapi is stopped)
+void YFunction::_ClearAsyncRequests(void)
+{
+    std::map<YDevice*, YAsyncDeviceQueue>::iterator it;
+    size_t i;
+
+    for (it = _asyncQueues.begin(); it != _asyncQueues.end(); it++) {
+        for (i = 0; i < it->second.waiting.size(); i++) {
+            delete it->second.waiting[i];
+        }
+    }
+    for (i = 0; i < _asyncSent.size(); i++) {
+        delete _asyncSent[i];
+    }
+    _asyncQueues.clear();
+    _asyncSent.clear();
+    _asyncPending = 0;
+}
+
+
+YRETCODE YFunction::loadAsync(int msValidity, YFunctionAsyncCallback callback, void* context)
+{
+    char serial[YOCTO_SERIAL_LEN];
+    char funcId[YOCTO_FUNCTION_LEN];
+    string errmsg;
+    YRETCODE res;
+
+    res = _getFunctionIds(serial, funcId, errmsg);
+    if (YISERR(res)) {
+        _throw(res, errmsg);
+        return res;
+    }
+    // function-scoped request, without HTTP/1.1 suffix to get light headers
+    return _queueAsync(YASYNC_LOAD, "GET /api/" + string(funcId) + ".json \r\n\r\n", msValidity, callback, NULL, context);
+}
+
+
+YRETCODE YFunction::downloadAsync(const string& url, YDownloadAsyncCallback callback, void* context)
+{
+    return _queueAsync(YASYNC_DOWNLOAD, "GET /" + url + " HTTP/1.1\r\n\r\n", 0, NULL, callback, context);
+}
+
+
+YRETCODE YFunction::setAttrAsync(const string& attrName, const string& value, YFunctionAsyncCallback callback, void* context)
+{
+    string request, errmsg;
+    YRETCODE res;
+
+    res = _buildSetRequest(attrName, &value, request, errmsg);
+    if (YISERR(res)) {
+        _throw(res, errmsg);
+        return res;
+    }
+    return _queueAsync(YASYNC_SET, request, 0, callback, NULL, context);
+}
+
+
+// Context of the typed asynchronous getters
+typedef struct {
+    YStringAsyncCallback        strCallback;
+    YSensorValueAsyncCallback   valCallback;
+    void*                       context;
+} YAsyncGetterCtx;
+
+void YFunction::_advertisedValueAsyncCallback(void* context, YFunction* func, YRETCODE retcode)
+{
+    YAsyncGetterCtx* ctx = (YAsyncGetterCtx*)context;
+    YStringAsyncCallback callback = ctx->strCallback;
+    void* userContext = ctx->context;
+    string value = YFunction::ADVERTISEDVALUE_INVALID;
+
+    delete ctx;
+    if (!YISERR(retcode)) {
+        yEnterCriticalSection(&func->_this_cs);
+        value = func->_advertisedValue;
+        yLeaveCriticalSection(&func->_this_cs);
+    }
+    callback(userContext, func, value);
+}
+
+YRETCODE YFunction::get_advertisedValueAsync(YStringAsyncCallback callback, void* context)
+{
+    YAsyncGetterCtx* ctx = new YAsyncGetterCtx();
+    YRETCODE res;
+
+    ctx->strCallback = callback;
+    ctx->valCallback = NULL;
+    ctx->context = context;
+    try {
+        res = this->loadAsync((int)YAPI::_yapiContext.GetCacheValidity(), _advertisedValueAsyncCallback, ctx);
+    } catch (std::exception&) {
+        delete ctx;
+        throw;
+    }
+    if (YISERR(res)) {
+        delete ctx;
+    }
+    return res;
+}
+
+
+/**
+ * Invalidates the cache. Invalidates the cache of the function attributes. Forces the
+ * next call to get_xxx() or loadxxx() to use values that come from the device.
+ *
+ * @noreturn
+ */
+void YFunction::clearCache()
+{
+    YDevice* dev;
+    string errmsg, apires;
+
+
+    yEnterCriticalSection(&_this_cs);
+    // Resolve our reference to our device, load REST API
+    int res = _getDevice(dev, errmsg);
+    if (YISERR(res)) {
+        yLeaveCriticalSection(&_this_cs);
+        return;
+    }
+    dev->clearCache(false);
+    if (_cacheExpiration) {
+        _cacheExpiration = yapiGetTickCount();
+    }
+    yLeaveCriticalSection(&_this_cs);
+}
+
+
+/**
+ * Gets the YModule object for the device on which the function is located.
+ * If the function cannot be located on any module, the returned instance of
+ * YModule is not shown as on-line.
+ *
+ * @return an instance of YModule
+ */
+YModule* YFunction::get_module(void)
+{
+    YFUN_DESCR fundescr;
+    YDEV_DESCR devdescr;
+    string errmsg, serial, funcId, funcName, funcValue;
+
+    yEnterCriticalSection(&_this_cs);
+    fundescr = YapiWrapper::getFunction(_className, _func, errmsg);
+    if (!YISERR(fundescr)) {
+        if (!YISERR(YapiWrapper::getFunctionInfo(fundescr, devdescr, serial, funcId, funcName, funcValue, errmsg))) {
+            yLeaveCriticalSection(&_this_cs);
+            return yFindModule(serial + ".module");
+        }
+    }
+    // return a true YModule object even if it is not a module valid for communicating
+    yLeaveCriticalSection(&_this_cs);
+    return yFindModule(string("module_of_") + _className + "_" + _func);
+}
+
+
+/**
+ * Returns the value of the userData attribute, as previously stored using method
+ * set_userData.
+ * This attribute is never touched directly by the API, and is at disposal of the caller to
+ * store a context.
+ *
+ * @return the object stored previously by the caller.
+ */
+void* YFunction::get_userData(void)
+{
+    void* res;
+    yEnterCriticalSection(&_this_cs);
+    res = _userData;
+    yLeaveCriticalSection(&_this_cs);
+    return res;
+}
+
+
+/**
+ * Stores a user context provided as argument in the userData attribute of the function.
+ * This attribute is never touched by the API, and is at disposal of the caller to store a context.
+ *
+ * @param data : any kind of object to be stored
+ * @noreturn
+ */
+void YFunction::set_userData(void* data)
+{
+    yEnterCriticalSection(&_this_cs);
+    _userData = data;
+    yLeaveCriticalSection(&_this_cs);
+}
+
+
+/**
+ * Returns a unique identifier of type YFUN_DESCR corresponding to the function.
+ * This identifier can be used to test if two instances of YFunction reference the same
+ * physical function on the same physical device.
+ *
+ * @return an identifier of type YFUN_DESCR.
+ *
+ * If the function has never been contacted, the returned value is Y_FUNCTIONDESCRIPTOR_INVALID.
+ */
+YFUN_DESCR YFunction::get_functionDescriptor(void)
+{
+    // do not take CS un purpose
+    return _fundescr;
+}
+
+void YFunction::_UpdateValueCallbackList(YFunction* func, bool add)
+{
+    if (add) {
+        func->isOnline();
+        vector<YFunction*>::iterator it;
+        for (it = _FunctionCallbacks.begin(); it < _FunctionCallbacks.end(); it++) {
+            if (*it == func)
+                return;
+        }
+        _FunctionCallbacks.push_back(func);
+        _ValueCallbackIndex.add(func);
+    } else {
+        vector<YFunction*>::iterator it;
+        for (it = _FunctionCallbacks.begin(); it < _FunctionCallbacks.end(); it++) {
+            if (*it == func) {
+                _FunctionCallbacks.erase(it);
+                _ValueCallbackIndex.remove(func);
+                break;
+            }
+        }
+    }
+}
+
+
+void YFunction::_UpdateTimedReportCallbackList(YSensor* func, bool add)
+{
+    // the YMeasure-based callback of the sensor has changed, keep the
+    // subscription as long as a plain record callback is still registered
+    func->_setTimedReportMeasureCallback(add);
+    _SetTimedReportSubscription(func, func->_hasTimedReportCallbacks());
+}
+
+void YFunction::_SetTimedReportSubscription(YSensor* func, bool subscribe)
+{
+    vector<YFunction*>::iterator it;
+
+    if (subscribe) {
+        for (it = _TimedReportCallbackList.begin(); it < _TimedReportCallbackList.end(); it++) {
+            if (*it == func)
+                return;
+        }
+        func->isOnline();
+        _TimedReportCallbackList.push_back(func);
+        _TimedReportCallbackIndex.add(func);
+    } else {
+        for (it = _TimedReportCallbackList.begin(); it < _TimedReportCallbackList.end(); it++) {
+            if (*it == func) {
+                _TimedReportCallbackList.erase(it);
+                _TimedReportCallbackIndex.remove(func);
+                break;
+            }
+        }
+    }
+}
+
+
+void YModule::_updateModuleCallbackList(YModule* module, bool add)
+{
+    map<YModule*, int>::iterator entry = _moduleCallbackList.find(module);
+    if (add) {
+        module->isOnline();
+        if (entry != _moduleCallbackList.end()) {
+            _moduleCallbackList[module]++;
+        } else {
+            _moduleCallbackList[module] = 1;
+        }
+    } else {
+        if (entry != _moduleCallbackList.end()) {
+            if (_moduleCallbackList[module] > 0) {
+                _moduleCallbackList[module]--;
+            }
+        }
+    }
+}
+
+
+// This is the internal device cache object
+vector<YDevice*> YDevice::_devCache;
+
+YDevice::YDevice(YDEV_DESCR devdesc): _devdescr(devdesc), _cacheStamp(0), _cacheJson(NULL), _subpath(NULL)
+{
+    yInitializeCriticalSection(&_lock);
+};
+
+
+YDevice::~YDevice() // destructor
+{
+    clearCache(true);
+    for (size_t i = 0; i < _jsonRetired.size(); i++) {
+        delete _jsonRetired[i];
+    }
+    yDeleteCriticalSection(&_lock);
+}
+
+void YDevice::ClearCache()
+{
+    for (unsigned int idx = 0; idx < YDevice::_devCache.size(); idx++) {
+        delete _devCache[idx];
+    }
+    _devCache.clear();
+    _devCache = vector<YDevice*>();
+}
+
+
+YDevice* YDevice::getDevice(YDEV_DESCR devdescr)
+{
+    // Search in cache
+    yEnterCriticalSection(&YAPI::_global_cs);
+    for (unsigned int idx = 0; idx < YDevice::_devCache.size(); idx++) {
+        if (YDevice::_devCache[idx]->_devdescr == devdescr) {
+            yLeaveCriticalSection(&YAPI::_global_cs);
+            return YDevice::_devCache[idx];
+        }
+    }
+
+    // Not found, add new entry
+    YDevice* dev = new YDevice(devdescr);
+    YDevice::_devCache.push_back(dev);
+    yLeaveCriticalSection(&YAPI::_global_cs);
+
+    return dev;
+}
+
+
+YRETCODE YDevice::HTTPRequestPrepare(const string& request, string& fullrequest, char* errbuff)
+{
+    YRETCODE res;
+    size_t pos;
+    // mutex allready taken by caller
+    if (_subpath == NULL) {
+        int neededsize;
+        res = yapiGetDevicePath(_devdescr, _rootdevice, NULL, 0, &neededsize, errbuff);
+        if (YISERR(res)) return res;
+        _subpath = new char[neededsize];
+        res = yapiGetDevicePath(_devdescr, _rootdevice, _subpath, neededsize, NULL, errbuff);
+        if (YISERR(res)) return res;
+    }
+    pos = request.find_first_of('/');
+    fullrequest = request.substr(0, pos) + (string)_subpath + request.substr(pos + 1);
+
+    return YAPI_SUCCESS;
+}
+
+
+YRETCODE YDevice::HTTPRequest_unsafe(int channel, const string& request, string& buffer, yapiRequestProgressCallback callback, void* context, string& errmsg)
+{
+    char errbuff[YOCTO_ERRMSG_LEN] = "";
+    YRETCODE res;
+    YIOHDL iohdl;
+    string fullrequest;
+    char* reply;
+    int replysize = 0;
+
+    if (YISERR(res = HTTPRequestPrepare(request, fullrequest, errbuff))) {
+        errmsg = (string)errbuff;
+        return res;
+    }
+    if (YISERR(res = yapiHTTPRequestSyncStartOutOfBand(&iohdl, channel, _rootdevice, fullrequest.data(), (int)fullrequest.size(), &reply, &replysize, callback, context, errbuff))) {
+        errmsg = (string)errbuff;
+        return res;
+    }
+    if (replysize > 0 && reply != NULL) {
+        buffer = string(reply, replysize);
+    } else {
+        buffer = "";
+    }
+    if (YISERR(res = yapiHTTPRequestSyncDone(&iohdl, errbuff))) {
+        errmsg = (string)errbuff;
+        return res;
+    }
+
+    return YAPI_SUCCESS;
+}
+
+
+// Context of an asynchronous request whose reply is forwarded to an HTTPRequestCallback
+typedef struct {
+    YDevice*            device;
+    HTTPRequestCallback callback;
+    void*               context;
+} YHTTPRequestAsyncCtx;
+
+static void yHTTPRequestAsyncCallback(void* context, const u8* result, u32 resultlen, int retcode, const char* errmsg)
+{
+    YHTTPRequestAsyncCtx* ctx = (YHTTPRequestAsyncCtx*)context;
+    string buffer;
+    string errstr;
+
+    if (result && resultlen) {
+        buffer.assign((const char*)result, resultlen);
+    }
+    if (errmsg) {
+        errstr = errmsg;
+    }
+    ctx->callback(ctx->device, ctx->context, (YRETCODE)retcode, buffer, errstr);
+    delete ctx;
+}
+
+
+YRETCODE YDevice::HTTPRequestAsync(int channel, const string& request, HTTPRequestCallback callback, void* context, string& errmsg)
+{
+    return _HTTPRequestAsync(channel, request, true, callback, context, errmsg);
+}
+
+
+// Same as HTTPRequestAsync, for read-only requests: the device cache stays valid
+YRETCODE YDevice::HTTPGetAsync(int channel, const string& request, HTTPRequestCallback callback, void* context, string& errmsg)
+{
+    return _HTTPRequestAsync(channel, request, false, callback, context, errmsg);
+}
+
+
+YRETCODE YDevice::_HTTPRequestAsync(int channel, const string& request, bool invalidateCache, HTTPRequestCallback callback, void* context, string& errmsg)
+{
+    char errbuff[YOCTO_ERRMSG_LEN] = "";
+    YRETCODE res = YAPI_SUCCESS;
+    string fullrequest;
+    YHTTPRequestAsyncCtx* ctx = NULL;
+
+    if (callback) {
+        ctx = new YHTTPRequestAsyncCtx;
+        ctx->device = this;
+        ctx->callback = callback;
+        ctx->context = context;
+    }
+    yEnterCriticalSection(&_lock);
+    if (invalidateCache) {
+        _cacheStamp = YAPI::GetTickCount(); //invalidate cache
+        _funcCacheStamp.clear();
+    }
+    if (YISERR(res=HTTPRequestPrepare(request, fullrequest, errbuff)) ||
+        YISERR(res=yapiHTTPRequestAsyncOutOfBand(channel, _rootdevice, fullrequest.c_str(), (int)fullrequest.length(),
+                                                 ctx ? yHTTPRequestAsyncCallback : NULL, ctx, errbuff))) {
+        errmsg = (string)errbuff;
+        // the callback is not invoked when the request could not be sent
+        delete ctx;
+    }
+    yLeaveCriticalSection(&_lock);
+    return res;
+}
+
+
+YRETCODE YDevice::HTTPRequest(int channel, const string& request, string& buffer, yapiRequestProgressCallback callback, void* context, string& errmsg)
+{
+    YRETCODE res;
+    int locked = 0;
+    int i;
+
+    for (i = 0; !locked && i < 5; i++) {
+        locked = yTryEnterCriticalSection(&_lock);
+        if (!locked) {
+            yApproximateSleep(50);
+        }
+    }
+    if (!locked) {
+        yEnterCriticalSection(&_lock);
+    }
+    res = HTTPRequest_unsafe(channel, request, buffer, callback, context, errmsg);
+    yLeaveCriticalSection(&_lock);
+    return res;
+}
+
+
+// Send a GET request to the device and extract the JSON body of the reply.
+// The device lock must be held by the caller. Like the other API errors, an
+// invalid HTTP reply throws an exception unless they are disabled: in that
+// case the device lock is released before throwing.
+YRETCODE YDevice::_requestJSON_unsafe(const string& request, string& json_str, string& errmsg)
+{
+    string buffer;
+    int res;
+
+    res = this->HTTPRequest_unsafe(0, request, buffer, NULL, NULL, errmsg);
+    if (YISERR(res)) {
+        yLeaveCriticalSection(&_lock);
+        // Check if an update of the device list does not solve the issue
+        res = YapiWrapper::updateDeviceList(true, errmsg);
+        yEnterCriticalSection(&_lock);
+        if (YISERR(res)) {
+            return (YRETCODE)res;
+        }
+        res = this->HTTPRequest_unsafe(0, request, buffer, NULL, NULL, errmsg);
+        if (YISERR(res)) {
+            return (YRETCODE)res;
+        }
+    }
+    res = _extractJSON(buffer, json_str, errmsg);
+    if (YISERR(res) && !YAPI::ExceptionsDisabled) {
+        yLeaveCriticalSection(&_lock);
+        throw YAPI_Exception((YRETCODE)res, errmsg);
+    }
+    return (YRETCODE)res;
+}
+
+
+// Check the HTTP header of a reply and extract its JSON body.
+YRETCODE YDevice::_extractJSON(const string& buffer, string& json_str, string& errmsg)
+{
+    yJsonStateMachine j;
+
+    // Parse HTTP header
+    j.src = buffer.data();
+    j.end = j.src + buffer.size();
+    j.st = YJSON_HTTP_START;
+    if (yJsonParse(&j) != YJSON_PARSE_AVAIL || j.st != YJSON_HTTP_READ_CODE) {
+        errmsg = "Failed to parse HTTP header";
+        return YAPI_IO_ERROR;
+    }
+    if (string(j.token) != "200") {
+        errmsg = string("Unexpected HTTP return code: ") + j.token;
+        return YAPI_IO_ERROR;
+    }
+    if (yJsonParse(&j) != YJSON_PARSE_AVAIL || j.st != YJSON_HTTP_READ_MSG) {
+        errmsg = "Unexpected HTTP header format";
+        return YAPI_IO_ERROR;
+    }
+    if (yJsonParse(&j) != YJSON_PARSE_AVAIL || (j.st != YJSON_PARSE_STRUCT && j.st != YJSON_PARSE_ARRAY)) {
+        errmsg = "Unexpected JSON reply format";
+        return YAPI_IO_ERROR;
+    }
+    // we know for sure that the last character parsed was a '{' or '['
+    do j.src--; while (j.src[0] != '{' && j.src[0] != '[');
+    json_str = string(j.src);
+    return YAPI_SUCCESS;
+}
+
+
+// Build the request used to load the whole REST API of the device.
+// The device lock must be held by the caller.
+string YDevice::_apiRequest_unsafe(void)
+{
+    if (_cacheJson == NULL) {
+        return "GET /api.json \r\n\r\n";
+    }
+    string fw_release = _cacheJson->getYJSONObject("module")->getString("firmwareRelease");
+    fw_release = __escapeAttr(fw_release);
+    // send request, without HTTP/1.1 suffix to get light headers
+    return "GET /api.json?fw=" + fw_release + " \r\n\r\n";
+}
+
+
+// Keep a cached JSON tree alive until the node handed out from it is given
+// back with releaseAPI. The device lock must be held by the caller.
+YJSONObject* YDevice::_retainJson_unsafe(YJSONObject* tree, YJSONObject* node)
+{
+    _jsonRefs[tree]++;
+    _jsonOwner[node] = tree;
+    return node;
+}
+
+
+// Delete a JSON tree removed from the cache, or defer it until the last
+// node handed out from it is released. The device lock must be held by the caller.
+void YDevice::_dropJson_unsafe(YJSONObject* tree)
+{
+    if (_jsonRefs.find(tree) == _jsonRefs.end()) {
+        delete tree;
+    } else {
+        _jsonRetired.push_back(tree);
+    }
+}
+
+
+// Give back a node obtained from retainAPI, retainFunctionAPI or parseAPIReply
+void YDevice::releaseAPI(YJSONObject* json)
+{
+    map<YJSONObject*, YJSONObject*>::iterator it;
+    YJSONObject* tree;
+
+    yEnterCriticalSection(&_lock);
+    it = _jsonOwner.find(json);
+    if (it != _jsonOwner.end()) {
+        tree = it->second;
+        if (--_jsonRefs[tree] == 0) {
+            _jsonRefs.erase(tree);
+            for (it = _jsonOwner.begin(); it != _jsonOwner.end();) {
+                if (it->second == tree) {
+                    _jsonOwner.erase(it++);
+                } else {
+                    ++it;
+                }
+            }
+            for (size_t i = 0; i < _jsonRetired.size(); i++) {
+                if (_jsonRetired[i] == tree) {
+                    _jsonRetired.erase(_jsonRetired.begin() + i);
+                    delete tree;
+                    break;
+                }
+            }
+        }
+    }
+    yLeaveCriticalSection(&_lock);
+}
+
+
+// Parse an api.json reply and store it in the device cache.
+// The device lock must be held by the caller.
+YRETCODE YDevice::_cacheAPI_unsafe(const string& json_str, YJSONObject*& apires, string& errmsg)
+{
+    apires = NULL;
+    try {
+        apires = new YJSONObject(json_str, 0, (int)json_str.length());
+        apires->parseWithRef(_cacheJson);
+    } catch (std::exception ex) {
+        errmsg = "unexpected JSON structure: " + string(ex.what());
+        if (apires) {
+            delete apires;
+            apires = NULL;
+        }
+        if (_cacheJson) {
+            _dropJson_unsafe(_cacheJson);
+            _cacheJson = NULL;
+        }
+        _funcCacheStamp.clear();
+        return YAPI_IO_ERROR;
+    }
+    // store result in cache
+    if (_cacheJson) {
+        _dropJson_unsafe(_cacheJson);
+    }
+    _cacheJson = apires;
+    _cacheStamp = yapiGetTickCount() + YAPI::_yapiContext.GetCacheValidity();
+    _funcCacheStamp.clear();
+    return YAPI_SUCCESS;
+}
+
+
+YRETCODE YDevice::requestAPI(YJSONObject*& apires, string& errmsg)
+{
+    string json_str;
+    int res;
+
+    yEnterCriticalSection(&_lock);
+
+    // Check if we have a valid cache value
+    if (_cacheStamp > YAPI::GetTickCount()) {
+        apires = _cacheJson;
+        yLeaveCriticalSection(&_lock);
+        return YAPI_SUCCESS;
+    }
+    res = _requestJSON_unsafe(_apiRequest_unsafe(), json_str, errmsg);
+    if (YISERR(res)) {
+        yLeaveCriticalSection(&_lock);
+        return (YRETCODE)res;
+    }
+    res = _cacheAPI_unsafe(json_str, apires, errmsg);
+    yLeaveCriticalSection(&_lock);
+    if (YISERR(res) && !YAPI::ExceptionsDisabled) {
+        throw YAPI_Exception((YRETCODE)res, errmsg);
+    }
+    return (YRETCODE)res;
+}
+
+
+// Same as requestAPI, but the returned tree stays valid even if the device
+// cache is reloaded by another thread, until it is given back with releaseAPI.
+YRETCODE YDevice::retainAPI(YJSONObject*& apires, string& errmsg)
+{
+    YRETCODE res;
+
+    res = requestAPI(apires, errmsg);
+    if (YISERR(res)) {
+        return res;
+    }
+    yEnterCriticalSection(&_lock);
+    if (_cacheJson == NULL) {
+        // cleared by another thread in the meantime
+        yLeaveCriticalSection(&_lock);
+        errmsg = "Device cache was cleared";
+        if (!YAPI::ExceptionsDisabled) {
+            throw YAPI_Exception(YAPI_DEVICE_NOT_FOUND, errmsg);
+        }
+        return YAPI_DEVICE_NOT_FOUND;
+    }
+    apires = _retainJson_unsafe(_cacheJson, _cacheJson);
+    yLeaveCriticalSection(&_lock);
+    return YAPI_SUCCESS;
+}
+
+
+// Returns true if the api.json of the device is still valid in cache.
+bool YDevice::isAPICacheValid(void)
+{
+    bool res;
+
+    yEnterCriticalSection(&_lock);
+    res = (_cacheStamp > YAPI::GetTickCount());
+    yLeaveCriticalSection(&_lock);
+    return res;
+}
+
+
+// Send an asynchronous request for the api.json of the device. The raw reply
+// is passed to the callback, and must be stored using parseAPIReply. Only
+// network devices are supported: YAPI_NOT_SUPPORTED is returned for USB
+// devices, which must be loaded using requestAPI.
+YRETCODE YDevice::requestAPIAsync(yapiRequestAsyncCallback callback, void* context, string& errmsg)
+{
+    char errbuff[YOCTO_ERRMSG_LEN] = "";
+    YRETCODE res;
+    string fullrequest;
+    string path;
+
+    res = getDevicePath(path, errmsg);
+    if (YISERR(res)) {
+        return res;
+    }
+    if (path == "usb") {
+        errmsg = "Asynchronous api.json requests are not supported over USB";
+        return YAPI_NOT_SUPPORTED;
+    }
+    yEnterCriticalSection(&_lock);
+    if (YISERR(res = HTTPRequestPrepare(_apiRequest_unsafe(), fullrequest, errbuff)) ||
+        YISERR(res = yapiHTTPRequestAsyncOutOfBand(0, _rootdevice, fullrequest.c_str(), (int)fullrequest.length(), callback, context, errbuff))) {
+        errmsg = (string)errbuff;
+    }
+    yLeaveCriticalSection(&_lock);
+    return res;
+}
+
+
+// Retrieve the path used to reach the device: "usb" for USB devices, or
+// the url of the device ("ws://..." or "http://...") for network devices
+YRETCODE YDevice::getDevicePath(string& path, string& errmsg)
+{
+    char errbuff[YOCTO_ERRMSG_LEN] = "";
+    char url[1024];
+    int neededsize = 0;
+    yDeviceSt infos;
+    YRETCODE res;
+
+    res = yapiGetDeviceInfo(_devdescr, &infos, errbuff);
+    if (YISERR(res) ||
+        YISERR(res = yapiGetDevicePathEx(infos.serial, NULL, url, sizeof(url), &neededsize, errbuff))) {
+        errmsg = (string)errbuff;
+        return res;
+    }
+    path = url;
+    return YAPI_SUCCESS;
+}
+
+
+// Store the reply of a request sent by requestAPIAsync in the device cache.
+// On success, the returned tree must be given back with releaseAPI.
+YRETCODE YDevice::parseAPIReply(const string& buffer, YJSONObject*& apires, string& errmsg)
+{
+    string json_str;
+    YRETCODE res;
+
+    yEnterCriticalSection(&_lock);
+    res = _extractJSON(buffer, json_str, errmsg);
+    if (!YISERR(res)) {
+        res = _cacheAPI_unsafe(json_str, apires, errmsg);
+    }
+    if (!YISERR(res)) {
+        _retainJson_unsafe(apires, apires);
+    }
+    yLeaveCriticalSection(&_lock);
+    return res;
+}
+
+
+// Reload the attributes of a single function (GET /api/<funcId>.json). The
+// reply is cached separately for each function, with its own expiration, and
+// the whole device cache is used instead as long as it is valid. The first call
+// falls back to a full api.json load, in order to get a complete reference
+// structure for the device. The returned node must be given back with releaseAPI.
+YRETCODE YDevice::retainFunctionAPI(const string& funcId, YJSONObject*& funcres, string& errmsg)
+{
+    YJSONObject* apires;
+    YJSONObject* node;
+    string json_str;
+    bool fullLoad = false;
+    u64 now;
+    int res;
+
+    yEnterCriticalSection(&_lock);
+    if (_cacheJson == NULL) {
+        yLeaveCriticalSection(&_lock);
+        res = this->requestAPI(apires, errmsg);
+        if (YISERR(res)) {
+            return (YRETCODE)res;
+        }
+        yEnterCriticalSection(&_lock);
+        fullLoad = true;
+    }
+    now = YAPI::GetTickCount();
+    if (fullLoad || _cacheStamp > now) {
+        if (_cacheJson == NULL || !_cacheJson->has(funcId)) {
+            errmsg = "unexpected JSON structure: missing function " + funcId;
+            yLeaveCriticalSection(&_lock);
+            if (!YAPI::ExceptionsDisabled) {
+                throw YAPI_Exception(YAPI_IO_ERROR, errmsg);
+            }
+            return YAPI_IO_ERROR;
+        }
+        funcres = _retainJson_unsafe(_cacheJson, _cacheJson->getYJSONObject(funcId));
+        yLeaveCriticalSection(&_lock);
+        return YAPI_SUCCESS;
+    }
+    map<string, u64>::iterator it = _funcCacheStamp.find(funcId);
+    if (it == _funcCacheStamp.end() || it->second <= now) {
+        // send request, without HTTP/1.1 suffix to get light headers
+        res = _requestJSON_unsafe("GET /api/" + funcId + ".json \r\n\r\n", json_str, errmsg);
+        if (YISERR(res)) {
+            yLeaveCriticalSection(&_lock);
+            return (YRETCODE)res;
+        }
+        node = new YJSONObject(json_str, 0, (int)json_str.length());
+        try {
+            node->parse();
+        } catch (std::exception ex) {
+            delete node;
+            errmsg = "unexpected JSON structure: " + string(ex.what());
+            yLeaveCriticalSection(&_lock);
+            if (!YAPI::ExceptionsDisabled) {
+                throw YAPI_Exception(YAPI_IO_ERROR, errmsg);
+            }
+            return YAPI_IO_ERROR;
+        }
+        // never modify a tree in place: it may still be used by other threads
+        map<string, YJSONObject*>::iterator old = _funcCacheJson.find(funcId);
+        if (old != _funcCacheJson.end()) {
+            _dropJson_unsafe(old->second);
+        }
+        _funcCacheJson[funcId] = node;
+        _funcCacheStamp[funcId] = yapiGetTickCount() + YAPI::_yapiContext.GetCacheValidity();
+    }
+    node = _funcCacheJson[funcId];
+    funcres = _retainJson_unsafe(node, node);
+    yLeaveCriticalSection(&_lock);
+    return YAPI_SUCCESS;
+}
+
+
+void YDevice::clearCache(bool clearSubpath)
+{
+    yEnterCriticalSection(&_lock);
+    _cacheStamp = 0;
+    _funcCacheStamp.clear();
+    if (clearSubpath) {
+        if (_cacheJson) {
+            _dropJson_unsafe(_cacheJson);
+            _cacheJson = NULL;
+        }
+        for (map<string, YJSONObject*>::iterator it = _funcCacheJson.begin(); it != _funcCacheJson.end(); ++it) {
+            _dropJson_unsafe(it->second);
+        }
+        _funcCacheJson.clear();
+        if (_subpath) {
+            delete _subpath;
+            _subpath = NULL;
+        }
+    }
+    yLeaveCriticalSection(&_lock);
+}
+
+YRETCODE YDevice::getFunctions(vector<YFUN_DESCR>** functions, string& errmsg)
+{
+    yEnterCriticalSection(&_lock);
+    if (_functions.size() == 0) {
+        int res = YapiWrapper::getFunctionsByDevice(_devdescr, 0, _functions, 64, errmsg);
+        if (YISERR(res)) return (YRETCODE)res;
+    }
+    *functions = &_functions;
+    yLeaveCriticalSection(&_lock);
+
+    return YAPI_SUCCESS;
+}
+
+
+YEventQueue::YEventQueue(int elemsize, int capacity):
+    _elemsize(elemsize), _mask((u32)capacity - 1), _enqueuePos(0), _dequeuePos(0), _overflows(0),
+    _policy(Y_EVENTQUEUE_DROP_OLDEST)
+{
+    // each cell holds a sequence number followed by the event record
+    _stride = (int)((sizeof(s32) + elemsize + 7) & ~7);
+    _cells = new u8[_stride * capacity];
+    for (u32 i = 0; i <= _mask; i++) {
+        *_cellSeq(i) = (s32)i;
+    }
+}
+
+YEventQueue::~YEventQueue()
+{
+    delete[] _cells;
+}
+
+volatile s32* YEventQueue::_cellSeq(u32 pos)
+{
+    return (volatile s32*)(_cells + (pos & _mask) * _stride);
+}
+
+bool YEventQueue::tryPush(const void* ev)
+{
+    u32 pos = (u32)yAtomicLoad(&_enqueuePos);
+    volatile s32* seq;
+
+    while (1) {
+        seq = _cellSeq(pos);
+        s32 dif = (s32)((u32)yAtomicLoad(seq) - pos);
+        if (dif == 0) {
+            u32 prev = (u32)yAtomicCompareExchange(&_enqueuePos, (s32)(pos + 1), (s32)pos);
+            if (prev == pos) {
+                break;
+            }
+            pos = prev;
+        } else if (dif < 0) {
+            // queue full
+            return false;
+        } else {
+            pos = (u32)yAtomicLoad(&_enqueuePos);
+        }
+    }
+    memcpy((u8*)seq + sizeof(s32), ev, _elemsize);
+    yAtomicStore(seq, (s32)(pos + 1));
+    return true;
+}
+
+bool YEventQueue::tryPop(void* ev)
+{
+    u32 pos = (u32)yAtomicLoad(&_dequeuePos);
+    volatile s32* seq;
+
+    while (1) {
+        seq = _cellSeq(pos);
+        s32 dif = (s32)((u32)yAtomicLoad(seq) - (pos + 1));
+        if (dif == 0) {
+            u32 prev = (u32)yAtomicCompareExchange(&_dequeuePos, (s32)(pos + 1), (s32)pos);
+            if (prev == pos) {
+                break;
+            }
+            pos = prev;
+        } else if (dif < 0) {
+            // queue empty
+            return false;
+        } else {
+            pos = (u32)yAtomicLoad(&_dequeuePos);
+        }
+    }
+    if (ev) {
+        memcpy(ev, (u8*)seq + sizeof(s32), _elemsize);
+    }
+    yAtomicStore(seq, (s32)(pos + _mask + 1));
+    return true;
+}
+
+// Producers are the USB and network I/O threads: they must never wait for
+// the consumer, so an event that does not fit is discarded and counted.
+void YEventQueue::push(const void* ev)
+{
+    while (!tryPush(ev)) {
+        if (_policy == Y_EVENTQUEUE_BACKPRESSURE) {
+            // keep the pending events, refuse the new one
+            yAtomicAdd(&_overflows, 1);
+            return;
+        }
+        if (tryPop(NULL)) {
+            yAtomicAdd(&_overflows, 1);
+        }
+    }
+}
+
+// Remove up to maxcount events at once, returns the number of events copied to evbuf
+int YEventQueue::popBatch(void* evbuf, int maxcount)
+{
+    int count = 0;
+    u8* dst = (u8*)evbuf;
+
+    while (count < maxcount && tryPop(dst)) {
+        dst += _elemsize;
+        count++;
+    }
+    return count;
+}
+
+bool YEventQueue::empty(void)
+{
+    u32 pos = (u32)yAtomicLoad(&_dequeuePos);
+    return yAtomicLoad(_cellSeq(pos)) != (s32)(pos + 1);
+}
+
+void YEventQueue::clear(void)
+{
+    while (tryPop(NULL)) { }
+}
+
+void YEventQueue::setOverflowPolicy(Y_EVENTQUEUE_POLICY_enum policy)
+{
+    _policy = policy;
+}
+
+Y_EVENTQUEUE_POLICY_enum YEventQueue::getOverflowPolicy(void)
+{
+    return (Y_EVENTQUEUE_POLICY_enum)_policy;
+}
+
+int YEventQueue::getOverflowCount(void)
+{
+    return yAtomicLoad(&_overflows);
+}
+
+
+YFunctionCallbackIndex::YFunctionCallbackIndex():
+    _buckets(64), _count(0)
+{
+    yInitializeCriticalSection(&_lock);
+}
+
+YFunctionCallbackIndex::~YFunctionCallbackIndex()
+{
+    yDeleteCriticalSection(&_lock);
+}
+
+unsigned YFunctionCallbackIndex::_bucketOf(YFUN_DESCR fundescr, size_t nbuckets)
+{
+    // descriptors are made of two 16-bit string references (serial, funcId),
+    // mix both halves before keeping the low bits
+    u32 h = (u32)fundescr;
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h & (u32)(nbuckets - 1);
+}
+
+// Double the number of buckets, called with the lock held
+void YFunctionCallbackIndex::_grow(void)
+{
+    vector< vector<Entry> > newbuckets(_buckets.size() * 2);
+    for (size_t b = 0; b < _buckets.size(); b++) {
+        for (size_t i = 0; i < _buckets[b].size(); i++) {
+            const Entry& e = _buckets[b][i];
+            newbuckets[_bucketOf(e.fundescr, newbuckets.size())].push_back(e);
+        }
+    }
+    _buckets.swap(newbuckets);
+}
+
+// Remove the entry of a function under a given descriptor, called with the lock held
+bool YFunctionCallbackIndex::_remove(YFunction* fun, YFUN_DESCR fundescr)
+{
+    vector<Entry>& bucket = _buckets[_bucketOf(fundescr, _buckets.size())];
+    for (vector<Entry>::iterator it = bucket.begin(); it != bucket.end(); it++) {
+        if (it->fun == fun && it->fundescr == fundescr) {
+            bucket.erase(it);
+            _count--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool YFunctionCallbackIndex::add(YFunction* fun)
+{
+    Entry e;
+    e.fun = fun;
+    yEnterCriticalSection(&_lock);
+    e.fundescr = fun->get_functionDescriptor();
+    vector<Entry>& bucket = _buckets[_bucketOf(e.fundescr, _buckets.size())];
+    for (size_t i = 0; i < bucket.size(); i++) {
+        if (bucket[i].fun == fun) {
+            yLeaveCriticalSection(&_lock);
+            return false;
+        }
+    }
+    bucket.push_back(e);
+    _count++;
+    if (_count > (int)_buckets.size() * 2) {
+        _grow();
+    }
+    yLeaveCriticalSection(&_lock);
+    return true;
+}
+
+bool YFunctionCallbackIndex::remove(YFunction* fun)
+{
+    bool res;
+    yEnterCriticalSection(&_lock);
+    res = _remove(fun, fun->get_functionDescriptor());
+    yLeaveCriticalSection(&_lock);
+    return res;
+}
+
+// Move a function to the slot of its current descriptor, if it was indexed
+// under olddescr. Called when a function descriptor gets resolved.
+void YFunctionCallbackIndex::rebind(YFunction* fun, YFUN_DESCR olddescr)
+{
+    Entry e;
+    yEnterCriticalSection(&_lock);
+    if (_remove(fun, olddescr)) {
+        e.fun = fun;
+        e.fundescr = fun->get_functionDescriptor();
+        _buckets[_bucketOf(e.fundescr, _buckets.size())].push_back(e);
+        _count++;
+    }
+    yLeaveCriticalSection(&_lock);
+}
+
+// Append to res all functions indexed under fundescr, and return their number
+int YFunctionCallbackIndex::lookup(YFUN_DESCR fundescr, vector<YFunction*>& res)
+{
+    int found = 0;
+    yEnterCriticalSection(&_lock);
+    const vector<Entry>& bucket = _buckets[_bucketOf(fundescr, _buckets.size())];
+    for (size_t i = 0; i < bucket.size(); i++) {
+        if (bucket[i].fundescr == fundescr) {
+            res.push_back(bucket[i].fun);
+            found++;
+        }
+    }
+    yLeaveCriticalSection(&_lock);
+    return found;
+}
+
+void YFunctionCallbackIndex::clear(void)
+{
+    yEnterCriticalSection(&_lock);
+    for (size_t b = 0; b < _buckets.size(); b++) {
+        _buckets[b].clear();
+    }
+    _count = 0;
+    yLeaveCriticalSection(&_lock);
+}
+
+
+YFunctionRegistry::YFunctionRegistry():
+    _byName(256), _byDescr(64), _nameCount(0), _descrCount(0)
+{
+    yInitializeCriticalSection(&_lock);
+}
+
+YFunctionRegistry::~YFunctionRegistry()
+{
+    yDeleteCriticalSection(&_lock);
+}
+
+// FNV-1a hash of the class name followed by the function name
+u32 YFunctionRegistry::_hash(const char* classname, const string& func)
+{
+    u32 h = 2166136261u;
+    size_t i;
+    for (i = 0; classname[i]; i++) {
+        h = (h ^ (u8)classname[i]) * 16777619u;
     }
-    if (string(j.token) != "200") {
-        errmsg = string("Unexpected HTTP return code: ") + j.token;
-        if (!YAPI::ExceptionsDisabled) {
-            throw YAPI_Exception(YAPI_IO_ERROR, errmsg);
-        }
-        yLeaveCriticalSection(&_lock);
-        return YAPI_IO_ERROR;
+    h = (h ^ '_') * 16777619u;
+    for (i = 0; i < func.length(); i++) {
+        h = (h ^ (u8)func[i]) * 16777619u;
     }
-    if (yJsonParse(&j) != YJSON_PARSE_AVAIL || j.st != YJSON_HTTP_READ_MSG) {
-        errmsg = "Unexpected HTTP header format";
-        if (!YAPI::ExceptionsDisabled) {
-            throw YAPI_Exception(YAPI_IO_ERROR, errmsg);
+    return h;
+}
+
+u32 YFunctionRegistry::_hash(const char* classname, YFUN_DESCR fundescr)
+{
+    u32 h = 2166136261u;
+    u32 d = (u32)fundescr;
+    for (size_t i = 0; classname[i]; i++) {
+        h = (h ^ (u8)classname[i]) * 16777619u;
+    }
+    d ^= d >> 16;
+    d *= 0x45d9f3b;
+    d ^= d >> 16;
+    return h ^ d;
+}
+
+// Double the number of buckets, called with the lock held
+template<class T> void YFunctionRegistry::_grow(vector< vector<T> >& buckets)
+{
+    vector< vector<T> > newbuckets(buckets.size() * 2);
+    for (size_t b = 0; b < buckets.size(); b++) {
+        for (size_t i = 0; i < buckets[b].size(); i++) {
+            const T& e = buckets[b][i];
+            newbuckets[e.hash & (newbuckets.size() - 1)].push_back(e);
         }
-        yLeaveCriticalSection(&_lock);
-        return YAPI_IO_ERROR;
     }
-    if (yJsonParse(&j) != YJSON_PARSE_AVAIL || (j.st != YJSON_PARSE_STRUCT && j.st != YJSON_PARSE_ARRAY)) {
-        errmsg = "Unexpected JSON reply format";
-        if (!YAPI::ExceptionsDisabled) {
-            throw YAPI_Exception(YAPI_IO_ERROR, errmsg);
+    buckets.swap(newbuckets);
+}
+
+YFunction* YFunctionRegistry::find(const char* classname, const string& func)
+{
+    YFunction* res = NULL;
+    u32 h = _hash(classname, func);
+    yEnterCriticalSection(&_lock);
+    const vector<NameEntry>& bucket = _byName[h & (_byName.size() - 1)];
+    for (size_t i = 0; i < bucket.size(); i++) {
+        if (bucket[i].hash == h && bucket[i].func == func && bucket[i].className == classname) {
+            res = bucket[i].fun;
+            break;
         }
-        yLeaveCriticalSection(&_lock);
-        return YAPI_IO_ERROR;
     }
-    // we know for sure that the last character parsed was a '{' or '['
-    do j.src--; while (j.src[0] != '{' && j.src[0] != '[');
-    json_str = string(j.src);
-    try {
-        apires = new YJSONObject(json_str, 0, (int)json_str.length());
-        apires->parseWithRef(_cacheJson);
-    } catch (std::exception ex) {
-        errmsg = "unexpected JSON structure: " + string(ex.what());
-        if (_cacheJson) {
-            delete _cacheJson;
-            _cacheJson = NULL;
+    yLeaveCriticalSection(&_lock);
+    return res;
+}
+
+YFunction* YFunctionRegistry::find(const char* classname, YFUN_DESCR fundescr)
+{
+    YFunction* res = NULL;
+    u32 h = _hash(classname, fundescr);
+    yEnterCriticalSection(&_lock);
+    const vector<DescrEntry>& bucket = _byDescr[h & (_byDescr.size() - 1)];
+    for (size_t i = 0; i < bucket.size(); i++) {
+        if (bucket[i].fundescr == fundescr && bucket[i].className == classname) {
+            res = bucket[i].fun;
+            break;
         }
-        yLeaveCriticalSection(&_lock);
-        if (!YAPI::ExceptionsDisabled) {
-            throw YAPI_Exception(YAPI_IO_ERROR, errmsg);
+    }
+    yLeaveCriticalSection(&_lock);
+    return res;
+}
+
+// Register a new object, replacing any object previously registered under the same name
+void YFunctionRegistry::add(const char* classname, const string& func, YFunction* obj)
+{
+    NameEntry e;
+    e.hash = _hash(classname, func);
+    e.className = classname;
+    e.func = func;
+    e.fun = obj;
+    yEnterCriticalSection(&_lock);
+    vector<NameEntry>& bucket = _byName[e.hash & (_byName.size() - 1)];
+    for (size_t i = 0; i < bucket.size(); i++) {
+        if (bucket[i].hash == e.hash && bucket[i].func == func && bucket[i].className == classname) {
+            bucket[i].fun = obj;
+            yLeaveCriticalSection(&_lock);
+            return;
         }
-        return YAPI_IO_ERROR;
     }
-    // store result in cache
-    if (_cacheJson) {
-        delete _cacheJson;
+    bucket.push_back(e);
+    _nameCount++;
+    if (_nameCount > (int)_byName.size() * 2) {
+        _grow(_byName);
     }
-    _cacheJson = apires;
-    _cacheStamp = yapiGetTickCount() + YAPI::_yapiContext.GetCacheValidity();
     yLeaveCriticalSection(&_lock);
-
-    return YAPI_SUCCESS;
 }
 
-
-void YDevice::clearCache(bool clearSubpath)
+// Index an object already registered by name under its hardware descriptor.
+// Descriptors are never reused for another function, so entries remain valid.
+void YFunctionRegistry::add(const char* classname, YFUN_DESCR fundescr, YFunction* obj)
 {
+    DescrEntry e;
+    e.hash = _hash(classname, fundescr);
+    e.fundescr = fundescr;
+    e.className = classname;
+    e.fun = obj;
     yEnterCriticalSection(&_lock);
-    _cacheStamp = 0;
-    if (clearSubpath) {
-        if (_cacheJson) {
-            delete _cacheJson;
-            _cacheJson = NULL;
-        }
-        if (_subpath) {
-            delete _subpath;
-            _subpath = NULL;
+    vector<DescrEntry>& bucket = _byDescr[e.hash & (_byDescr.size() - 1)];
+    for (size_t i = 0; i < bucket.size(); i++) {
+        if (bucket[i].fundescr == fundescr && bucket[i].className == classname) {
+            bucket[i].fun = obj;
+            yLeaveCriticalSection(&_lock);
+            return;
         }
     }
+    bucket.push_back(e);
+    _descrCount++;
+    if (_descrCount > (int)_byDescr.size() * 2) {
+        _grow(_byDescr);
+    }
     yLeaveCriticalSection(&_lock);
 }
 
-YRETCODE YDevice::getFunctions(vector<YFUN_DESCR>** functions, string& errmsg)
+// Delete all registered objects
+void YFunctionRegistry::clear(void)
 {
+    vector<YFunction*> objs;
+    size_t b, i;
     yEnterCriticalSection(&_lock);
-    if (_functions.size() == 0) {
-        int res = YapiWrapper::getFunctionsByDevice(_devdescr, 0, _functions, 64, errmsg);
-        if (YISERR(res)) return (YRETCODE)res;
+    for (b = 0; b < _byName.size(); b++) {
+        for (i = 0; i < _byName[b].size(); i++) {
+            objs.push_back(_byName[b][i].fun);
+        }
+        _byName[b].clear();
     }
-    *functions = &_functions;
+    for (b = 0; b < _byDescr.size(); b++) {
+        _byDescr[b].clear();
+    }
+    _nameCount = 0;
+    _descrCount = 0;
     yLeaveCriticalSection(&_lock);
-
-    return YAPI_SUCCESS;
+    // objects are deleted without the lock, as destructors may use the registry
+    for (i = 0; i < objs.size(); i++) {
+        delete objs[i];
+    }
 }
 
 
-queue<yapiGlobalEvent> YAPI::_plug_events;
-queue<yapiDataEvent> YAPI::_data_events;
+YEventQueue YAPI::_plug_events(sizeof(yapiGlobalEvent), YAPI_PLUG_EVENT_QUEUE_SIZE);
+YEventQueue YAPI::_data_events(sizeof(yapiDataEvent), YAPI_DATA_EVENT_QUEUE_SIZE);
 
 u64 YAPI::_nextEnum = 0;
 bool YAPI::_apiInitialized = false;
@@ -3946,16 +6823,17 @@ void YAPI::_yapiDeviceArrivalCallbackFwd(YDEV_DESCR devdesc)
     yapiDataEvent dataEv;
     yDeviceSt infos;
     string errmsg;
-    vector<YFunction*>::iterator it;
+    vector<YFunction*> unresolved;
 
     YDevice* dev = YDevice::getDevice(devdesc);
     dev->clearCache(true);
+    // functions not yet resolved are indexed under the invalid descriptor,
+    // they will be moved to their own slot once refreshed
     dataEv.type = YAPI_FUN_REFRESH;
-    for (it = _FunctionCallbacks.begin(); it < _FunctionCallbacks.end(); it++) {
-        if ((*it)->functionDescriptor() == Y_FUNCTIONDESCRIPTOR_INVALID) {
-            dataEv.fun = *it;
-            _data_events.push(dataEv);
-        }
+    _ValueCallbackIndex.lookup(Y_FUNCTIONDESCRIPTOR_INVALID, unresolved);
+    for (unsigned i = 0; i < unresolved.size(); i++) {
+        dataEv.fun = unresolved[i];
+        _data_events.push(&dataEv);
     }
     if (YAPI::DeviceArrivalCallback == NULL) return;
     ev.type = YAPI_DEV_ARRIVAL;
@@ -3963,7 +6841,7 @@ void YAPI::_yapiDeviceArrivalCallbackFwd(YDEV_DESCR devdesc)
     if (YapiWrapper::getDeviceInfo(devdesc, infos, errmsg) != YAPI_SUCCESS) return;
     ev.module = yFindModule(string(infos.serial) + ".module");
     ev.module->setImmutableAttributes(&infos);
-    _plug_events.push(ev);
+    _plug_events.push(&ev);
 }
 
 void YAPI::_yapiDeviceRemovalCallbackFwd(YDEV_DESCR devdesc)
@@ -3977,7 +6855,7 @@ void YAPI::_yapiDeviceRemovalCallbackFwd(YDEV_DESCR devdesc)
     if (YapiWrapper::getDeviceInfo(devdesc, infos, errmsg) != YAPI_SUCCESS) return;
     ev.module = yFindModule(string(infos.serial) + ".module");
     //the function is allready thread safe (use yapiLockDeviceCallaback)
-    _plug_events.push(ev);
+    _plug_events.push(&ev);
 }
 
 void YAPI::_yapiDeviceChangeCallbackFwd(YDEV_DESCR devdesc)
@@ -3992,7 +6870,7 @@ void YAPI::_yapiDeviceChangeCallbackFwd(YDEV_DESCR devdesc)
     ev.module = yFindModule(string(infos.serial) + ".module");
     ev.module->setImmutableAttributes(&infos);
     //the function is allready thread safe (use yapiLockDeviceCallaback)
-    _plug_events.push(ev);
+    _plug_events.push(&ev);
 }
 
 void YAPI::_yapiBeaconCallbackFwd(YDEV_DESCR devdesc, int beacon)
@@ -4009,7 +6887,7 @@ void YAPI::_yapiBeaconCallbackFwd(YDEV_DESCR devdesc, int beacon)
         ev.module = module;
         ev.beacon = beacon;
         //the function is allready thread safe (use yapiLockFunctionCallaback)
-        _data_events.push(ev);
+        _data_events.push(&ev);
     }
 }
 
@@ -4028,13 +6906,14 @@ void YAPI::_yapiDeviceConfigChangeCallbackFwd(YDEV_DESCR devdesc)
         ev.module = module;
         ev.module->setImmutableAttributes(&infos);
         //the function is allready thread safe (use yapiLockFunctionCallaback)
-        _data_events.push(ev);
+        _data_events.push(&ev);
     }
 }
 
 void YAPI::_yapiFunctionUpdateCallbackFwd(YAPI_FUNCTION fundesc, const char* value)
 {
     yapiDataEvent ev;
+    vector<YFunction*> subscribers;
 
     //the function is allready thread safe (use yapiLockFunctionCallaback)
     if (value == NULL) {
@@ -4043,31 +6922,34 @@ void YAPI::_yapiFunctionUpdateCallbackFwd(YAPI_FUNCTION fundesc, const char* val
         ev.type = YAPI_FUN_VALUE;
         memcpy(ev.value, value,YOCTO_PUBVAL_LEN);
     }
-    for (unsigned i = 0; i < _FunctionCallbacks.size(); i++) {
-        if (_FunctionCallbacks[i]->get_functionDescriptor() == fundesc) {
-            ev.fun = _FunctionCallbacks[i];
-            _data_events.push(ev);
-        }
+    if (_ValueCallbackIndex.lookup(fundesc, subscribers) == 0) {
+        return;
+    }
+    for (unsigned i = 0; i < subscribers.size(); i++) {
+        ev.fun = subscribers[i];
+        _data_events.push(&ev);
     }
 }
 
 void YAPI::_yapiFunctionTimedReportCallbackFwd(YAPI_FUNCTION fundesc, double timestamp, const u8* bytes, u32 len, double duration)
 {
     yapiDataEvent ev;
+    vector<YFunction*> subscribers;
+    u32 p;
 
-    for (unsigned i = 0; i < _TimedReportCallbackList.size(); i++) {
-        if (_TimedReportCallbackList[i]->get_functionDescriptor() == fundesc) {
-            u32 p = 0;
-            ev.type = YAPI_FUN_TIMEDREPORT;
-            ev.sensor = (YSensor*)_TimedReportCallbackList[i];
-            ev.timestamp = timestamp;
-            ev.duration = duration;
-            ev.len = len;
-            while (p < len) {
-                ev.report[p++] = *bytes++;
-            }
-            _data_events.push(ev);
-        }
+    if (_TimedReportCallbackIndex.lookup(fundesc, subscribers) == 0) {
+        return;
+    }
+    ev.type = YAPI_FUN_TIMEDREPORT;
+    ev.timestamp = timestamp;
+    ev.duration = duration;
+    ev.len = len;
+    for (p = 0; p < len; p++) {
+        ev.report[p] = bytes[p];
+    }
+    for (unsigned i = 0; i < subscribers.size(); i++) {
+        ev.sensor = (YSensor*)subscribers[i];
+        _data_events.push(&ev);
     }
 }
 
@@ -4079,7 +6961,7 @@ void YAPI::_yapiHubDiscoveryCallbackFwd(const char* serial, const char* url)
     ev.type = YAPI_HUB_DISCOVER;
     strcpy(ev.serial, serial);
     strcpy(ev.url, url);
-    _plug_events.push(ev);
+    _plug_events.push(&ev);
 }
 
 
@@ -4148,35 +7030,46 @@ yCalibrationHandler YAPI::_getCalibrationHandler(int calibType)
 // Parse an array of u16 encoded in a base64-like string with memory-based compresssion
 vector<int> YAPI::_decodeWords(string sdat)
 {
-    vector<int> udat;
+    vector<int> udat(sdat.size() + 1);
+    int count;
 
-    for (unsigned p = 0; p < sdat.size();) {
+    count = YAPI::_decodeWords(sdat.data(), (int)sdat.size(), &udat[0]);
+    udat.resize(count);
+    return udat;
+}
+
+// Same as above, decoding directly into a buffer of at least len words
+// (each word takes one or three chars). Returns the number of words decoded.
+int YAPI::_decodeWords(const char* sdat, int len, int* udat)
+{
+    const char *p = sdat;
+    const char *end = sdat + len;
+    int *out = udat;
+
+    while (p < end) {
         unsigned val;
-        unsigned c = sdat[p++];
-        if (c == '*') {
+        unsigned c = *p++;
+        if (c >= 'a') {
+            // back-reference to one of the previous words
+            unsigned back = c - 'a';
+            val = (back < (unsigned)(out - udat) ? (unsigned)out[-1 - (int)back] : 0);
+        } else if (c == '*') {
             val = 0;
         } else if (c == 'X') {
             val = 0xffff;
         } else if (c == 'Y') {
             val = 0x7fff;
-        } else if (c >= 'a') {
-            int srcpos = (int)udat.size() - 1 - (c - 'a');
-            if (srcpos < 0)
-                val = 0;
-            else
-                val = udat[srcpos];
         } else {
-            if (p + 2 > sdat.size()) return udat;
-            val = (c - '0');
-            c = sdat[p++];
-            val += (c - '0') << 5;
-            c = sdat[p++];
+            if (end - p < 2) break;
+            val = (c - '0') + (((unsigned)p[0] - '0') << 5);
+            c = p[1];
             if (c == 'z') c = '\\';
             val += (c - '0') << 10;
+            p += 2;
         }
-        udat.push_back((int)val);
+        *out++ = (int)val;
     }
-    return udat;
+    return (int)(out - udat);
 }
 
 // Parse a list of floats and return them as an array of fixed-point 1/1000 numbers
@@ -4358,6 +7251,9 @@ YRETCODE YAPI::InitAPI(int mode, string& errmsg)
     yInitializeCriticalSection(&_updateDeviceList_CS);
     yInitializeCriticalSection(&_handleEvent_CS);
     yInitializeCriticalSection(&_global_cs);
+    yInitializeCriticalSection(&_asyncRequests_CS);
+    YDeviceBatch::_Init();
+    YRxStream::_Init();
     for (i = 0; i <= 20; i++) {
         YAPI::RegisterCalibrationHandler(i, YAPI::LinearCalibrationHandler);
     }
@@ -4383,14 +7279,14 @@ void YAPI::FreeAPI(void)
         yDeleteCriticalSection(&_updateDeviceList_CS);
         yDeleteCriticalSection(&_handleEvent_CS);
         yDeleteCriticalSection(&_global_cs);
+        YFunction::_ClearAsyncRequests();
+        yDeleteCriticalSection(&_asyncRequests_CS);
+        YDeviceBatch::_Free();
         YDevice::ClearCache();
         YFunction::_ClearCache();
-        while (!_plug_events.empty()) {
-            _plug_events.pop();
-        }
-        while (!_data_events.empty()) {
-            _data_events.pop();
-        }
+        YRxStream::_Free();
+        _plug_events.clear();
+        _data_events.clear();
         _calibHandlers.clear();
     }
 }
@@ -4723,16 +7619,8 @@ YRETCODE YAPI::UpdateDeviceList(string& errmsg)
         return res;
     }
     // unpop plug/unplug event and call user callback
-    while (!_plug_events.empty()) {
-        yapiGlobalEvent ev;
-        yapiLockDeviceCallBack(NULL);
-        if (_plug_events.empty()) {
-            yapiUnlockDeviceCallBack(NULL);
-            break;
-        }
-        ev = _plug_events.front();
-        _plug_events.pop();
-        yapiUnlockDeviceCallBack(NULL);
+    yapiGlobalEvent ev;
+    while (_plug_events.tryPop(&ev)) {
         switch (ev.type) {
         case YAPI_DEV_ARRIVAL:
             if (!YAPI::DeviceArrivalCallback) break;
@@ -4778,6 +7666,13 @@ YRETCODE YAPI::UpdateDeviceList(string& errmsg)
 YRETCODE YAPI::HandleEvents(string& errmsg)
 {
     YRETCODE res;
+    yapiDataEvent events[YAPI_EVENT_BATCH_SIZE];
+    int count;
+    // timed reports for batch callbacks, delivered per sensor after each batch
+    YSensor* batchSensors[YAPI_EVENT_BATCH_SIZE];
+    YMeasureData batchMeasures[YAPI_EVENT_BATCH_SIZE];
+    YMeasureData sensorMeasures[YAPI_EVENT_BATCH_SIZE];
+    int nbatch;
 
     // prevent reentrance into this function
     yEnterCriticalSection(&_handleEvent_CS);
@@ -4787,48 +7682,108 @@ YRETCODE YAPI::HandleEvents(string& errmsg)
         yLeaveCriticalSection(&_handleEvent_CS);
         return res;
     }
-    // pop data event and call user callback
-    while (!_data_events.empty()) {
-        yapiDataEvent ev;
-        YSensor* sensor;
-        vector<int> report;
-
-        yapiLockFunctionCallBack(NULL);
-        if (_data_events.empty()) {
-            yapiUnlockFunctionCallBack(NULL);
-            break;
+    // pop data events by batch and call user callback
+    while ((count = _data_events.popBatch(events, YAPI_EVENT_BATCH_SIZE)) > 0) {
+        nbatch = 0;
+        for (int i = 0; i < count; i++) {
+            yapiDataEvent& ev = events[i];
+            YSensor* sensor;
+            YMeasureData measure;
+
+            switch (ev.type) {
+            case YAPI_FUN_VALUE:
+                ev.fun->_invokeValueCallback((string)ev.value);
+                break;
+            case YAPI_FUN_TIMEDREPORT:
+                if (ev.report[0] <= 2) {
+                    sensor = ev.sensor;
+                    sensor->_decodeTimedReportData(ev.timestamp, ev.duration, ev.report, ev.len, measure);
+                    sensor->_invokeTimedReportData(measure);
+                    if (sensor->_hasTimedReportBatchCallback()) {
+                        batchSensors[nbatch] = sensor;
+                        batchMeasures[nbatch] = measure;
+                        nbatch++;
+                    }
+                }
+                break;
+            case YAPI_FUN_REFRESH:
+                ev.fun->isOnline();
+                break;
+            case YAPI_DEV_CONFCHANGE:
+                ev.module->_invokeConfigChangeCallback();
+                break;
+            case YAPI_DEV_BEACON:
+                ev.module->_invokeBeaconCallback((Y_BEACON_enum)ev.beacon);
+                break;
+            default:
+                break;
+            }
         }
-        ev = _data_events.front();
-        _data_events.pop();
-        yapiUnlockFunctionCallBack(NULL);
-        switch (ev.type) {
-        case YAPI_FUN_VALUE:
-            ev.fun->_invokeValueCallback((string)ev.value);
-            break;
-        case YAPI_FUN_TIMEDREPORT:
-            if (ev.report[0] <= 2) {
-                sensor = ev.sensor;
-                report.assign(ev.report, ev.report + ev.len);
-                sensor->_invokeTimedReportCallback(sensor->_decodeTimedReport(ev.timestamp, ev.duration, report));
+        // group the pending measures by sensor, keeping their chronological order
+        for (int i = 0; i < nbatch; i++) {
+            YSensor* sensor = batchSensors[i];
+            int n = 0;
+
+            if (sensor == NULL) continue;
+            for (int j = i; j < nbatch; j++) {
+                if (batchSensors[j] == sensor) {
+                    sensorMeasures[n++] = batchMeasures[j];
+                    batchSensors[j] = NULL;
+                }
             }
-            break;
-        case YAPI_FUN_REFRESH:
-            ev.fun->isOnline();
-            break;
-        case YAPI_DEV_CONFCHANGE:
-            ev.module->_invokeConfigChangeCallback();
-            break;
-        case YAPI_DEV_BEACON:
-            ev.module->_invokeBeaconCallback((Y_BEACON_enum)ev.beacon);
-            break;
-        default:
-            break;
+            sensor->_invokeTimedReportBatchCallback(sensorMeasures, n);
         }
     }
+    // completed asynchronous requests
+    YFunction::_HandleAsyncRequests();
+    // local receive streams of serial ports
+    YRxStream::_HandleStreams();
     yLeaveCriticalSection(&_handleEvent_CS);
     return YAPI_SUCCESS;
 }
 
+
+void YAPI::SetEventQueueOverflowPolicy(Y_EVENTQUEUE_POLICY_enum policy)
+{
+    _data_events.setOverflowPolicy(policy);
+    _plug_events.setOverflowPolicy(policy);
+}
+
+
+int YAPI::GetEventQueueOverflowCount(void)
+{
+    return _data_events.getOverflowCount() + _plug_events.getOverflowCount();
+}
+
+
+YRETCODE YAPI::ReadMany(const vector<YFunction*>& functions, int msValidity, string& errmsg)
+{
+    YRETCODE res = YFunction::_LoadMany(functions, msValidity, errmsg);
+    if (YISERR(res) && !YAPI::ExceptionsDisabled) {
+        throw YAPI_Exception(res, errmsg);
+    }
+    return res;
+}
+
+
+int YAPI::GetPendingAsyncRequests(void)
+{
+    return YFunction::_PendingAsyncRequests();
+}
+
+
+YRETCODE YAPI::GetHTTPPoolStats(const string& url, int& hits, int& misses, int& idle, string& errmsg)
+{
+    char errbuf[YOCTO_ERRMSG_LEN];
+    YRETCODE res;
+
+    res = yapiGetHTTPPoolStats(url.c_str(), &hits, &misses, &idle, errbuf);
+    if (YISERR(res)) {
+        errmsg = errbuf;
+    }
+    return res;
+}
+
 /**
  * Pauses the execution flow for a specified duration.
  * This function implements a passive waiting loop, meaning that it does not
@@ -4853,20 +7808,25 @@ YRETCODE YAPI::Sleep(unsigned ms_duration, string& errmsg)
     char errbuf[YOCTO_ERRMSG_LEN];
     YRETCODE res;
     u64 waituntil = YAPI::GetTickCount() + ms_duration;
-    do {
-        res = YAPI::HandleEvents(errmsg);
+    u64 now;
+
+    res = YAPI::HandleEvents(errmsg);
+    if (YISERR(res)) {
+        return res;
+    }
+    // block until a notification is received (device packets and hub
+    // notifications wake up yapiWaitForEvents), then dispatch it at once
+    while ((now = YAPI::GetTickCount()) < waituntil) {
+        res = yapiWaitForEvents((int)(waituntil - now), errbuf);
         if (YISERR(res)) {
             errmsg = errbuf;
             return res;
         }
-        if (waituntil > YAPI::GetTickCount()) {
-            res = yapiSleep(2, errbuf);
-            if (YISERR(res)) {
-                errmsg = errbuf;
-                return res;
-            }
+        res = YAPI::HandleEvents(errmsg);
+        if (YISERR(res)) {
+            return res;
         }
-    } while (waituntil > YAPI::GetTickCount());
+    }
 
     return YAPI_SUCCESS;
 }
@@ -6945,11 +9905,17 @@ string YModule::get_url(void)
 YModule *YModule::nextModule(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Module", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YModule::FindModule(hwid);
+    if (next == NULL) {
+        next = YModule::FindModule(hwid);
+        YFunction::_AddToCache("Module", nextdescr, next);
+    }
+    return (YModule*)next;
 }
 
 YModule* YModule::FirstModule(void)
@@ -7199,6 +10165,11 @@ YSensor::YSensor(const string& func): YFunction(func)
 //--- (end of generated code: YSensor initialization)
 {
     _className = "Sensor";
+    _calhdl = NULL;
+    _timedReportDataCallback = NULL;
+    _timedReportBatchCallback = NULL;
+    _timedReportMeasureCallback = false;
+    _fastCalNpt = -1;
 }
 
 YSensor::~YSensor()
@@ -8398,11 +11369,17 @@ double YSensor::_decodeAvg(int dw)
 YSensor *YSensor::nextSensor(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Sensor", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YSensor::FindSensor(hwid);
+    if (next == NULL) {
+        next = YSensor::FindSensor(hwid);
+        YFunction::_AddToCache("Sensor", nextdescr, next);
+    }
+    return (YSensor*)next;
 }
 
 YSensor* YSensor::FirstSensor(void)
@@ -8431,6 +11408,178 @@ YDataSet YSensor::get_recordedData(int startTime, int endTime)
     return this->get_recordedData((double)startTime, (double)endTime);
 }
 
+int YSensor::registerTimedReportDataCallback(YSensorTimedReportDataCallback callback)
+{
+    _timedReportDataCallback = callback;
+    YFunction::_SetTimedReportSubscription(this, this->_hasTimedReportCallbacks());
+    return 0;
+}
+
+int YSensor::registerTimedReportBatchCallback(YSensorTimedReportBatchCallback callback)
+{
+    _timedReportBatchCallback = callback;
+    YFunction::_SetTimedReportSubscription(this, this->_hasTimedReportCallbacks());
+    return 0;
+}
+
+void YSensor::_invokeTimedReportData(const YMeasureData& measure)
+{
+    if (_timedReportDataCallback != NULL) {
+        _timedReportDataCallback(this, &measure);
+    }
+    this->_invokeTimedReportCallback(YMeasure(measure.startTime, measure.endTime,
+                                              measure.minValue, measure.averageValue, measure.maxValue));
+}
+
+void YSensor::_invokeTimedReportBatchCallback(const YMeasureData* measures, int count)
+{
+    if (_timedReportBatchCallback != NULL && count > 0) {
+        _timedReportBatchCallback(this, measures, count);
+    }
+}
+
+void YSensor::_parsedHook(void)
+{
+    _refreshFastCalibration();
+}
+
+// Rebuild the cached calibration table from the parameters decoded by _parserHelper.
+// Only the standard linear handler is mirrored; any other handler is called as is.
+void YSensor::_refreshFastCalibration(void)
+{
+    int npt, i;
+
+    _fastCalNpt = -1;
+    if (_caltyp <= 0 || _calhdl != YAPI::LinearCalibrationHandler) {
+        return;
+    }
+    npt = (int)_calraw.size();
+    if (npt < 1 || npt > YSENSOR_FASTCAL_MAXPT || npt != (int)_calref.size()) {
+        return;
+    }
+    for (i = 0; i < npt; i++) {
+        _fastCalRaw[i] = _calraw[i];
+        _fastCalRef[i] = _calref[i];
+    }
+    if (_caltyp < YOCTO_CALIB_TYPE_OFS && _caltyp % 10 < npt) {
+        npt = _caltyp % 10;
+    }
+    _fastCalNpt = npt;
+}
+
+// Same result as _calhdl(rawValue, ...), without copying the calibration vectors
+double YSensor::_applyFastCalibration(double rawValue)
+{
+    if (_caltyp == 0 || _calhdl == NULL) {
+        return rawValue;
+    }
+    if (_fastCalNpt < 0) {
+        return _calhdl(rawValue, _caltyp, _calpar, _calraw, _calref);
+    }
+    return yLinearCalibration(rawValue, _fastCalRaw, _fastCalRef, _fastCalNpt);
+}
+
+void YSensor::_currentValueAsyncCallback(void* context, YFunction* func, YRETCODE retcode)
+{
+    YAsyncGetterCtx* ctx = (YAsyncGetterCtx*)context;
+    YSensorValueAsyncCallback callback = ctx->valCallback;
+    void* userContext = ctx->context;
+    YSensor* sensor = (YSensor*)func;
+    double res = YSensor::CURRENTVALUE_INVALID;
+
+    delete ctx;
+    if (!YISERR(retcode)) {
+        // same as get_currentValue, from the attributes that have just been loaded
+        yEnterCriticalSection(&sensor->_this_cs);
+        res = sensor->_applyCalibration(sensor->_currentRawValue);
+        if (res == YSensor::CURRENTVALUE_INVALID) {
+            res = sensor->_currentValue;
+        }
+        res = res * sensor->_iresol;
+        res = floor(res + 0.5) / sensor->_iresol;
+        yLeaveCriticalSection(&sensor->_this_cs);
+    }
+    callback(userContext, sensor, res);
+}
+
+YRETCODE YSensor::get_currentValueAsync(YSensorValueAsyncCallback callback, void* context)
+{
+    YAsyncGetterCtx* ctx = new YAsyncGetterCtx();
+    YRETCODE res;
+
+    ctx->strCallback = NULL;
+    ctx->valCallback = callback;
+    ctx->context = context;
+    try {
+        res = this->loadAsync((int)YAPI::_yapiContext.GetCacheValidity(), _currentValueAsyncCallback, ctx);
+    } catch (std::exception&) {
+        delete ctx;
+        throw;
+    }
+    if (YISERR(res)) {
+        delete ctx;
+    }
+    return res;
+}
+
+// Decode a little-endian integer of up to 4 bytes from a timed report
+static double yDecodeReportInt(const int* report, int len, int& pos, int nbytes, bool isSigned)
+{
+    double poww = 1;
+    double res = 0;
+    int byteVal = 0;
+
+    while (nbytes > 0 && pos < len) {
+        byteVal = report[pos++];
+        res += poww * byteVal;
+        poww *= 0x100;
+        nbytes--;
+    }
+    if (isSigned && (byteVal & 0x80) != 0) {
+        res -= poww;
+    }
+    return res;
+}
+
+// Allocation-free equivalent of _decodeTimedReport, working directly on the
+// event payload (32bit timed report format)
+void YSensor::_decodeTimedReportData(double timestamp, double duration, const int* report, int len, YMeasureData& measure)
+{
+    double startTime, endTime;
+    double avgRaw, minRaw, maxRaw;
+    int pos;
+
+    if (duration > 0) {
+        startTime = timestamp - duration;
+    } else {
+        startTime = _prevTimedReport;
+    }
+    endTime = timestamp;
+    _prevTimedReport = endTime;
+    if (startTime == 0) {
+        startTime = endTime;
+    }
+    measure.startTime = startTime;
+    measure.endTime = endTime;
+    if (len <= 5) {
+        // sub-second report, 1-4 bytes
+        pos = 1;
+        avgRaw = yDecodeReportInt(report, len, pos, 4, true);
+        measure.averageValue = _applyFastCalibration(avgRaw / 1000.0);
+        measure.minValue = measure.averageValue;
+        measure.maxValue = measure.averageValue;
+    } else {
+        // averaged report: avg,avg-min,max-avg (differences are unsigned)
+        pos = 2;
+        avgRaw = yDecodeReportInt(report, len, pos, 1 + (report[1] & 3), true);
+        minRaw = avgRaw - yDecodeReportInt(report, len, pos, 1 + ((report[1] >> 2) & 3), false);
+        maxRaw = avgRaw + yDecodeReportInt(report, len, pos, 1 + ((report[1] >> 4) & 3), false);
+        measure.averageValue = _applyFastCalibration(avgRaw / 1000.0);
+        measure.minValue = _applyFastCalibration(minRaw / 1000.0);
+        measure.maxValue = _applyFastCalibration(maxRaw / 1000.0);
+    }
+}
+
 //--- (generated code: YSensor functions)
 //--- (end of generated code: YSensor functions)
 
@@ -8974,11 +12123,17 @@ vector<YDataSet> YDataLogger::parse_dataSets(string json)
 YDataLogger *YDataLogger::nextDataLogger(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("DataLogger", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YDataLogger::FindDataLogger(hwid);
+    if (next == NULL) {
+        next = YDataLogger::FindDataLogger(hwid);
+        YFunction::_AddToCache("DataLogger", nextdescr, next);
+    }
+    return (YDataLogger*)next;
 }
 
 YDataLogger* YDataLogger::FirstDataLogger(void)
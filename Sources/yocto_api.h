@@ -148,6 +148,31 @@ typedef enum {
 #define Y_SENSORSTATE_INVALID           (YAPI_INVALID_INT)
 //--- (end of generated code: YSensor definitions)
 
+/// plain measure record, as delivered by the allocation-free timed report callbacks
+typedef struct {
+    double      startTime;      // start of the measure interval (UTC, seconds)
+    double      endTime;        // end of the measure interval (UTC, seconds)
+    double      minValue;
+    double      averageValue;
+    double      maxValue;
+} YMeasureData;
+
+/// read-only view on the measures of a YDataSet, stored as one contiguous array per field;
+/// the pointers remain valid until the YDataSet is modified (loadMore, ...)
+typedef struct {
+    const double    *startTime;     // start of each measure interval (UTC, seconds)
+    const double    *endTime;       // end of each measure interval (UTC, seconds)
+    const double    *minValue;
+    const double    *averageValue;
+    const double    *maxValue;
+    int             count;
+} YMeasureColumns;
+
+typedef void (*YSensorTimedReportDataCallback)(YSensor *func, const YMeasureData *measure);
+typedef void (*YSensorTimedReportBatchCallback)(YSensor *func, const YMeasureData *measures, int count);
+
+#define YSENSOR_FASTCAL_MAXPT           10      // max calibration points handled by the cached linear calibration
+
 
 //--- (generated code: YDataStream definitions)
 //--- (end of generated code: YDataStream definitions)
@@ -222,6 +247,20 @@ typedef void (*yDeviceUpdateCallback)(YModule *module);
 /// prototype of the Hub discoverycallback
 typedef void (*YHubDiscoveryCallback)(const string& serial, const string& url);
 
+/// prototype of the progress callback of YDataSet::loadMoreParallel and YDataSet::loadAll
+typedef void (*YDataSetProgressCallback)(YDataSet *dataset, int progress, void *context);
+
+#define YDATASET_MAX_PENDING            4       // stream downloads kept in progress by YDataSet::loadAll
+
+/// prototypes of the completion handlers of asynchronous requests (see YFunction::loadAsync),
+/// invoked by yHandleEvents and ySleep
+typedef void (*YFunctionAsyncCallback)(void *context, YFunction *func, YRETCODE retcode);
+typedef void (*YDownloadAsyncCallback)(void *context, YFunction *func, YRETCODE retcode, const string& content);
+typedef void (*YStringAsyncCallback)(void *context, YFunction *func, const string& value);
+typedef void (*YSensorValueAsyncCallback)(void *context, YSensor *sensor, double value);
+
+#define YFUNCTION_ASYNC_MAX_PENDING     8       // asynchronous requests kept in flight per websocket device
+
 
 
 /// prototype of the value calibration handlers
@@ -300,6 +339,113 @@ typedef struct{
     };
 }yapiDataEvent;
 
+#define YAPI_DATA_EVENT_QUEUE_SIZE      4096    // must be a power of two
+#define YAPI_PLUG_EVENT_QUEUE_SIZE      1024    // must be a power of two
+#define YAPI_EVENT_BATCH_SIZE           32      // number of events drained at once by yHandleEvents
+
+typedef enum {
+    Y_EVENTQUEUE_DROP_OLDEST = 0,   // discard the oldest pending event to make room
+    Y_EVENTQUEUE_BACKPRESSURE = 1   // refuse new events until the consumer makes room
+} Y_EVENTQUEUE_POLICY_enum;
+
+//
+// Bounded lock-free queue of fixed-size event records, used to pass events
+// from the USB/TCP notification threads to the thread calling yHandleEvents().
+// Any number of threads may push; entries are removed by the consumer thread,
+// or by a producer when dropping the oldest entry on overflow.
+//
+class YEventQueue
+{
+    u8*                 _cells;
+    int                 _elemsize;
+    int                 _stride;
+    u32                 _mask;
+    volatile s32        _enqueuePos;
+    volatile s32        _dequeuePos;
+    volatile s32        _overflows;
+    volatile int        _policy;
+    volatile s32*       _cellSeq(u32 pos);
+public:
+    YEventQueue(int elemsize, int capacity);
+    ~YEventQueue();
+    bool    tryPush(const void* ev);
+    bool    tryPop(void* ev);
+    void    push(const void* ev);
+    int     popBatch(void* evbuf, int maxcount);
+    bool    empty(void);
+    void    clear(void);
+    void    setOverflowPolicy(Y_EVENTQUEUE_POLICY_enum policy);
+    Y_EVENTQUEUE_POLICY_enum getOverflowPolicy(void);
+    int     getOverflowCount(void);
+};
+
+//
+// Hash index from function descriptor to the function objects that have
+// registered a callback, so that notifications can be dispatched without
+// scanning every registered callback. Functions whose descriptor is not yet
+// known are kept under Y_FUNCTIONDESCRIPTOR_INVALID until they are resolved.
+//
+class YFunctionCallbackIndex
+{
+    typedef struct {
+        YFUN_DESCR  fundescr;
+        YFunction*  fun;
+    } Entry;
+    vector< vector<Entry> > _buckets;
+    int                     _count;
+    yCRITICAL_SECTION       _lock;
+    unsigned    _bucketOf(YFUN_DESCR fundescr, size_t nbuckets);
+    void        _grow(void);
+    bool        _remove(YFunction* fun, YFUN_DESCR fundescr);
+public:
+    YFunctionCallbackIndex();
+    ~YFunctionCallbackIndex();
+    bool    add(YFunction* fun);
+    bool    remove(YFunction* fun);
+    void    rebind(YFunction* fun, YFUN_DESCR olddescr);
+    int     lookup(YFUN_DESCR fundescr, vector<YFunction*>& res);
+    void    clear(void);
+};
+
+//
+// Registry of the function objects created by the FindXxx factory functions.
+// Objects are indexed by class name and function name, using a hash computed
+// in place so that lookups do not allocate any string. Objects found through
+// a hardware descriptor (nextXxx) are also indexed by class name and
+// descriptor. The registry owns the objects and is safe to use from any thread.
+//
+class YFunctionRegistry
+{
+    typedef struct {
+        u32         hash;
+        string      className;
+        string      func;
+        YFunction*  fun;
+    } NameEntry;
+    typedef struct {
+        u32         hash;
+        YFUN_DESCR  fundescr;
+        string      className;
+        YFunction*  fun;
+    } DescrEntry;
+    vector< vector<NameEntry> >  _byName;
+    vector< vector<DescrEntry> > _byDescr;
+    int                     _nameCount;
+    int                     _descrCount;
+    yCRITICAL_SECTION       _lock;
+    static u32  _hash(const char* classname, const string& func);
+    static u32  _hash(const char* classname, YFUN_DESCR fundescr);
+    template<class T> static void _grow(vector< vector<T> >& buckets);
+public:
+    YFunctionRegistry();
+    ~YFunctionRegistry();
+    YFunction*  find(const char* classname, const string& func);
+    YFunction*  find(const char* classname, YFUN_DESCR fundescr);
+    void        add(const char* classname, const string& func, YFunction* obj);
+    void        add(const char* classname, YFUN_DESCR fundescr, YFunction* obj);
+    void        clear(void);
+};
+
 
 // internal helper function
 s64 yatoi(const char *c);
@@ -328,33 +474,74 @@ typedef enum {
 } Tjstate;
 
 class YJSONObject;
+class YJSONContent;
+
+// Storage shared by all the nodes of a parsed JSON tree: a single copy of the
+// source text, and an arena from which the nodes are allocated. Nodes keep
+// only offsets and pointers into this storage, and the whole arena is freed
+// in one shot when the last root node referencing the document is deleted.
+class YJSONDocument
+{
+    typedef struct _Chunk {
+        struct _Chunk*  next;
+        size_t          size;
+        size_t          used;
+    } Chunk;
+
+    int                     _refcount;
+    char*                   _buffer;
+    int                     _length;
+    Chunk*                  _chunks;
+    size_t                  _nextChunkSize;
+    vector<YJSONContent*>   _adopted;   // root nodes of other documents owned by this one
+    ~YJSONDocument();
+public:
+    YJSONDocument(const char* data, int len);
+    void        retain(void);
+    void        release(void);
+    void*       alloc(size_t size);
+    const char* copyString(const char* str, int len);
+    void        adopt(YJSONContent* root);
+    bool        drop(YJSONContent* root);
+    const char* buffer(void) const { return _buffer; }
+    int         length(void) const { return _length; }
+};
 
 class YJSONContent
 {
     public:
-        string _data;
+        YJSONDocument* _doc;
+        bool _isRoot;
         int _data_start;
         int _data_len;
         int _data_boundary;
         YJSONType _type;
         static YJSONContent* ParseJson(const string& data, int start, int stop);
         YJSONContent(const string& data, int start, int stop, YJSONType type);
+        YJSONContent(YJSONDocument* doc, int start, int stop, YJSONType type);
         YJSONContent(YJSONContent *ref);
         YJSONContent(YJSONType type);
         virtual ~YJSONContent();
         YJSONType getJSONType();
         virtual int parse()=0;
         static int SkipGarbage(const string& data, int start, int stop);
+        static int SkipGarbage(const char* data, int start, int stop);
         string FormatError(const string& errmsg, int cur_pos);
         virtual string toJSON()=0;
         virtual string toString()=0;
+    protected:
+        YJSONContent* _parseValue(int cur_pos, int& len);
 };
 
 class YJSONArray : public YJSONContent
 {
-        vector<YJSONContent*> _arrayValue;
+        YJSONContent** _items;
+        int _count;
+        int _size;
+        void _append(YJSONContent* item);
     public:
         YJSONArray(const string& data, int start, int stop);
+        YJSONArray(YJSONDocument* doc, int start, int stop);
         YJSONArray(const string& data);
         YJSONArray(YJSONArray *ref);
         YJSONArray();
@@ -374,9 +561,11 @@ class YJSONArray : public YJSONContent
 
 class YJSONString : public YJSONContent
 {
-        string _stringValue;
+        const char* _str;
+        int _strlen;
     public:
         YJSONString(const string& data, int start, int stop);
+        YJSONString(YJSONDocument* doc, int start, int stop);
         YJSONString(YJSONString *ref);
         YJSONString();
 
@@ -397,6 +586,7 @@ class YJSONNumber : public YJSONContent
         bool _isFloat;
     public:
         YJSONNumber(const string& data, int start, int stop);
+        YJSONNumber(YJSONDocument* doc, int start, int stop);
         YJSONNumber(YJSONNumber *ref);
 
         virtual ~YJSONNumber()    { }
@@ -410,14 +600,27 @@ class YJSONNumber : public YJSONContent
 };
 
 
+typedef struct {
+    const char*     key;
+    int             keylen;
+    YJSONContent*   value;
+} YJSONMember;
+
 class YJSONObject : public YJSONContent
 {
-    map<string, YJSONContent*> _parsed;
-    vector<string> _keys;
+    YJSONMember* _members;  // in document order
+    int* _index;            // member indexes, sorted by key
+    int _count;
+    int _size;
+    void _append(const char* key, int keylen, YJSONContent* value);
+    void _buildIndex(void);
+    int _find(const string& key);
+    YJSONContent* _lookup(const string& key);
     void convert(YJSONObject* reference, YJSONArray* newArray);
 public:
     YJSONObject(const string& data);
     YJSONObject(const string& data, int start, int len);
+    YJSONObject(YJSONDocument* doc, int start, int stop);
     YJSONObject(YJSONObject *ref);
     virtual ~YJSONObject();
 
@@ -433,6 +636,7 @@ public:
     YJSONContent* get(const string& key);
     s64 getLong(const string& key);
     double getDouble(const string& key);
+    void put(const string& key, YJSONContent* value);
     virtual string toJSON();
     virtual string toString();
     void parseWithRef(YJSONObject* reference);
@@ -468,6 +672,8 @@ protected:
     // Attributes (function value cache)
     u64             _defaultCacheValidity;
     //--- (end of generated code: YAPIContext attributes)
+    bool            _functionScopedLoad;
+    string          _historyCacheDir;
 
 public:
     YAPIContext();
@@ -527,6 +733,73 @@ public:
 #pragma option pop
 #endif
     //--- (end of generated code: YAPIContext accessors declaration)
+
+    /**
+     * Enables or disables function-scoped cache refresh.
+     * By default, whenever the cache of a function expires, the library
+     * reloads the attributes of all the functions of the module at once.
+     * When function-scoped refresh is enabled, only the attributes of the
+     * function being accessed are reloaded from the device, and the cache
+     * validity is tracked separately for each function. This reduces
+     * network and USB traffic when only a few functions of a module are
+     * polled at a high rate.
+     *
+     * @param enabled : true to reload only the function being accessed,
+     *         false to reload the whole module API (default).
+     * @noreturn
+     */
+    virtual void        SetFunctionScopedLoad(bool enabled);
+
+    /**
+     * Returns true if the library reloads only the function being accessed
+     * when its cache expires.
+     *
+     * @return true if function-scoped cache refresh is enabled
+     */
+    virtual bool        GetFunctionScopedLoad(void);
+
+    /**
+     * Enables the local history cache, in the given directory.
+     * Data streams of closed datalogger runs can never change, so once
+     * downloaded they are saved to this directory and later loaded
+     * from disk instead of from the device. Only the streams of the
+     * current run are still downloaded each time.
+     * The directory must exist and be writable.
+     *
+     * @param directory : path of the cache directory, or an empty
+     *         string to disable the history cache (default).
+     * @noreturn
+     */
+    virtual void        SetHistoryCacheDir(const string& directory);
+
+    /**
+     * Returns the directory used by the local history cache.
+     *
+     * @return the path of the cache directory, or an empty string if
+     *         the history cache is disabled
+     */
+    virtual string      GetHistoryCacheDir(void);
+
+    /**
+     * Changes the maximum number of idle connections kept open to each
+     * plain HTTP YoctoHub. Connections used for attribute changes are
+     * kept open and shared by all modules of the hub, so that the next
+     * requests do not need to open a new TCP connection.
+     * Note: This function must be called after yInitAPI.
+     *
+     * @param poolSize : maximum number of idle connections per hub,
+     *         or 0 to close every connection after use (default: 4).
+     * @noreturn
+     */
+    virtual void        SetHTTPPoolSize(int poolSize);
+
+    /**
+     * Returns the maximum number of idle connections kept open to each
+     * plain HTTP YoctoHub.
+     *
+     * @return the maximum number of idle connections per hub
+     */
+    virtual int         GetHTTPPoolSize(void);
 };
 
 //--- (generated code: YAPIContext functions declaration)
@@ -541,8 +814,8 @@ public:
 //
 class YOCTO_CLASS_EXPORT YAPI {
 private:
-    static  queue<yapiGlobalEvent>  _plug_events;
-    static  queue<yapiDataEvent>    _data_events;
+    static  YEventQueue             _plug_events;
+    static  YEventQueue             _data_events;
     static  YHubDiscoveryCallback   _HubDiscoveryCallback;
     static  u64                 _nextEnum;
 
@@ -564,6 +837,7 @@ public:
     static  s16         _doubleToDecimal(double val);
     static  yCalibrationHandler _getCalibrationHandler(int calibType);
     static  vector<int> _decodeWords(string s);
+    static  int         _decodeWords(const char* sdat, int len, int* udat);
     static  vector<int> _decodeFloats(string sdat);
     static  string      _bin2HexStr(const string& data);
     static  string      _hexStr2Bin(const string& str);
@@ -863,6 +1137,74 @@ public:
      * On failure, throws an exception or returns a negative error code.
      */
     static  YRETCODE    HandleEvents(string& errmsg);
+
+    /**
+     * Selects what happens when events are produced faster than they are
+     * handled by yHandleEvents() and the internal event queue is full.
+     * With Y_EVENTQUEUE_DROP_OLDEST (default), the oldest pending event is
+     * discarded. With Y_EVENTQUEUE_BACKPRESSURE, pending events are kept
+     * and new events are discarded until yHandleEvents() makes room.
+     * The USB and network threads are never blocked: in both cases, the
+     * discarded events are counted by GetEventQueueOverflowCount().
+     *
+     * @param policy : either Y_EVENTQUEUE_DROP_OLDEST or Y_EVENTQUEUE_BACKPRESSURE
+     * @noreturn
+     */
+    static  void        SetEventQueueOverflowPolicy(Y_EVENTQUEUE_POLICY_enum policy);
+
+    /**
+     * Returns the number of events discarded so far because the internal
+     * event queues were full.
+     *
+     * @return an integer corresponding to the number of discarded events
+     */
+    static  int         GetEventQueueOverflowCount(void);
+
+    /**
+     * Loads the attributes of several functions at once.
+     * The functions are grouped by module, and a single request is sent to
+     * each module whose cache has expired. Requests to network modules are
+     * sent in parallel, so that the whole operation takes about as long as
+     * the slowest module, instead of the sum of all modules.
+     * The attributes of each function are then kept in cache for the
+     * specified duration, as with YFunction::load().
+     *
+     * @param functions : a vector of YFunction objects (or any subclass)
+     * @param msValidity : an integer corresponding to the validity attributed to the
+     *         loaded function parameters, in milliseconds
+     * @param errmsg : a string passed by reference to receive any error message.
+     *
+     * @return YAPI_SUCCESS when the call succeeds.
+     *
+     * On failure, throws an exception or returns a negative error code.
+     */
+    static  YRETCODE    ReadMany(const vector<YFunction*>& functions, int msValidity, string& errmsg);
+
+    /**
+     * Returns the number of asynchronous requests (see YFunction::loadAsync)
+     * that are queued or in progress, and whose completion handler has not
+     * been invoked yet.
+     *
+     * @return an integer corresponding to the number of pending asynchronous requests
+     */
+    static  int         GetPendingAsyncRequests(void);
+
+    /**
+     * Returns the connection reuse statistics of a plain HTTP YoctoHub
+     * (see YAPI::SetHTTPPoolSize).
+     *
+     * @param url : the URL of the hub, as passed to YAPI::RegisterHub
+     * @param hits : the number of requests sent on an already open connection
+     * @param misses : the number of requests that had to open a new connection
+     * @param idle : the number of connections currently kept open
+     * @param errmsg : a string passed by reference to receive any error message.
+     *
+     * @return YAPI::SUCCESS when the call succeeds.
+     *
+     * On failure, returns a negative error code.
+     */
+    static  YRETCODE    GetHTTPPoolStats(const string& url, int& hits, int& misses, int& idle, string& errmsg);
+
     /**
      * Pauses the execution flow for a specified duration.
      * This function implements a passive waiting loop, meaning that it does not
@@ -963,6 +1305,88 @@ public:
     }
 //--- (end of generated code: YAPIContext yapiwrapper)
 
+    /**
+     * Enables or disables function-scoped cache refresh.
+     * By default, whenever the cache of a function expires, the library
+     * reloads the attributes of all the functions of the module at once.
+     * When function-scoped refresh is enabled, only the attributes of the
+     * function being accessed are reloaded from the device.
+     *
+     * @param enabled : true to reload only the function being accessed,
+     *         false to reload the whole module API (default).
+     * @noreturn
+     */
+    inline static void SetFunctionScopedLoad(bool enabled)
+    {
+        YAPI::_yapiContext.SetFunctionScopedLoad(enabled);
+    }
+
+    /**
+     * Returns true if the library reloads only the function being accessed
+     * when its cache expires.
+     *
+     * @return true if function-scoped cache refresh is enabled
+     */
+    inline static bool GetFunctionScopedLoad(void)
+    {
+        return YAPI::_yapiContext.GetFunctionScopedLoad();
+    }
+
+    /**
+     * Enables the local history cache, in the given directory.
+     * Data streams of closed datalogger runs can never change, so once
+     * downloaded they are saved to this directory and later loaded
+     * from disk instead of from the device. Only the streams of the
+     * current run are still downloaded each time.
+     * The directory must exist and be writable.
+     *
+     * @param directory : path of the cache directory, or an empty
+     *         string to disable the history cache (default).
+     * @noreturn
+     */
+    inline static void SetHistoryCacheDir(const string& directory)
+    {
+        YAPI::_yapiContext.SetHistoryCacheDir(directory);
+    }
+
+    /**
+     * Returns the directory used by the local history cache.
+     *
+     * @return the path of the cache directory, or an empty string if
+     *         the history cache is disabled
+     */
+    inline static string GetHistoryCacheDir(void)
+    {
+        return YAPI::_yapiContext.GetHistoryCacheDir();
+    }
+
+    /**
+     * Changes the maximum number of idle connections kept open to each
+     * plain HTTP YoctoHub. Connections used for attribute changes are
+     * kept open and shared by all modules of the hub, so that the next
+     * requests do not need to open a new TCP connection.
+     * Note: This function must be called after yInitAPI.
+     *
+     * @param poolSize : maximum number of idle connections per hub,
+     *         or 0 to close every connection after use (default: 4).
+     * @noreturn
+     */
+    inline static void SetHTTPPoolSize(int poolSize)
+    {
+        YAPI::_yapiContext.SetHTTPPoolSize(poolSize);
+    }
+
+    /**
+     * Returns the maximum number of idle connections kept open to each
+     * plain HTTP YoctoHub.
+     *
+     * @return the maximum number of idle connections per hub
+     */
+    inline static int GetHTTPPoolSize(void)
+    {
+        return YAPI::_yapiContext.GetHTTPPoolSize();
+    }
+
 
 };
 
@@ -1130,11 +1554,28 @@ protected:
     vector<int>     _calpar;
     vector<double>  _calraw;
     vector<double>  _calref;
-    vector< vector<double> > _values;
     //--- (end of generated code: YDataStream attributes)
 
+    // decoded rows, stored by column: min, avg and max for averaged
+    // streams, only avg for streams of single measures
+    vector<double>  _minColumn;
+    vector<double>  _avgColumn;
+    vector<double>  _maxColumn;
+
     yCalibrationHandler _calhdl;
 
+    // Decode the words of a stream into the columns, and calibrate them
+    int                 _decodeStream(const string& sval);
+
+    // Apply the stream calibration to a whole column of decoded values
+    void                _calibrateColumn(vector<double>& values);
+
+    // Rows of the stream rebuilt from the decoded columns
+    vector< vector<double> > _getDataRows(void);
+
+    // file name of the stream in the history cache, once known
+    string              _cacheFile;
+
 public:
     YDataStream(YFunction *parent);
     YDataStream(YFunction *parent, YDataSet &dataset, const vector<int>& encoded);
@@ -1144,6 +1585,32 @@ public:
     static const double DATA_INVALID;
     static const int    DURATION_INVALID = -1;
 
+    // Column-oriented access to the decoded rows, without copy (no download)
+    int                 _getColumnData(int col, const double*& values);
+
+    /**
+     * Returns the values of a column of the data stream, without copy.
+     * The meaning of the values present in each column can be obtained
+     * using the method get_columnNames().
+     *
+     * This method fetches the whole data stream from the device,
+     * if not yet done.
+     *
+     * @param col : column index
+     * @param values : a pointer set to the first value of the column,
+     *         valid until the stream is loaded again
+     *
+     * @return the number of rows, or zero if the column does not exist.
+     *
+     * On failure, throws an exception or returns zero.
+     */
+    virtual int         get_columnData(int col, const double*& values);
+
+    // Local history cache of closed streams (see YAPI::SetHistoryCacheDir)
+    string              _get_cachePath(void);
+    bool                _loadCache(string& data);
+    void                _saveCache(const string& data);
+
     //--- (generated code: YDataStream accessors declaration)
 
 
@@ -1478,9 +1945,22 @@ protected:
     vector<YDataStream*> _streams;
     YMeasure        _summary;
     vector<YMeasure> _preview;
-    vector<YMeasure> _measures;
     //--- (end of generated code: YDataSet attributes)
 
+    // measures loaded so far, stored by field
+    vector<double>  _measureStart;
+    vector<double>  _measureEnd;
+    vector<double>  _measureMin;
+    vector<double>  _measureAvg;
+    vector<double>  _measureMax;
+
+    void            _clearMeasures(void);
+    void            _appendMeasures(YDataStream* stream, bool useFirstDuration, vector<double>& start,
+                                    vector<double>& end, vector<double>& minVal, vector<double>& avgVal, vector<double>& maxVal);
+    vector<YMeasure> _getMeasures(const vector<double>& start, const vector<double>& end,
+                                  const vector<double>& minVal, const vector<double>& avgVal, const vector<double>& maxVal);
+    vector<YMeasure> _getStreamMeasures(YDataStream* stream);
+
 public:
     YDataSet(YFunction *parent, const string& functionId, const string& unit, double startTime, double endTime);
     YDataSet(YFunction *parent);
@@ -1489,6 +1969,73 @@ public:
 
     int _parse(const string& json);
 
+    /**
+     * Loads the next blocks of measures from the dataLogger, keeping several
+     * stream downloads in progress at the same time. Each stream is decoded
+     * as soon as it has been received, while the next ones are transferred,
+     * and the progress indicator is updated after each stream.
+     *
+     * @param maxStreams : maximal number of streams to load (0 to load all
+     *         remaining streams)
+     * @param maxPending : maximal number of downloads in progress at the same
+     *         time (devices connected by USB always process one at a time)
+     * @param callback : the callback function invoked with the new progress
+     *         after each stream, or NULL
+     * @param context : user-specific pointer passed to the callback
+     *
+     * @return an integer in the range 0 to 100 (percentage of completion),
+     *         or a negative error code in case of failure.
+     *
+     * On failure, throws an exception or returns a negative error code.
+     */
+    virtual int         loadMoreParallel(int maxStreams, int maxPending, YDataSetProgressCallback callback, void *context);
+
+    /**
+     * Loads all measures from the dataLogger, with YDATASET_MAX_PENDING
+     * stream downloads in progress at the same time (see loadMoreParallel).
+     *
+     * @param callback : the callback function invoked with the new progress
+     *         after each stream, or NULL
+     * @param context : user-specific pointer passed to the callback
+     *
+     * @return 100 when all measures have been loaded,
+     *         or a negative error code in case of failure.
+     *
+     * On failure, throws an exception or returns a negative error code.
+     */
+    virtual int         loadAll(YDataSetProgressCallback callback = NULL, void *context = NULL);
+
+    /**
+     * Returns the number of measures currently available for this DataSet.
+     *
+     * @return the number of measures loaded so far.
+     */
+    virtual int         get_measureCount(void);
+
+    /**
+     * Returns all measured values currently available for this DataSet,
+     * without copy, as one array per field (see get_measures).
+     *
+     * @return a YMeasureColumns structure, whose pointers remain valid
+     *         until more measures are loaded.
+     */
+    virtual YMeasureColumns get_measureColumns(void);
+
+    /**
+     * Transfers all measured values currently available for this DataSet
+     * to the caller, without copy: the content of the vectors is swapped
+     * with the measures of the DataSet, which is left without measures.
+     *
+     * @param start : receives the start time of each measure (UTC, seconds)
+     * @param end : receives the end time of each measure (UTC, seconds)
+     * @param minVal : receives the minimal value of each measure
+     * @param avgVal : receives the average value of each measure
+     * @param maxVal : receives the maximal value of each measure
+     *
+     * @return the number of measures transferred.
+     */
+    virtual int         takeMeasureColumns(vector<double>& start, vector<double>& end,
+                                           vector<double>& minVal, vector<double>& avgVal, vector<double>& maxVal);
 
 
     //--- (generated code: YDataSet accessors declaration)
@@ -1696,7 +2243,12 @@ private:
     // Device cache entries
     YDEV_DESCR          _devdescr;
     u64                 _cacheStamp; // used only by requestAPI method
-    YJSONObject*        _cacheJson;  // used only by requestAPI method
+    YJSONObject*        _cacheJson;  // used by requestAPI and retainFunctionAPI methods
+    map<string,u64>     _funcCacheStamp; // per-function expiration, used only by retainFunctionAPI
+    map<string,YJSONObject*> _funcCacheJson; // per-function replies, used only by retainFunctionAPI
+    map<YJSONObject*,int> _jsonRefs;  // number of nodes handed out from each cached tree
+    map<YJSONObject*,YJSONObject*> _jsonOwner; // tree holding each node handed out
+    vector<YJSONObject*> _jsonRetired; // trees removed from cache while still in use
     vector<YFUN_DESCR>  _functions;
     char                _rootdevice[YOCTO_SERIAL_LEN];
     char                *_subpath;
@@ -1705,14 +2257,29 @@ private:
     YDevice(YDEV_DESCR devdesc);
     ~YDevice();
     YRETCODE   HTTPRequestPrepare(const string& request, string& fullrequest, char *errbuff);
+    YRETCODE   _HTTPRequestAsync(int channel, const string& request, bool invalidateCache, HTTPRequestCallback callback, void *context, string& errmsg);
     YRETCODE   HTTPRequest_unsafe(int channel, const string& request, string& buffer, yapiRequestProgressCallback progress_cb, void *progress_ctx, string& errmsg);
+    YRETCODE   _requestJSON_unsafe(const string& request, string& json_str, string& errmsg);
+    string     _apiRequest_unsafe(void);
+    YRETCODE   _cacheAPI_unsafe(const string& json_str, YJSONObject*& apires, string& errmsg);
+    YJSONObject* _retainJson_unsafe(YJSONObject* tree, YJSONObject* node);
+    void       _dropJson_unsafe(YJSONObject* tree);
 
 public:
+    static YRETCODE _extractJSON(const string& buffer, string& json_str, string& errmsg);
     static void ClearCache();
     static YDevice *getDevice(YDEV_DESCR devdescr);
     YRETCODE    HTTPRequestAsync(int channel, const string& request, HTTPRequestCallback callback, void *context, string& errmsg);
+    YRETCODE    HTTPGetAsync(int channel, const string& request, HTTPRequestCallback callback, void *context, string& errmsg);
     YRETCODE    HTTPRequest(int channel, const string& request, string& buffer, yapiRequestProgressCallback progress_cb, void *progress_ctx, string& errmsg);
     YRETCODE    requestAPI(YJSONObject*& apires, string& errmsg);
+    YRETCODE    retainAPI(YJSONObject*& apires, string& errmsg);
+    YRETCODE    retainFunctionAPI(const string& funcId, YJSONObject*& funcres, string& errmsg);
+    void        releaseAPI(YJSONObject* json);
+    bool        isAPICacheValid(void);
+    YRETCODE    requestAPIAsync(yapiRequestAsyncCallback callback, void *context, string& errmsg);
+    YRETCODE    getDevicePath(string& path, string& errmsg);
+    YRETCODE    parseAPIReply(const string& buffer, YJSONObject*& apires, string& errmsg);
     void        clearCache(bool clearSubpath);
     YRETCODE    getFunctions(vector<YFUN_DESCR> **functions, string& errmsg);
     string      getHubSerial(void);
@@ -1751,6 +2318,8 @@ protected:
     yCRITICAL_SECTION _this_cs;
     std::map<string,YDataStream*> _dataStreams;
     void*                   _userData;
+    friend class YDeviceBatch;
+    friend class YRxStream;
     //--- (generated code: YFunction attributes)
     // Attributes (function value cache)
     string          _logicalName;
@@ -1770,7 +2339,7 @@ protected:
     // Constructor is protected, use yFindFunction factory function to instantiate
     YFunction(const string& func);
     //--- (end of generated code: YFunction attributes)
-    static  std::map<string,YFunction*> _cache;
+    static  YFunctionRegistry _cache;
 
 
     // Method used to retrieve our unique function descriptor (may trigger a hub scan)
@@ -1781,8 +2350,11 @@ protected:
 
     // Method used to find the next instance of our function
     YRETCODE    _nextFunction(string &hwId);
+    YRETCODE    _nextFunction(const char* classname, YFUN_DESCR& nextdescr, YFunction*& next, string &hwId);
 
     int         _parse(YJSONObject* j);
+    // Called by _parse once the new attribute values have been decoded
+    virtual void _parsedHook(void);
 
     string      _escapeAttr(const string& changeval);
     YRETCODE    _buildSetRequest(const string& changeattr, const string  *changeval, string& request, string& errmsg);
@@ -1790,13 +2362,21 @@ protected:
     // Method used to change attributes
     YRETCODE    _setAttr(string attrname, string newvalue);
     YRETCODE    _load_unsafe(u64 msValidity);
+    YRETCODE    _getFunctionIds(char *serial, char *funcId, string& errmsg);
+    YRETCODE    _loadFromAPI_unsafe(YJSONObject* apires, u64 msValidity, string& errmsg);
+    static void _advertisedValueAsyncCallback(void *context, YFunction *func, YRETCODE retcode);
+    static YRETCODE _LoadFromAPI(const vector<YFunction*>& functions, YJSONObject* apires, u64 msValidity, string& errmsg);
+    static YRETCODE _LoadFromAPIRelease(YDevice* dev, const vector<YFunction*>& functions, YJSONObject* apires, u64 msValidity, string& errmsg);
 
     static void _UpdateValueCallbackList(YFunction* func, bool add);
-    static void _UpdateTimedReportCallbackList(YFunction* func, bool add);
+    static void _UpdateTimedReportCallbackList(YSensor* func, bool add);
+    static void _SetTimedReportSubscription(YSensor* func, bool subscribe);
 
     // function cache methods
-    static YFunction*  _FindFromCache(const string& classname, const string& func);
-    static void        _AddToCache(const string& classname, const string& func, YFunction *obj);
+    static YFunction*  _FindFromCache(const char* classname, const string& func);
+    static YFunction*  _FindFromCache(const char* classname, YFUN_DESCR fundescr);
+    static void        _AddToCache(const char* classname, const string& func, YFunction *obj);
+    static void        _AddToCache(const char* classname, YFUN_DESCR fundescr, YFunction *obj);
 
 public:
     virtual ~YFunction();
@@ -1804,6 +2384,16 @@ public:
     // clear cache of all YFunction object (use only on YAPI::FreeAPI)
     static void _ClearCache(void);
 
+    // load the attributes of several functions at once (see YAPI::ReadMany)
+    static YRETCODE _LoadMany(const vector<YFunction*>& functions, u64 msValidity, string& errmsg);
+
+    // asynchronous requests, queued per device (see loadAsync)
+    YRETCODE    _queueAsync(int kind, const string& request, u64 msValidity, YFunctionAsyncCallback callback,
+                            YDownloadAsyncCallback dlCallback, void *context);
+    static void _HandleAsyncRequests(void);
+    static int  _PendingAsyncRequests(void);
+    static void _ClearAsyncRequests(void);
+
     // Method used to throw exceptions or save error type/message
     void        _throw(YRETCODE errType, string errMsg);
 
@@ -1811,6 +2401,7 @@ public:
     string      _request(const string& request);
     string      _requestEx(int tcpchan, const string& request, yapiRequestProgressCallback callback, void *context);
     string      _download(const string& url);
+    YRETCODE    _downloadAsync(const string& url, HTTPRequestCallback callback, void *context, int *maxPending, string& errmsg);
 
     // Method used to upload a file to the device
     YRETCODE    _uploadWithProgress(const string& path, const string& content, yapiRequestProgressCallback callback, void *context);
@@ -2108,6 +2699,81 @@ public:
      */
     YRETCODE    load(int msValidity);
 
+    /**
+     * Preloads the function cache with a specified validity duration,
+     * asynchronously. The request is queued and sent as soon as the device
+     * is available, so that many requests can be kept in progress on many
+     * devices from a single thread. The completion handler is invoked by
+     * ySleep or yHandleEvents, once the function cache has been updated.
+     *
+     * @param msValidity : an integer corresponding to the validity attributed to the
+     *         loaded function parameters, in milliseconds
+     * @param callback : the callback function to invoke on completion. The callback
+     *         function receives three arguments: the user-specific context pointer,
+     *         the function object and the result code (YAPI_SUCCESS on success).
+     * @param context : user-specific object that is passed as-is to the callback function
+     *
+     * @return YAPI_SUCCESS when the request has been queued.
+     *
+     * On failure, throws an exception or returns a negative error code.
+     * The callback is not invoked in that case.
+     */
+    YRETCODE    loadAsync(int msValidity, YFunctionAsyncCallback callback, void *context);
+
+    /**
+     * Downloads the specified content from the device, asynchronously.
+     * The completion handler is invoked by ySleep or yHandleEvents.
+     *
+     * @param url : the path of the file to download, relative to the device root
+     * @param callback : the callback function to invoke on completion. The callback
+     *         function receives four arguments: the user-specific context pointer,
+     *         the function object, the result code and the downloaded content
+     *         (without the HTTP header).
+     * @param context : user-specific object that is passed as-is to the callback function
+     *
+     * @return YAPI_SUCCESS when the request has been queued.
+     *
+     * On failure, throws an exception or returns a negative error code.
+     * The callback is not invoked in that case.
+     */
+    YRETCODE    downloadAsync(const string& url, YDownloadAsyncCallback callback, void *context);
+
+    /**
+     * Changes an attribute of the function, asynchronously.
+     * The completion handler is invoked by ySleep or yHandleEvents, once
+     * the device has acknowledged the change.
+     *
+     * @param attrName : the name of the attribute to change
+     * @param value : the new value of the attribute, as a string
+     * @param callback : the callback function to invoke on completion, or NULL. The callback
+     *         function receives three arguments: the user-specific context pointer,
+     *         the function object and the result code (YAPI_SUCCESS on success).
+     * @param context : user-specific object that is passed as-is to the callback function
+     *
+     * @return YAPI_SUCCESS when the request has been queued.
+     *
+     * On failure, throws an exception or returns a negative error code.
+     * The callback is not invoked in that case.
+     */
+    YRETCODE    setAttrAsync(const string& attrName, const string& value, YFunctionAsyncCallback callback, void *context);
+
+    /**
+     * Retrieves the advertised value of the function, asynchronously.
+     * The completion handler is invoked by ySleep or yHandleEvents.
+     *
+     * @param callback : the callback function to invoke on completion. The callback
+     *         function receives three arguments: the user-specific context pointer,
+     *         the function object and the advertised value, or Y_ADVERTISEDVALUE_INVALID
+     *         on failure.
+     * @param context : user-specific object that is passed as-is to the callback function
+     *
+     * @return YAPI_SUCCESS when the request has been queued.
+     *
+     * On failure, throws an exception or returns a negative error code.
+     * The callback is not invoked in that case.
+     */
+    YRETCODE    get_advertisedValueAsync(YStringAsyncCallback callback, void *context);
+
     /**
      * Invalidates the cache. Invalidates the cache of the function attributes. Forces the
      * next call to get_xxx() or loadxxx() to use values that come from the device.
@@ -2165,6 +2831,180 @@ public:
 
 };
 
+//
+// YDeviceBatch Class: write-combining of attribute changes
+//
+// Between begin() and commit(), the set_xxx() methods called by the same
+// thread do not send any request: the changes are recorded in the batch,
+// and repeated changes of the same attribute are coalesced, the last value
+// wins. commit() then sends all changes at once, as a burst of requests
+// queued to each device without waiting for the previous reply, and
+// reports the status of each change.
+//
+class YOCTO_CLASS_EXPORT YDeviceBatch {
+public:
+    typedef struct {
+        YFunction*  function;
+        string      attrName;
+        string      value;
+        YRETCODE    status;         // YAPI_SUCCESS once the change has been acknowledged
+        string      errmsg;
+    } Change;
+
+protected:
+    typedef std::pair<YFunction*, string> ChangeKey;
+    vector<Change>          _changes;       // changes, in the order they were first recorded
+    std::map<ChangeKey, size_t> _index;     // position of each pending change in _changes
+    std::map<ChangeKey, string> _committed; // last values successfully committed
+    bool                    _pending;       // _changes holds changes not yet committed
+    bool                    _skipUnchanged;
+    int                     _thread;        // thread recording set_xxx() calls, or -1
+    int                     _coalesced;
+    int                     _skipped;
+    int                     _sent;
+
+    void        _stopRecording(void);
+
+public:
+    YDeviceBatch();
+    virtual ~YDeviceBatch();
+
+    /**
+     * Starts recording the attribute changes made by the calling thread.
+     *
+     * @param errmsg : a string passed by reference to receive any error message.
+     *
+     * @return YAPI_SUCCESS when the call succeeds.
+     *
+     * On failure returns a negative error code.
+     */
+    YRETCODE    begin(string& errmsg);
+
+    /**
+     * Records an attribute change, as set_xxx() would do within begin() and commit().
+     *
+     * @param function : the function to change
+     * @param attrName : the name of the attribute
+     * @param value : the new value, as sent to the device
+     *
+     * @return YAPI_SUCCESS when the call succeeds.
+     */
+    YRETCODE    set(YFunction* function, const string& attrName, const string& value);
+
+    /**
+     * Sends all the recorded changes, and waits for their completion.
+     * Recording of set_xxx() calls stops.
+     *
+     * @param errmsg : a string passed by reference to receive any error message.
+     *
+     * @return YAPI_SUCCESS when all changes succeed.
+     *
+     * On failure returns the error code of the first failed change, the
+     * status of each change is available using get_changes().
+     */
+    YRETCODE    commit(string& errmsg);
+
+    /**
+     * Stops recording set_xxx() calls, and drops the changes not yet committed.
+     */
+    void        cancel(void);
+
+    /**
+     * When enabled, commit() does not send the changes setting an attribute
+     * to the value it was last successfully committed to by this batch.
+     * This is useful when the same set of outputs is written at every control
+     * cycle, provided no other application changes them. Disabled by default.
+     *
+     * @param skip : true to skip unchanged values
+     */
+    void        set_skipUnchanged(bool skip);
+
+    // Changes recorded since the last commit, or changes of the last commit with their status
+    const vector<Change>& get_changes(void);
+
+    // Number of changes merged into a previous change of the same attribute since begin()
+    int         get_coalescedCount(void);
+
+    // Number of changes skipped as unchanged by the last commit
+    int         get_skippedCount(void);
+
+    // Number of requests sent by the last commit
+    int         get_sentCount(void);
+
+    // Record a change made by set_xxx(), if a batch is recording on the calling thread
+    static bool _Record(YFunction* function, const string& attrName, const string& value);
+    static void _Init(void);
+    static void _Free(void);
+};
+
+typedef void (*YRxStreamCallback)(YFunction* port, int availBytes, void* context);
+
+//
+// YRxStream Class: local receive stream of a serial or SPI port
+//
+// The stream keeps the data received by a port in a local ring buffer, so
+// that the read functions of the port are served without device round-trip.
+// New data are requested during YAPI::HandleEvents and YAPI::Sleep, as soon
+// as the port advertises some activity and at least every pollInterval
+// milliseconds, and are added to the ring buffer as soon as they are received.
+// When the ring buffer is full, requests are suspended until some data is read,
+// and the data remain in the device buffer meanwhile.
+// Stream positions count received bytes only: tell() may differ from the
+// device position when the device buffer holds interleaved transmitted data.
+//
+class YOCTO_CLASS_EXPORT YRxStream {
+protected:
+    YFunction*          _port;
+    yCRITICAL_SECTION   _lock;
+    volatile s32        _refcount;
+    vector<u8>          _ring;
+    int                 _head;          // ring index of the oldest byte
+    int                 _count;         // number of bytes in the ring
+    int                 _devpos;        // device position of the next byte to request
+    int                 _seq;           // incremented when the position changes
+    int                 _reqSeq;        // value of _seq when the pending request was sent
+    int                 _highWater;
+    int                 _pollInterval;
+    u64                 _nextPoll;
+    bool                _inFlight;
+    bool                _newData;       // data received since the last callback
+    bool                _stopped;
+    YRxStreamCallback   _callback;
+    void*               _context;
+
+    virtual ~YRxStream();
+    void        _pump(void);
+
+public:
+    YRxStream(YFunction* port, int startpos, int bufferSize, int highWaterMark, YRxStreamCallback callback, void* context);
+
+    void        addRef(void);
+    void        release(void);
+    // Detach the stream from its port, no further request is sent
+    void        stop(void);
+    // Request new data at the next call to YAPI::HandleEvents
+    void        signal(void);
+
+    int         readByte(void);
+    // Read up to len bytes, formatted as a device rxdata.bin reply (data, '@', new position)
+    string      readData(int len);
+    // Read the next line, or the whole buffer when it is full without any line feed
+    string      readLine(void);
+    int         avail(void);
+    int         tell(void);
+    void        seek(int absPos);
+
+    int         get_pollInterval(void);
+    void        set_pollInterval(int msInterval);
+    int         get_highWaterMark(void);
+    void        set_highWaterMark(int highWaterMark);
+
+    void        _received(YRETCODE retcode, const string& reply);
+    static void _HandleStreams(void);
+    static void _Init(void);
+    static void _Free(void);
+};
+
 //--- (generated code: YModule declaration)
 /**
  * YModule Class: Module control interface
@@ -2933,6 +3773,21 @@ protected:
     YSensor(const string& func);
     //--- (end of generated code: YSensor attributes)
 
+    YSensorTimedReportDataCallback  _timedReportDataCallback;
+    YSensorTimedReportBatchCallback _timedReportBatchCallback;
+    // set while a YMeasure-based callback is registered, by this class or a subclass
+    bool            _timedReportMeasureCallback;
+    // linear calibration table cached for the timed report fast path,
+    // rebuilt each time the calibration parameters are parsed
+    int             _fastCalNpt;    // -1 when the registered handler must be called
+    double          _fastCalRaw[YSENSOR_FASTCAL_MAXPT];
+    double          _fastCalRef[YSENSOR_FASTCAL_MAXPT];
+
+    virtual void    _parsedHook(void);
+    void            _refreshFastCalibration(void);
+    double          _applyFastCalibration(double rawValue);
+    static void     _currentValueAsyncCallback(void *context, YFunction *func, YRETCODE retcode);
+
     //--- (generated code: YSensor initialization)
     //--- (end of generated code: YSensor initialization)
 
@@ -3403,6 +4258,71 @@ public:
     YDataSet get_recordedData(s64 startTime, s64 endTime);
     YDataSet get_recordedData(int startTime, int endTime);
 
+    /**
+     * Registers a callback function that is invoked on every periodic timed notification,
+     * receiving the measure as a plain YMeasureData record. Unlike the YMeasure-based
+     * callback, this path does not perform any memory allocation when decoding the
+     * notification. The callback is invoked only during the execution of ySleep or
+     * yHandleEvents. To unregister the callback, pass a NULL pointer as argument.
+     *
+     * @param callback : the callback function to call, or a NULL pointer. The callback function
+     *         should take two arguments: the sensor object, and a pointer to the YMeasureData
+     *         record describing the new advertised measure. The record is only valid during the call.
+     * @noreturn
+     */
+    int         registerTimedReportDataCallback(YSensorTimedReportDataCallback callback);
+
+    /**
+     * Registers a callback function that receives periodic timed notifications by batch.
+     * All the measures of this sensor drained at once by ySleep or yHandleEvents are
+     * delivered in a single call, in chronological order. To unregister the callback,
+     * pass a NULL pointer as argument.
+     *
+     * @param callback : the callback function to call, or a NULL pointer. The callback function
+     *         should take three arguments: the sensor object, a pointer to an array of
+     *         YMeasureData records, and the number of records in the array. The array is
+     *         only valid during the call.
+     * @noreturn
+     */
+    int         registerTimedReportBatchCallback(YSensorTimedReportBatchCallback callback);
+
+    // Decodes a timed report straight from the event payload, without allocation
+    void        _decodeTimedReportData(double timestamp, double duration, const int *report, int len, YMeasureData& measure);
+
+    // Invokes the per-measure timed report callbacks (plain record and YMeasure)
+    void        _invokeTimedReportData(const YMeasureData& measure);
+
+    bool        _hasTimedReportBatchCallback(void)
+    { return _timedReportBatchCallback != NULL; }
+
+    bool        _hasTimedReportDataCallbacks(void)
+    { return _timedReportDataCallback != NULL || _timedReportBatchCallback != NULL; }
+
+    bool        _hasTimedReportCallbacks(void)
+    { return _timedReportMeasureCallback || this->_hasTimedReportDataCallbacks(); }
+
+    void        _setTimedReportMeasureCallback(bool registered)
+    { _timedReportMeasureCallback = registered; }
+
+    void        _invokeTimedReportBatchCallback(const YMeasureData *measures, int count);
+
+    /**
+     * Retrieves the current value of the measure, asynchronously.
+     * The completion handler is invoked by ySleep or yHandleEvents.
+     *
+     * @param callback : the callback function to invoke on completion. The callback
+     *         function receives three arguments: the user-specific context pointer,
+     *         the sensor object and the current value, or Y_CURRENTVALUE_INVALID
+     *         on failure.
+     * @param context : user-specific object that is passed as-is to the callback function
+     *
+     * @return YAPI_SUCCESS when the request has been queued.
+     *
+     * On failure, throws an exception or returns a negative error code.
+     * The callback is not invoked in that case.
+     */
+    YRETCODE    get_currentValueAsync(YSensorValueAsyncCallback callback, void *context);
+
 
 };
 
@@ -381,11 +381,17 @@ int YAudioIn::_invokeValueCallback(string value)
 YAudioIn *YAudioIn::nextAudioIn(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("AudioIn", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YAudioIn::FindAudioIn(hwid);
+    if (next == NULL) {
+        next = YAudioIn::FindAudioIn(hwid);
+        YFunction::_AddToCache("AudioIn", nextdescr, next);
+    }
+    return (YAudioIn*)next;
 }
 
 YAudioIn* YAudioIn::FirstAudioIn(void)
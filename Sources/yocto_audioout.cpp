@@ -381,11 +381,17 @@ int YAudioOut::_invokeValueCallback(string value)
 YAudioOut *YAudioOut::nextAudioOut(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("AudioOut", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YAudioOut::FindAudioOut(hwid);
+    if (next == NULL) {
+        next = YAudioOut::FindAudioOut(hwid);
+        YFunction::_AddToCache("AudioOut", nextdescr, next);
+    }
+    return (YAudioOut*)next;
 }
 
 YAudioOut* YAudioOut::FirstAudioOut(void)
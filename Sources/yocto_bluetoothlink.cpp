@@ -664,11 +664,17 @@ int YBluetoothLink::disconnect(void)
 YBluetoothLink *YBluetoothLink::nextBluetoothLink(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("BluetoothLink", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YBluetoothLink::FindBluetoothLink(hwid);
+    if (next == NULL) {
+        next = YBluetoothLink::FindBluetoothLink(hwid);
+        YFunction::_AddToCache("BluetoothLink", nextdescr, next);
+    }
+    return (YBluetoothLink*)next;
 }
 
 YBluetoothLink* YBluetoothLink::FirstBluetoothLink(void)
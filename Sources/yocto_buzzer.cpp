@@ -755,11 +755,17 @@ int YBuzzer::playNotes(string notes)
 YBuzzer *YBuzzer::nextBuzzer(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Buzzer", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YBuzzer::FindBuzzer(hwid);
+    if (next == NULL) {
+        next = YBuzzer::FindBuzzer(hwid);
+        YFunction::_AddToCache("Buzzer", nextdescr, next);
+    }
+    return (YBuzzer*)next;
 }
 
 YBuzzer* YBuzzer::FirstBuzzer(void)
@@ -352,11 +352,17 @@ int YCarbonDioxide::triggetZeroCalibration(void)
 YCarbonDioxide *YCarbonDioxide::nextCarbonDioxide(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("CarbonDioxide", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YCarbonDioxide::FindCarbonDioxide(hwid);
+    if (next == NULL) {
+        next = YCarbonDioxide::FindCarbonDioxide(hwid);
+        YFunction::_AddToCache("CarbonDioxide", nextdescr, next);
+    }
+    return (YCarbonDioxide*)next;
 }
 
 YCarbonDioxide* YCarbonDioxide::FirstCarbonDioxide(void)
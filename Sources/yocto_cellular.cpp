@@ -1275,11 +1275,17 @@ vector<YCellRecord> YCellular::quickCellSurvey(void)
 YCellular *YCellular::nextCellular(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Cellular", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YCellular::FindCellular(hwid);
+    if (next == NULL) {
+        next = YCellular::FindCellular(hwid);
+        YFunction::_AddToCache("Cellular", nextdescr, next);
+    }
+    return (YCellular*)next;
 }
 
 YCellular* YCellular::FirstCellular(void)
@@ -689,11 +689,17 @@ int YColorLed::resetBlinkSeq(void)
 YColorLed *YColorLed::nextColorLed(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("ColorLed", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YColorLed::FindColorLed(hwid);
+    if (next == NULL) {
+        next = YColorLed::FindColorLed(hwid);
+        YFunction::_AddToCache("ColorLed", nextdescr, next);
+    }
+    return (YColorLed*)next;
 }
 
 YColorLed* YColorLed::FirstColorLed(void)
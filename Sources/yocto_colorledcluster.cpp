@@ -1337,11 +1337,17 @@ int YColorLedCluster::hsl2rgb(int hslValue)
 YColorLedCluster *YColorLedCluster::nextColorLedCluster(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("ColorLedCluster", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YColorLedCluster::FindColorLedCluster(hwid);
+    if (next == NULL) {
+        next = YColorLedCluster::FindColorLedCluster(hwid);
+        YFunction::_AddToCache("ColorLedCluster", nextdescr, next);
+    }
+    return (YColorLedCluster*)next;
 }
 
 YColorLedCluster* YColorLedCluster::FirstColorLedCluster(void)
@@ -315,11 +315,17 @@ int YCompass::_invokeTimedReportCallback(YMeasure value)
 YCompass *YCompass::nextCompass(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Compass", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YCompass::FindCompass(hwid);
+    if (next == NULL) {
+        next = YCompass::FindCompass(hwid);
+        YFunction::_AddToCache("Compass", nextdescr, next);
+    }
+    return (YCompass*)next;
 }
 
 YCompass* YCompass::FirstCompass(void)
@@ -238,11 +238,17 @@ int YCurrent::_invokeTimedReportCallback(YMeasure value)
 YCurrent *YCurrent::nextCurrent(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Current", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YCurrent::FindCurrent(hwid);
+    if (next == NULL) {
+        next = YCurrent::FindCurrent(hwid);
+        YFunction::_AddToCache("Current", nextdescr, next);
+    }
+    return (YCurrent*)next;
 }
 
 YCurrent* YCurrent::FirstCurrent(void)
@@ -385,11 +385,17 @@ int YCurrentLoopOutput::currentMove(double mA_target,int ms_duration)
 YCurrentLoopOutput *YCurrentLoopOutput::nextCurrentLoopOutput(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("CurrentLoopOutput", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YCurrentLoopOutput::FindCurrentLoopOutput(hwid);
+    if (next == NULL) {
+        next = YCurrentLoopOutput::FindCurrentLoopOutput(hwid);
+        YFunction::_AddToCache("CurrentLoopOutput", nextdescr, next);
+    }
+    return (YCurrentLoopOutput*)next;
 }
 
 YCurrentLoopOutput* YCurrentLoopOutput::FirstCurrentLoopOutput(void)
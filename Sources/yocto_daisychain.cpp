@@ -290,11 +290,17 @@ int YDaisyChain::_invokeValueCallback(string value)
 YDaisyChain *YDaisyChain::nextDaisyChain(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("DaisyChain", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YDaisyChain::FindDaisyChain(hwid);
+    if (next == NULL) {
+        next = YDaisyChain::FindDaisyChain(hwid);
+        YFunction::_AddToCache("DaisyChain", nextdescr, next);
+    }
+    return (YDaisyChain*)next;
 }
 
 YDaisyChain* YDaisyChain::FirstDaisyChain(void)
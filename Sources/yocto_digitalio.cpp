@@ -814,11 +814,17 @@ int YDigitalIO::delayedPulse(int bitno,int ms_delay,int ms_duration)
 YDigitalIO *YDigitalIO::nextDigitalIO(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("DigitalIO", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YDigitalIO::FindDigitalIO(hwid);
+    if (next == NULL) {
+        next = YDigitalIO::FindDigitalIO(hwid);
+        YFunction::_AddToCache("DigitalIO", nextdescr, next);
+    }
+    return (YDigitalIO*)next;
 }
 
 YDigitalIO* YDigitalIO::FirstDigitalIO(void)
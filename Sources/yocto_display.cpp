@@ -1388,11 +1388,17 @@ int YDisplay::swapLayerContent(int layerIdA,int layerIdB)
 YDisplay *YDisplay::nextDisplay(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Display", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YDisplay::FindDisplay(hwid);
+    if (next == NULL) {
+        next = YDisplay::FindDisplay(hwid);
+        YFunction::_AddToCache("Display", nextdescr, next);
+    }
+    return (YDisplay*)next;
 }
 
 YDisplay* YDisplay::FirstDisplay(void)
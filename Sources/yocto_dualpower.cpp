@@ -289,11 +289,17 @@ int YDualPower::_invokeValueCallback(string value)
 YDualPower *YDualPower::nextDualPower(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("DualPower", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YDualPower::FindDualPower(hwid);
+    if (next == NULL) {
+        next = YDualPower::FindDualPower(hwid);
+        YFunction::_AddToCache("DualPower", nextdescr, next);
+    }
+    return (YDualPower*)next;
 }
 
 YDualPower* YDualPower::FirstDualPower(void)
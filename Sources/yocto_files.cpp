@@ -429,11 +429,17 @@ int YFiles::remove(string pathname)
 YFiles *YFiles::nextFiles(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Files", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YFiles::FindFiles(hwid);
+    if (next == NULL) {
+        next = YFiles::FindFiles(hwid);
+        YFunction::_AddToCache("Files", nextdescr, next);
+    }
+    return (YFiles*)next;
 }
 
 YFiles* YFiles::FirstFiles(void)
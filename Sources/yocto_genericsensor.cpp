@@ -563,11 +563,17 @@ int YGenericSensor::zeroAdjust(void)
 YGenericSensor *YGenericSensor::nextGenericSensor(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("GenericSensor", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YGenericSensor::FindGenericSensor(hwid);
+    if (next == NULL) {
+        next = YGenericSensor::FindGenericSensor(hwid);
+        YFunction::_AddToCache("GenericSensor", nextdescr, next);
+    }
+    return (YGenericSensor*)next;
 }
 
 YGenericSensor* YGenericSensor::FirstGenericSensor(void)
@@ -669,11 +669,17 @@ int YGps::_invokeValueCallback(string value)
 YGps *YGps::nextGps(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Gps", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YGps::FindGps(hwid);
+    if (next == NULL) {
+        next = YGps::FindGps(hwid);
+        YFunction::_AddToCache("Gps", nextdescr, next);
+    }
+    return (YGps*)next;
 }
 
 YGps* YGps::FirstGps(void)
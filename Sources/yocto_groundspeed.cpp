@@ -191,11 +191,17 @@ int YGroundSpeed::_invokeTimedReportCallback(YMeasure value)
 YGroundSpeed *YGroundSpeed::nextGroundSpeed(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("GroundSpeed", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YGroundSpeed::FindGroundSpeed(hwid);
+    if (next == NULL) {
+        next = YGroundSpeed::FindGroundSpeed(hwid);
+        YFunction::_AddToCache("GroundSpeed", nextdescr, next);
+    }
+    return (YGroundSpeed*)next;
 }
 
 YGroundSpeed* YGroundSpeed::FirstGroundSpeed(void)
@@ -193,11 +193,17 @@ int YQt::_invokeTimedReportCallback(YMeasure value)
 YQt *YQt::nextQt(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Qt", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YQt::FindQt(hwid);
+    if (next == NULL) {
+        next = YQt::FindQt(hwid);
+        YFunction::_AddToCache("Qt", nextdescr, next);
+    }
+    return (YQt*)next;
 }
 
 YQt* YQt::FirstQt(void)
@@ -232,6 +238,15 @@ static void yInternalGyroCallback(YQt *obj, const string& value)
     gyro->_invokeGyroCallbacks(idx, dbl_value);
 }
 
+static void yInternalGyroReportCallback(YSensor *obj, const YMeasureData *measure)
+{
+    YGyro *gyro = (YGyro*) obj->get_userData();
+    if (gyro == NULL) {
+        return;
+    }
+    gyro->_invokeOrientationReport(obj, measure);
+}
+
 
 
 
@@ -259,8 +274,14 @@ YGyro::YGyro(const string& func): YSensor(func)
     ,_quatCallback(NULL)
     ,_anglesCallback(NULL)
 //--- (end of generated code: YGyro initialization)
+    ,_orientationCallback(NULL)
+    ,_rep_done(0)
 {
     _className="Gyro";
+    for (int i = 0; i < 4; i++) {
+        _rep_value[i] = 0.0;
+        _rep_time[i] = -1;
+    }
 }
 
 YGyro::~YGyro()
@@ -566,25 +587,7 @@ int YGyro::_loadQuaternion(void)
     now_stamp = (int) ((YAPI::GetTickCount()) & (0x7FFFFFFF));
     age_ms = (((now_stamp - _qt_stamp)) & (0x7FFFFFFF));
     if ((age_ms >= 10) || (_qt_stamp == 0)) {
-        if (this->_load_unsafe(10) != YAPI_SUCCESS) {
-            return YAPI_DEVICE_NOT_FOUND;
-        }
-        if (_qt_stamp == 0) {
-            _qt_w = YQt::FindQt(YapiWrapper::ysprintf("%s.qt1",_serial.c_str()));
-            _qt_x = YQt::FindQt(YapiWrapper::ysprintf("%s.qt2",_serial.c_str()));
-            _qt_y = YQt::FindQt(YapiWrapper::ysprintf("%s.qt3",_serial.c_str()));
-            _qt_z = YQt::FindQt(YapiWrapper::ysprintf("%s.qt4",_serial.c_str()));
-        }
-        if (_qt_w->load(9) != YAPI_SUCCESS) {
-            return YAPI_DEVICE_NOT_FOUND;
-        }
-        if (_qt_x->load(9) != YAPI_SUCCESS) {
-            return YAPI_DEVICE_NOT_FOUND;
-        }
-        if (_qt_y->load(9) != YAPI_SUCCESS) {
-            return YAPI_DEVICE_NOT_FOUND;
-        }
-        if (_qt_z->load(9) != YAPI_SUCCESS) {
+        if (this->_loadOrientation() != YAPI_SUCCESS) {
             return YAPI_DEVICE_NOT_FOUND;
         }
         _w = _qt_w->get_currentValue();
@@ -598,38 +601,11 @@ int YGyro::_loadQuaternion(void)
 
 int YGyro::_loadAngles(void)
 {
-    double sqw = 0.0;
-    double sqx = 0.0;
-    double sqy = 0.0;
-    double sqz = 0.0;
-    double norm = 0.0;
-    double delta = 0.0;
-
     if (this->_loadQuaternion() != YAPI_SUCCESS) {
         return YAPI_DEVICE_NOT_FOUND;
     }
     if (_angles_stamp != _qt_stamp) {
-        sqw = _w * _w;
-        sqx = _x * _x;
-        sqy = _y * _y;
-        sqz = _z * _z;
-        norm = sqx + sqy + sqz + sqw;
-        delta = _y * _w - _x * _z;
-        if (delta > 0.499 * norm) {
-            // singularity at north pole
-            _pitch = 90.0;
-            _head  = floor(2.0 * 1800.0/3.141592653589793238463 * atan2(_x,-_w)+0.5) / 10.0;
-        } else {
-            if (delta < -0.499 * norm) {
-                // singularity at south pole
-                _pitch = -90.0;
-                _head  = floor(-2.0 * 1800.0/3.141592653589793238463 * atan2(_x,-_w)+0.5) / 10.0;
-            } else {
-                _roll  = floor(1800.0/3.141592653589793238463 * atan2(2.0 * (_w * _x + _y * _z),sqw - sqx - sqy + sqz)+0.5) / 10.0;
-                _pitch = floor(1800.0/3.141592653589793238463 * asin(2.0 * delta / norm)+0.5) / 10.0;
-                _head  = floor(1800.0/3.141592653589793238463 * atan2(2.0 * (_x * _y + _z * _w),sqw + sqx - sqy - sqz)+0.5) / 10.0;
-            }
-        }
+        YGyro::_computeAngles(_w, _x, _y, _z, _roll, _pitch, _head);
         _angles_stamp = _qt_stamp;
     }
     return YAPI_SUCCESS;
@@ -864,11 +840,17 @@ int YGyro::_invokeGyroCallbacks(int qtIndex,double qtValue)
 YGyro *YGyro::nextGyro(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Gyro", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YGyro::FindGyro(hwid);
+    if (next == NULL) {
+        next = YGyro::FindGyro(hwid);
+        YFunction::_AddToCache("Gyro", nextdescr, next);
+    }
+    return (YGyro*)next;
 }
 
 YGyro* YGyro::FirstGyro(void)
@@ -887,5 +869,190 @@ YGyro* YGyro::FirstGyro(void)
 
 //--- (end of generated code: YGyro implementation)
 
+// Refresh the gyro and its four quaternion components from a single load
+// of the device API
+int YGyro::_loadOrientation(void)
+{
+    YDevice* dev;
+    YJSONObject* apires;
+    string errmsg;
+    int res;
+
+    if (_getDevice(dev, errmsg) != YAPI_SUCCESS || dev->retainAPI(apires, errmsg) != YAPI_SUCCESS) {
+        return YAPI_DEVICE_NOT_FOUND;
+    }
+    try {
+        res = _loadFromAPI_unsafe(apires, 10, errmsg);
+        if (res == YAPI_SUCCESS && _qt_stamp == 0) {
+            _qt_w = YQt::FindQt(YapiWrapper::ysprintf("%s.qt1",_serial.c_str()));
+            _qt_x = YQt::FindQt(YapiWrapper::ysprintf("%s.qt2",_serial.c_str()));
+            _qt_y = YQt::FindQt(YapiWrapper::ysprintf("%s.qt3",_serial.c_str()));
+            _qt_z = YQt::FindQt(YapiWrapper::ysprintf("%s.qt4",_serial.c_str()));
+        }
+        if (res == YAPI_SUCCESS) {
+            if (this->_loadQt(_qt_w, apires, errmsg) != YAPI_SUCCESS ||
+                this->_loadQt(_qt_x, apires, errmsg) != YAPI_SUCCESS ||
+                this->_loadQt(_qt_y, apires, errmsg) != YAPI_SUCCESS ||
+                this->_loadQt(_qt_z, apires, errmsg) != YAPI_SUCCESS) {
+                res = YAPI_DEVICE_NOT_FOUND;
+            }
+        }
+    } catch (std::exception) {
+        dev->releaseAPI(apires);
+        throw;
+    }
+    dev->releaseAPI(apires);
+    return res;
+}
+
+// Refresh a quaternion component from the device API loaded by the gyro
+int YGyro::_loadQt(YQt* qt, YJSONObject* apires, string& errmsg)
+{
+    YRETCODE res;
+
+    yEnterCriticalSection(&qt->_this_cs);
+    res = qt->_loadFromAPI_unsafe(apires, 9, errmsg);
+    yLeaveCriticalSection(&qt->_this_cs);
+    return res;
+}
+
+void YGyro::_computeAngles(double w, double x, double y, double z, double& roll, double& pitch, double& head)
+{
+    double sqw, sqx, sqy, sqz, norm, delta;
+
+    sqw = w * w;
+    sqx = x * x;
+    sqy = y * y;
+    sqz = z * z;
+    norm = sqx + sqy + sqz + sqw;
+    delta = y * w - x * z;
+    if (delta > 0.499 * norm) {
+        // singularity at north pole
+        pitch = 90.0;
+        head  = floor(2.0 * 1800.0/3.141592653589793238463 * atan2(x,-w)+0.5) / 10.0;
+    } else {
+        if (delta < -0.499 * norm) {
+            // singularity at south pole
+            pitch = -90.0;
+            head  = floor(-2.0 * 1800.0/3.141592653589793238463 * atan2(x,-w)+0.5) / 10.0;
+        } else {
+            roll  = floor(1800.0/3.141592653589793238463 * atan2(2.0 * (w * x + y * z),sqw - sqx - sqy + sqz)+0.5) / 10.0;
+            pitch = floor(1800.0/3.141592653589793238463 * asin(2.0 * delta / norm)+0.5) / 10.0;
+            head  = floor(1800.0/3.141592653589793238463 * atan2(2.0 * (x * y + z * w),sqw + sqx - sqy - sqz)+0.5) / 10.0;
+        }
+    }
+}
+
+int YGyro::get_orientation(YOrientationData& orientation)
+{
+    int res;
+
+    yEnterCriticalSection(&_this_cs);
+    try {
+        res = this->_loadAngles();
+        if (res == YAPI_SUCCESS) {
+            orientation.timestamp = 0;
+            orientation.w = _w;
+            orientation.x = _x;
+            orientation.y = _y;
+            orientation.z = _z;
+            orientation.roll = _roll;
+            orientation.pitch = _pitch;
+            orientation.heading = _head;
+        }
+    } catch (std::exception) {
+        yLeaveCriticalSection(&_this_cs);
+        throw;
+    }
+    yLeaveCriticalSection(&_this_cs);
+    if (res != YAPI_SUCCESS) {
+        _throw(YAPI_DEVICE_NOT_FOUND, "Unable to load the device orientation");
+    }
+    return res;
+}
+
+int YGyro::registerOrientationCallback(YOrientationCallback callback)
+{
+    YQt* qt[4];
+
+    _orientationCallback = callback;
+    if (_qt_stamp == 0 && this->_loadQuaternion() != YAPI_SUCCESS) {
+        _throw(YAPI_DEVICE_NOT_FOUND, "Unable to load the device orientation");
+        return YAPI_DEVICE_NOT_FOUND;
+    }
+    qt[0] = _qt_w;
+    qt[1] = _qt_x;
+    qt[2] = _qt_y;
+    qt[3] = _qt_z;
+    for (int i = 0; i < 4; i++) {
+        _rep_time[i] = -1;
+        qt[i]->set_userData(this);
+        qt[i]->registerTimedReportDataCallback(callback != NULL ? yInternalGyroReportCallback : NULL);
+    }
+    return YAPI_SUCCESS;
+}
+
+int YGyro::set_orientationReportFrequency(const string& newval)
+{
+    YQt* qt[4];
+    int res;
+
+    if (_qt_stamp == 0 && this->_loadQuaternion() != YAPI_SUCCESS) {
+        _throw(YAPI_DEVICE_NOT_FOUND, "Unable to load the device orientation");
+        return YAPI_DEVICE_NOT_FOUND;
+    }
+    qt[0] = _qt_w;
+    qt[1] = _qt_x;
+    qt[2] = _qt_y;
+    qt[3] = _qt_z;
+    for (int i = 0; i < 4; i++) {
+        res = qt[i]->set_reportFrequency(newval);
+        if (res != YAPI_SUCCESS) {
+            return res;
+        }
+    }
+    return YAPI_SUCCESS;
+}
+
+// Timed reports of the four components are notified separately: the orientation
+// is delivered once the four components of the same measure have been received
+void YGyro::_invokeOrientationReport(YSensor* qt, const YMeasureData* measure)
+{
+    YOrientationData orientation;
+    int idx, i;
+
+    if (qt == _qt_w) {
+        idx = 0;
+    } else if (qt == _qt_x) {
+        idx = 1;
+    } else if (qt == _qt_y) {
+        idx = 2;
+    } else if (qt == _qt_z) {
+        idx = 3;
+    } else {
+        return;
+    }
+    _rep_value[idx] = measure->averageValue;
+    _rep_time[idx] = measure->endTime;
+    for (i = 0; i < 4; i++) {
+        if (_rep_time[i] != measure->endTime) {
+            return;
+        }
+    }
+    if (_rep_done == measure->endTime || _orientationCallback == NULL) {
+        return;
+    }
+    _rep_done = measure->endTime;
+    orientation.timestamp = measure->endTime;
+    orientation.w = _rep_value[0];
+    orientation.x = _rep_value[1];
+    orientation.y = _rep_value[2];
+    orientation.z = _rep_value[3];
+    orientation.roll = 0.0;
+    YGyro::_computeAngles(orientation.w, orientation.x, orientation.y, orientation.z,
+                          orientation.roll, orientation.pitch, orientation.heading);
+    _orientationCallback(this, &orientation);
+}
+
 //--- (generated code: YGyro functions)
 //--- (end of generated code: YGyro functions)
@@ -81,6 +81,7 @@ protected:
     // Constructor is protected, use yFindQt factory function to instantiate
     YQt(const string& func);
     //--- (end of generated code: YQt attributes)
+    friend class YGyro;
 
 public:
     ~YQt();
@@ -248,6 +249,21 @@ typedef void (*YGyroTimedReportCallback)(YGyro *func, YMeasure measure);
 typedef void(*YQuatCallback)(YGyro *yGyro, double w, double x, double y, double z);
 typedef void(*YAnglesCallback)(YGyro *yGyro, double roll, double pitch, double head);
 
+/// consistent orientation record: the four quaternion components come from the same
+/// device API load or the same timed report, and the angles are derived from them
+typedef struct {
+    double      timestamp;      // UTC time of the measure (seconds), 0 if unknown
+    double      w;
+    double      x;
+    double      y;
+    double      z;
+    double      roll;
+    double      pitch;
+    double      heading;
+} YOrientationData;
+
+typedef void(*YOrientationCallback)(YGyro *yGyro, const YOrientationData *orientation);
+
 //--- (generated code: YGyro declaration)
 /**
  * YGyro Class: Gyroscope function interface
@@ -301,9 +317,65 @@ protected:
     // Constructor is protected, use yFindGyro factory function to instantiate
     YGyro(const string& func);
     //--- (end of generated code: YGyro attributes)
+    YOrientationCallback _orientationCallback;
+    double          _rep_value[4];      // quaternion components of the pending timed report
+    double          _rep_time[4];       // end time of each pending component
+    double          _rep_done;          // end time of the last timed report delivered
+
+    int             _loadOrientation(void);
+    int             _loadQt(YQt* qt, YJSONObject* apires, string& errmsg);
+    static void     _computeAngles(double w, double x, double y, double z, double& roll, double& pitch, double& head);
 
 public:
     ~YGyro();
+
+    /**
+     * Returns the estimated device orientation as a consistent record: the four
+     * quaternion components are read from a single load of the device API, together
+     * with the gyro attributes, and the angles are derived from them.
+     *
+     * @param orientation : the record to fill
+     *
+     * @return YAPI_SUCCESS if the call succeeds.
+     *
+     * On failure, throws an exception or returns a negative error code.
+     */
+    int             get_orientation(YOrientationData& orientation);
+
+    /**
+     * Registers a callback function that receives the device orientation on every
+     * periodic timed report of the quaternion components. The four components of a
+     * report are assembled from the binary timed reports, and the callback is invoked
+     * once per report with the quaternion and the derived roll, pitch and heading.
+     * The report rate is set with set_orientationReportFrequency.
+     * The callback is invoked only during the execution of ySleep or yHandleEvents.
+     * To unregister a callback, pass a NULL pointer as argument.
+     *
+     * @param callback : the callback function to invoke, or a NULL pointer.
+     *         The callback function should take two arguments: the YGyro object of
+     *         the turning device, and a pointer to the orientation record, only valid
+     *         during the call.
+     *
+     * @return YAPI_SUCCESS if the call succeeds.
+     *
+     * On failure, throws an exception or returns a negative error code.
+     */
+    int             registerOrientationCallback(YOrientationCallback callback);
+
+    /**
+     * Changes the timed report frequency of the four quaternion components, for
+     * instance "100/s" to get every orientation estimate. Remember to call the
+     * saveToFlash() method of the module if the modification must be kept.
+     *
+     * @param newval : a string corresponding to the timed report frequency, or "OFF"
+     *
+     * @return YAPI_SUCCESS if the call succeeds.
+     *
+     * On failure, throws an exception or returns a negative error code.
+     */
+    int             set_orientationReportFrequency(const string& newval);
+
+    void            _invokeOrientationReport(YSensor* qt, const YMeasureData* measure);
     //--- (generated code: YGyro accessors declaration)
 
     static const int BANDWIDTH_INVALID = YAPI_INVALID_INT;
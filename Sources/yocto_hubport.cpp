@@ -290,11 +290,17 @@ int YHubPort::_invokeValueCallback(string value)
 YHubPort *YHubPort::nextHubPort(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("HubPort", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YHubPort::FindHubPort(hwid);
+    if (next == NULL) {
+        next = YHubPort::FindHubPort(hwid);
+        YFunction::_AddToCache("HubPort", nextdescr, next);
+    }
+    return (YHubPort*)next;
 }
 
 YHubPort* YHubPort::FirstHubPort(void)
@@ -295,11 +295,17 @@ int YHumidity::_invokeTimedReportCallback(YMeasure value)
 YHumidity *YHumidity::nextHumidity(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Humidity", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YHumidity::FindHumidity(hwid);
+    if (next == NULL) {
+        next = YHumidity::FindHumidity(hwid);
+        YFunction::_AddToCache("Humidity", nextdescr, next);
+    }
+    return (YHumidity*)next;
 }
 
 YHumidity* YHumidity::FirstHumidity(void)
@@ -191,11 +191,17 @@ int YLatitude::_invokeTimedReportCallback(YMeasure value)
 YLatitude *YLatitude::nextLatitude(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Latitude", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YLatitude::FindLatitude(hwid);
+    if (next == NULL) {
+        next = YLatitude::FindLatitude(hwid);
+        YFunction::_AddToCache("Latitude", nextdescr, next);
+    }
+    return (YLatitude*)next;
 }
 
 YLatitude* YLatitude::FirstLatitude(void)
@@ -337,11 +337,17 @@ int YLed::_invokeValueCallback(string value)
 YLed *YLed::nextLed(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Led", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YLed::FindLed(hwid);
+    if (next == NULL) {
+        next = YLed::FindLed(hwid);
+        YFunction::_AddToCache("Led", nextdescr, next);
+    }
+    return (YLed*)next;
 }
 
 YLed* YLed::FirstLed(void)
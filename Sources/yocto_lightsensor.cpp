@@ -297,11 +297,17 @@ int YLightSensor::_invokeTimedReportCallback(YMeasure value)
 YLightSensor *YLightSensor::nextLightSensor(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("LightSensor", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YLightSensor::FindLightSensor(hwid);
+    if (next == NULL) {
+        next = YLightSensor::FindLightSensor(hwid);
+        YFunction::_AddToCache("LightSensor", nextdescr, next);
+    }
+    return (YLightSensor*)next;
 }
 
 YLightSensor* YLightSensor::FirstLightSensor(void)
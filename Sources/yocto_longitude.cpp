@@ -191,11 +191,17 @@ int YLongitude::_invokeTimedReportCallback(YMeasure value)
 YLongitude *YLongitude::nextLongitude(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Longitude", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YLongitude::FindLongitude(hwid);
+    if (next == NULL) {
+        next = YLongitude::FindLongitude(hwid);
+        YFunction::_AddToCache("Longitude", nextdescr, next);
+    }
+    return (YLongitude*)next;
 }
 
 YLongitude* YLongitude::FirstLongitude(void)
@@ -360,11 +360,17 @@ int YMagnetometer::_invokeTimedReportCallback(YMeasure value)
 YMagnetometer *YMagnetometer::nextMagnetometer(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Magnetometer", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YMagnetometer::FindMagnetometer(hwid);
+    if (next == NULL) {
+        next = YMagnetometer::FindMagnetometer(hwid);
+        YFunction::_AddToCache("Magnetometer", nextdescr, next);
+    }
+    return (YMagnetometer*)next;
 }
 
 YMagnetometer* YMagnetometer::FirstMagnetometer(void)
@@ -2236,11 +2236,17 @@ vector<YSms> YMessageBox::get_messages(void)
 YMessageBox *YMessageBox::nextMessageBox(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("MessageBox", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YMessageBox::FindMessageBox(hwid);
+    if (next == NULL) {
+        next = YMessageBox::FindMessageBox(hwid);
+        YFunction::_AddToCache("MessageBox", nextdescr, next);
+    }
+    return (YMessageBox*)next;
 }
 
 YMessageBox* YMessageBox::FirstMessageBox(void)
@@ -770,11 +770,17 @@ int YMotor::brakingForceMove(double targetPower,int delay)
 YMotor *YMotor::nextMotor(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Motor", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YMotor::FindMotor(hwid);
+    if (next == NULL) {
+        next = YMotor::FindMotor(hwid);
+        YFunction::_AddToCache("Motor", nextdescr, next);
+    }
+    return (YMotor*)next;
 }
 
 YMotor* YMotor::FirstMotor(void)
@@ -452,11 +452,17 @@ int YMultiAxisController::abortAndHiZ(void)
 YMultiAxisController *YMultiAxisController::nextMultiAxisController(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("MultiAxisController", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YMultiAxisController::FindMultiAxisController(hwid);
+    if (next == NULL) {
+        next = YMultiAxisController::FindMultiAxisController(hwid);
+        YFunction::_AddToCache("MultiAxisController", nextdescr, next);
+    }
+    return (YMultiAxisController*)next;
 }
 
 YMultiAxisController* YMultiAxisController::FirstMultiAxisController(void)
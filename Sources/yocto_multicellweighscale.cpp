@@ -711,11 +711,17 @@ int YMultiCellWeighScale::setupSpan(double currWeight,double maxWeight)
 YMultiCellWeighScale *YMultiCellWeighScale::nextMultiCellWeighScale(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("MultiCellWeighScale", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YMultiCellWeighScale::FindMultiCellWeighScale(hwid);
+    if (next == NULL) {
+        next = YMultiCellWeighScale::FindMultiCellWeighScale(hwid);
+        YFunction::_AddToCache("MultiCellWeighScale", nextdescr, next);
+    }
+    return (YMultiCellWeighScale*)next;
 }
 
 YMultiCellWeighScale* YMultiCellWeighScale::FirstMultiCellWeighScale(void)
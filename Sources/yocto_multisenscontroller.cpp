@@ -382,11 +382,17 @@ int YMultiSensController::setupAddress(int addr)
 YMultiSensController *YMultiSensController::nextMultiSensController(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("MultiSensController", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YMultiSensController::FindMultiSensController(hwid);
+    if (next == NULL) {
+        next = YMultiSensController::FindMultiSensController(hwid);
+        YFunction::_AddToCache("MultiSensController", nextdescr, next);
+    }
+    return (YMultiSensController*)next;
 }
 
 YMultiSensController* YMultiSensController::FirstMultiSensController(void)
@@ -1628,11 +1628,17 @@ int YNetwork::set_periodicCallbackSchedule(string interval,int offset)
 YNetwork *YNetwork::nextNetwork(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Network", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YNetwork::FindNetwork(hwid);
+    if (next == NULL) {
+        next = YNetwork::FindNetwork(hwid);
+        YFunction::_AddToCache("Network", nextdescr, next);
+    }
+    return (YNetwork*)next;
 }
 
 YNetwork* YNetwork::FirstNetwork(void)
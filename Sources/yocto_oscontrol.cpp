@@ -226,11 +226,17 @@ int YOsControl::shutdown(int secBeforeShutDown)
 YOsControl *YOsControl::nextOsControl(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("OsControl", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YOsControl::FindOsControl(hwid);
+    if (next == NULL) {
+        next = YOsControl::FindOsControl(hwid);
+        YFunction::_AddToCache("OsControl", nextdescr, next);
+    }
+    return (YOsControl*)next;
 }
 
 YOsControl* YOsControl::FirstOsControl(void)
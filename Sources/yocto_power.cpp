@@ -329,11 +329,17 @@ int YPower::reset(void)
 YPower *YPower::nextPower(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Power", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YPower::FindPower(hwid);
+    if (next == NULL) {
+        next = YPower::FindPower(hwid);
+        YFunction::_AddToCache("Power", nextdescr, next);
+    }
+    return (YPower*)next;
 }
 
 YPower* YPower::FirstPower(void)
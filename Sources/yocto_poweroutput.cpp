@@ -224,11 +224,17 @@ int YPowerOutput::_invokeValueCallback(string value)
 YPowerOutput *YPowerOutput::nextPowerOutput(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("PowerOutput", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YPowerOutput::FindPowerOutput(hwid);
+    if (next == NULL) {
+        next = YPowerOutput::FindPowerOutput(hwid);
+        YFunction::_AddToCache("PowerOutput", nextdescr, next);
+    }
+    return (YPowerOutput*)next;
 }
 
 YPowerOutput* YPowerOutput::FirstPowerOutput(void)
@@ -792,11 +792,17 @@ int YPowerSupply::voltageMove(double V_target,int ms_duration)
 YPowerSupply *YPowerSupply::nextPowerSupply(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("PowerSupply", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YPowerSupply::FindPowerSupply(hwid);
+    if (next == NULL) {
+        next = YPowerSupply::FindPowerSupply(hwid);
+        YFunction::_AddToCache("PowerSupply", nextdescr, next);
+    }
+    return (YPowerSupply*)next;
 }
 
 YPowerSupply* YPowerSupply::FirstPowerSupply(void)
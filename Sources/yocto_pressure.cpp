@@ -191,11 +191,17 @@ int YPressure::_invokeTimedReportCallback(YMeasure value)
 YPressure *YPressure::nextPressure(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Pressure", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YPressure::FindPressure(hwid);
+    if (next == NULL) {
+        next = YPressure::FindPressure(hwid);
+        YFunction::_AddToCache("Pressure", nextdescr, next);
+    }
+    return (YPressure*)next;
 }
 
 YPressure* YPressure::FirstPressure(void)
@@ -747,11 +747,17 @@ int YProximity::resetCounter(void)
 YProximity *YProximity::nextProximity(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Proximity", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YProximity::FindProximity(hwid);
+    if (next == NULL) {
+        next = YProximity::FindProximity(hwid);
+        YFunction::_AddToCache("Proximity", nextdescr, next);
+    }
+    return (YProximity*)next;
 }
 
 YProximity* YProximity::FirstProximity(void)
@@ -585,11 +585,17 @@ int YPwmInput::resetCounter(void)
 YPwmInput *YPwmInput::nextPwmInput(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("PwmInput", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YPwmInput::FindPwmInput(hwid);
+    if (next == NULL) {
+        next = YPwmInput::FindPwmInput(hwid);
+        YFunction::_AddToCache("PwmInput", nextdescr, next);
+    }
+    return (YPwmInput*)next;
 }
 
 YPwmInput* YPwmInput::FirstPwmInput(void)
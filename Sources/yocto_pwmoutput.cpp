@@ -797,11 +797,17 @@ int YPwmOutput::repeatFromMark(void)
 YPwmOutput *YPwmOutput::nextPwmOutput(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("PwmOutput", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YPwmOutput::FindPwmOutput(hwid);
+    if (next == NULL) {
+        next = YPwmOutput::FindPwmOutput(hwid);
+        YFunction::_AddToCache("PwmOutput", nextdescr, next);
+    }
+    return (YPwmOutput*)next;
 }
 
 YPwmOutput* YPwmOutput::FirstPwmOutput(void)
@@ -227,11 +227,17 @@ int YPwmPowerSource::_invokeValueCallback(string value)
 YPwmPowerSource *YPwmPowerSource::nextPwmPowerSource(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("PwmPowerSource", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YPwmPowerSource::FindPwmPowerSource(hwid);
+    if (next == NULL) {
+        next = YPwmPowerSource::FindPwmPowerSource(hwid);
+        YFunction::_AddToCache("PwmPowerSource", nextdescr, next);
+    }
+    return (YPwmPowerSource*)next;
 }
 
 YPwmPowerSource* YPwmPowerSource::FirstPwmPowerSource(void)
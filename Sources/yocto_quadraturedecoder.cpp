@@ -316,11 +316,17 @@ int YQuadratureDecoder::_invokeTimedReportCallback(YMeasure value)
 YQuadratureDecoder *YQuadratureDecoder::nextQuadratureDecoder(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("QuadratureDecoder", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YQuadratureDecoder::FindQuadratureDecoder(hwid);
+    if (next == NULL) {
+        next = YQuadratureDecoder::FindQuadratureDecoder(hwid);
+        YFunction::_AddToCache("QuadratureDecoder", nextdescr, next);
+    }
+    return (YQuadratureDecoder*)next;
 }
 
 YQuadratureDecoder* YQuadratureDecoder::FirstQuadratureDecoder(void)
@@ -514,11 +514,17 @@ int YRangeFinder::cancelCoverGlassCalibrations(void)
 YRangeFinder *YRangeFinder::nextRangeFinder(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("RangeFinder", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YRangeFinder::FindRangeFinder(hwid);
+    if (next == NULL) {
+        next = YRangeFinder::FindRangeFinder(hwid);
+        YFunction::_AddToCache("RangeFinder", nextdescr, next);
+    }
+    return (YRangeFinder*)next;
 }
 
 YRangeFinder* YRangeFinder::FirstRangeFinder(void)
@@ -347,11 +347,17 @@ int YRealTimeClock::_invokeValueCallback(string value)
 YRealTimeClock *YRealTimeClock::nextRealTimeClock(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("RealTimeClock", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YRealTimeClock::FindRealTimeClock(hwid);
+    if (next == NULL) {
+        next = YRealTimeClock::FindRealTimeClock(hwid);
+        YFunction::_AddToCache("RealTimeClock", nextdescr, next);
+    }
+    return (YRealTimeClock*)next;
 }
 
 YRealTimeClock* YRealTimeClock::FirstRealTimeClock(void)
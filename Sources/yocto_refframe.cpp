@@ -1036,11 +1036,17 @@ int YRefFrame::cancel3DCalibration(void)
 YRefFrame *YRefFrame::nextRefFrame(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("RefFrame", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YRefFrame::FindRefFrame(hwid);
+    if (next == NULL) {
+        next = YRefFrame::FindRefFrame(hwid);
+        YFunction::_AddToCache("RefFrame", nextdescr, next);
+    }
+    return (YRefFrame*)next;
 }
 
 YRefFrame* YRefFrame::FirstRefFrame(void)
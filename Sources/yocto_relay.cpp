@@ -637,11 +637,17 @@ int YRelay::_invokeValueCallback(string value)
 YRelay *YRelay::nextRelay(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Relay", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YRelay::FindRelay(hwid);
+    if (next == NULL) {
+        next = YRelay::FindRelay(hwid);
+        YFunction::_AddToCache("Relay", nextdescr, next);
+    }
+    return (YRelay*)next;
 }
 
 YRelay* YRelay::FirstRelay(void)
@@ -262,11 +262,17 @@ int YSegmentedDisplay::_invokeValueCallback(string value)
 YSegmentedDisplay *YSegmentedDisplay::nextSegmentedDisplay(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("SegmentedDisplay", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YSegmentedDisplay::FindSegmentedDisplay(hwid);
+    if (next == NULL) {
+        next = YSegmentedDisplay::FindSegmentedDisplay(hwid);
+        YFunction::_AddToCache("SegmentedDisplay", nextdescr, next);
+    }
+    return (YSegmentedDisplay*)next;
 }
 
 YSegmentedDisplay* YSegmentedDisplay::FirstSegmentedDisplay(void)
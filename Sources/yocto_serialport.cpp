@@ -42,6 +42,7 @@
 #include "yocto_serialport.h"
 #include "yapi/yjson.h"
 #include "yapi/yapi.h"
+#include "yapi/ythread.h"
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
@@ -125,12 +126,14 @@ YSerialPort::YSerialPort(const string& func): YFunction(func)
     ,_rxptr(0)
     ,_rxbuffptr(0)
 //--- (end of generated code: YSerialPort initialization)
+    ,_rxStream(NULL)
 {
     _className="SerialPort";
 }
 
 YSerialPort::~YSerialPort()
 {
+    this->stopRxStream();
 //--- (generated code: YSerialPort cleanup)
 //--- (end of generated code: YSerialPort cleanup)
 }
@@ -789,6 +792,11 @@ int YSerialPort::registerValueCallback(YSerialPortValueCallback callback)
 
 int YSerialPort::_invokeValueCallback(string value)
 {
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        stream->signal();
+        stream->release();
+    }
     if (_valueCallbackSerialPort != NULL) {
         _valueCallbackSerialPort(this, value);
     } else {
@@ -811,6 +819,11 @@ int YSerialPort::sendCommand(string text)
  */
 int YSerialPort::reset(void)
 {
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        stream->seek(0);
+        stream->release();
+    }
     _rxptr = 0;
     _rxbuffptr = 0;
     _rxbuff = string(0, (char)0);
@@ -993,6 +1006,13 @@ int YSerialPort::writeLine(string text)
  */
 int YSerialPort::readByte(void)
 {
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        int res = stream->readByte();
+        _rxptr = stream->tell();
+        stream->release();
+        return res;
+    }
     int currpos = 0;
     int reqlen = 0;
     string buff;
@@ -1073,7 +1093,13 @@ string YSerialPort::readStr(int nChars)
         nChars = 65535;
     }
 
-    buff = this->_download(YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _rxptr,nChars));
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        buff = stream->readData(nChars);
+        stream->release();
+    } else {
+        buff = this->_download(YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _rxptr,nChars));
+    }
     bufflen = (int)(buff).size() - 1;
     endpos = 0;
     mult = 1;
@@ -1110,7 +1136,13 @@ string YSerialPort::readBin(int nChars)
         nChars = 65535;
     }
 
-    buff = this->_download(YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _rxptr,nChars));
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        buff = stream->readData(nChars);
+        stream->release();
+    } else {
+        buff = this->_download(YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _rxptr,nChars));
+    }
     bufflen = (int)(buff).size() - 1;
     endpos = 0;
     mult = 1;
@@ -1153,7 +1185,13 @@ vector<int> YSerialPort::readArray(int nChars)
         nChars = 65535;
     }
 
-    buff = this->_download(YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _rxptr,nChars));
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        buff = stream->readData(nChars);
+        stream->release();
+    } else {
+        buff = this->_download(YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _rxptr,nChars));
+    }
     bufflen = (int)(buff).size() - 1;
     endpos = 0;
     mult = 1;
@@ -1196,7 +1234,13 @@ string YSerialPort::readHex(int nBytes)
         nBytes = 65535;
     }
 
-    buff = this->_download(YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _rxptr,nBytes));
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        buff = stream->readData(nBytes);
+        stream->release();
+    } else {
+        buff = this->_download(YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _rxptr,nBytes));
+    }
     bufflen = (int)(buff).size() - 1;
     endpos = 0;
     mult = 1;
@@ -1234,6 +1278,13 @@ string YSerialPort::readHex(int nBytes)
  */
 string YSerialPort::readLine(void)
 {
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        string res = stream->readLine();
+        _rxptr = stream->tell();
+        stream->release();
+        return res;
+    }
     string url;
     string msgbin;
     vector<string> msgarr;
@@ -1280,6 +1331,7 @@ string YSerialPort::readLine(void)
  */
 vector<string> YSerialPort::readMessages(string pattern,int maxWait)
 {
+    this->_rxStreamToPtr();
     string url;
     string msgbin;
     vector<string> msgarr;
@@ -1297,6 +1349,7 @@ vector<string> YSerialPort::readMessages(string pattern,int maxWait)
     // last element of array is the new position
     msglen = msglen - 1;
     _rxptr = atoi((msgarr[msglen]).c_str());
+    this->_rxPtrToStream();
     idx = 0;
     while (idx < msglen) {
         res.push_back(this->_json_get_string(msgarr[idx]));
@@ -1316,6 +1369,11 @@ vector<string> YSerialPort::readMessages(string pattern,int maxWait)
  */
 int YSerialPort::read_seek(int absPos)
 {
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        stream->seek(absPos);
+        stream->release();
+    }
     _rxptr = absPos;
     return YAPI_SUCCESS;
 }
@@ -1327,6 +1385,12 @@ int YSerialPort::read_seek(int absPos)
  */
 int YSerialPort::read_tell(void)
 {
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        int res = stream->tell();
+        stream->release();
+        return res;
+    }
     return _rxptr;
 }
 
@@ -1338,6 +1402,12 @@ int YSerialPort::read_tell(void)
  */
 int YSerialPort::read_avail(void)
 {
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        int res = stream->avail();
+        stream->release();
+        return res;
+    }
     string buff;
     int bufflen = 0;
     int res = 0;
@@ -1381,6 +1451,7 @@ string YSerialPort::queryLine(string query,int maxWait)
     // last element of array is the new position
     msglen = msglen - 1;
     _rxptr = atoi((msgarr[msglen]).c_str());
+    this->_rxPtrToStream();
     if (msglen == 0) {
         return "";
     }
@@ -1476,6 +1547,7 @@ int YSerialPort::get_CTS(void)
  */
 vector<YSnoopingRecord> YSerialPort::snoopMessages(int maxWait)
 {
+    this->_rxStreamToPtr();
     string url;
     string msgbin;
     vector<string> msgarr;
@@ -1493,6 +1565,7 @@ vector<YSnoopingRecord> YSerialPort::snoopMessages(int maxWait)
     // last element of array is the new position
     msglen = msglen - 1;
     _rxptr = atoi((msgarr[msglen]).c_str());
+    this->_rxPtrToStream();
     idx = 0;
     while (idx < msglen) {
         res.push_back(YSnoopingRecord(msgarr[idx]));
@@ -2050,11 +2123,17 @@ vector<int> YSerialPort::modbusWriteAndReadRegisters(int slaveNo,int pduWriteAdd
 YSerialPort *YSerialPort::nextSerialPort(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("SerialPort", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YSerialPort::FindSerialPort(hwid);
+    if (next == NULL) {
+        next = YSerialPort::FindSerialPort(hwid);
+        YFunction::_AddToCache("SerialPort", nextdescr, next);
+    }
+    return (YSerialPort*)next;
 }
 
 YSerialPort* YSerialPort::FirstSerialPort(void)
@@ -2073,5 +2152,532 @@ YSerialPort* YSerialPort::FirstSerialPort(void)
 
 //--- (end of generated code: YSerialPort implementation)
 
+int YSerialPort::startRxStream(int bufferSize, int highWaterMark, YRxStreamCallback callback, void* context)
+{
+    YRxStream* stream;
+
+    if (!YAPI::_apiInitialized) {
+        string errmsg;
+        if (YISERR(YAPI::InitAPI(0, errmsg))) {
+            _throw(YAPI_NOT_INITIALIZED, errmsg);
+            return YAPI_NOT_INITIALIZED;
+        }
+    }
+    this->stopRxStream();
+    yEnterCriticalSection(&_this_cs);
+    stream = new YRxStream(this, _rxptr, bufferSize, highWaterMark, callback, context);
+    _rxStream = stream;
+    yLeaveCriticalSection(&_this_cs);
+    // notifications of the port trigger an immediate fetch
+    YFunction::_UpdateValueCallbackList(this, true);
+    return YAPI_SUCCESS;
+}
+
+int YSerialPort::stopRxStream(void)
+{
+    YRxStream* stream;
+
+    yEnterCriticalSection(&_this_cs);
+    stream = _rxStream;
+    _rxStream = NULL;
+    if (stream != NULL) {
+        _rxptr = stream->tell();
+    }
+    yLeaveCriticalSection(&_this_cs);
+    if (stream == NULL) {
+        return YAPI_SUCCESS;
+    }
+    // reads still in progress hold their own reference on the stream
+    stream->stop();
+    stream->release();
+    if (_valueCallbackFunction == NULL && _valueCallbackSerialPort == NULL && YAPI::_apiInitialized) {
+        YFunction::_UpdateValueCallbackList(this, false);
+    }
+    return YAPI_SUCCESS;
+}
+
+// Returns the running stream with a new reference, to be released by the caller
+YRxStream* YSerialPort::_getRxStream(void)
+{
+    YRxStream* stream;
+
+    yEnterCriticalSection(&_this_cs);
+    stream = _rxStream;
+    if (stream != NULL) {
+        stream->addRef();
+    }
+    yLeaveCriticalSection(&_this_cs);
+    return stream;
+}
+
+// Message reads are served by the device from _rxptr: the position is taken from
+// the stream before the request, and the stream restarts from the new position after
+void YSerialPort::_rxStreamToPtr(void)
+{
+    YRxStream* stream = this->_getRxStream();
+
+    if (stream != NULL) {
+        _rxptr = stream->tell();
+        stream->release();
+    }
+}
+
+void YSerialPort::_rxPtrToStream(void)
+{
+    YRxStream* stream = this->_getRxStream();
+
+    if (stream != NULL) {
+        stream->seek(_rxptr);
+        stream->release();
+    }
+}
+
+YRxStream* YSerialPort::get_rxStream(void)
+{
+    return _rxStream;
+}
+
+// MODBUS scan (see YModbusScan). Queries are sent with YFunction::_downloadAsync
+// and their replies are decoded in the order of the queries.
+#define YMODBUS_MAX_REGISTERS   125
+#define YMODBUS_MAX_BITS        2000
+#define YMODBUS_MAX_PENDING     4
+
+class YModbusScanLoad {
+public:
+    struct Reply {
+        YModbusScanLoad* load;
+        bool            done;
+        YRETCODE        retcode;
+        string          data;
+        u64             doneTime;
+    };
+
+    yCRITICAL_SECTION   cs;
+    volatile s32        refcount;
+    vector<Reply*>      replies;
+
+    YModbusScanLoad() : refcount(1)
+    {
+        yInitializeCriticalSection(&cs);
+    }
+
+    ~YModbusScanLoad()
+    {
+        for (size_t i = 0; i < replies.size(); i++) {
+            delete replies[i];
+        }
+        yDeleteCriticalSection(&cs);
+    }
+
+    void addRef(void)
+    {
+        yAtomicAdd(&refcount, 1);
+    }
+
+    void release(void)
+    {
+        if (yAtomicAdd(&refcount, -1) == 0) {
+            delete this;
+        }
+    }
+};
+
+
+static void yModbusScanCallback(YDevice* device, void* context, YRETCODE returnval, const string& result, string& errmsg)
+{
+    YModbusScanLoad::Reply* reply = (YModbusScanLoad::Reply*)context;
+    YModbusScanLoad* load = reply->load;
+
+    yEnterCriticalSection(&load->cs);
+    reply->retcode = returnval;
+    reply->data = result;
+    reply->doneTime = yapiGetTickCount();
+    reply->done = true;
+    yLeaveCriticalSection(&load->cs);
+    load->release();
+}
+
+
+static int yHexNibble(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+
+YModbusScan::YModbusScan(YSerialPort* port):
+    _port(port), _maxGap(0), _maxPending(YMODBUS_MAX_PENDING), _sweepTime(0), _planned(false)
+{}
+
+int YModbusScan::addRange(int slaveNo, int funCode, int pduAddr, int count)
+{
+    Value value;
+    u32 key;
+
+    if (slaveNo < 0 || slaveNo > 255 || funCode < 1 || funCode > 4 ||
+        pduAddr < 0 || count < 1 || pduAddr + count > 0x10000) {
+        _port->_throw(YAPI_INVALID_ARGUMENT, "Invalid MODBUS range");
+        return YAPI_INVALID_ARGUMENT;
+    }
+    value.slaveNo = slaveNo;
+    value.funCode = funCode;
+    value.value = YAPI_INVALID_INT;
+    value.status = YAPI_NO_MORE_DATA;
+    for (int i = 0; i < count; i++) {
+        key = ((u32)slaveNo << 24) | ((u32)funCode << 16) | (u32)(pduAddr + i);
+        if (_index.find(key) != _index.end()) {
+            continue;
+        }
+        value.address = pduAddr + i;
+        _index[key] = (int)_values.size();
+        _values.push_back(value);
+    }
+    _planned = false;
+    return YAPI_SUCCESS;
+}
+
+void YModbusScan::clear(void)
+{
+    _values.clear();
+    _index.clear();
+    _queries.clear();
+    _planned = false;
+}
+
+void YModbusScan::set_maxGap(int maxGap)
+{
+    _maxGap = (maxGap < 0 ? 0 : maxGap);
+    _planned = false;
+}
+
+int YModbusScan::get_maxGap(void)
+{
+    return _maxGap;
+}
+
+void YModbusScan::set_maxPending(int maxPending)
+{
+    _maxPending = (maxPending < 1 ? 1 : maxPending);
+}
+
+int YModbusScan::get_maxPending(void)
+{
+    return _maxPending;
+}
+
+// Merge the requested addresses into queries. The index is sorted by slave,
+// function and address, so each query covers a run of consecutive keys.
+void YModbusScan::_plan(void)
+{
+    std::map<u32,int>::iterator it;
+    Query* query = NULL;
+    string cmd, pat;
+    int slaveNo, funCode, address, maxCount, nib;
+
+    _queries.clear();
+    for (it = _index.begin(); it != _index.end(); it++) {
+        slaveNo = (int)(it->first >> 24);
+        funCode = (int)((it->first >> 16) & 0xff);
+        address = (int)(it->first & 0xffff);
+        maxCount = (funCode <= 2 ? YMODBUS_MAX_BITS : YMODBUS_MAX_REGISTERS);
+        if (query && query->slaveNo == slaveNo && query->funCode == funCode &&
+            address - (query->address + query->count) <= _maxGap &&
+            address - query->address < maxCount) {
+            while (query->address + query->count < address) {
+                query->valueIdx.push_back(-1);
+                query->count++;
+            }
+        } else {
+            _queries.push_back(Query());
+            query = &_queries.back();
+            query->slaveNo = slaveNo;
+            query->funCode = funCode;
+            query->address = address;
+            query->count = 0;
+        }
+        query->valueIdx.push_back(it->second);
+        query->count++;
+    }
+    // the query urls do not change from one scan to the next
+    for (size_t i = 0; i < _queries.size(); i++) {
+        Query& q = _queries[i];
+        nib = q.funCode >> 4;
+        cmd = YapiWrapper::ysprintf("%02X%02X%02X%02X%02X%02X", q.slaveNo, q.funCode,
+                                    q.address >> 8, q.address & 0xff, q.count >> 8, q.count & 0xff);
+        pat = YapiWrapper::ysprintf("%02X[%X%X]%X.*", q.slaveNo, nib, nib + 8, q.funCode & 15);
+        q.url = YapiWrapper::ysprintf("rxmsg.json?cmd=:%s&pat=:%s", cmd.c_str(), pat.c_str());
+    }
+    _planned = true;
+}
+
+// Decode a raw rxmsg.json reply (http header included) into the snapshot.
+// The first message of the array is the reply of the slave, as ":SSFF<data>"
+// in hexadecimal, where SS is the slave address and FF the function code.
+YRETCODE YModbusScan::_decode(Query& query, const string& reply, string& errmsg)
+{
+    const char* p;
+    const char* end;
+    u8 pdu[3 + YMODBUS_MAX_BITS / 8];
+    int len = 0;
+    int hi, lo, i, idx;
+    size_t found;
+
+    found = reply.find("\r\n\r\n");
+    if (string::npos == found ||
+        (0 != reply.find("OK\r\n") && 0 != reply.find("HTTP/1.1 200 OK\r\n"))) {
+        errmsg = "http request failed";
+        return YAPI_IO_ERROR;
+    }
+    p = reply.data() + found + 4;
+    end = reply.data() + reply.size();
+    while (p < end && *p != '[') p++;
+    p++;
+    while (p < end && (*p == ' ' || *p == '\r' || *p == '\n')) p++;
+    if (p + 6 > end || p[0] != '"' || p[1] != ':') {
+        errmsg = "no reply from slave";
+        return YAPI_IO_ERROR;
+    }
+    // skip the slave address, keep the PDU
+    p += 4;
+    while (p + 1 < end && *p != '"' && len < (int)sizeof(pdu)) {
+        hi = yHexNibble(p[0]);
+        lo = yHexNibble(p[1]);
+        if (hi < 0 || lo < 0) {
+            break;
+        }
+        pdu[len++] = (u8)((hi << 4) | lo);
+        p += 2;
+    }
+    if (len < 2) {
+        errmsg = "no reply from slave";
+        return YAPI_IO_ERROR;
+    }
+    if (pdu[0] != query.funCode) {
+        switch (pdu[1]) {
+        case 1:
+            errmsg = "MODBUS error: unsupported function code";
+            return YAPI_NOT_SUPPORTED;
+        case 2:
+            errmsg = "MODBUS error: illegal data address";
+            return YAPI_INVALID_ARGUMENT;
+        case 3:
+            errmsg = "MODBUS error: illegal data value";
+            return YAPI_INVALID_ARGUMENT;
+        default:
+            errmsg = "MODBUS error: failed to execute function";
+            return YAPI_INVALID_ARGUMENT;
+        }
+    }
+    if (query.funCode <= 2) {
+        if (len < 2 + (query.count + 7) / 8) {
+            errmsg = "MODBUS error: truncated reply";
+            return YAPI_IO_ERROR;
+        }
+        for (i = 0; i < query.count; i++) {
+            idx = query.valueIdx[i];
+            if (idx >= 0) {
+                _values[idx].value = (pdu[2 + (i >> 3)] >> (i & 7)) & 1;
+            }
+        }
+    } else {
+        if (len < 2 + 2 * query.count) {
+            errmsg = "MODBUS error: truncated reply";
+            return YAPI_IO_ERROR;
+        }
+        for (i = 0; i < query.count; i++) {
+            idx = query.valueIdx[i];
+            if (idx >= 0) {
+                _values[idx].value = (pdu[2 + 2 * i] << 8) | pdu[3 + 2 * i];
+            }
+        }
+    }
+    return YAPI_SUCCESS;
+}
+
+void YModbusScan::_update(Query& query, YRETCODE status, int latency)
+{
+    int idx;
+
+    for (int i = 0; i < query.count; i++) {
+        idx = query.valueIdx[i];
+        if (idx >= 0) {
+            _values[idx].status = status;
+            if (YISERR(status)) {
+                _values[idx].value = YAPI_INVALID_INT;
+            }
+        }
+    }
+    if (_stats.find(query.slaveNo) == _stats.end()) {
+        SlaveStats init;
+        init.slaveNo = query.slaveNo;
+        init.queries = 0;
+        init.errors = 0;
+        init.lastLatency = 0;
+        init.minLatency = 0;
+        init.maxLatency = 0;
+        init.avgLatency = 0;
+        _stats[query.slaveNo] = init;
+        _latencySum[query.slaveNo] = 0;
+    }
+    SlaveStats& stats = _stats[query.slaveNo];
+    if (YISERR(status)) {
+        stats.errors++;
+    }
+    if (stats.queries == 0 || latency < stats.minLatency) {
+        stats.minLatency = latency;
+    }
+    if (latency > stats.maxLatency) {
+        stats.maxLatency = latency;
+    }
+    stats.queries++;
+    stats.lastLatency = latency;
+    _latencySum[query.slaveNo] += latency;
+    stats.avgLatency = (int)(_latencySum[query.slaveNo] / stats.queries);
+}
+
+int YModbusScan::scan(void)
+{
+    YModbusScanLoad* load;
+    YModbusScanLoad::Reply* reply;
+    YRETCODE res = YAPI_SUCCESS;
+    YRETCODE status, firstErr = YAPI_SUCCESS;
+    string errmsg, qerrmsg;
+    string data;
+    char errbuf[YOCTO_ERRMSG_LEN];
+    int maxPending = _maxPending;
+    int devPending = 0;
+    int* devPendingPtr = &devPending;
+    int next = 0, processed = 0;
+    int latency;
+    bool done;
+    u64 start, deadline, now, lastDone;
+
+    if (!_planned) {
+        this->_plan();
+    }
+    load = new YModbusScanLoad();
+    start = YAPI::GetTickCount();
+    lastDone = start;
+    try {
+        deadline = start + YIO_DEFAULT_TCP_TIMEOUT;
+        while (processed < (int)_queries.size()) {
+            // keep up to maxPending queries in progress
+            while (next < (int)_queries.size() && next - processed < maxPending) {
+                reply = new YModbusScanLoad::Reply();
+                reply->load = load;
+                reply->done = false;
+                reply->retcode = YAPI_SUCCESS;
+                reply->doneTime = 0;
+                load->replies.push_back(reply);
+                load->addRef();
+                // the kind of connection is only checked for the first query
+                if (YISERR(_port->_downloadAsync(_queries[next].url, yModbusScanCallback, reply,
+                                                 devPendingPtr, errmsg))) {
+                    // the query is sent synchronously when it is its turn
+                    reply->retcode = YAPI_IO_ERROR;
+                    reply->done = true;
+                    load->release();
+                }
+                devPendingPtr = NULL;
+                if (devPending > 0 && devPending < maxPending) {
+                    maxPending = devPending;
+                }
+                next++;
+            }
+            // decode the replies in the order of the queries
+            reply = load->replies[processed];
+            yEnterCriticalSection(&load->cs);
+            done = reply->done;
+            yLeaveCriticalSection(&load->cs);
+            now = YAPI::GetTickCount();
+            if (!done) {
+                if (now >= deadline) {
+                    res = YAPI_TIMEOUT;
+                    errmsg = "Timeout while waiting for MODBUS replies";
+                    break;
+                }
+                if (YISERR(res = yapiWaitForEvents((int)(deadline - now), errbuf))) {
+                    errmsg = errbuf;
+                    break;
+                }
+                continue;
+            }
+            Query& query = _queries[processed];
+            if (YISERR(reply->retcode)) {
+                data = _port->_requestEx(0, "GET /" + query.url + " HTTP/1.1\r\n\r\n", NULL, NULL);
+                reply->doneTime = YAPI::GetTickCount();
+            } else {
+                data.swap(reply->data);
+            }
+            // time spent by this query alone: pipelined queries wait for the previous one
+            latency = (int)(reply->doneTime - (lastDone > start ? lastDone : start));
+            lastDone = reply->doneTime;
+            status = this->_decode(query, data, qerrmsg);
+            this->_update(query, status, latency);
+            if (YISERR(status) && firstErr == YAPI_SUCCESS) {
+                firstErr = status;
+                _port->_lastErrorType = status;
+                _port->_lastErrorMsg = qerrmsg;
+            }
+            processed++;
+            deadline = YAPI::GetTickCount() + YIO_DEFAULT_TCP_TIMEOUT;
+        }
+    } catch (std::exception&) {
+        load->release();
+        throw;
+    }
+    load->release();
+    _sweepTime = (int)(YAPI::GetTickCount() - start);
+    if (YISERR(res)) {
+        _port->_throw(res, errmsg);
+        return res;
+    }
+    return firstErr;
+}
+
+const vector<YModbusScan::Value>& YModbusScan::get_snapshot(void)
+{
+    return _values;
+}
+
+int YModbusScan::get_value(int slaveNo, int funCode, int pduAddr)
+{
+    std::map<u32,int>::iterator it;
+    u32 key = ((u32)(slaveNo & 0xff) << 24) | ((u32)(funCode & 0xff) << 16) | (u32)(pduAddr & 0xffff);
+
+    it = _index.find(key);
+    if (it == _index.end() || YISERR(_values[it->second].status)) {
+        return YAPI_INVALID_INT;
+    }
+    return _values[it->second].value;
+}
+
+vector<YModbusScan::SlaveStats> YModbusScan::get_slaveStats(void)
+{
+    vector<SlaveStats> res;
+    std::map<int,SlaveStats>::iterator it;
+
+    for (it = _stats.begin(); it != _stats.end(); it++) {
+        res.push_back(it->second);
+    }
+    return res;
+}
+
+int YModbusScan::get_queryCount(void)
+{
+    if (!_planned) {
+        this->_plan();
+    }
+    return (int)_queries.size();
+}
+
+int YModbusScan::get_sweepTime(void)
+{
+    return _sweepTime;
+}
+
 //--- (generated code: YSerialPort functions)
 //--- (end of generated code: YSerialPort functions)
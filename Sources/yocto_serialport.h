@@ -172,9 +172,57 @@ protected:
     // Constructor is protected, use yFindSerialPort factory function to instantiate
     YSerialPort(const string& func);
     //--- (end of generated code: YSerialPort attributes)
+    YRxStream*      _rxStream;
+
+    YRxStream*      _getRxStream(void);
+    void            _rxStreamToPtr(void);
+    void            _rxPtrToStream(void);
 
 public:
     ~YSerialPort();
+
+    /**
+     * Starts a local receive stream: data received by the serial port are fetched in
+     * background into a local buffer, starting at the current stream position, and the
+     * read functions (readByte, readStr, readBin, readArray, readHex, readLine, read_avail)
+     * are then served from this buffer without device round-trip. New data are fetched
+     * during YAPI.HandleEvents() and YAPI.Sleep(), as soon as the device reports some
+     * activity. When the local buffer is full, data remain in the device buffer until
+     * the application reads some bytes. readLine() returns text lines ending with a
+     * line feed, regardless of the protocol set on the port. Functions that read
+     * messages on the device (readMessages, queryLine...) remain available: they
+     * start from the stream position and the stream then restarts after the messages read.
+     *
+     * @param bufferSize : the size of the local buffer, in bytes
+     * @param highWaterMark : the number of buffered bytes that triggers the callback
+     * @param callback : a function invoked with the number of bytes available in the
+     *         local buffer when at least highWaterMark bytes are buffered, or NULL.
+     *         The callback is invoked from YAPI.HandleEvents() or YAPI.Sleep().
+     * @param context : a user pointer passed to the callback
+     *
+     * @return YAPI_SUCCESS if the call succeeds.
+     *
+     * On failure, throws an exception or returns a negative error code.
+     */
+    int             startRxStream(int bufferSize, int highWaterMark, YRxStreamCallback callback, void* context);
+
+    /**
+     * Stops the local receive stream. Data that have been fetched but not read yet are
+     * dropped, and the stream position of the API object is set back to the first one.
+     *
+     * @return YAPI_SUCCESS if the call succeeds.
+     */
+    int             stopRxStream(void);
+
+    /**
+     * Returns the local receive stream of the serial port, if any.
+     *
+     * @return a pointer to a YRxStream object, or NULL if no stream is running.
+     *         The object is released by stopRxStream.
+     */
+    YRxStream*      get_rxStream(void);
+
+    friend class YModbusScan;
     //--- (generated code: YSerialPort accessors declaration)
 
     static const int RXCOUNT_INVALID = YAPI_INVALID_UINT;
@@ -966,6 +1014,143 @@ public:
     //--- (end of generated code: YSerialPort accessors declaration)
 };
 
+/**
+ * YModbusScan Class: periodic acquisition of a MODBUS register map
+ *
+ * A scan reads a set of bits and registers from the MODBUS slaves connected to
+ * a serial port. Contiguous addresses of a slave are merged into the largest
+ * reads allowed by the protocol, and several queries are kept in flight when
+ * the port is reached through a websocket hub, so that the slave replies are
+ * not delayed by one network round-trip each.
+ */
+class YOCTO_CLASS_EXPORT YModbusScan {
+public:
+    // Last value read for one register of the map
+    struct Value {
+        int         slaveNo;
+        int         funCode;
+        int         address;
+        int         value;
+        YRETCODE    status;     // YAPI_SUCCESS, or the error of the query
+    };
+
+    // Per-slave statistics, latencies in milliseconds
+    struct SlaveStats {
+        int         slaveNo;
+        int         queries;
+        int         errors;
+        int         lastLatency;
+        int         minLatency;
+        int         maxLatency;
+        int         avgLatency;
+    };
+
+protected:
+    struct Query {
+        int         slaveNo;
+        int         funCode;
+        int         address;
+        int         count;
+        string      url;
+        vector<int> valueIdx;   // index in _values for each address, or -1 when not requested
+    };
+
+    YSerialPort*        _port;
+    vector<Value>       _values;
+    std::map<u32,int>   _index;         // (slave, function, address) key to index in _values
+    vector<Query>       _queries;
+    std::map<int,SlaveStats> _stats;
+    std::map<int,s64>   _latencySum;    // per slave, for the averages of _stats
+    int                 _maxGap;
+    int                 _maxPending;
+    int                 _sweepTime;
+    bool                _planned;
+
+    void        _plan(void);
+    YRETCODE    _decode(Query& query, const string& reply, string& errmsg);
+    void        _update(Query& query, YRETCODE status, int latency);
+
+public:
+    YModbusScan(YSerialPort* port);
+    virtual ~YModbusScan() {}
+
+    /**
+     * Adds a range of bits or registers to the scan.
+     *
+     * @param slaveNo : the address of the slave MODBUS device
+     * @param funCode : the MODBUS read function code: 0x01 (coils), 0x02 (discrete inputs),
+     *         0x03 (holding registers) or 0x04 (input registers)
+     * @param pduAddr : the relative address of the first bit or register (zero-based)
+     * @param count : the number of bits or registers
+     *
+     * @return YAPI_SUCCESS if the call succeeds.
+     *
+     * On failure, throws an exception or returns a negative error code.
+     */
+    int         addRange(int slaveNo, int funCode, int pduAddr, int count);
+
+    /**
+     * Removes all ranges from the scan.
+     */
+    void        clear(void);
+
+    /**
+     * Changes the largest hole between two requested addresses that is read anyway
+     * to merge both reads in a single query. The default is 0.
+     *
+     * @param maxGap : a number of bits or registers
+     */
+    void        set_maxGap(int maxGap);
+    int         get_maxGap(void);
+
+    /**
+     * Changes the maximal number of queries sent in advance to a websocket hub.
+     * Other connections always process one query at a time.
+     *
+     * @param maxPending : a number of queries, 1 disables pipelining
+     */
+    void        set_maxPending(int maxPending);
+    int         get_maxPending(void);
+
+    /**
+     * Reads all ranges once and updates the snapshot. A slave that does not reply
+     * or replies with a MODBUS exception does not stop the scan: the status of its
+     * values is updated instead.
+     *
+     * @return YAPI_SUCCESS if all queries succeeded, or the error of the first failed query.
+     *
+     * On failure to reach the serial port, throws an exception or returns a negative error code.
+     */
+    int         scan(void);
+
+    /**
+     * Returns the values read by the last scan, in the order of the ranges.
+     */
+    const vector<Value>& get_snapshot(void);
+
+    /**
+     * Returns the value of a bit or register read by the last scan.
+     *
+     * @return the value, or YAPI_INVALID_INT if it could not be read.
+     */
+    int         get_value(int slaveNo, int funCode, int pduAddr);
+
+    /**
+     * Returns the statistics of each slave since the scan was created.
+     */
+    vector<SlaveStats> get_slaveStats(void);
+
+    /**
+     * Returns the number of queries of a complete scan.
+     */
+    int         get_queryCount(void);
+
+    /**
+     * Returns the duration of the last scan, in milliseconds.
+     */
+    int         get_sweepTime(void);
+};
+
 //--- (generated code: YSerialPort functions declaration)
 
 /**
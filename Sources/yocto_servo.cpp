@@ -593,11 +593,17 @@ int YServo::_invokeValueCallback(string value)
 YServo *YServo::nextServo(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Servo", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YServo::FindServo(hwid);
+    if (next == NULL) {
+        next = YServo::FindServo(hwid);
+        YFunction::_AddToCache("Servo", nextdescr, next);
+    }
+    return (YServo*)next;
 }
 
 YServo* YServo::FirstServo(void)
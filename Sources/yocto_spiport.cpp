@@ -68,12 +68,14 @@ YSpiPort::YSpiPort(const string& func): YFunction(func)
     ,_rxptr(0)
     ,_rxbuffptr(0)
 //--- (end of YSpiPort initialization)
+    ,_rxStream(NULL)
 {
     _className="SpiPort";
 }
 
 YSpiPort::~YSpiPort()
 {
+    this->stopRxStream();
 //--- (YSpiPort cleanup)
 //--- (end of YSpiPort cleanup)
 }
@@ -835,6 +837,11 @@ int YSpiPort::registerValueCallback(YSpiPortValueCallback callback)
 
 int YSpiPort::_invokeValueCallback(string value)
 {
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        stream->signal();
+        stream->release();
+    }
     if (_valueCallbackSpiPort != NULL) {
         _valueCallbackSpiPort(this, value);
     } else {
@@ -857,6 +864,11 @@ int YSpiPort::sendCommand(string text)
  */
 int YSpiPort::reset(void)
 {
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        stream->seek(0);
+        stream->release();
+    }
     _rxptr = 0;
     _rxbuffptr = 0;
     _rxbuff = string(0, (char)0);
@@ -1039,6 +1051,13 @@ int YSpiPort::writeLine(string text)
  */
 int YSpiPort::readByte(void)
 {
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        int res = stream->readByte();
+        _rxptr = stream->tell();
+        stream->release();
+        return res;
+    }
     int currpos = 0;
     int reqlen = 0;
     string buff;
@@ -1119,7 +1138,13 @@ string YSpiPort::readStr(int nChars)
         nChars = 65535;
     }
 
-    buff = this->_download(YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _rxptr,nChars));
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        buff = stream->readData(nChars);
+        stream->release();
+    } else {
+        buff = this->_download(YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _rxptr,nChars));
+    }
     bufflen = (int)(buff).size() - 1;
     endpos = 0;
     mult = 1;
@@ -1156,7 +1181,13 @@ string YSpiPort::readBin(int nChars)
         nChars = 65535;
     }
 
-    buff = this->_download(YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _rxptr,nChars));
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        buff = stream->readData(nChars);
+        stream->release();
+    } else {
+        buff = this->_download(YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _rxptr,nChars));
+    }
     bufflen = (int)(buff).size() - 1;
     endpos = 0;
     mult = 1;
@@ -1199,7 +1230,13 @@ vector<int> YSpiPort::readArray(int nChars)
         nChars = 65535;
     }
 
-    buff = this->_download(YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _rxptr,nChars));
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        buff = stream->readData(nChars);
+        stream->release();
+    } else {
+        buff = this->_download(YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _rxptr,nChars));
+    }
     bufflen = (int)(buff).size() - 1;
     endpos = 0;
     mult = 1;
@@ -1242,7 +1279,13 @@ string YSpiPort::readHex(int nBytes)
         nBytes = 65535;
     }
 
-    buff = this->_download(YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _rxptr,nBytes));
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        buff = stream->readData(nBytes);
+        stream->release();
+    } else {
+        buff = this->_download(YapiWrapper::ysprintf("rxdata.bin?pos=%d&len=%d", _rxptr,nBytes));
+    }
     bufflen = (int)(buff).size() - 1;
     endpos = 0;
     mult = 1;
@@ -1280,6 +1323,13 @@ string YSpiPort::readHex(int nBytes)
  */
 string YSpiPort::readLine(void)
 {
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        string res = stream->readLine();
+        _rxptr = stream->tell();
+        stream->release();
+        return res;
+    }
     string url;
     string msgbin;
     vector<string> msgarr;
@@ -1326,6 +1376,7 @@ string YSpiPort::readLine(void)
  */
 vector<string> YSpiPort::readMessages(string pattern,int maxWait)
 {
+    this->_rxStreamToPtr();
     string url;
     string msgbin;
     vector<string> msgarr;
@@ -1343,6 +1394,7 @@ vector<string> YSpiPort::readMessages(string pattern,int maxWait)
     // last element of array is the new position
     msglen = msglen - 1;
     _rxptr = atoi((msgarr[msglen]).c_str());
+    this->_rxPtrToStream();
     idx = 0;
     while (idx < msglen) {
         res.push_back(this->_json_get_string(msgarr[idx]));
@@ -1362,6 +1414,11 @@ vector<string> YSpiPort::readMessages(string pattern,int maxWait)
  */
 int YSpiPort::read_seek(int absPos)
 {
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        stream->seek(absPos);
+        stream->release();
+    }
     _rxptr = absPos;
     return YAPI_SUCCESS;
 }
@@ -1373,6 +1430,12 @@ int YSpiPort::read_seek(int absPos)
  */
 int YSpiPort::read_tell(void)
 {
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        int res = stream->tell();
+        stream->release();
+        return res;
+    }
     return _rxptr;
 }
 
@@ -1384,6 +1447,12 @@ int YSpiPort::read_tell(void)
  */
 int YSpiPort::read_avail(void)
 {
+    YRxStream* stream = this->_getRxStream();
+    if (stream != NULL) {
+        int res = stream->avail();
+        stream->release();
+        return res;
+    }
     string buff;
     int bufflen = 0;
     int res = 0;
@@ -1427,6 +1496,7 @@ string YSpiPort::queryLine(string query,int maxWait)
     // last element of array is the new position
     msglen = msglen - 1;
     _rxptr = atoi((msgarr[msglen]).c_str());
+    this->_rxPtrToStream();
     if (msglen == 0) {
         return "";
     }
@@ -1485,11 +1555,17 @@ int YSpiPort::set_SS(int val)
 YSpiPort *YSpiPort::nextSpiPort(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("SpiPort", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YSpiPort::FindSpiPort(hwid);
+    if (next == NULL) {
+        next = YSpiPort::FindSpiPort(hwid);
+        YFunction::_AddToCache("SpiPort", nextdescr, next);
+    }
+    return (YSpiPort*)next;
 }
 
 YSpiPort* YSpiPort::FirstSpiPort(void)
@@ -1508,5 +1584,90 @@ YSpiPort* YSpiPort::FirstSpiPort(void)
 
 //--- (end of YSpiPort implementation)
 
+int YSpiPort::startRxStream(int bufferSize, int highWaterMark, YRxStreamCallback callback, void* context)
+{
+    YRxStream* stream;
+
+    if (!YAPI::_apiInitialized) {
+        string errmsg;
+        if (YISERR(YAPI::InitAPI(0, errmsg))) {
+            _throw(YAPI_NOT_INITIALIZED, errmsg);
+            return YAPI_NOT_INITIALIZED;
+        }
+    }
+    this->stopRxStream();
+    yEnterCriticalSection(&_this_cs);
+    stream = new YRxStream(this, _rxptr, bufferSize, highWaterMark, callback, context);
+    _rxStream = stream;
+    yLeaveCriticalSection(&_this_cs);
+    // notifications of the port trigger an immediate fetch
+    YFunction::_UpdateValueCallbackList(this, true);
+    return YAPI_SUCCESS;
+}
+
+int YSpiPort::stopRxStream(void)
+{
+    YRxStream* stream;
+
+    yEnterCriticalSection(&_this_cs);
+    stream = _rxStream;
+    _rxStream = NULL;
+    if (stream != NULL) {
+        _rxptr = stream->tell();
+    }
+    yLeaveCriticalSection(&_this_cs);
+    if (stream == NULL) {
+        return YAPI_SUCCESS;
+    }
+    // reads still in progress hold their own reference on the stream
+    stream->stop();
+    stream->release();
+    if (_valueCallbackFunction == NULL && _valueCallbackSpiPort == NULL && YAPI::_apiInitialized) {
+        YFunction::_UpdateValueCallbackList(this, false);
+    }
+    return YAPI_SUCCESS;
+}
+
+// Returns the running stream with a new reference, to be released by the caller
+YRxStream* YSpiPort::_getRxStream(void)
+{
+    YRxStream* stream;
+
+    yEnterCriticalSection(&_this_cs);
+    stream = _rxStream;
+    if (stream != NULL) {
+        stream->addRef();
+    }
+    yLeaveCriticalSection(&_this_cs);
+    return stream;
+}
+
+// Message reads are served by the device from _rxptr: the position is taken from
+// the stream before the request, and the stream restarts from the new position after
+void YSpiPort::_rxStreamToPtr(void)
+{
+    YRxStream* stream = this->_getRxStream();
+
+    if (stream != NULL) {
+        _rxptr = stream->tell();
+        stream->release();
+    }
+}
+
+void YSpiPort::_rxPtrToStream(void)
+{
+    YRxStream* stream = this->_getRxStream();
+
+    if (stream != NULL) {
+        stream->seek(_rxptr);
+        stream->release();
+    }
+}
+
+YRxStream* YSpiPort::get_rxStream(void)
+{
+    return _rxStream;
+}
+
 //--- (YSpiPort functions)
 //--- (end of YSpiPort functions)
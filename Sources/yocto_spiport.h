@@ -142,9 +142,55 @@ protected:
     // Constructor is protected, use yFindSpiPort factory function to instantiate
     YSpiPort(const string& func);
     //--- (end of YSpiPort attributes)
+    YRxStream*      _rxStream;
+
+    YRxStream*      _getRxStream(void);
+    void            _rxStreamToPtr(void);
+    void            _rxPtrToStream(void);
 
 public:
     virtual ~YSpiPort();
+
+    /**
+     * Starts a local receive stream: data received by the SPI port are fetched in
+     * background into a local buffer, starting at the current stream position, and the
+     * read functions (readByte, readStr, readBin, readArray, readHex, readLine, read_avail)
+     * are then served from this buffer without device round-trip. New data are fetched
+     * during YAPI.HandleEvents() and YAPI.Sleep(), as soon as the device reports some
+     * activity. When the local buffer is full, data remain in the device buffer until
+     * the application reads some bytes. readLine() returns text lines ending with a
+     * line feed, regardless of the protocol set on the port. Functions that read
+     * messages on the device (readMessages, queryLine...) remain available: they
+     * start from the stream position and the stream then restarts after the messages read.
+     *
+     * @param bufferSize : the size of the local buffer, in bytes
+     * @param highWaterMark : the number of buffered bytes that triggers the callback
+     * @param callback : a function invoked with the number of bytes available in the
+     *         local buffer when at least highWaterMark bytes are buffered, or NULL.
+     *         The callback is invoked from YAPI.HandleEvents() or YAPI.Sleep().
+     * @param context : a user pointer passed to the callback
+     *
+     * @return YAPI_SUCCESS if the call succeeds.
+     *
+     * On failure, throws an exception or returns a negative error code.
+     */
+    int             startRxStream(int bufferSize, int highWaterMark, YRxStreamCallback callback, void* context);
+
+    /**
+     * Stops the local receive stream. Data that have been fetched but not read yet are
+     * dropped, and the stream position of the API object is set back to the first one.
+     *
+     * @return YAPI_SUCCESS if the call succeeds.
+     */
+    int             stopRxStream(void);
+
+    /**
+     * Returns the local receive stream of the SPI port, if any.
+     *
+     * @return a pointer to a YRxStream object, or NULL if no stream is running.
+     *         The object is released by stopRxStream.
+     */
+    YRxStream*      get_rxStream(void);
     //--- (YSpiPort accessors declaration)
 
     static const int RXCOUNT_INVALID = YAPI_INVALID_UINT;
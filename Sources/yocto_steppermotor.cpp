@@ -1124,11 +1124,17 @@ int YStepperMotor::abortAndHiZ(void)
 YStepperMotor *YStepperMotor::nextStepperMotor(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("StepperMotor", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YStepperMotor::FindStepperMotor(hwid);
+    if (next == NULL) {
+        next = YStepperMotor::FindStepperMotor(hwid);
+        YFunction::_AddToCache("StepperMotor", nextdescr, next);
+    }
+    return (YStepperMotor*)next;
 }
 
 YStepperMotor* YStepperMotor::FirstStepperMotor(void)
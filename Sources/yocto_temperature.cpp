@@ -586,11 +586,17 @@ int YTemperature::loadThermistorResponseTable(vector<double>& tempValues,vector<
 YTemperature *YTemperature::nextTemperature(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Temperature", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YTemperature::FindTemperature(hwid);
+    if (next == NULL) {
+        next = YTemperature::FindTemperature(hwid);
+        YFunction::_AddToCache("Temperature", nextdescr, next);
+    }
+    return (YTemperature*)next;
 }
 
 YTemperature* YTemperature::FirstTemperature(void)
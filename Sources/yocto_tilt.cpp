@@ -281,11 +281,17 @@ int YTilt::_invokeTimedReportCallback(YMeasure value)
 YTilt *YTilt::nextTilt(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Tilt", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YTilt::FindTilt(hwid);
+    if (next == NULL) {
+        next = YTilt::FindTilt(hwid);
+        YFunction::_AddToCache("Tilt", nextdescr, next);
+    }
+    return (YTilt*)next;
 }
 
 YTilt* YTilt::FirstTilt(void)
@@ -191,11 +191,17 @@ int YTvoc::_invokeTimedReportCallback(YMeasure value)
 YTvoc *YTvoc::nextTvoc(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Tvoc", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YTvoc::FindTvoc(hwid);
+    if (next == NULL) {
+        next = YTvoc::FindTvoc(hwid);
+        YFunction::_AddToCache("Tvoc", nextdescr, next);
+    }
+    return (YTvoc*)next;
 }
 
 YTvoc* YTvoc::FirstTvoc(void)
@@ -191,11 +191,17 @@ int YVoc::_invokeTimedReportCallback(YMeasure value)
 YVoc *YVoc::nextVoc(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Voc", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YVoc::FindVoc(hwid);
+    if (next == NULL) {
+        next = YVoc::FindVoc(hwid);
+        YFunction::_AddToCache("Voc", nextdescr, next);
+    }
+    return (YVoc*)next;
 }
 
 YVoc* YVoc::FirstVoc(void)
@@ -238,11 +238,17 @@ int YVoltage::_invokeTimedReportCallback(YMeasure value)
 YVoltage *YVoltage::nextVoltage(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Voltage", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YVoltage::FindVoltage(hwid);
+    if (next == NULL) {
+        next = YVoltage::FindVoltage(hwid);
+        YFunction::_AddToCache("Voltage", nextdescr, next);
+    }
+    return (YVoltage*)next;
 }
 
 YVoltage* YVoltage::FirstVoltage(void)
@@ -347,11 +347,17 @@ int YVoltageOutput::voltageMove(double V_target,int ms_duration)
 YVoltageOutput *YVoltageOutput::nextVoltageOutput(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("VoltageOutput", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YVoltageOutput::FindVoltageOutput(hwid);
+    if (next == NULL) {
+        next = YVoltageOutput::FindVoltageOutput(hwid);
+        YFunction::_AddToCache("VoltageOutput", nextdescr, next);
+    }
+    return (YVoltageOutput*)next;
 }
 
 YVoltageOutput* YVoltageOutput::FirstVoltageOutput(void)
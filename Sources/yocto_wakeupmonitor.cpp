@@ -541,11 +541,17 @@ int YWakeUpMonitor::resetSleepCountDown(void)
 YWakeUpMonitor *YWakeUpMonitor::nextWakeUpMonitor(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("WakeUpMonitor", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YWakeUpMonitor::FindWakeUpMonitor(hwid);
+    if (next == NULL) {
+        next = YWakeUpMonitor::FindWakeUpMonitor(hwid);
+        YFunction::_AddToCache("WakeUpMonitor", nextdescr, next);
+    }
+    return (YWakeUpMonitor*)next;
 }
 
 YWakeUpMonitor* YWakeUpMonitor::FirstWakeUpMonitor(void)
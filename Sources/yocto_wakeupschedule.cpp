@@ -571,11 +571,17 @@ int YWakeUpSchedule::set_minutes(s64 bitmap)
 YWakeUpSchedule *YWakeUpSchedule::nextWakeUpSchedule(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("WakeUpSchedule", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YWakeUpSchedule::FindWakeUpSchedule(hwid);
+    if (next == NULL) {
+        next = YWakeUpSchedule::FindWakeUpSchedule(hwid);
+        YFunction::_AddToCache("WakeUpSchedule", nextdescr, next);
+    }
+    return (YWakeUpSchedule*)next;
 }
 
 YWakeUpSchedule* YWakeUpSchedule::FirstWakeUpSchedule(void)
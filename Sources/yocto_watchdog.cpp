@@ -889,11 +889,17 @@ int YWatchdog::_invokeValueCallback(string value)
 YWatchdog *YWatchdog::nextWatchdog(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Watchdog", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YWatchdog::FindWatchdog(hwid);
+    if (next == NULL) {
+        next = YWatchdog::FindWatchdog(hwid);
+        YFunction::_AddToCache("Watchdog", nextdescr, next);
+    }
+    return (YWatchdog*)next;
 }
 
 YWatchdog* YWatchdog::FirstWatchdog(void)
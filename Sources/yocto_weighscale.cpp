@@ -896,11 +896,17 @@ int YWeighScale::loadSpanChgCompensationTable(vector<double>& tempValues,vector<
 YWeighScale *YWeighScale::nextWeighScale(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("WeighScale", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YWeighScale::FindWeighScale(hwid);
+    if (next == NULL) {
+        next = YWeighScale::FindWeighScale(hwid);
+        YFunction::_AddToCache("WeighScale", nextdescr, next);
+    }
+    return (YWeighScale*)next;
 }
 
 YWeighScale* YWeighScale::FirstWeighScale(void)
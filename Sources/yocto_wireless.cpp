@@ -604,11 +604,17 @@ vector<YWlanRecord> YWireless::get_detectedWlans(void)
 YWireless *YWireless::nextWireless(void)
 {
     string  hwid;
+    YFUN_DESCR nextdescr;
+    YFunction* next;
 
-    if(YISERR(_nextFunction(hwid)) || hwid=="") {
+    if(YISERR(_nextFunction("Wireless", nextdescr, next, hwid)) || (next == NULL && hwid=="")) {
         return NULL;
     }
-    return YWireless::FindWireless(hwid);
+    if (next == NULL) {
+        next = YWireless::FindWireless(hwid);
+        YFunction::_AddToCache("Wireless", nextdescr, next);
+    }
+    return (YWireless*)next;
 }
 
 YWireless* YWireless::FirstWireless(void)